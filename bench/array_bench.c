@@ -0,0 +1,159 @@
+// Measures array_t construction time and heap footprint against the previous
+// scheme, reproduced below: a separately allocated state buffer grown by a
+// fixed LIB_UTIL_ARRAY_CAPACITY_INCR.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#ifdef __GLIBC__
+#  include <malloc.h>
+#endif
+
+#define NUM_SMALL_ARRAYS 100000
+
+typedef struct {
+  void       **state;
+  unsigned int size;
+  unsigned int capacity;
+} legacy_array_t;
+
+static legacy_array_t *
+legacy_init (void)
+{
+  legacy_array_t *array = malloc(sizeof(legacy_array_t));
+  array->state          = malloc(sizeof(void *));
+  array->size           = 0;
+  array->capacity       = 0;
+  return array;
+}
+
+static void
+legacy_push (legacy_array_t *array, void *el)
+{
+  if (array->size == array->capacity) {
+    array->state = realloc(
+      array->state,
+      (array->size + LIB_UTIL_ARRAY_CAPACITY_INCR) * sizeof(void *)
+    );
+    array->capacity += LIB_UTIL_ARRAY_CAPACITY_INCR;
+  }
+  array->state[array->size++] = el;
+}
+
+static void
+legacy_free (legacy_array_t *array)
+{
+  free(array->state);
+  free(array);
+}
+
+static long
+heap_in_use (void)
+{
+#ifdef __GLIBC__
+  return (long)mallinfo2().uordblks;
+#else
+  return -1;
+#endif
+}
+
+static void
+bench_push (unsigned int n)
+{
+  int    reps = n >= 100000 ? 5 : 5000000 / n;
+
+  double start = bench_now();
+  for (int r = 0; r < reps; r++) {
+    legacy_array_t *array = legacy_init();
+    for (unsigned int i = 0; i < n; i++) {
+      legacy_push(array, &array);
+    }
+    legacy_free(array);
+  }
+  double legacy = (bench_now() - start) / reps;
+
+  start         = bench_now();
+  for (int r = 0; r < reps; r++) {
+    array_t *array = array_init();
+    for (unsigned int i = 0; i < n; i++) {
+      array_push(array, &array);
+    }
+    array_free(array);
+  }
+  double current = (bench_now() - start) / reps;
+
+  start          = bench_now();
+  for (int r = 0; r < reps; r++) {
+    array_t *array = array_init();
+    array_reserve(array, n);
+    for (unsigned int i = 0; i < n; i++) {
+      array_push(array, &array);
+    }
+    array_free(array);
+  }
+  double reserved = (bench_now() - start) / reps;
+
+  printf(
+    "push %7u  fixed-incr %12.0f ns  geometric %10.0f ns  reserved %10.0f "
+    "ns\n",
+    n,
+    legacy * 1e9,
+    current * 1e9,
+    reserved * 1e9
+  );
+}
+
+static void
+bench_footprint (unsigned int n)
+{
+  static legacy_array_t *legacy[NUM_SMALL_ARRAYS];
+  static array_t        *current[NUM_SMALL_ARRAYS];
+
+  long                   base = heap_in_use();
+  for (int i = 0; i < NUM_SMALL_ARRAYS; i++) {
+    legacy[i] = legacy_init();
+    for (unsigned int j = 0; j < n; j++) {
+      legacy_push(legacy[i], legacy);
+    }
+  }
+  long legacy_bytes = heap_in_use() - base;
+  for (int i = 0; i < NUM_SMALL_ARRAYS; i++) {
+    legacy_free(legacy[i]);
+  }
+
+  base = heap_in_use();
+  for (int i = 0; i < NUM_SMALL_ARRAYS; i++) {
+    current[i] = array_init();
+    for (unsigned int j = 0; j < n; j++) {
+      array_push(current[i], current);
+    }
+  }
+  long current_bytes = heap_in_use() - base;
+  for (int i = 0; i < NUM_SMALL_ARRAYS; i++) {
+    array_free(current[i]);
+  }
+
+  printf(
+    "%d arrays of %u  fixed-incr %6.1f B/array  inline %6.1f B/array\n",
+    NUM_SMALL_ARRAYS,
+    n,
+    (double)legacy_bytes / NUM_SMALL_ARRAYS,
+    (double)current_bytes / NUM_SMALL_ARRAYS
+  );
+}
+
+int
+main (void)
+{
+  unsigned int sizes[] = {1, 3, 16, 1000, 100000, 1000000};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    bench_push(sizes[i]);
+  }
+
+  for (unsigned int n = 0; n <= 3; n++) {
+    bench_footprint(n);
+  }
+
+  return 0;
+}
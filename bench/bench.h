@@ -0,0 +1,98 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#endif
+
+// Hardware counters are best-effort: they are unavailable in many containers
+// and VMs, in which case `bench_counter_open` returns -1 and the counter
+// reads as -1.
+typedef struct {
+  int fd;
+} bench_counter_t;
+
+static inline bench_counter_t
+bench_counter_open (uint32_t type, uint64_t config)
+{
+  bench_counter_t counter = {.fd = -1};
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type           = type;
+  attr.size           = sizeof(attr);
+  attr.config         = config;
+  attr.disabled       = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  counter.fd          = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  (void)type;
+  (void)config;
+#endif
+  return counter;
+}
+
+static inline void
+bench_counter_start (bench_counter_t *counter)
+{
+#ifdef __linux__
+  if (counter->fd >= 0) {
+    ioctl(counter->fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter->fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+static inline int64_t
+bench_counter_stop (bench_counter_t *counter)
+{
+  int64_t value = -1;
+#ifdef __linux__
+  if (counter->fd >= 0) {
+    ioctl(counter->fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(counter->fd, &value, sizeof(value)) != sizeof(value)) {
+      value = -1;
+    }
+  }
+#endif
+  return value;
+}
+
+static inline void
+bench_counter_close (bench_counter_t *counter)
+{
+  if (counter->fd >= 0) {
+    close(counter->fd);
+  }
+}
+
+static inline double
+bench_now (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift64; deterministic across runs so results are comparable
+static inline uint64_t
+bench_rand (uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,128 @@
+// Compares splitting a buffer of log lines with fsm_run_bytes against sending
+// each byte through fsm_transition as a one-character event and through
+// fsm_transition_id.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define INPUT_BYTES (64 << 20)
+#define SLOW_BYTES  (4 << 20)
+#define LINE_BYTES  120
+
+static void
+add_byte (
+  state_machine_t    *fsm,
+  state_descriptor_t *source,
+  int                 byte,
+  state_descriptor_t *target
+)
+{
+  char name[2] = {(char)byte, '\0'};
+  fsm_transition_register(
+    fsm,
+    source,
+    fsm_transition_create(name, target, NULL, NULL)
+  );
+}
+
+// Lines of fields, where a newline inside double quotes does not end the line
+static state_machine_t *
+build (void)
+{
+  state_machine_t    *fsm = fsm_create("lines", NULL);
+  state_descriptor_t *field
+    = fsm_state_register(fsm, fsm_state_create("field"));
+  state_descriptor_t *quoted
+    = fsm_state_register(fsm, fsm_state_create("quoted"));
+  state_descriptor_t *eol = fsm_state_register(fsm, fsm_state_create("eol"));
+  eol->accepting          = true;
+
+  for (int b = 1; b < 256; b++) {
+    add_byte(fsm, field, b, b == '"' ? quoted : b == '\n' ? eol : field);
+    add_byte(fsm, quoted, b, b == '"' ? field : quoted);
+  }
+
+  fsm_set_initial_state(fsm, field);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+static void
+report (const char *label, size_t bytes, size_t lines, double secs)
+{
+  printf(
+    "%-36s %9.1f MB/s  (%zu lines)\n",
+    label,
+    bytes / secs / 1e6,
+    lines
+  );
+}
+
+int
+main (void)
+{
+  state_machine_t    *fsm   = build();
+  state_descriptor_t *field = fsm_get_state(fsm, "field");
+  state_descriptor_t *eol   = fsm_get_state(fsm, "eol");
+
+  char               *input = malloc(INPUT_BYTES);
+  uint64_t            seed  = 37;
+  for (size_t i = 0; i < INPUT_BYTES; i++) {
+    input[i] = i % LINE_BYTES == LINE_BYTES - 1 ? '\n'
+             : i % LINE_BYTES == 40             ? '"'
+             : i % LINE_BYTES == 60             ? '"'
+                                                : 'a' + bench_rand(&seed) % 26;
+  }
+
+  // one-character event names
+  size_t lines = 0;
+  char   name[2] = {0, 0};
+  double start   = bench_now();
+  for (size_t i = 0; i < SLOW_BYTES; i++) {
+    name[0] = input[i];
+    fsm_transition(fsm, name);
+    if (fsm->state == eol) {
+      lines++;
+      fsm_set_initial_state(fsm, field);
+    }
+  }
+  report("fsm_transition per byte", SLOW_BYTES, lines, bench_now() - start);
+
+  // event IDs, resolved once per byte value
+  int ids[256];
+  for (int b = 0; b < 256; b++) {
+    name[0] = (char)b;
+    ids[b]  = b ? fsm_event_id(fsm, name) : -1;
+  }
+
+  lines = 0;
+  fsm_set_initial_state(fsm, field);
+  start = bench_now();
+  for (size_t i = 0; i < SLOW_BYTES; i++) {
+    fsm_transition_id(fsm, ids[(unsigned char)input[i]]);
+    if (fsm->state == eol) {
+      lines++;
+      fsm_set_initial_state(fsm, field);
+    }
+  }
+  report("fsm_transition_id per byte", SLOW_BYTES, lines, bench_now() - start);
+
+  lines = 0;
+  fsm_set_initial_state(fsm, field);
+  start = bench_now();
+  for (size_t i = 0; i < INPUT_BYTES;) {
+    i += fsm_run_bytes(fsm, input + i, INPUT_BYTES - i);
+    if (fsm->state == eol) {
+      lines++;
+      fsm_set_initial_state(fsm, field);
+    }
+  }
+  report("fsm_run_bytes", INPUT_BYTES, lines, bench_now() - start);
+
+  fsm_inline_free(fsm);
+  free(input);
+
+  return 0;
+}
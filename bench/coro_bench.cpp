@@ -0,0 +1,119 @@
+// Keeps many machines in flight at once, each transition suspending on a
+// stand-in for I/O, and compares the cost per transition against taking the
+// same transitions synchronously.
+#include <coroutine>
+#include <cstdlib>
+#include <vector>
+
+#include "bench.h"
+#include "libfsms_coro.hpp"
+
+#define NUM_MACHINES 10000
+#define NUM_ROUNDS   200
+
+static std::vector<std::coroutine_handle<>> parked;
+
+struct io {
+  bool
+  await_ready () const noexcept
+  {
+    return false;
+  }
+
+  void
+  await_suspend (std::coroutine_handle<> h)
+  {
+    parked.push_back(h);
+  }
+
+  void
+  await_resume () const noexcept
+  {
+  }
+};
+
+static state_machine_t *
+build (void)
+{
+  state_machine_t    *fsm = fsm_create("ping", NULL);
+  state_descriptor_t *a   = fsm_state_register(fsm, fsm_state_create("a"));
+  state_descriptor_t *b   = fsm_state_register(fsm, fsm_state_create("b"));
+
+  fsm_transition_register(fsm, a, fsm_transition_create("ping", b, NULL, NULL));
+  fsm_transition_register(fsm, b, fsm_transition_create("pong", a, NULL, NULL));
+  fsm_set_initial_state(fsm, a);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+int
+main (void)
+{
+  std::vector<state_machine_t *>      fsms;
+  std::vector<fsms::async_machine *> machines;
+  for (int i = 0; i < NUM_MACHINES; i++) {
+    fsms.push_back(build());
+  }
+  int ping = fsm_event_id(fsms[0], "ping");
+  int pong = fsm_event_id(fsms[0], "pong");
+
+  double start = bench_now();
+  for (int r = 0; r < NUM_ROUNDS; r++) {
+    for (state_machine_t *fsm : fsms) {
+      fsm_transition_id(fsm, ping);
+    }
+    for (state_machine_t *fsm : fsms) {
+      fsm_transition_id(fsm, pong);
+    }
+  }
+  double sync = bench_now() - start;
+
+  for (state_machine_t *fsm : fsms) {
+    auto *m = new fsms::async_machine(fsm);
+    m->on("a", "ping", [](void *) -> fsms::task { co_await io{}; });
+    machines.push_back(m);
+  }
+
+  size_t in_flight = 0;
+  start            = bench_now();
+  for (int r = 0; r < NUM_ROUNDS; r++) {
+    for (fsms::async_machine *m : machines) {
+      m->dispatch(ping);
+      // queued behind the ping until it completes
+      m->dispatch(pong);
+    }
+    in_flight = parked.size();
+
+    std::vector<std::coroutine_handle<>> ready;
+    ready.swap(parked);
+    for (auto h : ready) {
+      h.resume();
+    }
+  }
+  double async = bench_now() - start;
+
+  bool settled = true;
+  for (fsms::async_machine *m : machines) {
+    settled &= !m->transitioning()
+            && s_equals(fsm_get_state_name(m->get()), "a");
+    delete m;
+  }
+
+  double transitions = 2.0 * NUM_MACHINES * NUM_ROUNDS;
+  printf(
+    "%d machines, %zu in flight  sync %5.1f ns/transition"
+    "  async %5.1f ns/transition%s\n",
+    NUM_MACHINES,
+    in_flight,
+    sync * 1e9 / transitions,
+    async * 1e9 / transitions,
+    settled ? "" : "  MISMATCH"
+  );
+
+  for (state_machine_t *fsm : fsms) {
+    fsm_inline_free(fsm);
+  }
+
+  return 0;
+}
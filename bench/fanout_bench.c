@@ -0,0 +1,106 @@
+// Compares event lookup on finalized machines (perfect hash + dispatch table)
+// against the linear scan of unfinalized ones as the number of events each
+// state handles grows from 1 to 256.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_STATES 64
+#define NUM_EVENTS 256
+#define NUM_STEPS  500000
+
+static state_machine_t *
+build (unsigned int fanout, char **event_names)
+{
+  state_machine_t    *fsm = fsm_create("fanout", NULL);
+  state_descriptor_t *states[NUM_STATES];
+  uint64_t            seed = 11;
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    char *name = fmt_str("s%d", i);
+    states[i]  = fsm_state_register(fsm, fsm_state_create(name));
+    free(name);
+  }
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    unsigned int base = bench_rand(&seed) % NUM_EVENTS;
+    for (unsigned int j = 0; j < fanout; j++) {
+      fsm_transition_register(
+        fsm,
+        states[i],
+        fsm_transition_create(
+          event_names[(base + j) % NUM_EVENTS],
+          states[bench_rand(&seed) % NUM_STATES],
+          NULL,
+          NULL
+        )
+      );
+    }
+  }
+
+  fsm_set_initial_state(fsm, states[0]);
+
+  return fsm;
+}
+
+int
+main (void)
+{
+  char *event_names[NUM_EVENTS];
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    event_names[i] = fmt_str("protocol_event_%03d", i);
+  }
+
+  // Events arrive as fresh strings, as they would from a parser, so neither
+  // path can get away with comparing pointers
+  char **steps = malloc(NUM_STEPS * sizeof(char *));
+
+  for (unsigned int fanout = 1; fanout <= 256; fanout *= 2) {
+    state_machine_t    *fsm     = build(fanout, event_names);
+    state_descriptor_t *initial = fsm->state;
+
+    uint64_t seed               = 13;
+    for (int i = 0; i < NUM_STEPS; i++) {
+      state_descriptor_t *s    = fsm->state;
+      unsigned int        pick = bench_rand(&seed) % array_size(s->transitions);
+      transition_t       *t    = array_get(s->transitions, pick);
+      steps[i]                 = s_copy(t->name);
+      fsm->state               = t->target;
+    }
+
+    fsm_set_initial_state(fsm, initial);
+    double start = bench_now();
+    for (int i = 0; i < NUM_STEPS; i++) {
+      fsm_transition(fsm, steps[i]);
+    }
+    double linear = (bench_now() - start) / NUM_STEPS;
+
+    fsm_finalize(fsm);
+    fsm_set_initial_state(fsm, initial);
+    start = bench_now();
+    for (int i = 0; i < NUM_STEPS; i++) {
+      fsm_transition(fsm, steps[i]);
+    }
+    double hashed = (bench_now() - start) / NUM_STEPS;
+
+    printf(
+      "fanout %3u  linear scan %8.2f ns/event  perfect hash %6.2f ns/event\n",
+      fanout,
+      linear * 1e9,
+      hashed * 1e9
+    );
+
+    for (int i = 0; i < NUM_STEPS; i++) {
+      free(steps[i]);
+    }
+    fsm_inline_free(fsm);
+  }
+
+  free(steps);
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    free(event_names[i]);
+  }
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+// Compares a machine defined with libfsms.hpp against the same machine built
+// at runtime, stepping both by event over one random walk.
+#include <cstdlib>
+
+#include "bench.h"
+#include "libfsms.hpp"
+
+#define NUM_STEPS 50000000
+
+enum class tcp {
+  closed,
+  listen,
+  syn_received,
+  syn_sent,
+  established,
+  fin_wait_1,
+  fin_wait_2,
+  closing,
+  time_wait,
+  close_wait,
+  last_ack
+};
+
+enum class ev {
+  passive_open,
+  active_open,
+  syn,
+  syn_ack,
+  ack,
+  fin,
+  close,
+  timeout
+};
+
+using fsms::transition;
+
+using tcp_machine = fsms::machine<
+  int,
+  transition<tcp::closed, ev::passive_open, tcp::listen>,
+  transition<tcp::closed, ev::active_open, tcp::syn_sent>,
+  transition<tcp::listen, ev::syn, tcp::syn_received>,
+  transition<tcp::listen, ev::close, tcp::closed>,
+  transition<tcp::syn_sent, ev::syn_ack, tcp::established>,
+  transition<tcp::syn_sent, ev::close, tcp::closed>,
+  transition<tcp::syn_received, ev::ack, tcp::established>,
+  transition<tcp::established, ev::fin, tcp::close_wait>,
+  transition<tcp::established, ev::close, tcp::fin_wait_1>,
+  transition<tcp::fin_wait_1, ev::ack, tcp::fin_wait_2>,
+  transition<tcp::fin_wait_1, ev::fin, tcp::closing>,
+  transition<tcp::fin_wait_2, ev::fin, tcp::time_wait>,
+  transition<tcp::closing, ev::ack, tcp::time_wait>,
+  transition<tcp::time_wait, ev::timeout, tcp::closed>,
+  transition<tcp::close_wait, ev::close, tcp::last_ack>,
+  transition<tcp::last_ack, ev::ack, tcp::closed>>;
+
+static const char *state_names[] = {
+  "closed",
+  "listen",
+  "syn_received",
+  "syn_sent",
+  "established",
+  "fin_wait_1",
+  "fin_wait_2",
+  "closing",
+  "time_wait",
+  "close_wait",
+  "last_ack"};
+
+static const char *event_names[] = {
+  "passive_open",
+  "active_open",
+  "syn",
+  "syn_ack",
+  "ack",
+  "fin",
+  "close",
+  "timeout"};
+
+static const int transitions[][3] = {
+  {0, 0, 1},
+  {0, 1, 3},
+  {1, 2, 2},
+  {1, 6, 0},
+  {3, 3, 4},
+  {3, 6, 0},
+  {2, 4, 4},
+  {4, 5, 9},
+  {4, 6, 5},
+  {5, 4, 6},
+  {5, 5, 7},
+  {6, 5, 8},
+  {7, 4, 8},
+  {8, 7, 0},
+  {9, 6, 10},
+  {10, 4, 0}};
+
+// Builds the same machine at runtime
+static state_machine_t *
+build_runtime (void)
+{
+  state_machine_t *fsm = fsm_create("tcp", NULL);
+
+  for (const char *name : state_names) {
+    fsm_state_register(fsm, fsm_state_create(name));
+  }
+
+  for (const auto &t : transitions) {
+    fsm_transition_register(
+      fsm,
+      fsm_get_state(fsm, state_names[t[0]]),
+      fsm_transition_create(
+        event_names[t[1]],
+        fsm_get_state(fsm, state_names[t[2]]),
+        NULL,
+        NULL
+      )
+    );
+  }
+
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "closed"));
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+int
+main (void)
+{
+  int     *events = static_cast<int *>(malloc(NUM_STEPS * sizeof(int)));
+  uint64_t seed   = 19;
+  for (int i = 0; i < NUM_STEPS; i++) {
+    events[i] = bench_rand(&seed) % tcp_machine::num_events;
+  }
+
+  state_machine_t *dynamic = build_runtime();
+  int              ids[tcp_machine::num_events];
+  for (std::size_t e = 0; e < tcp_machine::num_events; e++) {
+    ids[e] = fsm_event_id(dynamic, event_names[e]);
+  }
+
+  double start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_transition_id(dynamic, ids[events[i]]);
+  }
+  double runtime_step = bench_now() - start;
+
+  tcp_machine m(tcp::closed);
+  start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    m.dispatch(static_cast<ev>(events[i]));
+  }
+  double hpp_step = bench_now() - start;
+
+  printf(
+    "step       runtime %8.1f ns  libfsms.hpp %5.1f ns  (%s, %s)\n",
+    runtime_step * 1e9 / NUM_STEPS,
+    hpp_step * 1e9 / NUM_STEPS,
+    fsm_get_state_name(dynamic),
+    state_names[static_cast<int>(m.state())]
+  );
+
+  fsm_inline_free(dynamic);
+  free(events);
+
+  return 0;
+}
@@ -0,0 +1,145 @@
+// Compares machines made with fsm_clone, which each register and finalize
+// their own copy of the definition, against fsm_instance, which share it: the
+// time and heap taken to create them, and the cost of a transition with and
+// without per-instance overrides.
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_STATES      32
+#define NUM_MACHINES    100000
+#define NUM_TRANSITIONS 20000000
+
+static state_machine_t *
+create_ring (void)
+{
+  state_machine_t    *fsm = fsm_create("ring", NULL);
+  state_descriptor_t *s[NUM_STATES];
+  static char         names[NUM_STATES][8];
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    snprintf(names[i], sizeof(names[i]), "r%d", i);
+    s[i] = fsm_state_register(fsm, fsm_state_create(names[i]));
+  }
+  for (int i = 0; i < NUM_STATES; i++) {
+    fsm_transition_register(
+      fsm,
+      s[i],
+      fsm_transition_create("next", s[(i + 1) % NUM_STATES], NULL, NULL)
+    );
+    fsm_transition_register(
+      fsm,
+      s[i],
+      fsm_transition_create("reset", s[0], NULL, NULL)
+    );
+  }
+  fsm_set_initial_state(fsm, s[0]);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+static state_machine_t *
+make_clone (state_machine_t *def)
+{
+  state_machine_t *fsm = fsm_clone("ring", NULL, def);
+  fsm_set_initial_state(fsm, def->state);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+static state_machine_t *
+make_instance (state_machine_t *def)
+{
+  return fsm_instance("ring", NULL, def);
+}
+
+static void
+create (
+  const char       *label,
+  state_machine_t  *def,
+  state_machine_t **machines,
+  state_machine_t *(*make)(state_machine_t *)
+)
+{
+  size_t heap  = mallinfo2().uordblks;
+  double start = bench_now();
+
+  for (int i = 0; i < NUM_MACHINES; i++) {
+    machines[i] = make(def);
+  }
+
+  double elapsed = bench_now() - start;
+  printf(
+    "%-24s %8.1f ns/machine %8.1f B/machine\n",
+    label,
+    elapsed * 1e9 / NUM_MACHINES,
+    (double)(mallinfo2().uordblks - heap) / NUM_MACHINES
+  );
+}
+
+static void
+dispatch (const char *label, state_machine_t **machines, int next)
+{
+  uint64_t seed  = 88172645463325252ull;
+  double   start = bench_now();
+
+  for (int i = 0; i < NUM_TRANSITIONS; i++) {
+    fsm_transition_id(machines[bench_rand(&seed) % NUM_MACHINES], next);
+  }
+
+  printf(
+    "%-24s %8.1f ns/transition\n",
+    label,
+    (bench_now() - start) * 1e9 / NUM_TRANSITIONS
+  );
+}
+
+int
+main (void)
+{
+  state_machine_t  *def       = create_ring();
+  int               next      = fsm_event_id(def, "next");
+  state_machine_t **clones    = malloc(NUM_MACHINES * sizeof(*clones));
+  state_machine_t **instances = malloc(NUM_MACHINES * sizeof(*instances));
+
+  create("fsm_clone", def, clones, make_clone);
+  create("fsm_instance", def, instances, make_instance);
+
+  dispatch("clones", clones, next);
+  dispatch("instances", instances, next);
+
+  // every instance reverses direction out of one state
+  size_t heap = mallinfo2().uordblks;
+  for (int i = 0; i < NUM_MACHINES; i++) {
+    transition_t *t = fsm_transition_create(
+      "next",
+      array_get(def->states, (i + NUM_STATES - 1) % NUM_STATES),
+      NULL,
+      NULL
+    );
+    fsm_transition_register(
+      instances[i],
+      array_get(def->states, i % NUM_STATES),
+      t
+    );
+    fsm_transition_free(t);
+  }
+  printf(
+    "one override             %8.1f B/machine\n",
+    (double)(mallinfo2().uordblks - heap) / NUM_MACHINES
+  );
+  dispatch("overridden instances", instances, next);
+
+  for (int i = 0; i < NUM_MACHINES; i++) {
+    fsm_free(clones[i]);
+    fsm_free(instances[i]);
+  }
+  free(clones);
+  free(instances);
+
+  return 0;
+}
@@ -0,0 +1,141 @@
+// Compares dispatch through the finalized tables against the native step
+// function built by fsm_jit, on a random walk through machines of two sizes.
+// The objects are built in a fresh cache, then loaded again from it.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define FANOUT     8
+#define MAX_EVENTS 64
+#define NUM_STEPS  20000000
+
+static state_machine_t *
+build (int num_states, int num_events, uint64_t seed)
+{
+  state_machine_t     *fsm    = fsm_create("jit", NULL);
+  state_descriptor_t **states = malloc(num_states * sizeof(*states));
+
+  for (int i = 0; i < num_states; i++) {
+    char *name = fmt_str("s%d", i);
+    states[i]  = fsm_state_register(fsm, fsm_state_create(name));
+    free(name);
+  }
+
+  for (int i = 0; i < num_states; i++) {
+    int base = bench_rand(&seed) % num_events;
+    for (int j = 0; j < FANOUT; j++) {
+      int   id    = (base + j * num_events / FANOUT) % num_events;
+      char *event = fmt_str("e%d", id);
+      fsm_transition_register(
+        fsm,
+        states[i],
+        fsm_transition_create(
+          event,
+          states[bench_rand(&seed) % num_states],
+          NULL,
+          NULL
+        )
+      );
+      free(event);
+    }
+  }
+
+  fsm_set_initial_state(fsm, states[0]);
+  fsm_finalize(fsm);
+  free(states);
+
+  return fsm;
+}
+
+static double
+run (state_machine_t *fsm, const int *ids)
+{
+  double start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_transition_id(fsm, ids[i]);
+  }
+
+  return (bench_now() - start) * 1e9 / NUM_STEPS;
+}
+
+static void
+compare (int num_states, int num_events, int *ids)
+{
+  state_machine_t *fsm  = build(num_states, num_events, 11);
+  uint64_t         seed = 5;
+
+  // a walk that only sends events the current state handles
+  uint64_t mask[FSM_EVENT_MASK_WORDS(MAX_EVENTS)];
+  for (int i = 0; i < NUM_STEPS; i++) {
+    unsigned int words = fsm_enabled_events(fsm, mask);
+    int          pick  = bench_rand(&seed) % FANOUT;
+    int          id    = -1;
+    for (unsigned int w = 0; w < words && id < 0; w++) {
+      for (uint64_t m = mask[w]; m; m &= m - 1) {
+        if (!pick--) {
+          id = w * 64 + __builtin_ctzll(m);
+          break;
+        }
+      }
+    }
+    ids[i] = id;
+    fsm_transition_id(fsm, id);
+  }
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "s0"));
+
+  double      tables = run(fsm, ids);
+  const char *end    = fsm_get_state_name(fsm);
+
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "s0"));
+  double start = bench_now();
+  bool   ok    = fsm_jit(fsm);
+  double built = bench_now() - start;
+
+  state_machine_t *twin = build(num_states, num_events, 11);
+  start                 = bench_now();
+  fsm_jit(twin);
+  double loaded = bench_now() - start;
+
+  double native = run(fsm, ids);
+
+  printf(
+    "%5d states x %4d events  tables %5.1f ns/event  native %5.1f ns/event"
+    "  (built in %.0f ms, loaded in %.2f ms)%s\n",
+    num_states,
+    num_events,
+    tables,
+    native,
+    built * 1e3,
+    loaded * 1e3,
+    ok && s_equals(end, fsm_get_state_name(fsm)) ? "" : "  MISMATCH"
+  );
+
+  fsm_inline_free(fsm);
+  fsm_inline_free(twin);
+}
+
+int
+main (void)
+{
+  char dir[] = "/tmp/fsms-jit-bench-XXXXXX";
+  if (!mkdtemp(dir)) {
+    return 1;
+  }
+  setenv("FSMS_JIT_CACHE", dir, 1);
+
+  int *ids = malloc(NUM_STEPS * sizeof(int));
+
+  compare(64, 32, ids);
+  compare(1024, 64, ids);
+
+  free(ids);
+
+  char *cmd = fmt_str("rm -rf %s", dir);
+  if (system(cmd)) {
+    fprintf(stderr, "could not remove %s\n", dir);
+  }
+  free(cmd);
+
+  return 0;
+}
@@ -0,0 +1,87 @@
+// Measures what journaling adds to a transition: plain fsm_transition_id
+// against fsm_journal_transition with group commits of various sizes, down to
+// an fdatasync per transition.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_TRANSITIONS 4000000
+#define NUM_SYNCED      2000
+
+static state_machine_t *
+create_light (void)
+{
+  state_machine_t    *fsm = fsm_create("light", NULL);
+  state_descriptor_t *off = fsm_state_register(fsm, fsm_state_create("off"));
+  state_descriptor_t *on  = fsm_state_register(fsm, fsm_state_create("on"));
+
+  fsm_transition_register(
+    fsm,
+    off,
+    fsm_transition_create("push", on, NULL, NULL)
+  );
+  fsm_transition_register(
+    fsm,
+    on,
+    fsm_transition_create("push", off, NULL, NULL)
+  );
+  fsm_set_initial_state(fsm, off);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+static void
+run_journaled (state_machine_t *fsm, int push, unsigned int batch, int n)
+{
+  char path[] = "/tmp/fsms-journal-bench-XXXXXX";
+  int  fd     = mkstemp(path);
+  if (fd < 0) {
+    return;
+  }
+  close(fd);
+
+  fsm_journal_t *j    = fsm_journal_open(path, batch);
+  uint64_t       seed = 88172645463325252ull;
+
+  double start = bench_now();
+  for (int i = 0; i < n; i++) {
+    fsm_journal_transition(j, bench_rand(&seed) % 100000, fsm, push);
+  }
+  fsm_journal_sync(j);
+  double elapsed = bench_now() - start;
+
+  printf(
+    "batch %-6u %10.1f ns/transition  %5.1f bytes/record\n",
+    batch,
+    elapsed * 1e9 / n,
+    (double)(fsm_journal_offset(j) - 8) / n
+  );
+
+  fsm_journal_close(j);
+  unlink(path);
+}
+
+int
+main (void)
+{
+  state_machine_t *fsm  = create_light();
+  int              push = fsm_event_id(fsm, "push");
+
+  double start = bench_now();
+  for (int i = 0; i < NUM_TRANSITIONS; i++) {
+    fsm_transition_id(fsm, push);
+  }
+  printf(
+    "unjournaled  %10.1f ns/transition\n",
+    (bench_now() - start) * 1e9 / NUM_TRANSITIONS
+  );
+
+  run_journaled(fsm, push, 0, NUM_TRANSITIONS);
+  run_journaled(fsm, push, 4096, NUM_TRANSITIONS);
+  run_journaled(fsm, push, 64, NUM_TRANSITIONS / 16);
+  run_journaled(fsm, push, 1, NUM_SYNCED);
+
+  return 0;
+}
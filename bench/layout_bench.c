@@ -0,0 +1,167 @@
+// Compares dispatch through the pointer-based definition (array_t of
+// separately allocated transition_t per state) against the packed rows built
+// by fsm_finalize on a machine too large to stay in L1.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_STATES  4096
+#define NUM_EVENTS  64
+#define FANOUT      4
+#define NUM_STEPS   2000000
+
+typedef struct {
+  const char *name;
+  int         id;
+} step_t;
+
+static state_machine_t *
+build (char **state_names, char **event_names, uint64_t seed)
+{
+  state_machine_t    *fsm = fsm_create("layout", NULL);
+  state_descriptor_t *states[NUM_STATES];
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    states[i] = fsm_state_register(fsm, fsm_state_create(state_names[i]));
+  }
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    // FANOUT distinct events per state, spread across the event space
+    int base = bench_rand(&seed) % NUM_EVENTS;
+    for (int j = 0; j < FANOUT; j++) {
+      fsm_transition_register(
+        fsm,
+        states[i],
+        fsm_transition_create(
+          event_names[(base + j * (NUM_EVENTS / FANOUT)) % NUM_EVENTS],
+          states[bench_rand(&seed) % NUM_STATES],
+          NULL,
+          NULL
+        )
+      );
+    }
+  }
+
+  fsm_set_initial_state(fsm, states[0]);
+
+  return fsm;
+}
+
+static void
+report (const char *label, double secs, int64_t misses, int64_t l1_misses)
+{
+  printf(
+    "%-28s %8.2f ns/event  cache-misses/event %7.3f  L1d-misses/event %7.3f\n",
+    label,
+    secs * 1e9 / NUM_STEPS,
+    misses < 0 ? -1.0 : (double)misses / NUM_STEPS,
+    l1_misses < 0 ? -1.0 : (double)l1_misses / NUM_STEPS
+  );
+}
+
+int
+main (void)
+{
+  char *state_names[NUM_STATES];
+  char *event_names[NUM_EVENTS];
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    state_names[i] = fmt_str("s%d", i);
+  }
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    event_names[i] = fmt_str("event_%d", i);
+  }
+
+  state_machine_t *fsm   = build(state_names, event_names, 42);
+
+  // Record a walk that always takes an enabled transition
+  step_t          *steps = malloc(NUM_STEPS * sizeof(step_t));
+  uint64_t         seed  = 7;
+  for (int i = 0; i < NUM_STEPS; i++) {
+    state_descriptor_t *s    = fsm->state;
+    unsigned int        pick = bench_rand(&seed) % array_size(s->transitions);
+    transition_t       *t    = array_get(s->transitions, pick);
+    steps[i].name = t->name;
+    fsm->state    = t->target;
+  }
+
+  bench_counter_t misses = bench_counter_open(
+    PERF_TYPE_HARDWARE,
+    PERF_COUNT_HW_CACHE_MISSES
+  );
+  bench_counter_t l1_misses = bench_counter_open(
+    PERF_TYPE_HW_CACHE,
+    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+  );
+
+  state_descriptor_t *initial = array_get(fsm->states, 0);
+
+  // pointer-based definition
+  fsm_set_initial_state(fsm, initial);
+  bench_counter_start(&misses);
+  bench_counter_start(&l1_misses);
+  double start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_transition(fsm, steps[i].name);
+  }
+  double secs = bench_now() - start;
+  report(
+    "linked (fsm_transition)",
+    secs,
+    bench_counter_stop(&misses),
+    bench_counter_stop(&l1_misses)
+  );
+
+  // packed rows, resolving names
+  fsm_finalize(fsm);
+  for (int i = 0; i < NUM_STEPS; i++) {
+    steps[i].id = fsm_event_id(fsm, steps[i].name);
+  }
+
+  fsm_set_initial_state(fsm, initial);
+  bench_counter_start(&misses);
+  bench_counter_start(&l1_misses);
+  start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_transition(fsm, steps[i].name);
+  }
+  secs = bench_now() - start;
+  report(
+    "packed (fsm_transition)",
+    secs,
+    bench_counter_stop(&misses),
+    bench_counter_stop(&l1_misses)
+  );
+
+  // packed rows, by event ID
+  fsm_set_initial_state(fsm, initial);
+  bench_counter_start(&misses);
+  bench_counter_start(&l1_misses);
+  start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_transition_id(fsm, steps[i].id);
+  }
+  secs = bench_now() - start;
+  report(
+    "packed (fsm_transition_id)",
+    secs,
+    bench_counter_stop(&misses),
+    bench_counter_stop(&l1_misses)
+  );
+
+  bench_counter_close(&misses);
+  bench_counter_close(&l1_misses);
+
+  fsm_inline_free(fsm);
+  free(steps);
+  for (int i = 0; i < NUM_STATES; i++) {
+    free(state_names[i]);
+  }
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    free(event_names[i]);
+  }
+
+  return 0;
+}
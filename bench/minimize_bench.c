@@ -0,0 +1,135 @@
+// Compares dispatch on a finalized machine against the same machine after
+// fsm_minimize, for a definition in which every behavior is duplicated across
+// several states, as generated definitions often are.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_BEHAVIORS 4096
+#define NUM_COPIES    8
+#define NUM_STATES    (NUM_BEHAVIORS * NUM_COPIES)
+#define NUM_EVENTS    64
+#define FANOUT        4
+#define NUM_STEPS     2000000
+
+static state_machine_t *
+build (char **event_names)
+{
+  state_machine_t     *fsm    = fsm_create("minimize", NULL);
+  state_descriptor_t **states = malloc(NUM_STATES * sizeof(*states));
+  int                 *events = malloc(NUM_BEHAVIORS * FANOUT * sizeof(int));
+  int                 *target = malloc(NUM_BEHAVIORS * FANOUT * sizeof(int));
+  uint64_t             seed   = 17;
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    char *name = fmt_str("s%d", i);
+    states[i]  = fsm_state_register(fsm, fsm_state_create(name));
+    free(name);
+  }
+
+  for (int b = 0; b < NUM_BEHAVIORS; b++) {
+    int base = bench_rand(&seed) % NUM_EVENTS;
+    for (int j = 0; j < FANOUT; j++) {
+      events[b * FANOUT + j] = (base + j * (NUM_EVENTS / FANOUT)) % NUM_EVENTS;
+      target[b * FANOUT + j] = bench_rand(&seed) % NUM_BEHAVIORS;
+    }
+  }
+
+  // state `i` behaves as behavior `i % NUM_BEHAVIORS`, and each transition
+  // picks any one of its target behavior's copies
+  for (int i = 0; i < NUM_STATES; i++) {
+    int b = i % NUM_BEHAVIORS;
+    for (int j = 0; j < FANOUT; j++) {
+      int copy = bench_rand(&seed) % NUM_COPIES;
+      fsm_transition_register(
+        fsm,
+        states[i],
+        fsm_transition_create(
+          event_names[events[b * FANOUT + j]],
+          states[target[b * FANOUT + j] + copy * NUM_BEHAVIORS],
+          NULL,
+          NULL
+        )
+      );
+    }
+  }
+
+  fsm_set_initial_state(fsm, states[0]);
+
+  free(states);
+  free(events);
+  free(target);
+
+  return fsm;
+}
+
+static double
+run (state_machine_t *fsm, const int *steps)
+{
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "s0"));
+
+  double start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_transition_id(fsm, steps[i]);
+  }
+
+  return (bench_now() - start) / NUM_STEPS;
+}
+
+int
+main (void)
+{
+  char *event_names[NUM_EVENTS];
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    event_names[i] = fmt_str("event_%d", i);
+  }
+
+  state_machine_t *fsm = build(event_names);
+  fsm_finalize(fsm);
+
+  // a walk that always takes an enabled transition
+  int     *steps       = malloc(NUM_STEPS * sizeof(int));
+  uint64_t seed        = 23;
+  for (int i = 0; i < NUM_STEPS; i++) {
+    state_descriptor_t *s    = fsm->state;
+    unsigned int        pick = bench_rand(&seed) % array_size(s->transitions);
+    transition_t       *t    = array_get(s->transitions, pick);
+    steps[i]                 = fsm_event_id(fsm, t->name);
+    fsm->state               = t->target;
+  }
+
+  double finalized = run(fsm, steps);
+
+  double start     = bench_now();
+  fsm_minimize(fsm);
+  double build_secs = bench_now() - start;
+
+  unsigned int classes = 0;
+  foreach (fsm->states, i) {
+    state_descriptor_t *s = array_get(fsm->states, i);
+    classes += fsm_get_state(fsm, s->name) == s;
+  }
+
+  double minimized = run(fsm, steps);
+
+  printf(
+    "%d states -> %u after minimizing (%.1f ms)\n",
+    NUM_STATES,
+    classes,
+    build_secs * 1e3
+  );
+  printf(
+    "finalized %6.2f ns/event  minimized %6.2f ns/event\n",
+    finalized * 1e9,
+    minimized * 1e9
+  );
+
+  fsm_inline_free(fsm);
+  free(steps);
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    free(event_names[i]);
+  }
+
+  return 0;
+}
@@ -0,0 +1,155 @@
+// Compares the bitset NFA simulation against walking each active state's
+// transition list, on the NFA for (a|b)*a(a|b){k}, whose DFA has 2^(k+1)
+// states.
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_STEPS 200000
+
+static state_machine_t *
+build (int k)
+{
+  state_machine_t     *fsm    = fsm_create("nfa", NULL);
+  state_descriptor_t **states = malloc((k + 2) * sizeof(*states));
+
+  for (int i = 0; i < k + 2; i++) {
+    char *name = fmt_str("s%d", i);
+    states[i]  = fsm_state_register(fsm, fsm_state_create(name));
+    free(name);
+  }
+  states[k + 1]->accepting = true;
+
+  fsm_transition_register(
+    fsm,
+    states[0],
+    fsm_transition_create("a", states[0], NULL, NULL)
+  );
+  fsm_transition_register(
+    fsm,
+    states[0],
+    fsm_transition_create("b", states[0], NULL, NULL)
+  );
+  fsm_transition_register(
+    fsm,
+    states[0],
+    fsm_transition_create("a", states[1], NULL, NULL)
+  );
+  for (int i = 1; i <= k; i++) {
+    fsm_transition_register(
+      fsm,
+      states[i],
+      fsm_transition_create("a", states[i + 1], NULL, NULL)
+    );
+    fsm_transition_register(
+      fsm,
+      states[i],
+      fsm_transition_create("b", states[i + 1], NULL, NULL)
+    );
+  }
+
+  fsm_set_initial_state(fsm, states[0]);
+  fsm_finalize(fsm);
+  free(states);
+
+  return fsm;
+}
+
+// The active states as a list, with a flag per state to drop duplicates
+static long
+run_lists (state_machine_t *fsm, const char **input)
+{
+  unsigned int         n       = array_size(fsm->states);
+  state_descriptor_t **current = malloc(n * sizeof(*current));
+  state_descriptor_t **next    = malloc(n * sizeof(*next));
+  bool                *seen    = malloc(n);
+  unsigned int         size    = 1;
+  long                 matches = 0;
+  current[0]                   = fsm->state;
+
+  for (int i = 0; i < NUM_STEPS; i++) {
+    unsigned int next_size = 0;
+    memset(seen, 0, n);
+
+    for (unsigned int j = 0; j < size; j++) {
+      foreach (current[j]->transitions, x) {
+        transition_t *t = array_get(current[j]->transitions, x);
+        if (t->name == input[i] && !seen[t->target->id]) {
+          seen[t->target->id] = true;
+          next[next_size++]   = t->target;
+        }
+      }
+    }
+
+    state_descriptor_t **swap = current;
+    current                   = next;
+    next                      = swap;
+    size                      = next_size;
+    for (unsigned int j = 0; j < size; j++) {
+      matches += current[j]->accepting;
+    }
+  }
+
+  free(current);
+  free(next);
+  free(seen);
+
+  return matches;
+}
+
+static long
+run_bitsets (fsm_nfa_t *nfa, const int *ids)
+{
+  long matches = 0;
+
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_nfa_transition_id(nfa, ids[i]);
+    matches += fsm_nfa_accepting(nfa);
+  }
+
+  return matches;
+}
+
+int
+main (void)
+{
+  const char **input = malloc(NUM_STEPS * sizeof(char *));
+  int         *ids   = malloc(NUM_STEPS * sizeof(int));
+  uint64_t     seed  = 41;
+
+  for (int k = 16; k <= 4096; k *= 4) {
+    state_machine_t *fsm = build(k);
+    fsm_nfa_t       *nfa = fsm_nfa_create(fsm);
+
+    for (int i = 0; i < NUM_STEPS; i++) {
+      input[i] = s_intern(bench_rand(&seed) % 2 ? "a" : "b");
+      ids[i]   = fsm_event_id(fsm, input[i]);
+    }
+
+    double start     = bench_now();
+    long   lists     = run_lists(fsm, input);
+    double list_secs = bench_now() - start;
+
+    start              = bench_now();
+    long   bitsets     = run_bitsets(nfa, ids);
+    double bitset_secs = bench_now() - start;
+
+    printf(
+      "%5d states  state lists %9.1f ns/event  bitsets %8.1f ns/event%s\n",
+      k + 2,
+      list_secs * 1e9 / NUM_STEPS,
+      bitset_secs * 1e9 / NUM_STEPS,
+      lists == bitsets ? "" : "  MISMATCH"
+    );
+
+    fsm_nfa_free(nfa);
+    fsm_inline_free(fsm);
+  }
+
+  free(input);
+  free(ids);
+
+  return 0;
+}
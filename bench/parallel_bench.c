@@ -0,0 +1,102 @@
+// Compares replaying a long event stream through fsm_transition_id against
+// fsm_run_parallel at increasing thread counts.
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_STATES 256
+#define NUM_EVENTS 32
+#define FANOUT     8
+#define NUM_STEPS  (1 << 24)
+
+static state_machine_t *
+build (void)
+{
+  state_machine_t    *fsm = fsm_create("parallel", NULL);
+  state_descriptor_t *states[NUM_STATES];
+  uint64_t            seed = 29;
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    char *name = fmt_str("s%d", i);
+    states[i]  = fsm_state_register(fsm, fsm_state_create(name));
+    free(name);
+  }
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    int base = bench_rand(&seed) % NUM_EVENTS;
+    for (int j = 0; j < FANOUT; j++) {
+      char *event = fmt_str("event_%d", (base + j) % NUM_EVENTS);
+      fsm_transition_register(
+        fsm,
+        states[i],
+        fsm_transition_create(
+          event,
+          states[bench_rand(&seed) % NUM_STATES],
+          NULL,
+          NULL
+        )
+      );
+      free(event);
+    }
+  }
+
+  fsm_set_initial_state(fsm, states[0]);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+int
+main (void)
+{
+  state_machine_t    *fsm     = build();
+  state_descriptor_t *initial = fsm->state;
+
+  int                *events  = malloc(NUM_STEPS * sizeof(int));
+  uint64_t            seed    = 31;
+  for (int i = 0; i < NUM_STEPS; i++) {
+    events[i] = bench_rand(&seed) % NUM_EVENTS;
+  }
+
+  double start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_transition_id(fsm, events[i]);
+  }
+  double              sequential = bench_now() - start;
+  state_descriptor_t *expected   = fsm->state;
+
+  printf(
+    "%d events, %ld cpus online\nfsm_transition_id         %8.2f ms\n",
+    NUM_STEPS,
+    sysconf(_SC_NPROCESSORS_ONLN),
+    sequential * 1e3
+  );
+
+  for (unsigned int threads = 1; threads <= 8; threads *= 2) {
+    fsm_set_initial_state(fsm, initial);
+    start                     = bench_now();
+    state_descriptor_t *final = fsm_run_parallel(
+      fsm,
+      events,
+      NUM_STEPS,
+      threads,
+      NULL
+    );
+    double secs = bench_now() - start;
+
+    printf(
+      "fsm_run_parallel (%u thr)  %8.2f ms  speedup %5.2fx%s\n",
+      threads,
+      secs * 1e3,
+      sequential / secs,
+      final == expected ? "" : "  MISMATCH"
+    );
+  }
+
+  fsm_inline_free(fsm);
+  free(events);
+
+  return 0;
+}
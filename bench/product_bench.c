@@ -0,0 +1,139 @@
+// Compares stepping several machines in lockstep, each resolving the event
+// itself, against stepping their product once. The machines are counters of
+// coprime sizes, so every combination is reachable.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_MACHINES 4
+#define NUM_STEPS    4000000
+
+static const int sizes[NUM_MACHINES] = {3, 5, 7, 11};
+
+static void
+count (void *ctx)
+{
+  (*(long *)ctx)++;
+}
+
+// A counter that "tick" advances and "reset" sends back to zero. The first
+// also counts its ticks, so the product carries an action.
+static state_machine_t *
+build (int size, long *ticks)
+{
+  state_machine_t     *fsm    = fsm_create("counter", ticks);
+  state_descriptor_t **states = malloc(size * sizeof(*states));
+
+  for (int i = 0; i < size; i++) {
+    char *name = fmt_str("s%d", i);
+    states[i]  = fsm_state_register(fsm, fsm_state_create(name));
+    free(name);
+  }
+
+  for (int i = 0; i < size; i++) {
+    fsm_transition_register(
+      fsm,
+      states[i],
+      fsm_transition_create(
+        "tick",
+        states[(i + 1) % size],
+        NULL,
+        ticks ? count : NULL
+      )
+    );
+    fsm_transition_register(
+      fsm,
+      states[i],
+      fsm_transition_create("reset", states[0], NULL, NULL)
+    );
+  }
+
+  fsm_set_initial_state(fsm, states[0]);
+  fsm_finalize(fsm);
+  free(states);
+
+  return fsm;
+}
+
+int
+main (void)
+{
+  state_machine_t *machines[NUM_MACHINES];
+  long             ticks = 0;
+  const char     **input = malloc(NUM_STEPS * sizeof(char *));
+  int             *ids   = malloc(NUM_STEPS * sizeof(int));
+  uint64_t         seed  = 43;
+
+  for (int m = 0; m < NUM_MACHINES; m++) {
+    machines[m] = build(sizes[m], m ? NULL : &ticks);
+  }
+
+  double         start = bench_now();
+  fsm_product_t *p     = fsm_product(
+    machines[0],
+    machines[1],
+    machines[2],
+    machines[3]
+  );
+  double build_s = bench_now() - start;
+  printf(
+    "built %u product states in %.2f ms\n",
+    array_size(fsm_product_machine(p)->states),
+    build_s * 1e3
+  );
+
+  for (int i = 0; i < NUM_STEPS; i++) {
+    input[i] = bench_rand(&seed) % 64 ? "tick" : "reset";
+    ids[i]   = fsm_event_id(fsm_product_machine(p), input[i]);
+  }
+
+  // each machine resolves the name through its own event table
+  start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    for (int m = 0; m < NUM_MACHINES; m++) {
+      fsm_transition(machines[m], input[i]);
+    }
+  }
+  double lockstep_s = bench_now() - start;
+  long   lockstep   = ticks;
+
+  ticks = 0;
+  start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_product_transition(p, input[i]);
+  }
+  double product_s = bench_now() - start;
+  long   product   = ticks;
+
+  ticks = 0;
+  start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_product_transition_id(p, ids[i]);
+  }
+  double product_id_s = bench_now() - start;
+
+  printf(
+    "%d machines in lockstep    %6.1f ns/event\n",
+    NUM_MACHINES,
+    lockstep_s * 1e9 / NUM_STEPS
+  );
+  printf(
+    "product by name            %6.1f ns/event%s\n",
+    product_s * 1e9 / NUM_STEPS,
+    product == lockstep ? "" : "  MISMATCH"
+  );
+  printf(
+    "product by event ID        %6.1f ns/event\n",
+    product_id_s * 1e9 / NUM_STEPS
+  );
+
+  fsm_product_free(p);
+  for (int m = 0; m < NUM_MACHINES; m++) {
+    fsm_inline_free(machines[m]);
+  }
+  free(input);
+  free(ids);
+
+  return 0;
+}
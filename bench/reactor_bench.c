@@ -0,0 +1,124 @@
+// Compares posting events to a machine from another thread through
+// fsm_reactor_post against the usual hand-written glue: one message written
+// to a pipe per event, and one epoll_wait and read per event on the
+// machine's thread.
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_EVENTS 1000000
+
+typedef struct {
+  fsm_reactor_t   *reactor;
+  state_machine_t *fsm;
+  int              event_id;
+  int              fd;
+} producer_t;
+
+static void
+tick (void *ctx)
+{
+  (*(int *)ctx)++;
+}
+
+static void *
+post_events (void *arg)
+{
+  producer_t *p = arg;
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    fsm_reactor_post(p->reactor, p->fsm, p->event_id);
+  }
+
+  return NULL;
+}
+
+static void *
+write_events (void *arg)
+{
+  producer_t *p = arg;
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    if (write(p->fd, &p->event_id, sizeof(int)) != sizeof(int)) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+int
+main (void)
+{
+  int                 ticks = 0;
+  state_machine_t    *fsm   = fsm_create("counter", &ticks);
+  state_descriptor_t *on    = fsm_state_register(fsm, fsm_state_create("on"));
+  fsm_transition_register(
+    fsm,
+    on,
+    fsm_transition_create("tick", on, NULL, tick)
+  );
+  fsm_set_initial_state(fsm, on);
+  fsm_finalize(fsm);
+
+  producer_t p = {.fsm = fsm, .event_id = fsm_event_id(fsm, "tick")};
+  pthread_t  thread;
+
+  int pipefd[2];
+  int epfd = epoll_create1(0);
+  if (pipe(pipefd) != 0) {
+    return 1;
+  }
+  struct epoll_event ev = {.events = EPOLLIN, .data.fd = pipefd[0]};
+  epoll_ctl(epfd, EPOLL_CTL_ADD, pipefd[0], &ev);
+  p.fd = pipefd[1];
+
+  long   waits = 0;
+  double start = bench_now();
+  pthread_create(&thread, NULL, write_events, &p);
+  while (ticks < NUM_EVENTS) {
+    epoll_wait(epfd, &ev, 1, -1);
+    waits++;
+
+    int id;
+    if (read(pipefd[0], &id, sizeof(id)) == sizeof(id)) {
+      fsm_transition_id(fsm, id);
+    }
+  }
+  pthread_join(thread, NULL);
+  double glue = bench_now() - start;
+
+  printf(
+    "pipe glue          %6.1f ns/event  %8ld wakeups\n",
+    glue * 1e9 / NUM_EVENTS,
+    waits
+  );
+
+  fsm_reactor_t *r = fsm_reactor_create();
+  p.reactor        = r;
+  ticks            = 0;
+  waits            = 0;
+
+  start = bench_now();
+  pthread_create(&thread, NULL, post_events, &p);
+  while (ticks < NUM_EVENTS && fsm_reactor_run(r, -1) >= 0) {
+    waits++;
+  }
+  pthread_join(thread, NULL);
+  double posted = bench_now() - start;
+
+  printf(
+    "fsm_reactor_post   %6.1f ns/event  %8ld wakeups\n",
+    posted * 1e9 / NUM_EVENTS,
+    waits
+  );
+
+  fsm_reactor_free(r);
+  close(pipefd[0]);
+  close(pipefd[1]);
+  close(epfd);
+  fsm_inline_free(fsm);
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Compares dispatching events to entities by 64-bit ID through an fsm_registry,
+// one event at a time and in bulk, against the map consumers otherwise build
+// themselves: a chained hash table from ID to machine.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_IDS    1000000
+#define NUM_EVENTS 10000000
+#define BATCH      4096
+
+typedef struct node {
+  uint64_t         id;
+  state_machine_t *fsm;
+  struct node     *next;
+} node_t;
+
+typedef struct {
+  node_t         **buckets;
+  uint64_t         mask;
+  state_machine_t *def;
+} chained_map_t;
+
+static state_machine_t *
+create_connection (void)
+{
+  state_machine_t    *fsm     = fsm_create("connection", NULL);
+  const char         *names[] = {"idle", "reading", "writing"};
+  state_descriptor_t *s[3];
+
+  for (int i = 0; i < 3; i++) {
+    s[i] = fsm_state_register(fsm, fsm_state_create(names[i]));
+  }
+  for (int i = 0; i < 3; i++) {
+    fsm_transition_register(
+      fsm,
+      s[i],
+      fsm_transition_create("step", s[(i + 1) % 3], NULL, NULL)
+    );
+  }
+  fsm_set_initial_state(fsm, s[0]);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+static state_machine_t *
+chained_get (chained_map_t *m, uint64_t id)
+{
+  node_t **bucket = &m->buckets[(id * 0x9e3779b97f4a7c15) >> 44 & m->mask];
+
+  for (node_t *n = *bucket; n; n = n->next) {
+    if (n->id == id) {
+      return n->fsm;
+    }
+  }
+
+  node_t *n = malloc(sizeof(node_t));
+  n->id     = id;
+  n->fsm    = fsm_instance("connection", NULL, m->def);
+  n->next   = *bucket;
+  *bucket   = n;
+
+  return n->fsm;
+}
+
+int
+main (void)
+{
+  state_machine_t *def  = create_connection();
+  int              step = fsm_event_id(def, "step");
+  uint64_t        *ids  = malloc(NUM_EVENTS * sizeof(uint64_t));
+  int             *evs  = malloc(NUM_EVENTS * sizeof(int));
+  uint64_t         seed = 88172645463325252ull;
+
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    ids[i] = (bench_rand(&seed) % NUM_IDS) * 0x100000001b3;
+    evs[i] = step;
+  }
+
+  chained_map_t map = {
+    .buckets = calloc(1 << 20, sizeof(node_t *)),
+    .mask    = (1 << 20) - 1,
+    .def     = def};
+  fsm_registry_t *reg = fsm_registry_create(def);
+
+  // every ID is seen once before timing, so that creation isn't measured
+  for (uint64_t i = 0; i < NUM_IDS; i++) {
+    chained_get(&map, i * 0x100000001b3);
+    fsm_registry_instance(reg, i * 0x100000001b3);
+  }
+
+  double start = bench_now();
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    fsm_transition_id(chained_get(&map, ids[i]), evs[i]);
+  }
+  printf(
+    "chained map + fsm_transition_id  %6.1f ns/event\n",
+    (bench_now() - start) * 1e9 / NUM_EVENTS
+  );
+
+  start = bench_now();
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    fsm_registry_dispatch_id(reg, ids[i], evs[i]);
+  }
+  printf(
+    "fsm_registry_dispatch_id         %6.1f ns/event\n",
+    (bench_now() - start) * 1e9 / NUM_EVENTS
+  );
+
+  start = bench_now();
+  for (int i = 0; i < NUM_EVENTS; i += BATCH) {
+    fsm_registry_dispatch_n(reg, ids + i, evs + i, BATCH);
+  }
+  printf(
+    "fsm_registry_dispatch_n          %6.1f ns/event\n",
+    (bench_now() - start) * 1e9 / NUM_EVENTS
+  );
+
+  for (uint64_t b = 0; b <= map.mask; b++) {
+    for (node_t *n = map.buckets[b], *next; n; n = next) {
+      next = n->next;
+      fsm_free(n->fsm);
+      free(n);
+    }
+  }
+  free(map.buckets);
+  fsm_registry_free(reg);
+  fsm_free(def);
+  free(ids);
+  free(evs);
+
+  return 0;
+}
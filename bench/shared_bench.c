@@ -0,0 +1,165 @@
+// Compares worker processes transitioning machines in a shared segment
+// against the usual alternative: one process owns the machines, and workers
+// send it each event over a socket and wait for the new state.
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_WORKERS     4
+#define NUM_INSTANCES   100000
+#define NUM_TRANSITIONS 1000000
+
+typedef struct {
+  uint32_t instance;
+  int      event_id;
+} request_t;
+
+static state_machine_t *
+create_connection (void)
+{
+  state_machine_t    *fsm     = fsm_create("connection", NULL);
+  const char         *names[] = {"idle", "reading", "writing"};
+  state_descriptor_t *s[3];
+
+  for (int i = 0; i < 3; i++) {
+    s[i] = fsm_state_register(fsm, fsm_state_create(names[i]));
+  }
+  for (int i = 0; i < 3; i++) {
+    fsm_transition_register(
+      fsm,
+      s[i],
+      fsm_transition_create("step", s[(i + 1) % 3], NULL, NULL)
+    );
+  }
+  fsm_set_initial_state(fsm, s[0]);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+static double
+run_workers (void (*work)(void *, int), void *arg)
+{
+  pid_t  pids[NUM_WORKERS];
+  double start = bench_now();
+
+  for (int i = 0; i < NUM_WORKERS; i++) {
+    if ((pids[i] = fork()) == 0) {
+      work(arg, i);
+      _exit(0);
+    }
+  }
+  for (int i = 0; i < NUM_WORKERS; i++) {
+    waitpid(pids[i], NULL, 0);
+  }
+
+  return bench_now() - start;
+}
+
+static void
+shared_work (void *arg, int worker)
+{
+  fsm_shared_t *sh   = arg;
+  int           step = fsm_shared_event_id(sh, "step");
+  uint64_t      seed = 88172645463325252ull + worker;
+
+  for (int i = 0; i < NUM_TRANSITIONS; i++) {
+    fsm_shared_transition_id(sh, bench_rand(&seed) % NUM_INSTANCES, step);
+  }
+}
+
+typedef struct {
+  int fds[NUM_WORKERS][2];
+  int step;
+} ipc_t;
+
+static void
+ipc_work (void *arg, int worker)
+{
+  ipc_t   *ipc  = arg;
+  int      fd   = ipc->fds[worker][1];
+  uint64_t seed = 88172645463325252ull + worker;
+
+  for (int i = 0; i < NUM_TRANSITIONS / 10; i++) {
+    request_t req = {bench_rand(&seed) % NUM_INSTANCES, ipc->step};
+    int       state;
+    if (write(fd, &req, sizeof(req)) != sizeof(req)
+        || read(fd, &state, sizeof(state)) != sizeof(state)) {
+      break;
+    }
+  }
+  close(fd);
+}
+
+int
+main (void)
+{
+  state_machine_t *def = create_connection();
+  fsm_shared_t    *sh  = fsm_shared_create(NULL, def, NUM_INSTANCES);
+
+  double shared = run_workers(shared_work, sh);
+  printf(
+    "fsm_shared          %8.1f ns/transition per worker\n",
+    shared * 1e9 / NUM_TRANSITIONS
+  );
+
+  // the owner keeps one machine state per instance and serves every worker
+  ipc_t ipc = {.step = fsm_event_id(def, "step")};
+  for (int i = 0; i < NUM_WORKERS; i++) {
+    socketpair(AF_UNIX, SOCK_STREAM, 0, ipc.fds[i]);
+  }
+
+  pid_t owner = fork();
+  if (owner == 0) {
+    for (int i = 0; i < NUM_WORKERS; i++) {
+      close(ipc.fds[i][1]);
+    }
+
+    uint8_t            *states = calloc(NUM_INSTANCES, 1);
+    state_descriptor_t *rows[3];
+    for (int i = 0; i < 3; i++) {
+      rows[i] = array_get(def->states, i);
+    }
+
+    int open = NUM_WORKERS;
+    while (open) {
+      open = 0;
+      for (int i = 0; i < NUM_WORKERS; i++) {
+        request_t req;
+        if (read(ipc.fds[i][0], &req, sizeof(req)) != sizeof(req)) {
+          continue;
+        }
+        open++;
+
+        def->state = rows[states[req.instance]];
+        fsm_transition_id(def, req.event_id);
+        int state            = (int)def->state->id;
+        states[req.instance] = (uint8_t)state;
+        if (write(ipc.fds[i][0], &state, sizeof(state)) != sizeof(state)) {
+          break;
+        }
+      }
+    }
+    _exit(0);
+  }
+  for (int i = 0; i < NUM_WORKERS; i++) {
+    close(ipc.fds[i][0]);
+  }
+
+  double rpc = run_workers(ipc_work, &ipc);
+  for (int i = 0; i < NUM_WORKERS; i++) {
+    close(ipc.fds[i][1]);
+  }
+  waitpid(owner, NULL, 0);
+  printf(
+    "socket round trips  %8.1f ns/transition per worker\n",
+    rpc * 1e9 / (NUM_TRANSITIONS / 10)
+  );
+
+  fsm_shared_free(sh);
+
+  return 0;
+}
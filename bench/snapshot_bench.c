@@ -0,0 +1,107 @@
+// Times writing and restoring a snapshot of 10M instances with 8-byte
+// contexts.
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_INSTANCES 10000000
+
+static size_t
+save_counter (void *context, void *out, size_t capacity)
+{
+  if (capacity >= sizeof(uint64_t)) {
+    memcpy(out, context, sizeof(uint64_t));
+  }
+
+  return sizeof(uint64_t);
+}
+
+typedef struct {
+  state_machine_t *instances;
+  uint64_t        *counters;
+} fleet_t;
+
+static void
+restore (
+  void               *arg,
+  uint64_t            index,
+  state_descriptor_t *state,
+  const void         *context,
+  size_t              len
+)
+{
+  fleet_t *f = arg;
+  f->instances[index].state = state;
+  memcpy(&f->counters[index], context, len);
+}
+
+int
+main (void)
+{
+  state_machine_t    *def = fsm_create("stages", NULL);
+  state_descriptor_t *s[4];
+  char                name[8];
+
+  for (int i = 0; i < 4; i++) {
+    snprintf(name, sizeof(name), "s%d", i);
+    s[i] = fsm_state_register(def, fsm_state_create(name));
+  }
+  for (int i = 0; i < 3; i++) {
+    fsm_transition_register(
+      def,
+      s[i],
+      fsm_transition_create("next", s[i + 1], NULL, NULL)
+    );
+  }
+  fsm_set_initial_state(def, s[0]);
+  fsm_finalize(def);
+
+  // instances need only a state and a context to be snapshotted
+  state_machine_t  *instances = calloc(NUM_INSTANCES, sizeof(state_machine_t));
+  state_machine_t **pointers  = malloc(NUM_INSTANCES * sizeof(*pointers));
+  uint64_t         *counters  = malloc(NUM_INSTANCES * sizeof(uint64_t));
+  uint64_t          seed      = 88172645463325252ull;
+
+  for (size_t i = 0; i < NUM_INSTANCES; i++) {
+    counters[i]          = bench_rand(&seed);
+    instances[i].state   = s[counters[i] % 4];
+    instances[i].context = &counters[i];
+    pointers[i]          = &instances[i];
+  }
+
+  char path[] = "/tmp/fsms-snapshot-bench-XXXXXX";
+  int  fd     = mkstemp(path);
+  if (fd < 0) {
+    return 1;
+  }
+  close(fd);
+
+  struct stat st;
+  double      start = bench_now();
+  fsm_snapshot_write(path, def, pointers, NUM_INSTANCES, save_counter);
+  double write = bench_now() - start;
+  stat(path, &st);
+  printf(
+    "fsm_snapshot_write  %7.3f s  %6.1f MB\n",
+    write,
+    st.st_size / 1e6
+  );
+
+  fleet_t fleet = {
+    .instances = malloc(NUM_INSTANCES * sizeof(state_machine_t)),
+    .counters  = malloc(NUM_INSTANCES * sizeof(uint64_t))};
+  // fault the destination in first, so only the restore itself is timed
+  memset(fleet.instances, 0xff, NUM_INSTANCES * sizeof(state_machine_t));
+  memset(fleet.counters, 0xff, NUM_INSTANCES * sizeof(uint64_t));
+
+  start       = bench_now();
+  int64_t n   = fsm_snapshot_read(path, def, restore, &fleet);
+  double read = bench_now() - start;
+  printf("fsm_snapshot_read   %7.3f s  %lld instances\n", read, (long long)n);
+
+  unlink(path);
+
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Compares a machine defined with FSM_DEFINE against the same machine built
+// at runtime: the cost of constructing it, and of stepping it by event ID.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+#include "libfsms_static.h"
+
+#define NUM_BUILDS 100000
+#define NUM_STEPS  50000000
+
+#define TCP_STATES(X, M)                                                    \
+  X(M, closed) X(M, listen) X(M, syn_received) X(M, syn_sent)               \
+  X(M, established) X(M, fin_wait_1) X(M, fin_wait_2) X(M, closing)         \
+  X(M, time_wait) X(M, close_wait) X(M, last_ack)
+
+#define TCP_EVENTS(X, M)                                                    \
+  X(M, passive_open) X(M, active_open) X(M, syn) X(M, syn_ack) X(M, ack)    \
+  X(M, fin) X(M, close) X(M, timeout)
+
+#define TCP_TRANSITIONS(X, M)                                               \
+  X(M, closed, passive_open, listen, NULL, NULL)                            \
+  X(M, closed, active_open, syn_sent, NULL, NULL)                           \
+  X(M, listen, syn, syn_received, NULL, NULL)                               \
+  X(M, listen, close, closed, NULL, NULL)                                   \
+  X(M, syn_sent, syn_ack, established, NULL, NULL)                          \
+  X(M, syn_sent, close, closed, NULL, NULL)                                 \
+  X(M, syn_received, ack, established, NULL, NULL)                          \
+  X(M, established, fin, close_wait, NULL, NULL)                            \
+  X(M, established, close, fin_wait_1, NULL, NULL)                          \
+  X(M, fin_wait_1, ack, fin_wait_2, NULL, NULL)                             \
+  X(M, fin_wait_1, fin, closing, NULL, NULL)                                \
+  X(M, fin_wait_2, fin, time_wait, NULL, NULL)                              \
+  X(M, closing, ack, time_wait, NULL, NULL)                                 \
+  X(M, time_wait, timeout, closed, NULL, NULL)                              \
+  X(M, close_wait, close, last_ack, NULL, NULL)                             \
+  X(M, last_ack, ack, closed, NULL, NULL)
+
+FSM_DEFINE(tcp, TCP_STATES, TCP_EVENTS, TCP_TRANSITIONS)
+
+#define STATE_NAME(M, s)                   #s,
+#define TRANSITION_NAMES(M, s, e, t, g, a) {#s, #e, #t},
+
+static const char *state_names[] = {TCP_STATES(STATE_NAME, tcp)};
+static const char *transition_names[][3]
+  = {TCP_TRANSITIONS(TRANSITION_NAMES, tcp)};
+
+// Builds the same machine at runtime, as fsm_inline does
+static state_machine_t *
+build_runtime (void)
+{
+  state_machine_t *fsm = fsm_create("tcp", NULL);
+
+  for (int i = 0; i < tcp_num_states; i++) {
+    fsm_state_register(fsm, fsm_state_create(state_names[i]));
+  }
+
+  for (int i = 0; i < tcp_num_transitions; i++) {
+    fsm_transition_register(
+      fsm,
+      fsm_get_state(fsm, transition_names[i][0]),
+      fsm_transition_create(
+        transition_names[i][1],
+        fsm_get_state(fsm, transition_names[i][2]),
+        NULL,
+        NULL
+      )
+    );
+  }
+
+  fsm_set_initial_state(fsm, array_get(fsm->states, 0));
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+int
+main (void)
+{
+  double start = bench_now();
+  for (int i = 0; i < NUM_BUILDS; i++) {
+    fsm_inline_free(build_runtime());
+  }
+  double inline_build = bench_now() - start;
+
+  start = bench_now();
+  for (int i = 0; i < NUM_BUILDS; i++) {
+    state_machine_t fsm = FSM_STATIC_MACHINE(tcp, tcp_closed, NULL);
+    // keep the initialization from being optimized away
+    __asm__ volatile("" : : "r"(&fsm) : "memory");
+  }
+  double static_build = bench_now() - start;
+
+  printf(
+    "construct  runtime %8.1f ns  FSM_DEFINE %5.1f ns\n",
+    inline_build * 1e9 / NUM_BUILDS,
+    static_build * 1e9 / NUM_BUILDS
+  );
+
+  // a random walk over the events, resolved up front for both
+  int     *events = malloc(NUM_STEPS * sizeof(int));
+  uint64_t seed   = 19;
+  for (int i = 0; i < NUM_STEPS; i++) {
+    events[i] = bench_rand(&seed) % tcp_num_events;
+  }
+
+  state_machine_t *dynamic = build_runtime();
+  int              ids[tcp_num_events];
+  for (int e = 0; e < tcp_num_events; e++) {
+    ids[e] = fsm_event_id(dynamic, tcp_events[e]);
+  }
+
+  start = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    fsm_transition_id(dynamic, ids[events[i]]);
+  }
+  double inline_step = bench_now() - start;
+
+  state_machine_t fsm = FSM_STATIC_MACHINE(tcp, tcp_closed, NULL);
+  start               = bench_now();
+  for (int i = 0; i < NUM_STEPS; i++) {
+    tcp_transition(&fsm, events[i]);
+  }
+  double static_step = bench_now() - start;
+
+  printf(
+    "step       runtime %8.1f ns  FSM_DEFINE %5.1f ns  (%s, %s)\n",
+    inline_step * 1e9 / NUM_STEPS,
+    static_step * 1e9 / NUM_STEPS,
+    fsm_get_state_name(dynamic),
+    fsm_get_state_name(&fsm)
+  );
+
+  fsm_inline_free(dynamic);
+  free(events);
+
+  return 0;
+}
@@ -0,0 +1,117 @@
+// Compares keeping a fleet of entities in an fsm_store against the usual
+// approach of one heap-allocated machine per entity, found through an
+// array indexed by entity: memory per entity, and the cost of transitioning
+// random entities.
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_ENTITIES    1000000
+#define NUM_TRANSITIONS 10000000
+
+static long
+resident_bytes (void)
+{
+  long  pages = 0;
+  FILE *f     = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%*d %ld", &pages) != 1) {
+      pages = 0;
+    }
+    fclose(f);
+  }
+
+  return pages * sysconf(_SC_PAGESIZE);
+}
+
+// "next" cycles through four states
+static state_machine_t *
+create_cycle (void)
+{
+  state_machine_t    *fsm = fsm_create("cycle", NULL);
+  state_descriptor_t *s[4];
+  char                name[8];
+
+  for (int i = 0; i < 4; i++) {
+    snprintf(name, sizeof(name), "s%d", i);
+    s[i] = fsm_state_register(fsm, fsm_state_create(name));
+  }
+  for (int i = 0; i < 4; i++) {
+    fsm_transition_register(
+      fsm,
+      s[i],
+      fsm_transition_create("next", s[(i + 1) % 4], NULL, NULL)
+    );
+  }
+  fsm_set_initial_state(fsm, s[0]);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+int
+main (void)
+{
+  state_machine_t *def  = create_cycle();
+  int              next = fsm_event_id(def, "next");
+  uint64_t         seed = 88172645463325252ull;
+  long             base = resident_bytes();
+
+  state_machine_t **fleet = malloc(NUM_ENTITIES * sizeof(state_machine_t *));
+  for (int i = 0; i < NUM_ENTITIES; i++) {
+    fleet[i] = fsm_clone("entity", NULL, def);
+    fsm_set_initial_state(fleet[i], fsm_get_state(def, "s0"));
+    fsm_finalize(fleet[i]);
+  }
+  long heap = resident_bytes() - base;
+
+  double start = bench_now();
+  for (int i = 0; i < NUM_TRANSITIONS; i++) {
+    fsm_transition_id(fleet[bench_rand(&seed) % NUM_ENTITIES], next);
+  }
+  double heap_time = bench_now() - start;
+
+  printf(
+    "heap machines  %6.1f bytes/entity  %6.1f ns/transition\n",
+    (double)heap / NUM_ENTITIES,
+    heap_time * 1e9 / NUM_TRANSITIONS
+  );
+
+  char path[] = "/tmp/fsms-store-bench-XXXXXX";
+  int  fd     = mkstemp(path);
+  if (fd < 0) {
+    return 1;
+  }
+  close(fd);
+
+  fsm_store_t        *s  = fsm_store_open(path, def, NUM_ENTITIES);
+  state_descriptor_t *s0 = fsm_get_state(def, "s0");
+  for (uint64_t id = 0; id < NUM_ENTITIES; id++) {
+    fsm_store_set(s, id, s0);
+  }
+  struct stat st;
+  stat(path, &st);
+
+  start = bench_now();
+  for (int i = 0; i < NUM_TRANSITIONS; i++) {
+    fsm_store_transition_id(s, bench_rand(&seed) % NUM_ENTITIES, next);
+  }
+  double store_time = bench_now() - start;
+
+  printf(
+    "fsm_store      %6.1f bytes/entity  %6.1f ns/transition\n",
+    (double)st.st_size / NUM_ENTITIES,
+    store_time * 1e9 / NUM_TRANSITIONS
+  );
+
+  start = bench_now();
+  fsm_store_sync(s);
+  printf("fsm_store_sync %6.1f ms\n", (bench_now() - start) * 1e3);
+
+  fsm_store_close(s);
+  unlink(path);
+
+  return 0;
+}
@@ -0,0 +1,214 @@
+// Compares libutil's string primitives against byte-at-a-time loops and the
+// previous strtok-based s_split, on event-name-sized strings and on
+// multi-kilobyte split inputs.
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_NAMES   1024
+#define NAME_REPS   2000
+#define SPLIT_BYTES 8192
+#define SPLIT_REPS  2000
+
+static volatile long sink;
+
+static bool
+equals_bytewise (const char *a, size_t la, const char *b, size_t lb)
+{
+  if (la != lb) {
+    return false;
+  }
+  for (size_t i = 0; i < la; i++) {
+    if (a[i] != b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int
+indexof_bytewise (const char *s, size_t n, const char *t, size_t k)
+{
+  for (size_t i = 0; i + k <= n; i++) {
+    size_t j = 0;
+    while (j < k && s[i + j] == t[j]) {
+      j++;
+    }
+    if (j == k) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static array_t *
+split_strtok (const char *s, const char *delim)
+{
+  char    *input  = s_copy(s);
+  array_t *tokens = array_init();
+
+  if (!strstr(input, delim) || s_equals(input, delim)) {
+    free(input);
+    return tokens;
+  }
+
+  char *token = strtok(input, delim);
+  while (token != NULL) {
+    array_push(tokens, s_copy(token));
+    token = strtok(NULL, delim);
+  }
+
+  free(input);
+  return tokens;
+}
+
+static void
+report (const char *label, double baseline, double current)
+{
+  printf(
+    "%-40s baseline %9.2f ns  libutil %9.2f ns  speedup %5.2fx\n",
+    label,
+    baseline * 1e9,
+    current * 1e9,
+    baseline / current
+  );
+}
+
+static void
+bench_names (size_t min_len, size_t max_len)
+{
+  static char   names[NUM_NAMES][64];
+  static char   copies[NUM_NAMES][64];
+  static size_t lens[NUM_NAMES];
+  uint64_t      seed = 1;
+
+  for (int i = 0; i < NUM_NAMES; i++) {
+    lens[i] = min_len + bench_rand(&seed) % (max_len - min_len + 1);
+    for (size_t j = 0; j < lens[i]; j++) {
+      names[i][j] = 'a' + bench_rand(&seed) % 26;
+    }
+    names[i][lens[i]] = '\0';
+    memcpy(copies[i], names[i], lens[i] + 1);
+  }
+
+  long   hits  = 0;
+  double start = bench_now();
+  for (int r = 0; r < NAME_REPS; r++) {
+    for (int i = 0; i < NUM_NAMES; i++) {
+      hits += equals_bytewise(names[i], lens[i], copies[i], lens[i]);
+    }
+  }
+  double baseline = (bench_now() - start) / (NAME_REPS * NUM_NAMES);
+
+  start           = bench_now();
+  for (int r = 0; r < NAME_REPS; r++) {
+    for (int i = 0; i < NUM_NAMES; i++) {
+      hits += s_equals_n(names[i], lens[i], copies[i], lens[i]);
+    }
+  }
+  double current = (bench_now() - start) / (NAME_REPS * NUM_NAMES);
+
+  start          = bench_now();
+  for (int r = 0; r < NAME_REPS; r++) {
+    for (int i = 0; i < NUM_NAMES; i++) {
+      hits += s_equals(names[i], copies[i]);
+    }
+  }
+  double nul_terminated = (bench_now() - start) / (NAME_REPS * NUM_NAMES);
+  sink                  = hits;
+
+  char label[64];
+  snprintf(label, sizeof(label), "s_equals_n (%zu-%zu B)", min_len, max_len);
+  report(label, baseline, current);
+  snprintf(label, sizeof(label), "s_equals (%zu-%zu B)", min_len, max_len);
+  report(label, baseline, nul_terminated);
+}
+
+static void
+bench_indexof (void)
+{
+  static char haystack[SPLIT_BYTES + 1];
+  uint64_t    seed = 3;
+
+  for (int i = 0; i < SPLIT_BYTES; i++) {
+    haystack[i] = 'a' + bench_rand(&seed) % 26;
+  }
+  haystack[SPLIT_BYTES] = '\0';
+  const char *needle    = "event:closed";
+  memcpy(haystack + SPLIT_BYTES - 12, needle, 12);
+
+  long   hits  = 0;
+  double start = bench_now();
+  for (int r = 0; r < SPLIT_REPS; r++) {
+    hits += indexof_bytewise(haystack, SPLIT_BYTES, needle, 12);
+  }
+  double baseline = (bench_now() - start) / SPLIT_REPS;
+
+  start           = bench_now();
+  for (int r = 0; r < SPLIT_REPS; r++) {
+    hits += s_indexof_n(haystack, SPLIT_BYTES, needle, 12);
+  }
+  double current = (bench_now() - start) / SPLIT_REPS;
+  sink           = hits;
+
+  report("s_indexof_n (8KiB haystack)", baseline, current);
+}
+
+static void
+bench_split (const char *delim, const char *delim_label, size_t avg_token)
+{
+  static char input[SPLIT_BYTES + 1];
+  uint64_t    seed = 5;
+
+  for (int i = 0; i < SPLIT_BYTES; i++) {
+    input[i] = bench_rand(&seed) % avg_token == 0
+               ? delim[bench_rand(&seed) % strlen(delim)]
+               : 'a' + bench_rand(&seed) % 26;
+  }
+  input[SPLIT_BYTES] = '\0';
+  // s_split returns nothing unless the whole delimiter occurs somewhere
+  memcpy(input, delim, strlen(delim));
+
+  long   tokens      = 0;
+  double start       = bench_now();
+  for (int r = 0; r < SPLIT_REPS; r++) {
+    array_t *a  = split_strtok(input, delim);
+    tokens     += array_size(a);
+    array_free_ptrs(a);
+  }
+  double baseline = (bench_now() - start) / SPLIT_REPS;
+
+  start           = bench_now();
+  for (int r = 0; r < SPLIT_REPS; r++) {
+    array_t *a  = s_split_n(input, SPLIT_BYTES, delim, strlen(delim));
+    tokens     += array_size(a);
+    array_free_ptrs(a);
+  }
+  double current = (bench_now() - start) / SPLIT_REPS;
+  sink           = tokens;
+
+  char label[64];
+  snprintf(
+    label,
+    sizeof(label),
+    "s_split_n (8KiB, %s, ~%zuB tokens)",
+    delim_label,
+    avg_token
+  );
+  report(label, baseline, current);
+}
+
+int
+main (void)
+{
+  bench_names(4, 12);
+  bench_names(12, 32);
+  bench_names(32, 63);
+  bench_indexof();
+  bench_split("\n", "'\\n'", 64);
+  bench_split(",", "','", 16);
+  bench_split(" ,;\n", "4 seps", 256);
+
+  return 0;
+}
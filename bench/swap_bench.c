@@ -0,0 +1,126 @@
+// Measures what hot-swappable dispatch costs a transition: fsm_transition_id
+// outside any read-side section, inside one per batch of events and inside one
+// per event, and while another thread keeps swapping the definition.
+#include <pthread.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_TRANSITIONS 20000000
+#define NUM_SWAPS       2000
+#define BATCH           64
+
+static state_machine_t *
+create_light (void)
+{
+  state_machine_t    *fsm = fsm_create("light", NULL);
+  state_descriptor_t *off = fsm_state_register(fsm, fsm_state_create("off"));
+  state_descriptor_t *on  = fsm_state_register(fsm, fsm_state_create("on"));
+
+  fsm_transition_register(
+    fsm,
+    off,
+    fsm_transition_create("push", on, NULL, NULL)
+  );
+  fsm_transition_register(
+    fsm,
+    on,
+    fsm_transition_create("push", off, NULL, NULL)
+  );
+  fsm_set_initial_state(fsm, off);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+// Runs the transitions in batches, entering a read-side section once per
+// batch, once per event, or not at all
+typedef enum { NONE, PER_BATCH, PER_EVENT } sections_t;
+
+static double
+run (state_machine_t *fsm, sections_t sections)
+{
+  int    push  = fsm_event_id(fsm, "push");
+  double start = bench_now();
+
+  for (int i = 0; i < NUM_TRANSITIONS; i += BATCH) {
+    if (sections == PER_BATCH) {
+      fsm_epoch_enter();
+    }
+    for (int k = 0; k < BATCH; k++) {
+      if (sections == PER_EVENT) {
+        fsm_epoch_enter();
+      }
+      fsm_transition_id(fsm, push);
+      if (sections == PER_EVENT) {
+        fsm_epoch_exit();
+      }
+    }
+    if (sections == PER_BATCH) {
+      fsm_epoch_exit();
+    }
+  }
+
+  return (bench_now() - start) * 1e9 / NUM_TRANSITIONS;
+}
+
+typedef struct {
+  state_machine_t *fsm;
+  state_machine_t *defs[2];
+  bool             stop;
+  int              swaps;
+} swapper_t;
+
+static void *
+swap_loop (void *arg)
+{
+  swapper_t *sw = arg;
+
+  while (!__atomic_load_n(&sw->stop, __ATOMIC_ACQUIRE)
+         && sw->swaps < NUM_SWAPS) {
+    fsm_definition_swap(sw->fsm, sw->defs[sw->swaps % 2], NULL);
+    sw->swaps++;
+    usleep(100);
+  }
+
+  return NULL;
+}
+
+int
+main (void)
+{
+  swapper_t sw = {.defs = {create_light(), create_light()}};
+  sw.fsm       = fsm_clone("light", NULL, sw.defs[0]);
+  fsm_set_initial_state(sw.fsm, sw.defs[0]->state);
+  fsm_finalize(sw.fsm);
+
+  printf("no sections          %6.2f ns/transition\n", run(sw.fsm, NONE));
+  printf("section per batch    %6.2f ns/transition\n", run(sw.fsm, PER_BATCH));
+  printf("section per event    %6.2f ns/transition\n", run(sw.fsm, PER_EVENT));
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, swap_loop, &sw);
+  double during = run(sw.fsm, PER_BATCH);
+  __atomic_store_n(&sw.stop, true, __ATOMIC_RELEASE);
+  pthread_join(thread, NULL);
+  printf(
+    "while swapping       %6.2f ns/transition (%d swaps)\n",
+    during,
+    sw.swaps
+  );
+
+  double start = bench_now();
+  for (int i = 0; i < NUM_SWAPS; i++) {
+    fsm_definition_swap(sw.fsm, sw.defs[i % 2], NULL);
+  }
+  printf(
+    "fsm_definition_swap  %6.2f us/swap\n",
+    (bench_now() - start) * 1e6 / NUM_SWAPS
+  );
+
+  fsm_free(sw.fsm);
+  fsm_free(sw.defs[0]);
+  fsm_free(sw.defs[1]);
+
+  return 0;
+}
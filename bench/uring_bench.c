@@ -0,0 +1,122 @@
+// Compares driving many machines through reads of a local file one syscall at
+// a time against batching the reads through fsm_uring: the I/O is submitted
+// and reaped in bulk, and each completion steps its machine directly.
+#include <fcntl.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "libfsms.h"
+
+#define NUM_MACHINES 64
+#define CHUNK        4096
+#define NUM_READS    200000
+#define FILE_SIZE    (1 << 20)
+
+static state_machine_t *
+build (void)
+{
+  state_machine_t    *fsm  = fsm_create("reader", NULL);
+  state_descriptor_t *idle = fsm_state_register(fsm, fsm_state_create("idle"));
+  state_descriptor_t *busy = fsm_state_register(fsm, fsm_state_create("busy"));
+
+  fsm_transition_register(
+    fsm,
+    idle,
+    fsm_transition_create("read", busy, NULL, NULL)
+  );
+  fsm_transition_register(
+    fsm,
+    busy,
+    fsm_transition_create("done", idle, NULL, NULL)
+  );
+  fsm_set_initial_state(fsm, idle);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+int
+main (void)
+{
+  char  path[] = "/tmp/fsms-uring-bench-XXXXXX";
+  int   fd     = mkstemp(path);
+  char *data   = calloc(1, FILE_SIZE);
+  if (fd < 0 || write(fd, data, FILE_SIZE) != FILE_SIZE) {
+    return 1;
+  }
+  free(data);
+
+  state_machine_t *fsms[NUM_MACHINES];
+  char            *bufs = malloc((size_t)NUM_MACHINES * CHUNK);
+  int              results[NUM_MACHINES];
+  for (int i = 0; i < NUM_MACHINES; i++) {
+    fsms[i] = build();
+  }
+  int read = fsm_event_id(fsms[0], "read");
+  int done = fsm_event_id(fsms[0], "done");
+
+  double start = bench_now();
+  for (int n = 0; n < NUM_READS; n++) {
+    int i = n % NUM_MACHINES;
+    fsm_transition_id(fsms[i], read);
+    results[i] = pread(
+      fd,
+      bufs + (size_t)i * CHUNK,
+      CHUNK,
+      (off_t)(n % (FILE_SIZE / CHUNK)) * CHUNK
+    );
+    fsm_transition_id(fsms[i], done);
+  }
+  double sync = bench_now() - start;
+
+  fsm_uring_t *ring = fsm_uring_create(NUM_MACHINES);
+  if (!ring) {
+    printf("io_uring is unavailable\n");
+    return 0;
+  }
+
+  start = bench_now();
+  for (int n = 0; n < NUM_READS; n += NUM_MACHINES) {
+    for (int i = 0; i < NUM_MACHINES && n + i < NUM_READS; i++) {
+      fsm_transition_id(fsms[i], read);
+      fsm_uring_queue(
+        ring,
+        fsms[i],
+        done,
+        &results[i],
+        &(fsm_uring_io_t){
+          .op     = FSM_URING_READ,
+          .fd     = fd,
+          .buf    = bufs + (size_t)i * CHUNK,
+          .len    = CHUNK,
+          .offset = (int64_t)((n + i) % (FILE_SIZE / CHUNK)) * CHUNK}
+      );
+    }
+    while (fsm_uring_in_flight(ring)) {
+      fsm_uring_run(ring, fsm_uring_in_flight(ring));
+    }
+  }
+  double batched = bench_now() - start;
+
+  bool settled = true;
+  for (int i = 0; i < NUM_MACHINES; i++) {
+    settled &= s_equals(fsm_get_state_name(fsms[i]), "idle")
+            && results[i] == CHUNK;
+    fsm_inline_free(fsms[i]);
+  }
+
+  printf(
+    "%d machines  pread %6.0f ns/read  fsm_uring %6.0f ns/read%s\n",
+    NUM_MACHINES,
+    sync * 1e9 / NUM_READS,
+    batched * 1e9 / NUM_READS,
+    settled ? "" : "  MISMATCH"
+  );
+
+  fsm_uring_free(ring);
+  free(bufs);
+  close(fd);
+  unlink(path);
+
+  return 0;
+}
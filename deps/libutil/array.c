@@ -35,17 +35,47 @@ array_t *array_init(void) {
     return NULL;
   }
 
-  array->state = malloc(sizeof(void *));
-  if (!array->state) {
-    free(array);
+  array->state = array->inline_state;
+  array->size = 0;
+  array->capacity = LIB_UTIL_ARRAY_INLINE_CAPACITY;
+
+  return (array_t *)array;
+}
+
+bool array_reserve(array_t *array, unsigned int capacity) {
+  __array_t *internal = (__array_t *)array;
+
+  if (capacity <= internal->capacity) {
+    return true;
+  }
+
+  unsigned int next_capacity = internal->capacity * 2;
+  if (next_capacity < internal->capacity + LIB_UTIL_ARRAY_CAPACITY_INCR) {
+    next_capacity = internal->capacity + LIB_UTIL_ARRAY_CAPACITY_INCR;
+  }
+  if (next_capacity < capacity) {
+    next_capacity = capacity;
+  }
+
+  void **next_state;
+  if (internal->state == internal->inline_state) {
+    next_state = malloc(next_capacity * sizeof(void *));
+    if (next_state) {
+      memcpy(next_state, internal->state, internal->size * sizeof(void *));
+    }
+  } else {
+    next_state = realloc(internal->state, next_capacity * sizeof(void *));
+  }
+
+  if (!next_state) {
     errno = ENOMEM;
-    return NULL;
+    return false;
   }
 
-  array->size = 0;
-  array->capacity = 0;
+  internal->state = next_state;
+  internal->capacity = next_capacity;
 
-  return (array_t *)array;
+  return true;
 }
 
 array_t *__array_collect(void *v, ...) {
@@ -92,19 +122,9 @@ int array_find(array_t *array, comparator_t *comparator, void *compare_to) {
 bool array_push(array_t *array, void *el) {
   __array_t *internal = (__array_t *)array;
 
-  if (internal->size == internal->capacity) {
-    void **next_state = realloc(
-        internal->state,
-        (internal->size + LIB_UTIL_ARRAY_CAPACITY_INCR) * sizeof(void *));
-    if (!next_state) {
-      free(next_state);
-      errno = ENOMEM;
-
-      return false;
-    }
-
-    internal->state = next_state;
-    internal->capacity += LIB_UTIL_ARRAY_CAPACITY_INCR;
+  if (internal->size == internal->capacity &&
+      !array_reserve(array, internal->size + 1)) {
+    return false;
   }
 
   internal->state[internal->size++] = el;
@@ -138,18 +158,11 @@ void *array_shift(array_t *array) {
   }
 
   void *el = internal->state[0];
-  array_t *new = array_init();
 
-  for (unsigned int i = 1; i < internal->size; i++) {
-    array_push(new, internal->state[i]);
-  }
-
-  free(internal->state);
-
-  internal->state = ((__array_t *)new)->state;  // Assign the new state
   internal->size--;
+  memmove(internal->state, internal->state + 1,
+          internal->size * sizeof(void *));
 
-  free(new);
   return el;
 }
 
@@ -191,6 +204,7 @@ array_t *array_map(array_t *array, callback_t *callback) {
   __array_t *internal = (__array_t *)array;
 
   array_t *ret = array_init();
+  array_reserve(ret, internal->size);
   for (unsigned int i = 0; i < internal->size; i++) {
     array_push(ret, callback(internal->state[i], i, array));
   }
@@ -226,11 +240,12 @@ array_t *array_concat(array_t *arr1, array_t *arr2) {
   __array_t *internal2 = (__array_t *)arr2;
 
   __array_t *result = (__array_t *)array_init();
+  if (!result) {
+    return NULL;
+  }
 
-  result->state = realloc(result->state,
-                          (internal1->size + internal2->size) * sizeof(void *));
-  if (!result->state) {
-    errno = ENOMEM;
+  if (!array_reserve((array_t *)result, internal1->size + internal2->size)) {
+    array_free((array_t *)result);
     return NULL;
   }
 
@@ -246,7 +261,9 @@ array_t *array_concat(array_t *arr1, array_t *arr2) {
 void array_free(array_t *array) {
   __array_t *internal = (__array_t *)array;
 
-  free(internal->state);
+  if (internal->state != internal->inline_state) {
+    free(internal->state);
+  }
   internal->state = NULL;
   free(internal);
 }
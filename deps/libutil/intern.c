@@ -0,0 +1,124 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libutil.h"
+
+typedef struct intern_node {
+  struct intern_node *next;
+  uint64_t hash;
+  size_t len;
+  char str[];
+} intern_node_t;
+
+// Chains are only ever prepended to, with a CAS on the bucket head, so readers
+// walk them without locks and nodes are never freed.
+static _Atomic(intern_node_t *) buckets[LIB_UTIL_INTERN_BUCKETS];
+
+uint64_t s_hash_n(const char *s, size_t len) {
+  // Consumes 8 bytes per step, then finishes with the MurmurHash3 finalizer so
+  // every input bit reaches every output bit.
+  uint64_t hash = 0xcbf29ce484222325ULL ^ (len * 0x9e3779b97f4a7c15ULL);
+  uint64_t word;
+
+  for (; len >= 8; s += 8, len -= 8) {
+    memcpy(&word, s, 8);
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    hash = (hash << 31) | (hash >> 33);
+  }
+
+  word = 0;
+  memcpy(&word, s, len);
+  hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+
+  return hash;
+}
+
+static const char *find(intern_node_t *node, intern_node_t *stop,
+                        uint64_t hash, const char *s, size_t len) {
+  for (; node != stop; node = node->next) {
+    if (node->hash == hash && node->len == len &&
+        memcmp(node->str, s, len) == 0) {
+      return node->str;
+    }
+  }
+  return NULL;
+}
+
+const char *s_intern_lookup(const char *s) {
+  if (s == NULL) {
+    return NULL;
+  }
+
+  return s_intern_lookup_n(s, strlen(s));
+}
+
+const char *s_intern_lookup_n(const char *s, size_t len) {
+  if (s == NULL) {
+    return NULL;
+  }
+
+  uint64_t hash = s_hash_n(s, len);
+  _Atomic(intern_node_t *) *bucket =
+      &buckets[hash & (LIB_UTIL_INTERN_BUCKETS - 1)];
+
+  return find(atomic_load_explicit(bucket, memory_order_acquire), NULL, hash,
+              s, len);
+}
+
+const char *s_intern(const char *s) {
+  if (s == NULL) {
+    return NULL;
+  }
+
+  return s_intern_n(s, strlen(s));
+}
+
+const char *s_intern_n(const char *s, size_t len) {
+  if (s == NULL) {
+    return NULL;
+  }
+
+  uint64_t hash = s_hash_n(s, len);
+  _Atomic(intern_node_t *) *bucket =
+      &buckets[hash & (LIB_UTIL_INTERN_BUCKETS - 1)];
+
+  intern_node_t *head = atomic_load_explicit(bucket, memory_order_acquire);
+  const char *found = find(head, NULL, hash, s, len);
+  if (found) {
+    return found;
+  }
+
+  intern_node_t *node = malloc(sizeof(intern_node_t) + len + 1);
+  if (!node) {
+    return NULL;
+  }
+
+  node->hash = hash;
+  node->len = len;
+  memcpy(node->str, s, len);
+  node->str[len] = '\0';
+
+  // On contention, only the nodes pushed since our last look need checking
+  intern_node_t *seen = head;
+  node->next = head;
+  while (!atomic_compare_exchange_weak_explicit(
+      bucket, &node->next, node, memory_order_release,
+      memory_order_acquire)) {
+    found = find(node->next, seen, hash, s, len);
+    if (found) {
+      free(node);
+      return found;
+    }
+    seen = node->next;
+  }
+
+  return node->str;
+}
@@ -7,15 +7,31 @@ extern "C" {
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #ifndef LIB_UTIL_ARRAY_CAPACITY_INCR
 #define LIB_UTIL_ARRAY_CAPACITY_INCR 4
 #endif
 
+// Number of elements an array holds inline before it allocates a separate
+// buffer. Changes the layout of __array_t, so it must be the same for libutil
+// and every translation unit that uses it.
+#ifndef LIB_UTIL_ARRAY_INLINE_CAPACITY
+#define LIB_UTIL_ARRAY_INLINE_CAPACITY 4
+#endif
+
+// Number of hash buckets in the s_intern pool. Must be a power of two.
+#ifndef LIB_UTIL_INTERN_BUCKETS
+#define LIB_UTIL_INTERN_BUCKETS 4096
+#endif
+
 typedef struct {
   void **state;
   unsigned int size;
   unsigned int capacity;
+  // Backing storage for small arrays; `state` points here until the array
+  // outgrows it.
+  void *inline_state[LIB_UTIL_ARRAY_INLINE_CAPACITY];
 } __array_t;
 
 /**
@@ -83,10 +99,18 @@ unsigned int array_size(array_t *array);
 void *array_get(array_t *array, int index);
 
 /**
- * array_init initializes and returns a new array_t*.
+ * array_init initializes and returns a new array_t*. The first
+ * LIB_UTIL_ARRAY_INLINE_CAPACITY elements are stored inside the array itself,
+ * so small arrays cost a single allocation.
  */
 array_t *array_init(void);
 
+/**
+ * array_reserve ensures the array can hold at least `capacity` elements
+ * without reallocating. Returns false if the memory could not be allocated.
+ */
+bool array_reserve(array_t *array, unsigned int capacity);
+
 /**
  * array_includes accepts a comparator function `comparator` which it invokes
  * with each element of the array and `compare_to`. If the comparator returns
@@ -108,10 +132,10 @@ int array_find(array_t *array, comparator_t *comparator, void *compare_to);
 /**
  * array_push appends the given element to the end of the array.
  *
- * Set the `LIB_UTIL_ARRAY_CAPACITY_INCR` macro if you want to change the
- * default capacity incrementor. i.e. if using the default (4), the array
- * reallocates memory every 4 elements. If you know you'll be using more, you
- * can increase this amount and maintain a more performant array.
+ * When full, the array's capacity doubles, growing by at least
+ * `LIB_UTIL_ARRAY_CAPACITY_INCR` elements, so pushing N elements costs O(N)
+ * amortized copying. If you know how many elements you'll push, call
+ * array_reserve up front to avoid reallocating at all.
  */
 bool array_push(array_t *array, void *el);
 
@@ -253,6 +277,21 @@ char *s_copy(const char *s);
  */
 int s_indexof(const char *str, const char *target);
 
+/**
+ * s_indexof_n is s_indexof for strings of known length. Neither `str` nor
+ * `target` needs to be NUL-terminated.
+ */
+int s_indexof_n(const char *str, size_t len, const char *target,
+                size_t target_len);
+
+/**
+ * s_find_any_n returns the index of the first of the `len` bytes at `s` that
+ * occurs in the `set_len` bytes at `set`, or `len` if there is none. Sets of up
+ * to 16 bytes are matched against a whole vector of input at a time.
+ */
+size_t s_find_any_n(const char *s, size_t len, const char *set,
+                    size_t set_len);
+
 /**
  * s_substr finds and returns the substring between
  * indices `start` and `end` for a given string `str`.
@@ -275,10 +314,18 @@ char *s_upper(const char *s);
 
 /**
  * s_equals returns a bool indicating whether strings s1 and s2 are completely
- * equal (case-sensitive).
+ * equal (case-sensitive). Identical pointers, such as two strings returned by
+ * s_intern, compare equal without reading either string.
  */
 bool s_equals(const char *s1, const char *s2);
 
+/**
+ * s_equals_n is s_equals for strings of known length. Neither string needs to
+ * be NUL-terminated, and strings of different lengths are rejected without
+ * reading them.
+ */
+bool s_equals_n(const char *s1, size_t len1, const char *s2, size_t len2);
+
 /**
  * s_nullish tests whether a given string `s` is NULL or empty i.e. "".
  */
@@ -289,12 +336,52 @@ bool s_nullish(const char *s);
  */
 char *s_trim(const char *s);
 
+/**
+ * s_intern returns the canonical copy of `s` from a process-wide pool, adding
+ * it if this is the first time it has been seen. Equal strings always intern to
+ * the same pointer, so interned strings can be compared with `==`. Interned
+ * strings live until the process exits. Safe to call from multiple threads.
+ * Returns NULL if `s` is NULL or the memory could not be allocated.
+ */
+const char *s_intern(const char *s);
+
+/**
+ * s_intern_n is s_intern for a string of known length, which need not be
+ * NUL-terminated. The interned copy is.
+ */
+const char *s_intern_n(const char *s, size_t len);
+
+/**
+ * s_intern_lookup returns the canonical copy of `s` if it has already been
+ * interned, or NULL otherwise. Unlike s_intern, it never grows the pool.
+ */
+const char *s_intern_lookup(const char *s);
+
+/**
+ * s_intern_lookup_n is s_intern_lookup for a string of known length, which need
+ * not be NUL-terminated.
+ */
+const char *s_intern_lookup_n(const char *s, size_t len);
+
+/**
+ * s_hash_n returns a 64-bit non-cryptographic hash of the `len` bytes at `s`,
+ * read a word at a time. This is the hash the s_intern pool uses.
+ */
+uint64_t s_hash_n(const char *s, size_t len);
+
 /**
  * s_split splits a string on all instances of a delimiter.
  * Returns an array_t* of matches, if any, or NULL if erroneous.
  */
 array_t *s_split(const char *s, const char *delim);
 
+/**
+ * s_split_n is s_split for strings of known length. Neither `s` nor `delim`
+ * needs to be NUL-terminated; the tokens are.
+ */
+array_t *s_split_n(const char *s, size_t len, const char *delim,
+                   size_t delim_len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,4 +1,5 @@
 #include <ctype.h>  // for toupper
+#include <stdint.h>
 #include <stdio.h>  // for snprintf
 #include <stdlib.h>
 #include <string.h>
@@ -6,10 +7,251 @@
 
 #include "libutil.h"
 
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(LIB_UTIL_NO_SIMD)
+#define LIB_UTIL_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
 static bool is_ascii_space(char b) {
   return b == ' ' || b == '\t' || b == '\n' || b == '\r';
 }
 
+/*
+ * Search and comparison kernels. The scalar versions are portable; on x86 the
+ * SSE2 (baseline on x86-64) or AVX2 versions are selected once at load time
+ * based on what the CPU supports. Build with LIB_UTIL_NO_SIMD to force the
+ * scalar versions.
+ */
+
+// Compares short strings with at most two overlapping word loads, which covers
+// typical identifiers without a call into memcmp.
+static bool equals_short(const char *a, const char *b, size_t n) {
+  if (n >= 8) {
+    uint64_t a0, a1, b0, b1;
+    memcpy(&a0, a, 8);
+    memcpy(&b0, b, 8);
+    memcpy(&a1, a + n - 8, 8);
+    memcpy(&b1, b + n - 8, 8);
+    return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+  }
+  if (n >= 4) {
+    uint32_t a0, a1, b0, b1;
+    memcpy(&a0, a, 4);
+    memcpy(&b0, b, 4);
+    memcpy(&a1, a + n - 4, 4);
+    memcpy(&b1, b + n - 4, 4);
+    return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (a[i] != b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#ifndef LIB_UTIL_SIMD_X86
+static bool equals_scalar(const char *a, const char *b, size_t n) {
+  return n <= 16 ? equals_short(a, b, n) : memcmp(a, b, n) == 0;
+}
+#endif
+
+static int indexof_scalar(const char *s, size_t n, const char *t, size_t k) {
+  for (size_t i = 0; i + k <= n; i++) {
+    if (s[i] == t[0] && memcmp(s + i + 1, t + 1, k - 1) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Returns the index of the first byte of `s` found in `set`, or `n`
+static size_t find_any_scalar(const char *s, size_t n, const char *set,
+                              size_t set_len) {
+  bool table[256] = {false};
+  for (size_t j = 0; j < set_len; j++) {
+    table[(unsigned char)set[j]] = true;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    if (table[(unsigned char)s[i]]) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#ifdef LIB_UTIL_SIMD_X86
+static bool equals_sse2(const char *a, const char *b, size_t n) {
+  if (n < 16) {
+    return equals_short(a, b, n);
+  }
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) {
+      return false;
+    }
+  }
+
+  // The final, overlapping block covers the remainder
+  __m128i x = _mm_loadu_si128((const __m128i *)(a + n - 16));
+  __m128i y = _mm_loadu_si128((const __m128i *)(b + n - 16));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+}
+
+// Compares the needle's first and last bytes against 16 candidate positions at
+// once and only verifies the positions where both match.
+static int indexof_sse2(const char *s, size_t n, const char *t, size_t k) {
+  __m128i first = _mm_set1_epi8(t[0]);
+  __m128i last = _mm_set1_epi8(t[k - 1]);
+
+  size_t i = 0;
+  for (; i + k - 1 + 16 <= n; i += 16) {
+    __m128i block_first = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i block_last = _mm_loadu_si128((const __m128i *)(s + i + k - 1));
+    unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+        _mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+
+    while (mask) {
+      unsigned int bit = __builtin_ctz(mask);
+      if (k <= 2 || memcmp(s + i + bit + 1, t + 1, k - 2) == 0) {
+        return i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  int rest = indexof_scalar(s + i, n - i, t, k);
+  return rest == -1 ? -1 : (int)i + rest;
+}
+
+static size_t find_any_sse2(const char *s, size_t n, const char *set,
+                            size_t set_len) {
+  if (set_len > 16) {
+    return find_any_scalar(s, n, set, set_len);
+  }
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(s + i));
+    __m128i hits = _mm_setzero_si128();
+    for (size_t j = 0; j < set_len; j++) {
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8(set[j])));
+    }
+
+    unsigned int mask = _mm_movemask_epi8(hits);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + find_any_scalar(s + i, n - i, set, set_len);
+}
+
+__attribute__((target("avx2"))) static bool equals_avx2(const char *a,
+                                                         const char *b,
+                                                         size_t n) {
+  if (n < 32) {
+    return equals_sse2(a, b, n);
+  }
+
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    if ((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) !=
+        0xFFFFFFFFu) {
+      return false;
+    }
+  }
+
+  __m256i x = _mm256_loadu_si256((const __m256i *)(a + n - 32));
+  __m256i y = _mm256_loadu_si256((const __m256i *)(b + n - 32));
+  return (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) ==
+         0xFFFFFFFFu;
+}
+
+__attribute__((target("avx2"))) static int indexof_avx2(const char *s,
+                                                         size_t n,
+                                                         const char *t,
+                                                         size_t k) {
+  __m256i first = _mm256_set1_epi8(t[0]);
+  __m256i last = _mm256_set1_epi8(t[k - 1]);
+
+  size_t i = 0;
+  for (; i + k - 1 + 32 <= n; i += 32) {
+    __m256i block_first = _mm256_loadu_si256((const __m256i *)(s + i));
+    __m256i block_last = _mm256_loadu_si256((const __m256i *)(s + i + k - 1));
+    unsigned int mask = _mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first),
+                         _mm256_cmpeq_epi8(last, block_last)));
+
+    while (mask) {
+      unsigned int bit = __builtin_ctz(mask);
+      if (k <= 2 || memcmp(s + i + bit + 1, t + 1, k - 2) == 0) {
+        return i + bit;
+      }
+      mask &= mask - 1;
+    }
+  }
+
+  int rest = indexof_sse2(s + i, n - i, t, k);
+  return rest == -1 ? -1 : (int)i + rest;
+}
+
+__attribute__((target("avx2"))) static size_t find_any_avx2(const char *s,
+                                                             size_t n,
+                                                             const char *set,
+                                                             size_t set_len) {
+  if (set_len > 16) {
+    return find_any_scalar(s, n, set, set_len);
+  }
+
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(s + i));
+    __m256i hits = _mm256_setzero_si256();
+    for (size_t j = 0; j < set_len; j++) {
+      __m256i byte = _mm256_set1_epi8(set[j]);
+      hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, byte));
+    }
+
+    unsigned int mask = _mm256_movemask_epi8(hits);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+
+  return i + find_any_sse2(s + i, n - i, set, set_len);
+}
+#endif
+
+static struct {
+  bool (*equals)(const char *a, const char *b, size_t n);
+  int (*indexof)(const char *s, size_t n, const char *t, size_t k);
+  size_t (*find_any)(const char *s, size_t n, const char *set, size_t set_len);
+} kernels = {
+#ifdef LIB_UTIL_SIMD_X86
+    equals_sse2, indexof_sse2, find_any_sse2
+#else
+    equals_scalar, indexof_scalar, find_any_scalar
+#endif
+};
+
+#ifdef LIB_UTIL_SIMD_X86
+__attribute__((constructor)) static void select_kernels(void) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.equals = equals_avx2;
+    kernels.indexof = indexof_avx2;
+    kernels.find_any = find_any_avx2;
+  }
+}
+#endif
+
 char *s_truncate(const char *s, int n) {
   unsigned int full_len = strlen(s);
   unsigned int trunclen = abs(n);
@@ -67,12 +309,30 @@ int s_indexof(const char *s, const char *target) {
     return -1;
   }
 
-  char *needle = strstr(s, target);
-  if (needle == NULL) {
+  return s_indexof_n(s, strlen(s), target, strlen(target));
+}
+
+int s_indexof_n(const char *s, size_t len, const char *target,
+                size_t target_len) {
+  if (s == NULL || target == NULL || target_len > len) {
     return -1;
   }
 
-  return needle - s;
+  if (target_len == 0) {
+    return 0;
+  }
+
+  if (target_len == 1) {
+    const char *p = memchr(s, target[0], len);
+    return p ? p - s : -1;
+  }
+
+  return kernels.indexof(s, len, target, target_len);
+}
+
+size_t s_find_any_n(const char *s, size_t len, const char *set,
+                    size_t set_len) {
+  return kernels.find_any(s, len, set, set_len);
 }
 
 char *s_substr(const char *s, int start, int end, bool inclusive) {
@@ -128,7 +388,7 @@ char *s_upper(const char *s) {
     return NULL;
   }
 
-  strncpy(ca, s, l);
+  memcpy(ca, s, l);
   ca[l] = '\0';
 
   for (size_t i = 0; i < l; i++) {
@@ -139,7 +399,7 @@ char *s_upper(const char *s) {
 }
 
 bool s_equals(const char *s1, const char *s2) {
-  if (!s1 && !s2)
+  if (s1 == s2)
     return true;
   else if (!s1)
     return false;
@@ -149,6 +409,17 @@ bool s_equals(const char *s1, const char *s2) {
     return strcmp(s1, s2) == 0;
 }
 
+bool s_equals_n(const char *s1, size_t len1, const char *s2, size_t len2) {
+  if (len1 != len2)
+    return false;
+  else if (s1 == s2)
+    return true;
+  else if (!s1 || !s2)
+    return false;
+  else
+    return kernels.equals(s1, s2, len1);
+}
+
 bool s_nullish(const char *s) { return s == NULL || s_equals(s, ""); }
 
 char *s_trim(const char *s) {
@@ -174,41 +445,51 @@ array_t *s_split(const char *s, const char *delim) {
     return NULL;
   }
 
-  // see:
-  // https://wiki.sei.cmu.edu/confluence/display/c/STR06-C.+Do+not+assume+that+strtok%28%29+leaves+the+parse+string+unchanged
-  char *input = s_copy(s);
+  return s_split_n(s, strlen(s), delim, strlen(delim));
+}
+
+array_t *s_split_n(const char *s, size_t len, const char *delim,
+                   size_t delim_len) {
+  if (s == NULL || delim == NULL) {
+    return NULL;
+  }
 
   array_t *tokens = array_init();
   if (tokens == NULL) {
-    free(input);
     return NULL;
   }
 
   // If the input doesn't even contain the delimiter, return early and avoid
   // further computation
-  if (!strstr(input, delim)) {
-    free(input);
+  if (s_indexof_n(s, len, delim, delim_len) == -1) {
     return tokens;
   }
 
   // If the input *is* the delimiter, just return the empty array
-  if (s_equals(input, delim)) {
-    free(input);
+  if (s_equals_n(s, len, delim, delim_len)) {
     return tokens;
   }
 
-  char *token = strtok(input, delim);
-  if (token == NULL) {
-    free(input);
-    return tokens;
-  }
-
-  while (token != NULL) {
-    array_push(tokens, s_copy(token));
-    token = strtok(NULL, delim);
+  // Like strtok, every byte of `delim` is a separator and empty tokens are
+  // skipped, but the input is never copied or modified.
+  size_t start = 0;
+  while (start < len) {
+    size_t end = start + kernels.find_any(s + start, len - start, delim,
+                                          delim_len);
+    if (end > start) {
+      char *token = malloc(end - start + 1);
+      if (!token) {
+        array_free_ptrs(tokens);
+        return NULL;
+      }
+
+      memcpy(token, s + start, end - start);
+      token[end - start] = '\0';
+      array_push(tokens, token);
+    }
+
+    start = end + 1;
   }
 
-  free(input);
-
   return tokens;
 }
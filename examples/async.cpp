@@ -0,0 +1,92 @@
+#include <coroutine>
+#include <cstdio>
+#include <vector>
+
+#include "libfsms_coro.hpp"
+
+// A stand-in for an I/O layer: awaiting `io` parks the coroutine until the
+// loop in `main` resumes it
+static std::vector<std::coroutine_handle<>> parked;
+
+struct io {
+  const char* what;
+
+  bool
+  await_ready () const noexcept
+  {
+    return false;
+  }
+
+  void
+  await_suspend (std::coroutine_handle<> h)
+  {
+    printf("  waiting on %s\n", what);
+    parked.push_back(h);
+  }
+
+  void
+  await_resume () const noexcept
+  {
+  }
+};
+
+static void*
+on_transition (void* arg)
+{
+  auto* args = static_cast<transition_subscriber_args_t*>(arg);
+  printf("%s -(%s)-> %s\n", args->prev, args->ev, args->next);
+
+  return NULL;
+}
+
+int
+main ()
+{
+  state_machine_t*    fsm       = fsm_create("conn", NULL);
+  state_descriptor_t* idle      = fsm_state_create("idle");
+  state_descriptor_t* connected = fsm_state_create("connected");
+
+  fsm_state_register(fsm, idle);
+  fsm_state_register(fsm, connected);
+  fsm_transition_register(
+    fsm,
+    idle,
+    fsm_transition_create("connect", connected, NULL, NULL)
+  );
+  fsm_transition_register(
+    fsm,
+    connected,
+    fsm_transition_create("close", idle, NULL, NULL)
+  );
+  fsm_set_initial_state(fsm, idle);
+  fsm_subscribe(fsm, on_transition);
+
+  fsms::async_machine m(fsm, fsms::policy::queue);
+  m.on("idle", "connect", [](void*) -> fsms::task {
+    co_await io{"the handshake"};
+  });
+
+  m.dispatch(fsm_event_id(fsm, "connect"));
+  m.dispatch(fsm_event_id(fsm, "close"));
+  printf(
+    "transitioning: %s, state: %s, queued: %zu\n",
+    m.transitioning() ? "yes" : "no",
+    fsm_get_state_name(fsm),
+    m.queued()
+  );
+
+  while (!parked.empty()) {
+    std::vector<std::coroutine_handle<>> ready;
+    ready.swap(parked);
+    for (auto h : ready) {
+      h.resume();
+    }
+  }
+
+  printf("ending state: %s\n", fsm_get_state_name(fsm));
+  fsm_inline_free(fsm);
+
+  printf("done\n");
+
+  return 0;
+}
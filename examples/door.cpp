@@ -0,0 +1,70 @@
+#include <cstdio>
+
+#include "libfsms.hpp"
+
+enum class door { closed, open, locked };
+enum class ev { open, close, lock, unlock };
+
+struct ctx_t {
+  bool has_key;
+  int  opened;
+};
+
+struct has_key {
+  bool
+  operator() (ctx_t& ctx) const
+  {
+    return ctx.has_key;
+  }
+};
+
+static void
+on_open (ctx_t& ctx)
+{
+  ctx.opened++;
+}
+
+using door_machine = fsms::machine<
+  ctx_t,
+  fsms::transition<door::closed, ev::open, door::open, fsms::always,
+                   fsms::fn<on_open>>,
+  fsms::transition<door::open, ev::close, door::closed>,
+  fsms::transition<door::closed, ev::lock, door::locked, has_key>,
+  fsms::transition<door::locked, ev::unlock, door::closed, has_key>>;
+
+static void*
+on_transition (void* arg)
+{
+  auto* args = static_cast<transition_subscriber_args_t*>(arg);
+  printf("%s -(%s)-> %s\n", args->prev, args->ev, args->next);
+
+  return NULL;
+}
+
+int
+main ()
+{
+  door_machine         m(door::closed, ctx_t{false, 0});
+  door_machine::c_view view(
+    m,
+    "door",
+    {"closed", "open", "locked"},
+    {"open", "close", "lock", "unlock"}
+  );
+  fsm_subscribe(view.get(), on_transition);
+
+  printf("starting state: %s\n", fsm_get_state_name(view.get()));
+  m.dispatch(ev::open);
+  m.dispatch(ev::close);
+  m.dispatch(ev::lock);
+  printf("without a key: %s\n", fsm_get_state_name(view.get()));
+
+  m.context().has_key = true;
+  m.dispatch(ev::lock);
+  printf("ending state: %s\n", fsm_get_state_name(view.get()));
+  printf("opened %d time(s)\n", m.context().opened);
+
+  printf("done\n");
+
+  return 0;
+}
@@ -6,14 +6,28 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "libutil/libutil.h"
 
 #define GET_CONTEXT(tt, fsm) ((tt *)fsm->context)
 
+// Number of 64-bit words needed to hold a mask of `n` event IDs.
+#define FSM_EVENT_MASK_WORDS(n) (((n) + 63) / 64)
+
+// Number of 64-bit words needed to hold a set of `n` state IDs.
+#define FSM_STATE_SET_WORDS(n)  (((n) + 63) / 64)
+
+// The event name of an epsilon transition in a machine run as an NFA.
+#define FSM_EPSILON             ""
+
 typedef struct {
-  const char *name;
-  array_t    *transitions;
+  const char  *name;
+  array_t     *transitions;
+  unsigned int id;
+  // Whether reaching this state completes a match; see `fsm_run_bytes`. Set it
+  // before finalizing the machine.
+  bool         accepting;
 } state_descriptor_t;
 
 typedef struct {
@@ -31,20 +45,102 @@ typedef struct {
   bool (*guard)(void *context);
 } inline_transition_t;
 
+// Lookup tables built by `fsm_finalize`; opaque to consumers.
+typedef struct fsm_compiled fsm_compiled_t;
+
+// A state machine definition run as an NFA; see `fsm_nfa_create`.
+typedef struct fsm_nfa fsm_nfa_t;
+
+// Machines stepped in lockstep as one; see `fsm_product`.
+typedef struct fsm_product fsm_product_t;
+
+// An io_uring instance that feeds I/O completions to machines as events; see
+// `fsm_uring_create`.
+typedef struct fsm_uring fsm_uring_t;
+
+// A single-threaded epoll loop that feeds file descriptor readiness to
+// machines as events; see `fsm_reactor_create`.
+typedef struct fsm_reactor fsm_reactor_t;
+
+// The current states of many entities sharing one definition, kept in a
+// memory-mapped file; see `fsm_store_open`.
+typedef struct fsm_store fsm_store_t;
+
+// An append-only log of committed transitions, for recovering machine states
+// after a crash; see `fsm_journal_open`.
+typedef struct fsm_journal fsm_journal_t;
+
+// A definition's transitions and a table of instance states in a shared memory
+// segment, driven from any process that maps it; see `fsm_shared_create`.
+typedef struct fsm_shared fsm_shared_t;
+
+// The transitions an instance takes in place of its definition's; see
+// `fsm_instance`.
+typedef struct fsm_overlay fsm_overlay_t;
+
+// Instances of one definition, keyed by 64-bit IDs and created on first use;
+// see `fsm_registry_create`.
+typedef struct fsm_registry fsm_registry_t;
+
+// A transition read back from a journal by `fsm_journal_replay`.
+typedef struct {
+  uint64_t     machine_id;
+  int          event_id;
+  // the ID of the state the machine ended up in
+  unsigned int state_id;
+} fsm_journal_record_t;
+
+// Readiness to watch for with `fsm_reactor_watch`.
+#define FSM_REACTOR_READABLE 1
+#define FSM_REACTOR_WRITABLE 2
+
+typedef enum {
+  FSM_URING_READ,
+  FSM_URING_WRITE,
+  FSM_URING_RECV,
+  FSM_URING_SEND,
+  FSM_URING_ACCEPT
+} fsm_uring_op_t;
+
+// An I/O operation for `fsm_uring_queue`. `buf` and `len` are unused by
+// FSM_URING_ACCEPT; `offset` is used by FSM_URING_READ and FSM_URING_WRITE
+// only, where -1 means the file's current position.
+typedef struct {
+  fsm_uring_op_t op;
+  int            fd;
+  void          *buf;
+  unsigned int   len;
+  int64_t        offset;
+} fsm_uring_io_t;
+
 typedef struct {
   const char         *name;
   void               *context;
   array_t            *subscribers;
   array_t            *states;
   state_descriptor_t *state;
+  fsm_compiled_t     *compiled;
+  // set on machines made by `fsm_instance`, whose states and tables belong
+  // to their definition
+  fsm_overlay_t      *overlay;
 } state_machine_t;
 
+// Passed to subscribers by pointer. The struct itself is only valid for the
+// duration of the callback; the names are interned (see `s_intern`) and stay
+// valid for the life of the process.
 typedef struct {
   const char *prev;
   const char *next;
   const char *ev;
 } transition_subscriber_args_t;
 
+// A transition resolved by `fsm_transition_lookup` but not yet taken.
+typedef struct {
+  state_descriptor_t *target;
+  void (*action)(void *context);
+  const char *event;
+} fsm_pending_t;
+
 // Creates a function `<name>` that returns the fsm context as the type `<tt>`.
 #define CREATE_CONTEXT_GETTER(name, tt) \
   tt *name(state_machine_t *fsm)        \
@@ -110,8 +206,32 @@ void fsm_subscribe(state_machine_t *fsm, void *(*subscriber)(void *));
  */
 void fsm_set_initial_state(state_machine_t *fsm, state_descriptor_t *s);
 
+/**
+ * Get the name of the current state. On a minimized machine this is the name
+ * of the first registered member of the current state's class.
+ *
+ * @param fsm
+ * @return const char*
+ */
 const char *fsm_get_state_name(state_machine_t *fsm);
 
+/**
+ * Find a registered state by name. On a minimized machine, names of states
+ * that were merged resolve to the state that now stands in for them.
+ *
+ * @param fsm
+ * @param name
+ * @return state_descriptor_t* NULL if no state has the name
+ */
+state_descriptor_t *fsm_get_state(state_machine_t *fsm, const char *name);
+
+/**
+ * Create a new state. The name is interned, so states and transitions with
+ * equal names share one copy and compare by pointer during dispatch.
+ *
+ * @param name
+ * @return state_descriptor_t*
+ */
 state_descriptor_t *fsm_state_create(const char *name);
 
 state_descriptor_t *
@@ -119,6 +239,15 @@ fsm_state_register(state_machine_t *fsm, state_descriptor_t *s);
 
 void fsm_state_free(state_descriptor_t *s);
 
+/**
+ * Create a new transition on the event `name`. The name is interned.
+ *
+ * @param name
+ * @param target
+ * @param guard May be NULL
+ * @param action May be NULL
+ * @return transition_t*
+ */
 transition_t *fsm_transition_create(
   const char         *name,
   state_descriptor_t *target,
@@ -136,9 +265,1117 @@ void fsm_transition_free(transition_t *t);
 
 void fsm_transition(state_machine_t *fsm, const char *const event);
 
+/**
+ * Transition the state machine on an event name of known length. The name need
+ * not be NUL-terminated, so it can point straight into a network or log buffer
+ * without being copied. On a finalized machine the name is resolved through a
+ * hash of its bytes.
+ *
+ * @param fsm
+ * @param event
+ * @param len The length of `event` in bytes
+ */
+void fsm_transition_n(state_machine_t *fsm, const char *event, size_t len);
+
+/**
+ * Finalize the state machine's definition. Assigns every distinct event name a
+ * dense integer ID and precomputes, for each state, a bitmask of the event IDs
+ * it handles. Registering another state or transition discards the finalized
+ * tables; call `fsm_finalize` again once the definition is complete.
+ *
+ * A finalized machine dispatches from a packed copy of its transitions: each
+ * state's candidates are contiguous, refer to their targets by 32-bit index,
+ * and keep names in a separate side table.
+ *
+ * @param fsm
+ * @return bool false if the machine has no states or a transition targets a
+ * state that was not registered with it
+ */
+bool fsm_finalize(state_machine_t *fsm);
+
+/**
+ * Finalize the state machine and merge equivalent states with Hopcroft's
+ * algorithm. Two states are equivalent when, for every event, they have the
+ * same candidate transitions in the same order, with identical guards and
+ * actions and equivalent targets. Each class of equivalent states dispatches
+ * from a single row, so the finalized tables shrink accordingly.
+ *
+ * All states stay registered, and event IDs are unchanged. Registered states
+ * are reordered so that each class's first member comes first; the current
+ * state, and any state later passed to `fsm_set_initial_state`, is replaced by
+ * its class's first member. Use `fsm_get_state` to resolve the original names.
+ * Registering another state or transition discards the minimization along with
+ * the finalized tables.
+ *
+ * Reordering renumbers the descriptors, including any shared with clones. Such
+ * machines keep dispatching correctly, but find their current state's row by a
+ * search rather than by its ID.
+ *
+ * @param fsm
+ * @return bool false if the machine could not be finalized, or is an instance
+ */
+bool fsm_minimize(state_machine_t *fsm);
+
+/**
+ * Finalize the state machine and compile its dispatch to native code. A step
+ * function with every state's row baked in as constants is emitted as C, built
+ * into a shared object with the system compiler ($CC, or `cc`) and loaded with
+ * `dlopen`; from then on `fsm_transition_id`, and the lookups that go through
+ * it, step through the native function. Transitions with guards or actions, and
+ * events with several candidates, still run through the library once the
+ * native code has found them.
+ *
+ * Objects are cached on disk by a hash of the layout, so machines with the same
+ * states and transitions share one, and later processes skip the compiler. The
+ * cache lives in $FSMS_JIT_CACHE, or else libfsms/ under $XDG_CACHE_HOME or
+ * $HOME/.cache. The cache directory, and any object loaded from it, must be
+ * owned by the effective user and writable by no one else. Each object records
+ * the layout it was built for, and one that doesn't match the machine is not
+ * used. Registering another state or transition, or minimizing the machine,
+ * unloads the native code along with the finalized tables.
+ *
+ * @param fsm
+ * @return bool false if the machine could not be finalized, has more than
+ * FSM_JIT_MAX_ENTRIES (state, event) pairs, or no trusted, matching object
+ * could be built or loaded; the machine keeps working through its tables either
+ * way
+ */
+bool fsm_jit(state_machine_t *fsm);
+
+/**
+ * Get the ID assigned to `event` by `fsm_finalize`.
+ *
+ * @param fsm
+ * @param event
+ * @return int The event ID, or -1 if the event is unknown or the machine has
+ * not been finalized
+ */
+int fsm_event_id(state_machine_t *fsm, const char *event);
+
+/**
+ * Get the ID assigned to an event name of known length, which need not be
+ * NUL-terminated.
+ *
+ * @param fsm
+ * @param event
+ * @param len The length of `event` in bytes
+ * @return int The event ID, or -1 if the event is unknown or the machine has
+ * not been finalized
+ */
+int fsm_event_id_n(state_machine_t *fsm, const char *event, size_t len);
+
+/**
+ * Transition a finalized state machine by event ID, skipping the event name
+ * lookup `fsm_transition` performs. Does nothing if the machine has not been
+ * finalized or the current state does not handle the event.
+ *
+ * @param fsm
+ * @param event_id An ID returned by `fsm_event_id`
+ */
+void fsm_transition_id(state_machine_t *fsm, int event_id);
+
+/**
+ * Get the number of distinct events in a finalized state machine.
+ *
+ * @param fsm
+ * @return unsigned int
+ */
+unsigned int fsm_event_count(state_machine_t *fsm);
+
+/**
+ * Test whether the current state has a transition for the given event ID.
+ * Costs a single bit test on a finalized machine.
+ *
+ * @param fsm
+ * @param event_id An ID returned by `fsm_event_id`
+ * @return bool
+ */
+bool fsm_can_handle(state_machine_t *fsm, int event_id);
+
+/**
+ * Copy the current state's enabled-event bitmask into `out_mask`. Bit `i` of
+ * word `i / 64` is set if event ID `i` is handled. `out_mask` must hold at
+ * least `FSM_EVENT_MASK_WORDS(fsm_event_count(fsm))` words.
+ *
+ * @param fsm
+ * @param out_mask
+ * @return unsigned int The number of words written; 0 if the machine has not
+ * been finalized
+ */
+unsigned int fsm_enabled_events(state_machine_t *fsm, uint64_t *out_mask);
+
+/**
+ * Resolve the transition the given event ID would take from the current state,
+ * without taking it: runs the guard of the first candidate and, if it passes,
+ * fills `out` with its target, action and event name. Only the first candidate
+ * is considered. Pair with `fsm_transition_commit` to split a transition
+ * around work done in between, e.g. by an asynchronous action.
+ *
+ * @param fsm A finalized state machine
+ * @param event_id An ID returned by `fsm_event_id`
+ * @param out
+ * @return bool false if the state doesn't handle the event or the guard fails
+ */
+bool fsm_transition_lookup(
+  state_machine_t *fsm,
+  int              event_id,
+  fsm_pending_t   *out
+);
+
+/**
+ * Take a transition resolved by `fsm_transition_lookup`: runs its action, moves
+ * the machine to its target and notifies subscribers. The target must still be
+ * registered with the machine.
+ *
+ * @param fsm
+ * @param pending
+ */
+void fsm_transition_commit(state_machine_t *fsm, const fsm_pending_t *pending);
+
+/**
+ * Run a stream of event IDs through a finalized state machine, splitting it
+ * across up to `threads` threads. Each thread computes, for its chunk of the
+ * stream, which state every possible start state leads to; the chunks are then
+ * composed in order. Events the current state does not handle leave it
+ * unchanged, as in `fsm_transition_id`.
+ *
+ * Only machines without guards or actions can be run this way, and
+ * subscribers are not notified. The machine is left in the final state.
+ *
+ * @param fsm
+ * @param events Event IDs returned by `fsm_event_id`
+ * @param n The number of events
+ * @param threads The maximum number of threads to use; short streams use fewer
+ * @param out_states May be NULL. Otherwise receives, for each event, the ID of
+ * the state the machine is in after it
+ * @return state_descriptor_t* The final state, or NULL if the machine has not
+ * been finalized, has no current state, has a guard or action, or is an
+ * instance with transitions of its own
+ */
+state_descriptor_t *fsm_run_parallel(
+  state_machine_t *fsm,
+  const int       *events,
+  size_t           n,
+  unsigned int     threads,
+  unsigned int    *out_states
+);
+
+/**
+ * Run a finalized state machine over a buffer of bytes. Every transition on a
+ * one-character event name is a transition on that byte; all other
+ * transitions are ignored. Bytes are first reduced to classes of bytes that
+ * every state treats alike, and each step is then a single lookup in a (state,
+ * byte class) table. In states that loop on all but a handful of bytes, runs
+ * of looping bytes are skipped with vector compares.
+ *
+ * Stops after the first byte that leads to an accepting state, or before the
+ * first byte the current state has no transition for; the NUL byte never has
+ * one. Guards, actions and subscribers are not run, and machines with a guard
+ * or action on a one-character event are not run at all, nor are instances
+ * with transitions of their own (see `fsm_instance`). When an event has
+ * several candidates, the last one decides. The machine is left in the state
+ * reached.
+ *
+ * @param fsm
+ * @param buf
+ * @param len The length of `buf` in bytes
+ * @return size_t The number of bytes consumed. When less than `len`, the
+ * machine is either in an accepting state or stopped on a byte it does not
+ * handle.
+ */
+size_t fsm_run_bytes(state_machine_t *fsm, const char *buf, size_t len);
+
+/**
+ * Create an NFA from a state machine definition, finalizing it if needed. The
+ * NFA's current state is a set of states: an event moves every state in the
+ * set along all of its transitions on the event at once, and states without
+ * one drop out. Transitions on `FSM_EPSILON` are epsilon edges, followed
+ * without consuming an event. The initial set is the definition's current
+ * state and whatever it reaches through epsilon edges.
+ *
+ * Sets are bitsets, and the successors of each (state, event) pair are
+ * precomputed with epsilon edges already followed, so an event costs one
+ * word-parallel OR per state in the set that handles it.
+ *
+ * The definition must outlive the NFA and not change while it is in use.
+ * Guards, actions and subscribers are not supported.
+ *
+ * @param def
+ * @return fsm_nfa_t* NULL if the definition could not be finalized, has no
+ * current state, or has a guard or action
+ */
+fsm_nfa_t *fsm_nfa_create(state_machine_t *def);
+
+/**
+ * Free the given NFA. The definition it was created from is left alone.
+ *
+ * @param nfa
+ */
+void fsm_nfa_free(fsm_nfa_t *nfa);
+
+/**
+ * Return the NFA to its initial set of states.
+ *
+ * @param nfa
+ */
+void fsm_nfa_reset(fsm_nfa_t *nfa);
+
+/**
+ * Advance every state in the NFA's current set on the given event.
+ *
+ * @param nfa
+ * @param event
+ */
+void fsm_nfa_transition(fsm_nfa_t *nfa, const char *event);
+
+/**
+ * Advance every state in the NFA's current set on the given event ID. An
+ * unknown ID empties the set.
+ *
+ * @param nfa
+ * @param event_id An ID returned by `fsm_event_id` on the definition
+ */
+void fsm_nfa_transition_id(fsm_nfa_t *nfa, int event_id);
+
+/**
+ * Test whether a state is in the NFA's current set.
+ *
+ * @param nfa
+ * @param s A state registered with the definition
+ * @return bool
+ */
+bool fsm_nfa_in_state(fsm_nfa_t *nfa, const state_descriptor_t *s);
+
+/**
+ * Test whether the NFA's current set holds an accepting state.
+ *
+ * @param nfa
+ * @return bool
+ */
+bool fsm_nfa_accepting(fsm_nfa_t *nfa);
+
+/**
+ * Copy the NFA's current set into `out_set`. Bit `i` of word `i / 64` is set if
+ * the state with ID `i` is in the set. `out_set` must hold at least
+ * `FSM_STATE_SET_WORDS(n)` words, where `n` is the number of states
+ * registered with the definition.
+ *
+ * @param nfa
+ * @param out_set
+ * @return unsigned int The number of words written
+ */
+unsigned int fsm_nfa_states(fsm_nfa_t *nfa, uint64_t *out_set);
+
+fsm_product_t *__fsm_product(state_machine_t *first, ...);
+
+/**
+ * Build the product of the given machines: one machine whose states are the
+ * reachable combinations of theirs, finalizing each if needed. An event on the
+ * product steps every component that handles the event in its current state,
+ * in the order given, and leaves the rest where they are, just as sending the
+ * event to each machine in turn would. Only combinations reachable from the
+ * machines' current states are built.
+ *
+ * Guards and actions run with their own machine's context. A component whose
+ * guard fails stays put while the others move on, so the product's target may
+ * depend on which guards pass; every such outcome is built up front.
+ *
+ * The components must outlive the product and not change while it is in use.
+ * They are not stepped themselves, and their subscribers are not notified.
+ *
+ * e.g. fsm_product(switch1, switch2)
+ *
+ * @return fsm_product_t* NULL if a machine could not be finalized, has no
+ * current state or is an instance with transitions of its own, or if an edge
+ * has too many guard outcomes
+ */
+#define fsm_product(...) __fsm_product(__VA_ARGS__, NULL)
+
+/**
+ * Free the given product. Its components are left alone.
+ *
+ * @param p
+ */
+void fsm_product_free(fsm_product_t *p);
+
+/**
+ * Get the finalized machine underlying a product. Its states are named after
+ * the components' states, joined with commas, e.g. "off,on". Subscribers
+ * registered with it are notified of the product's transitions. It has no
+ * guards or actions of its own, so send events through
+ * `fsm_product_transition` unless the components have none either.
+ *
+ * @param p
+ * @return state_machine_t*
+ */
+state_machine_t *fsm_product_machine(fsm_product_t *p);
+
+/**
+ * Step the product on the given event.
+ *
+ * @param p
+ * @param event
+ */
+void fsm_product_transition(fsm_product_t *p, const char *event);
+
+/**
+ * Step the product on the given event ID.
+ *
+ * @param p
+ * @param event_id An ID returned by `fsm_event_id` on `fsm_product_machine`
+ */
+void fsm_product_transition_id(fsm_product_t *p, int event_id);
+
+/**
+ * Get the current state of one of the product's components.
+ *
+ * @param p
+ * @param i The component's position in the call to `fsm_product`
+ * @return state_descriptor_t* NULL if out of range
+ */
+state_descriptor_t *fsm_product_state(fsm_product_t *p, unsigned int i);
+
+/**
+ * Create an io_uring instance with room for `entries` submissions at a time.
+ * Operations queued on it are tagged with a machine and an event; when one
+ * completes, `fsm_uring_run` sends the event to the machine. Queued
+ * operations are submitted, and completions reaped, in batches by a single
+ * call to `fsm_uring_run`, on the calling thread.
+ *
+ * Not synchronized: queue operations and run the ring from one thread, e.g.
+ * from the actions of the machines it drives. Linux only.
+ *
+ * @param entries Rounded up to a power of 2 by the kernel
+ * @return fsm_uring_t* NULL if io_uring is unavailable
+ */
+fsm_uring_t *fsm_uring_create(unsigned int entries);
+
+/**
+ * Free the given ring. Operations still in flight are cancelled, and their
+ * events are not sent.
+ *
+ * @param r
+ */
+void fsm_uring_free(fsm_uring_t *r);
+
+/**
+ * Queue an I/O operation whose completion sends `event_id` to `fsm`. It is
+ * submitted by the next `fsm_uring_run`, or sooner if the submission queue
+ * fills up. The buffer must stay valid until the event is sent.
+ *
+ * e.g.
+ *
+ * fsm_uring_queue(r, fsm, read_done, &ctx->n, &(fsm_uring_io_t){
+ *   .op = FSM_URING_READ, .fd = fd, .buf = ctx->buf, .len = 4096});
+ *
+ * @param r
+ * @param fsm A finalized state machine
+ * @param event_id An ID returned by `fsm_event_id`
+ * @param result If not NULL, receives the operation's result before the event
+ * is sent: as the corresponding syscall returns, or -errno on failure
+ * @param io
+ * @return bool false if as many operations as the ring can complete at once
+ * are already in flight, or the submission queue could not be flushed
+ */
+bool fsm_uring_queue(
+  fsm_uring_t          *r,
+  state_machine_t      *fsm,
+  int                   event_id,
+  int                  *result,
+  const fsm_uring_io_t *io
+);
+
+/**
+ * Submit the queued operations, wait until at least `wait_for` have
+ * completed, then send the events of every completion available, in the
+ * order they completed. Actions those events run may queue further
+ * operations; they are submitted by the next call.
+ *
+ * e.g. while (fsm_uring_in_flight(r)) fsm_uring_run(r, 1);
+ *
+ * @param r
+ * @param wait_for Capped at the number of operations in flight; 0 does not
+ * block
+ * @return int The number of events sent, or -1 if submitting or waiting fails
+ */
+int fsm_uring_run(fsm_uring_t *r, unsigned int wait_for);
+
+/**
+ * Get the number of operations queued or in flight whose events have not been
+ * sent.
+ *
+ * @param r
+ * @return unsigned int
+ */
+unsigned int fsm_uring_in_flight(fsm_uring_t *r);
+
+/**
+ * Create a reactor: an epoll instance whose descriptors are each mapped to a
+ * machine and an event. `fsm_reactor_run` waits for readiness and sends the
+ * mapped events, in batches, on the calling thread. Only `fsm_reactor_post`
+ * may be called from other threads. Linux only.
+ *
+ * @return fsm_reactor_t* NULL if epoll is unavailable
+ */
+fsm_reactor_t *fsm_reactor_create(void);
+
+/**
+ * Free the given reactor, closing the descriptors it created. Watched
+ * descriptors it did not create are left open.
+ *
+ * @param r
+ */
+void fsm_reactor_free(fsm_reactor_t *r);
+
+/**
+ * Send `event_id` to `fsm` whenever `fd` is ready. Readiness is level-
+ * triggered: the event is sent on every `fsm_reactor_run` until the machine's
+ * actions consume it, e.g. by reading the descriptor. A descriptor may be
+ * watched once; watch it again to change its mapping. A descriptor closed
+ * without being unwatched leaves the reactor, and its number can be watched
+ * afresh.
+ *
+ * @param r
+ * @param fd
+ * @param readiness FSM_REACTOR_READABLE, FSM_REACTOR_WRITABLE, or both
+ * @param fsm A finalized state machine
+ * @param event_id An ID returned by `fsm_event_id`
+ * @return bool false if epoll refuses the descriptor
+ */
+bool fsm_reactor_watch(
+  fsm_reactor_t   *r,
+  int              fd,
+  unsigned int     readiness,
+  state_machine_t *fsm,
+  int              event_id
+);
+
+/**
+ * Stop watching `fd`, closing it if the reactor created it. Events already
+ * reaped for it in the current batch are dropped.
+ *
+ * @param r
+ * @param fd
+ */
+void fsm_reactor_unwatch(fsm_reactor_t *r, int fd);
+
+/**
+ * Create a timer that sends `event_id` to `fsm` once for each expiration. A
+ * run sends at most FSM_REACTOR_COUNTER_MAX (65536 by default) expirations of
+ * one timer, and drops any beyond that.
+ *
+ * @param r
+ * @param initial_ns Time until the first expiration
+ * @param interval_ns Time between later expirations; 0 for a one-shot timer
+ * @param fsm A finalized state machine
+ * @param event_id An ID returned by `fsm_event_id`
+ * @return int The timer's descriptor, owned by the reactor, or -1 on failure
+ */
+int fsm_reactor_timer(
+  fsm_reactor_t   *r,
+  uint64_t         initial_ns,
+  uint64_t         interval_ns,
+  state_machine_t *fsm,
+  int              event_id
+);
+
+/**
+ * Create an eventfd that sends `event_id` to `fsm` once for each count added
+ * to it, e.g. by another process or a signal handler writing to it. Counts
+ * added between runs are read with one syscall. A run sends at most
+ * FSM_REACTOR_COUNTER_MAX (65536 by default) of them, and leaves the rest in
+ * the eventfd for later runs.
+ *
+ * @param r
+ * @param fsm A finalized state machine
+ * @param event_id An ID returned by `fsm_event_id`
+ * @return int The eventfd, owned by the reactor, or -1 on failure
+ */
+int fsm_reactor_eventfd(fsm_reactor_t *r, state_machine_t *fsm, int event_id);
+
+/**
+ * Send `event_id` to `fsm` on the reactor's thread, from any thread. Posts are
+ * queued in order and sent by the next `fsm_reactor_run`; the reactor is woken
+ * once per batch of posts, not once per post.
+ *
+ * @param r
+ * @param fsm
+ * @param event_id An ID returned by `fsm_event_id`
+ */
+void fsm_reactor_post(fsm_reactor_t *r, state_machine_t *fsm, int event_id);
+
+/**
+ * Wait for ready descriptors or posted events, then send every mapped event
+ * that is due: those of the ready descriptors in the order epoll reported
+ * them, then the posted ones.
+ *
+ * e.g. while (fsm_reactor_run(r, -1) >= 0) {}
+ *
+ * @param r
+ * @param timeout_ms As for epoll_wait: -1 waits indefinitely, 0 does not block
+ * @return int The number of events sent, or -1 if waiting fails
+ */
+int fsm_reactor_run(fsm_reactor_t *r, int timeout_ms);
+
+/**
+ * Open the instance store at `path`, creating it if needed. The store maps
+ * 64-bit entity IDs to states of `def`, each kept in 1 byte, or 2 for
+ * definitions with over 256 states, in a hash table in a file mapped into
+ * memory. Each entity occupies a slot in a 64-byte bucket holding its ID and
+ * state together, so touching one entity touches one cache line and one
+ * page, and the OS can page cold entities out.
+ *
+ * The store's size is fixed when it is created. The file records the
+ * definition's states, and reopening it with a definition whose states
+ * differ fails. `def` must outlive the store, and its states must not change
+ * while the store is open, including by `fsm_minimize`.
+ *
+ * @param path
+ * @param def The definition, finalized if it isn't already
+ * @param capacity The number of entities to make room for, when creating the
+ * file; ignored when opening an existing one
+ * @return fsm_store_t* NULL if the file can't be opened or mapped, or holds
+ * a different definition
+ */
+fsm_store_t *
+fsm_store_open(const char *path, state_machine_t *def, uint64_t capacity);
+
+/**
+ * Unmap and close the given store. Changes not yet written back by
+ * `fsm_store_sync` are left to the OS to write.
+ *
+ * @param s
+ */
+void fsm_store_close(fsm_store_t *s);
+
+/**
+ * Set an entity's state, adding the entity if it is new.
+ *
+ * @param s
+ * @param id Any ID but UINT64_MAX
+ * @param state A state registered with the definition
+ * @return bool false if the ID is reserved, the state isn't registered, or
+ * the store is full
+ */
+bool fsm_store_set(fsm_store_t *s, uint64_t id, state_descriptor_t *state);
+
+/**
+ * Get an entity's current state.
+ *
+ * @param s
+ * @param id
+ * @return state_descriptor_t* NULL if the entity isn't in the store
+ */
+state_descriptor_t *fsm_store_get(fsm_store_t *s, uint64_t id);
+
+/**
+ * Transition an entity as `fsm_transition_id` would transition the
+ * definition from the entity's state. Guards and actions run with the
+ * definition's context, and its subscribers are notified; the definition's
+ * own state is left as it was. Not safe to call concurrently.
+ *
+ * @param s
+ * @param id
+ * @param event_id An ID returned by `fsm_event_id` on the definition
+ * @return bool false if the entity isn't in the store
+ */
+bool fsm_store_transition_id(fsm_store_t *s, uint64_t id, int event_id);
+
+/**
+ * Transition an entity on the given event; see `fsm_store_transition_id`.
+ *
+ * @param s
+ * @param id
+ * @param event
+ * @return bool false if the entity isn't in the store
+ */
+bool fsm_store_transition(fsm_store_t *s, uint64_t id, const char *event);
+
+/**
+ * Get the number of entities in the store.
+ *
+ * @param s
+ * @return uint64_t
+ */
+uint64_t fsm_store_count(fsm_store_t *s);
+
+/**
+ * Checkpoint the store: write every change back to the file with msync, then
+ * flush the file with fdatasync. Blocks until both are done.
+ *
+ * @param s
+ * @return bool false if either fails
+ */
+bool fsm_store_sync(fsm_store_t *s);
+
+/**
+ * Open the journal at `path` for appending, creating it if needed. Records are
+ * buffered and written out in groups, and the file is flushed with fdatasync
+ * once every `batch` records, so one flush makes a whole group durable. The
+ * flush runs outside the journal's lock: appends carry on meanwhile, and the
+ * threads whose records it covers return together when it completes. A
+ * record is 8 to 25 bytes: its length, the machine ID, event ID and state ID
+ * as varints, and a CRC32C of the rest.
+ *
+ * A record left half-written by a crash is dropped when the journal is
+ * reopened, along with anything after it.
+ *
+ * @param path
+ * @param batch Records per fdatasync; 1 flushes every record, and 0 only
+ * flushes on `fsm_journal_sync` and `fsm_journal_close`
+ * @return fsm_journal_t* NULL if the file can't be opened or isn't a journal
+ */
+fsm_journal_t *fsm_journal_open(const char *path, unsigned int batch);
+
+/**
+ * Write out and flush any buffered records, then close the given journal.
+ *
+ * @param j
+ */
+void fsm_journal_close(fsm_journal_t *j);
+
+/**
+ * Append a record that machine `machine_id` took event `event_id` to state
+ * `state_id`. Safe to call from several threads at once. The append that
+ * completes a batch returns once the batch is durable.
+ *
+ * @param j
+ * @param machine_id
+ * @param event_id
+ * @param state_id
+ * @return bool false if writing out or flushing a group failed
+ */
+bool fsm_journal_append(
+  fsm_journal_t *j,
+  uint64_t       machine_id,
+  int            event_id,
+  unsigned int   state_id
+);
+
+/**
+ * Transition the given machine as `fsm_transition_id` would, then append the
+ * state it ended up in. Events the current state doesn't handle are not
+ * recorded; ones it handles are, even if a guard kept the machine in place.
+ *
+ * @param j
+ * @param machine_id The ID to record the machine under
+ * @param fsm A finalized state machine
+ * @param event_id An ID returned by `fsm_event_id`
+ * @return bool false if writing out a group failed
+ */
+bool fsm_journal_transition(
+  fsm_journal_t   *j,
+  uint64_t         machine_id,
+  state_machine_t *fsm,
+  int              event_id
+);
+
+/**
+ * Write out and flush buffered records now, whatever the batch size.
+ *
+ * @param j
+ * @return bool false if writing or flushing failed
+ */
+bool fsm_journal_sync(fsm_journal_t *j);
+
+/**
+ * Get the offset just past the last record appended, buffered or not. Pass
+ * it to `fsm_journal_replay` to skip the records a snapshot already covers.
+ *
+ * @param j
+ * @return uint64_t
+ */
+uint64_t fsm_journal_offset(fsm_journal_t *j);
+
+/**
+ * Read the journal at `path`, calling `apply` with each intact record from
+ * `offset` on, in the order they were appended. Reading stops at the first
+ * torn or corrupt record. To recover a machine, restore its snapshot and set
+ * its state to that of the last record for its ID, e.g. with
+ * `fsm_set_initial_state(fsm, array_get(fsm->states, record->state_id))`.
+ *
+ * @param path
+ * @param offset 0, or an offset returned by `fsm_journal_offset`
+ * @param apply May be NULL, to only count records
+ * @param context Passed to `apply`
+ * @return int64_t The number of records read, or -1 if the file can't be read
+ * or isn't a journal
+ */
+int64_t fsm_journal_replay(
+  const char *path,
+  uint64_t    offset,
+  void (*apply)(void *context, const fsm_journal_record_t *record),
+  void *context
+);
+
+/**
+ * Write the states and contexts of the given instances of `def` to a
+ * snapshot at `path`. Instances are machines sharing `def`'s states, e.g.
+ * made with `fsm_clone`. Each is stored as its state's index and its
+ * serialized context, in a versioned file that records `def`'s states and
+ * ends in a CRC32C. The snapshot is written in large sequential writes to a
+ * temporary file, flushed, then renamed over `path`, so a crash leaves either
+ * the old snapshot or the new one.
+ *
+ * @param path
+ * @param def The definition, finalized if it isn't already
+ * @param instances
+ * @param count
+ * @param save Serializes a context into `out`, returning its length. If that
+ * is more than `capacity`, it is called again with room for it, and must
+ * then fit. May be NULL to store no contexts.
+ * @return bool false if the file can't be written, an instance is in a state
+ * `def` doesn't have, or `save` outgrows the room it asked for
+ */
+bool fsm_snapshot_write(
+  const char       *path,
+  state_machine_t  *def,
+  state_machine_t **instances,
+  size_t            count,
+  size_t (*save)(void *context, void *out, size_t capacity)
+);
+
+/**
+ * Read a snapshot written by `fsm_snapshot_write`, calling `restore` with each
+ * instance's index, state and serialized context, in the order written. The
+ * whole file is checked before any instance is restored.
+ *
+ * @param path
+ * @param def A definition with the same states as the one written
+ * @param restore Given the instance's position in the array written, its
+ * state, and its context's bytes, which are only valid during the call
+ * @param arg Passed to `restore`
+ * @return int64_t The number of instances, or -1 if the file can't be read,
+ * is corrupt, or was written with a definition whose states differ
+ */
+int64_t fsm_snapshot_read(
+  const char      *path,
+  state_machine_t *def,
+  void (*restore)(
+    void               *arg,
+    uint64_t            index,
+    state_descriptor_t *state,
+    const void         *context,
+    size_t              len
+  ),
+  void *arg
+);
+
+/**
+ * Create a shared memory segment holding the transitions of `def` and
+ * `num_instances` instances of it, all in their initial state. The segment
+ * holds no pointers, only offsets from its start, so it works wherever it is
+ * mapped: in children forked after this call, which may use the returned
+ * handle as is, or in processes that map it with `fsm_shared_open` or
+ * `fsm_shared_open_fd`.
+ *
+ * Instance states are committed with atomic compare-and-swap, so any process
+ * may transition or read any instance without locks or IPC. States and events
+ * are identified by row and event ID, as in `def` after finalizing.
+ *
+ * Only definitions without guards or actions can be shared; subscribers are
+ * not notified.
+ *
+ * @param name The `shm_open` name to create it under, or NULL for an
+ * anonymous memfd
+ * @param def The definition, finalized if it isn't already
+ * @param num_instances
+ * @return fsm_shared_t* NULL if `def` has a guard or action or no initial
+ * state, or the segment can't be created (e.g. `name` already exists)
+ */
+fsm_shared_t *fsm_shared_create(
+  const char      *name,
+  state_machine_t *def,
+  uint32_t         num_instances
+);
+
+/**
+ * Map the shared machines created under `name` by `fsm_shared_create`.
+ *
+ * @param name
+ * @return fsm_shared_t* NULL if there is no such segment or it isn't one of
+ * ours
+ */
+fsm_shared_t *fsm_shared_open(const char *name);
+
+/**
+ * Map the shared machines in the segment open on `fd`, e.g. one received
+ * from another process. The descriptor is duplicated, not taken over.
+ *
+ * @param fd
+ * @return fsm_shared_t* NULL if the segment isn't one of ours
+ */
+fsm_shared_t *fsm_shared_open_fd(int fd);
+
+/**
+ * Get the descriptor of the segment, to pass to another process.
+ *
+ * @param sh
+ * @return int
+ */
+int fsm_shared_fd(fsm_shared_t *sh);
+
+/**
+ * Unmap the segment and close its descriptor in this process. The segment
+ * itself lives on while any process maps it, or, if named, until
+ * `shm_unlink`.
+ *
+ * @param sh
+ */
+void fsm_shared_free(fsm_shared_t *sh);
+
+/**
+ * Get the ID of the named event, as `fsm_event_id` would give it for the
+ * definition. Searches linearly; look IDs up once and keep them.
+ *
+ * @param sh
+ * @param event
+ * @return int -1 if there is no such event
+ */
+int fsm_shared_event_id(fsm_shared_t *sh, const char *event);
+
+/**
+ * Get the name of the given state.
+ *
+ * @param sh
+ * @param state
+ * @return const char* NULL if there is no such state. Points into the
+ * segment; valid while it is mapped.
+ */
+const char *fsm_shared_state_name(fsm_shared_t *sh, unsigned int state);
+
+/**
+ * Get an instance's current state.
+ *
+ * @param sh
+ * @param instance
+ * @return int -1 if there is no such instance
+ */
+int fsm_shared_state(fsm_shared_t *sh, uint32_t instance);
+
+/**
+ * Set an instance's state, regardless of transitions.
+ *
+ * @param sh
+ * @param instance
+ * @param state
+ * @return bool false if there is no such instance or state
+ */
+bool fsm_shared_set(fsm_shared_t *sh, uint32_t instance, unsigned int state);
+
+/**
+ * Transition an instance on the given event. The new state is committed with
+ * a compare-and-swap against the state it was computed from, so concurrent
+ * transitions of one instance, from any process, each take effect once and in
+ * some order.
+ *
+ * @param sh
+ * @param instance
+ * @param event_id An ID returned by `fsm_shared_event_id`
+ * @return int The instance's new state, or -1 if there is no such instance
+ * or its state doesn't handle the event
+ */
+int fsm_shared_transition_id(fsm_shared_t *sh, uint32_t instance, int event_id);
+
+/**
+ * Transition an instance on the named event; see `fsm_shared_transition_id`.
+ *
+ * @param sh
+ * @param instance
+ * @param event
+ * @return int
+ */
+int fsm_shared_transition(
+  fsm_shared_t *sh,
+  uint32_t      instance,
+  const char   *event
+);
+
+/**
+ * Enter a read-side section. A machine's definition can be swapped by
+ * `fsm_definition_swap` while other threads dispatch on it, so long as they
+ * do so inside one: the tables a section has seen are freed only once it
+ * exits. Sections nest, and cost a couple of thread-local stores; dispatch a
+ * batch of events in one rather than entering for each.
+ *
+ * A thread must not block for long inside a section, since swaps wait for it.
+ */
+void fsm_epoch_enter(void);
+
+/**
+ * Exit the read-side section entered by the matching `fsm_epoch_enter`.
+ */
+void fsm_epoch_exit(void);
+
+/**
+ * Replace the states and transitions a machine dispatches through with those
+ * registered with `def`, without stopping the threads dispatching on it. The
+ * machine moves to the state of `def` its current state maps onto.
+ *
+ * Other threads may call `fsm_transition`, `fsm_transition_n`,
+ * `fsm_transition_id`, `fsm_can_handle`, `fsm_enabled_events`,
+ * `fsm_event_id` and `fsm_get_state_name` on the machine throughout, from
+ * inside `fsm_epoch_enter` sections; each transition runs wholly against the
+ * old definition or the new one. Dispatch must still come from one thread at a
+ * time. Event IDs belong to a definition, so look them up again once the swap
+ * returns.
+ *
+ * Returns once no thread can still be using the old tables, which are then
+ * freed; the old states are the caller's to free. The machine is finalized
+ * against `def`, which must outlive it, and is neither minimized nor compiled
+ * to native code.
+ *
+ * @param fsm
+ * @param def The new definition, with an initial state
+ * @param state_mapping May be NULL, to map each state onto the state of `def`
+ * with the same name. Otherwise maps each state registered with `fsm`, by ID,
+ * onto the ID of a state of `def`. Either way, states with no counterpart, or
+ * mapped to -1, map onto `def`'s initial state.
+ * @return bool false if `def` has no initial state, a transition to a state it
+ * doesn't have, or a mapping to one, if either machine is an instance (see
+ * `fsm_instance`), or if called from inside a section
+ */
+bool fsm_definition_swap(
+  state_machine_t *fsm,
+  state_machine_t *def,
+  const int       *state_mapping
+);
+
 state_machine_t *
 fsm_clone(const char *name, void *context, state_machine_t *source);
 
+/**
+ * Create an instance of a definition: a machine that dispatches through
+ * `def`'s states and finalized tables rather than copies of them, so that
+ * creating one costs a single small allocation however large `def` is. It
+ * starts in `def`'s current state.
+ *
+ * Transitions registered with the instance, with `fsm_transition_register`,
+ * are its own: each replaces the candidates `def` has for its source state
+ * and event, or adds one, and is checked before `def`'s tables. Only these
+ * overrides take memory, and the instance copies what it needs of each, so
+ * the transition stays the caller's. Their event must be one of `def`'s, so
+ * that event IDs stay shared, and their states must be `def`'s; registering a
+ * state with an instance fails.
+ *
+ * `def` must outlive its instances and must not change while it has any,
+ * including by `fsm_minimize` and `fsm_definition_swap`. Free instances with
+ * `fsm_free`. `fsm_run_parallel`, `fsm_run_bytes` and `fsm_product` refuse
+ * instances that have overrides.
+ *
+ * @param name
+ * @param context
+ * @param def The definition, finalized if it isn't already
+ * @return state_machine_t* NULL if `def` could not be finalized
+ */
+state_machine_t *
+fsm_instance(const char *name, void *context, state_machine_t *def);
+
+/**
+ * Create a registry of instances of `def` (see `fsm_instance`), keyed by
+ * 64-bit IDs. An ID's instance is created in `def`'s current state the first
+ * time it is dispatched to or asked for, with a NULL context.
+ *
+ * IDs are spread over FSM_REGISTRY_STRIPES open-addressed tables, each behind
+ * its own lock, so the registry may be used from any number of threads. An
+ * instance is only ever transitioned with its table locked: guards, actions
+ * and subscribers run under the lock, and must not call back into the
+ * registry.
+ *
+ * @param def The definition, finalized if it isn't already. Must outlive the
+ * registry, and must not change while the registry exists.
+ * @return fsm_registry_t* NULL if `def` could not be finalized
+ */
+fsm_registry_t *fsm_registry_create(state_machine_t *def);
+
+/**
+ * Free the given registry and every instance in it.
+ *
+ * @param reg
+ */
+void fsm_registry_free(fsm_registry_t *reg);
+
+/**
+ * Get the number of instances in a registry.
+ *
+ * @param reg
+ * @return uint64_t
+ */
+uint64_t fsm_registry_count(fsm_registry_t *reg);
+
+/**
+ * Get an ID's instance, if it has one. The instance may be used to set its
+ * context or to subscribe to it, but must not be used while other threads
+ * dispatch to the same ID, nor after it is removed.
+ *
+ * @param reg
+ * @param id
+ * @return state_machine_t* NULL if the ID has no instance
+ */
+state_machine_t *fsm_registry_get(fsm_registry_t *reg, uint64_t id);
+
+/**
+ * Get an ID's instance, creating it if it has none; see `fsm_registry_get`.
+ *
+ * @param reg
+ * @param id
+ * @return state_machine_t*
+ */
+state_machine_t *fsm_registry_instance(fsm_registry_t *reg, uint64_t id);
+
+/**
+ * Remove and free an ID's instance.
+ *
+ * @param reg
+ * @param id
+ * @return bool false if the ID has no instance
+ */
+bool fsm_registry_remove(fsm_registry_t *reg, uint64_t id);
+
+/**
+ * Transition an ID's instance, creating it first if it has none, as
+ * `fsm_transition_id` would.
+ *
+ * @param reg
+ * @param id
+ * @param event_id An ID returned by `fsm_event_id` on the definition
+ * @return state_descriptor_t* The instance's state after the transition, or
+ * NULL if the event is unknown, in which case no instance is created
+ */
+state_descriptor_t *
+fsm_registry_dispatch_id(fsm_registry_t *reg, uint64_t id, int event_id);
+
+/**
+ * Transition an ID's instance on the named event; see
+ * `fsm_registry_dispatch_id`.
+ *
+ * @param reg
+ * @param id
+ * @param event
+ * @return state_descriptor_t*
+ */
+state_descriptor_t *
+fsm_registry_dispatch(fsm_registry_t *reg, uint64_t id, const char *event);
+
+/**
+ * Dispatch `event_ids[i]` to the instance of `ids[i]`, for each `i` in order,
+ * as `fsm_registry_dispatch_id` would. The table slots of IDs a few places
+ * ahead are prefetched, so that looking them up overlaps with the transitions
+ * before them.
+ *
+ * @param reg
+ * @param ids
+ * @param event_ids IDs returned by `fsm_event_id` on the definition; unknown
+ * events are skipped
+ * @param n The number of (ID, event) pairs
+ */
+void fsm_registry_dispatch_n(
+  fsm_registry_t *reg,
+  const uint64_t *ids,
+  const int      *event_ids,
+  size_t          n
+);
+
 state_machine_t *__fsm_inline(
   const char          *name,
   const char          *initial_state,
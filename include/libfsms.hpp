@@ -0,0 +1,401 @@
+#ifndef LIBFSMS_HPP
+#define LIBFSMS_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "libfsms.h"
+
+/*
+ * Machines whose transition tables are built at compile time, for C++17.
+ * States and events are enumerations, the table is a `constexpr` array, and
+ * guards and actions are types, so a call to one is a direct call the
+ * compiler can inline; stepping the machine involves no calls through
+ * pointers.
+ *
+ * e.g.
+ *
+ * enum class door { closed, open, locked };
+ * enum class ev { open, close, lock };
+ *
+ * struct has_key {
+ *   bool operator()(ctx_t &ctx) const { return ctx.has_key; }
+ * };
+ *
+ * using door_machine = fsms::machine<
+ *   ctx_t,
+ *   fsms::transition<door::closed, ev::open, door::open>,
+ *   fsms::transition<door::open, ev::close, door::closed>,
+ *   fsms::transition<door::closed, ev::lock, door::locked, has_key>>;
+ *
+ * door_machine m(door::closed);
+ * m.dispatch(ev::lock);
+ *
+ * Guards and actions are default-constructible callables taking the context;
+ * `fsms::fn<f>` adapts a function. Each (source, event) pair may appear once,
+ * and enumerators index the table, so they should be small and dense.
+ *
+ * `machine::c_view` exports a running machine as a `state_machine_t`, so code
+ * written against the C API can read its state with `fsm_get_state_name` and
+ * watch it with `fsm_subscribe`. Subscribers see the same arguments as for
+ * any other machine. The view has no registered transitions; drive the
+ * machine through `dispatch`, not `fsm_transition`, and don't pass the view
+ * to `fsm_free`.
+ */
+
+namespace fsms {
+
+// The default guard, which always passes
+struct always {
+  template <typename Context>
+  constexpr bool
+  operator() (Context &) const noexcept
+  {
+    return true;
+  }
+};
+
+// The default action, which does nothing
+struct nothing {
+  template <typename Context>
+  constexpr void
+  operator() (Context &) const noexcept
+  {
+  }
+};
+
+// Adapts the function `F` into a guard or action
+template <auto F>
+struct fn {
+  template <typename... Args>
+  constexpr decltype(auto)
+  operator() (Args &&...args) const
+  {
+    return F(std::forward<Args>(args)...);
+  }
+};
+
+template <
+  auto Source,
+  auto Event,
+  auto Target,
+  typename Guard  = always,
+  typename Action = nothing>
+struct transition {
+  static constexpr auto source = Source;
+  static constexpr auto event  = Event;
+  static constexpr auto target = Target;
+
+  using guard  = Guard;
+  using action = Action;
+};
+
+template <typename Context, typename... Transitions>
+class machine {
+  static_assert(sizeof...(Transitions) > 0, "a machine needs transitions");
+  static_assert(
+    sizeof...(Transitions) < UINT16_MAX,
+    "too many transitions"
+  );
+
+  using first_t = std::tuple_element_t<0, std::tuple<Transitions...>>;
+
+ public:
+  using state_type = std::remove_cv_t<decltype(first_t::source)>;
+  using event_type = std::remove_cv_t<decltype(first_t::event)>;
+
+  static_assert(
+    std::is_enum_v<state_type> && std::is_enum_v<event_type>,
+    "states and events must be enumerations"
+  );
+  static_assert(
+    (std::is_same_v<std::remove_cv_t<decltype(Transitions::source)>, state_type>
+     && ...)
+      && (std::is_same_v<
+            std::remove_cv_t<decltype(Transitions::target)>,
+            state_type>
+          && ...),
+    "every source and target must be of the same state type"
+  );
+  static_assert(
+    (std::is_same_v<std::remove_cv_t<decltype(Transitions::event)>, event_type>
+     && ...),
+    "every event must be of the same event type"
+  );
+
+ private:
+  static constexpr std::size_t num_transitions = sizeof...(Transitions);
+
+  static constexpr std::size_t
+  ordinal (state_type s)
+  {
+    return static_cast<std::size_t>(s);
+  }
+
+  static constexpr std::size_t
+  ordinal (event_type e)
+  {
+    return static_cast<std::size_t>(e);
+  }
+
+  static constexpr std::array<std::size_t, num_transitions> sources
+    = {ordinal(Transitions::source)...};
+  static constexpr std::array<std::size_t, num_transitions> events
+    = {ordinal(Transitions::event)...};
+  static constexpr std::array<std::size_t, num_transitions> targets
+    = {ordinal(Transitions::target)...};
+
+  // transitions without a guard or action only move the machine, so
+  // `dispatch` takes them straight from the table
+  static constexpr std::array<bool, num_transitions> plain = {
+    (std::is_same_v<typename Transitions::guard, always>
+     && std::is_same_v<typename Transitions::action, nothing>)...};
+
+  static constexpr std::size_t
+  max_of (const std::array<std::size_t, num_transitions> &a)
+  {
+    std::size_t m = 0;
+    for (std::size_t x : a) {
+      m = x > m ? x : m;
+    }
+
+    return m;
+  }
+
+ public:
+  // One more than the largest state and event used by a transition
+  static constexpr std::size_t num_states
+    = (max_of(sources) > max_of(targets) ? max_of(sources) : max_of(targets))
+    + 1;
+  static constexpr std::size_t num_events = max_of(events) + 1;
+
+ private:
+  // entries are the transition's index + 1, or 0
+  static constexpr std::array<std::uint16_t, num_states * num_events> table
+    = [] {
+        std::array<std::uint16_t, num_states * num_events> t{};
+        for (std::size_t i = 0; i < num_transitions; i++) {
+          t[sources[i] * num_events + events[i]]
+            = static_cast<std::uint16_t>(i + 1);
+        }
+
+        return t;
+      }();
+
+  static constexpr bool
+  unique ()
+  {
+    for (std::size_t i = 0; i < num_transitions; i++) {
+      if (table[sources[i] * num_events + events[i]] != i + 1) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  static_assert(unique(), "each (source, event) pair may appear once");
+
+ public:
+  class c_view;
+
+  explicit machine (state_type initial, Context context = Context())
+    : context_(std::move(context)), state_(initial)
+  {
+  }
+
+  machine (const machine &)            = delete;
+  machine &operator=(const machine &) = delete;
+
+  ~machine ()
+  {
+    if (view_) {
+      view_->machine_ = nullptr;
+    }
+  }
+
+  state_type
+  state () const noexcept
+  {
+    return state_;
+  }
+
+  Context &
+  context () noexcept
+  {
+    return context_;
+  }
+
+  /**
+   * Sends `event` to the machine. Returns whether it moved; an event the
+   * current state doesn't handle, or whose guard fails, leaves it in place.
+   */
+  bool
+  dispatch (event_type event)
+  {
+    std::size_t e = ordinal(event);
+    if (e >= num_events) {
+      return false;
+    }
+
+    std::uint16_t entry = table[ordinal(state_) * num_events + e];
+    if (!entry) {
+      return false;
+    }
+
+    if (plain[entry - 1]) {
+      commit(targets[entry - 1], e);
+      return true;
+    }
+
+    return fire(entry - 1, e, std::index_sequence_for<Transitions...>{});
+  }
+
+  /**
+   * Gets the state `event` moves a machine in `from` to if the transition's
+   * guard passes, or `from` if no transition handles it. Usable in constant
+   * expressions, e.g. to check the table with `static_assert`.
+   */
+  static constexpr state_type
+  target (state_type from, event_type event) noexcept
+  {
+    std::size_t s = ordinal(from);
+    std::size_t e = ordinal(event);
+    if (s >= num_states || e >= num_events || !table[s * num_events + e]) {
+      return from;
+    }
+
+    return static_cast<state_type>(targets[table[s * num_events + e] - 1]);
+  }
+
+ private:
+  template <std::size_t... I>
+  bool
+  fire (std::size_t i, std::size_t e, std::index_sequence<I...>)
+  {
+    bool moved = false;
+    ((i == I && (moved = step<I>(e), true)) || ...);
+
+    return moved;
+  }
+
+  template <std::size_t I>
+  bool
+  step (std::size_t e)
+  {
+    using t = std::tuple_element_t<I, std::tuple<Transitions...>>;
+
+    if (!typename t::guard()(context_)) {
+      return false;
+    }
+    typename t::action()(context_);
+    commit(targets[I], e);
+
+    return true;
+  }
+
+  void
+  commit (std::size_t target, std::size_t e)
+  {
+    state_ = static_cast<state_type>(target);
+    if (view_) {
+      view_->commit(target, e);
+    }
+  }
+
+  Context    context_;
+  state_type state_;
+  c_view    *view_ = nullptr;
+};
+
+/**
+ * A `state_machine_t` that mirrors a machine, named `name`, with
+ * `state_names` and `event_names` indexed by enumerator. The names must
+ * outlive the view. A machine has at most one view; the view must not
+ * outlive the machine it was attached to unless it was detached first.
+ */
+template <typename Context, typename... Transitions>
+class machine<Context, Transitions...>::c_view {
+ public:
+  c_view (
+    machine                                     &m,
+    const char                                  *name,
+    const std::array<const char *, num_states> &state_names,
+    const std::array<const char *, num_events> &event_names
+  )
+    : machine_(&m), event_names_(event_names)
+  {
+    for (std::size_t i = 0; i < num_states; i++) {
+      states_[i] = state_descriptor_t();
+      states_[i].name = state_names[i];
+      states_[i].id   = static_cast<unsigned int>(i);
+    }
+
+    fsm_             = state_machine_t();
+    fsm_.name        = name;
+    fsm_.context     = &m.context_;
+    fsm_.state       = &states_[ordinal(m.state_)];
+
+    if (m.view_) {
+      m.view_->machine_ = nullptr;
+    }
+    m.view_ = this;
+  }
+
+  c_view (const c_view &)            = delete;
+  c_view &operator=(const c_view &) = delete;
+
+  ~c_view ()
+  {
+    if (machine_) {
+      machine_->view_ = nullptr;
+    }
+    if (fsm_.subscribers) {
+      array_free(fsm_.subscribers);
+    }
+  }
+
+  state_machine_t *
+  get () noexcept
+  {
+    return &fsm_;
+  }
+
+ private:
+  friend class machine;
+
+  // kept out of line so the calls to subscribers stay out of `dispatch`
+  [[gnu::noinline]] void
+  commit (std::size_t target, std::size_t e)
+  {
+    transition_subscriber_args_t s;
+    s.prev = fsm_.state->name;
+    s.next = states_[target].name;
+    s.ev   = event_names_[e];
+
+    fsm_.state = &states_[target];
+
+    if (fsm_.subscribers) {
+      foreach (fsm_.subscribers, i) {
+        void *(*subscriber)(void *);
+        // stored as data pointers; POSIX guarantees the conversion
+        *reinterpret_cast<void **>(&subscriber)
+          = array_get(fsm_.subscribers, i);
+        subscriber(&s);
+      }
+    }
+  }
+
+  machine                                *machine_;
+  std::array<const char *, num_events>    event_names_;
+  std::array<state_descriptor_t, num_states> states_;
+  state_machine_t                         fsm_;
+};
+
+}  // namespace fsms
+
+#endif /* LIBFSMS_HPP */
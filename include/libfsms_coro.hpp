@@ -0,0 +1,322 @@
+#ifndef LIBFSMS_CORO_HPP
+#define LIBFSMS_CORO_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "libfsms.h"
+
+/*
+ * Asynchronous actions for machines built with the C API, for C++20. An
+ * asynchronous action is a coroutine returning `fsms::task`; it may
+ * `co_await` whatever the application's I/O layer provides. While it is
+ * suspended the machine is transitioning: it stays in the source state, and
+ * events sent to it are queued or rejected according to its policy. The
+ * transition's C action, if any, runs and the machine commits to the target
+ * when the coroutine finishes.
+ *
+ * e.g.
+ *
+ * fsms::async_machine m(fsm, fsms::policy::queue);
+ * m.on("idle", "fetch", [](void *ctx) -> fsms::task {
+ *   co_await read_async(...);
+ * });
+ * m.dispatch(fsm_event_id(fsm, "fetch"));
+ *
+ * Transitions without an asynchronous action are taken at once, as with
+ * `fsm_transition_id`. As with `fsm_transition_lookup`, only the first
+ * candidate for an event is considered.
+ *
+ * Nothing here is synchronized: `dispatch`, and the resumption of the
+ * coroutines it starts, must not run concurrently for one machine. Machines
+ * are independent, so many can be in flight across a few threads as long as
+ * each is resumed on one at a time. An action that throws aborts its
+ * transition, leaving the machine in the source state; see `error`.
+ */
+
+namespace fsms {
+
+class async_machine;
+
+// What an asynchronous action returns
+class task {
+ public:
+  struct promise_type {
+    async_machine     *machine = nullptr;
+    std::exception_ptr error;
+
+    task
+    get_return_object () noexcept
+    {
+      return task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    // started by the machine once it is ready to be told of completion
+    std::suspend_always
+    initial_suspend () noexcept
+    {
+      return {};
+    }
+
+    struct final_awaiter {
+      bool
+      await_ready () const noexcept
+      {
+        return false;
+      }
+
+      void await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+
+      void
+      await_resume () const noexcept
+      {
+      }
+    };
+
+    final_awaiter
+    final_suspend () noexcept
+    {
+      return {};
+    }
+
+    void
+    return_void () noexcept
+    {
+    }
+
+    void
+    unhandled_exception () noexcept
+    {
+      error = std::current_exception();
+    }
+  };
+
+  task (task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+  task &operator=(task &&) = delete;
+
+  ~task ()
+  {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+ private:
+  friend class async_machine;
+
+  explicit task (std::coroutine_handle<promise_type> h) noexcept : handle_(h)
+  {
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+// What happens to events sent to a machine while it is transitioning
+enum class policy {
+  // run them in order once the transition completes
+  queue,
+  // drop them; `dispatch` returns false
+  reject
+};
+
+class async_machine {
+ public:
+  using action_type = std::function<task(void *context)>;
+
+  /**
+   * Wraps `fsm`, finalizing it if it isn't already. The machine must outlive
+   * the wrapper, and its states and transitions must not change while the
+   * wrapper is in use.
+   */
+  explicit async_machine (state_machine_t *fsm, policy p = policy::queue)
+    : fsm_(fsm), policy_(p)
+  {
+    if (!fsm_->compiled) {
+      fsm_finalize(fsm_);
+    }
+  }
+
+  async_machine (const async_machine &)            = delete;
+  async_machine &operator=(const async_machine &) = delete;
+
+  // Destroys a suspended action without taking its transition
+  ~async_machine ()
+  {
+    if (running_) {
+      running_.destroy();
+    }
+  }
+
+  /**
+   * Runs `action` on the transition out of `source` for `event`, before the
+   * transition's C action and its commit. Returns false if either name is
+   * unknown to the machine.
+   */
+  bool
+  on (const char *source, const char *event, action_type action)
+  {
+    state_descriptor_t *s = fsm_get_state(fsm_, source);
+    int                 e = fsm_event_id(fsm_, event);
+    if (!s || e < 0) {
+      return false;
+    }
+
+    std::size_t k = slot(s->id, e);
+    if (actions_.size() <= k) {
+      actions_.resize(k + 1);
+    }
+    actions_[k] = std::move(action);
+
+    return true;
+  }
+
+  /**
+   * Sends the event with the given ID. Returns whether it was accepted: taken,
+   * started or queued. An event the current state doesn't handle, or whose
+   * guard fails, is not; when it is dequeued later, it is dropped.
+   */
+  bool
+  dispatch (int event_id)
+  {
+    if (running_) {
+      if (policy_ == policy::reject) {
+        return false;
+      }
+      queue_.push_back(event_id);
+
+      return true;
+    }
+
+    bool accepted = start(event_id);
+    drain();
+
+    return accepted;
+  }
+
+  // Whether an asynchronous action is in flight
+  bool
+  transitioning () const noexcept
+  {
+    return static_cast<bool>(running_);
+  }
+
+  // Events waiting for the current transition to complete
+  std::size_t
+  queued () const noexcept
+  {
+    return queue_.size() - head_;
+  }
+
+  /**
+   * Gets the exception thrown by the last action that threw, and clears it.
+   * Null if none has.
+   */
+  std::exception_ptr
+  error () noexcept
+  {
+    return std::exchange(error_, nullptr);
+  }
+
+  state_machine_t *
+  get () const noexcept
+  {
+    return fsm_;
+  }
+
+ private:
+  friend struct task::promise_type::final_awaiter;
+
+  std::size_t
+  slot (unsigned int sid, int event_id) const
+  {
+    return static_cast<std::size_t>(sid) * fsm_event_count(fsm_) + event_id;
+  }
+
+  bool
+  start (int event_id)
+  {
+    fsm_pending_t pending;
+    if (!fsm_transition_lookup(fsm_, event_id, &pending)) {
+      return false;
+    }
+
+    std::size_t k = slot(fsm_->state->id, event_id);
+    if (k >= actions_.size() || !actions_[k]) {
+      fsm_transition_commit(fsm_, &pending);
+      return true;
+    }
+
+    task t   = actions_[k](fsm_->context);
+    pending_ = pending;
+    running_ = std::exchange(t.handle_, {});
+    running_.promise().machine = this;
+
+    // an action that never suspends finishes within this call
+    starting_ = true;
+    running_.resume();
+    starting_ = false;
+
+    return true;
+  }
+
+  // Called as the action's coroutine reaches its final suspend point
+  void
+  finish (std::coroutine_handle<task::promise_type> h)
+  {
+    std::exception_ptr e = std::move(h.promise().error);
+    h.destroy();
+    running_ = {};
+
+    if (e) {
+      error_ = e;
+    } else {
+      fsm_transition_commit(fsm_, &pending_);
+    }
+
+    // otherwise the dispatch that started the action drains the queue
+    if (!starting_) {
+      drain();
+    }
+  }
+
+  void
+  drain ()
+  {
+    while (!running_ && head_ < queue_.size()) {
+      start(queue_[head_++]);
+    }
+
+    // consumed entries are dropped once the queue empties, keeping its storage
+    if (head_ == queue_.size()) {
+      queue_.clear();
+      head_ = 0;
+    }
+  }
+
+  state_machine_t                          *fsm_;
+  policy                                    policy_;
+  std::vector<action_type>                  actions_;
+  std::vector<int>                          queue_;
+  std::size_t                               head_ = 0;
+  std::coroutine_handle<task::promise_type> running_;
+  fsm_pending_t                             pending_{};
+  bool                                      starting_ = false;
+  std::exception_ptr                        error_;
+};
+
+inline void
+task::promise_type::final_awaiter::await_suspend (
+  std::coroutine_handle<promise_type> h
+) noexcept
+{
+  h.promise().machine->finish(h);
+}
+
+}  // namespace fsms
+
+#endif /* LIBFSMS_CORO_HPP */
@@ -0,0 +1,163 @@
+#ifndef LIBFSMS_STATIC_H
+#define LIBFSMS_STATIC_H
+
+#include <stdint.h>
+
+#include "libfsms.h"
+
+/*
+ * Machines defined at compile time from X-macro lists. A definition expands
+ * into enums of its states and events, constant tables, and an inlinable step
+ * function; nothing is allocated or built at runtime, and a transition that
+ * names an undeclared state or event fails to compile.
+ *
+ * e.g.
+ *
+ * #define DOOR_STATES(X, M) X(M, closed) X(M, open) X(M, locked)
+ * #define DOOR_EVENTS(X, M) X(M, open) X(M, close) X(M, lock)
+ * #define DOOR_TRANSITIONS(X, M)                \
+ *   X(M, closed, open, open, NULL, on_open)     \
+ *   X(M, open, close, closed, NULL, NULL)       \
+ *   X(M, closed, lock, locked, has_key, NULL)
+ *
+ * FSM_DEFINE(door, DOOR_STATES, DOOR_EVENTS, DOOR_TRANSITIONS)
+ *
+ * state_machine_t fsm = FSM_STATIC_MACHINE(door, door_closed, &ctx);
+ * door_transition(&fsm, door_ev_lock);
+ *
+ * Each list passes its second argument, the machine's name, through as the
+ * first argument of every entry. Transitions are `X(M, source, event, target,
+ * guard, action)`, with NULL for a missing guard or action. Each (source,
+ * event) pair may appear once; a second one is a duplicate enumerator.
+ *
+ * The machine is an ordinary `state_machine_t`, so `fsm_get_state_name` and
+ * `fsm_subscribe` work on it, and subscribers see the same arguments as for
+ * any other machine. It has no registered states and is never finalized:
+ * drive it with `<name>_transition` rather than `fsm_transition`, and don't
+ * pass it to `fsm_free`; if anything subscribed, release the list with
+ * `array_free(fsm.subscribers)`. Its names are string literals, not interned
+ * ones.
+ */
+
+typedef struct {
+  uint16_t target;
+  bool (*guard)(void *context);
+  void (*action)(void *context);
+} fsm_static_transition_t;
+
+// Moves `fsm` to `target` and notifies its subscribers, if it has any
+static inline void
+fsm_static_commit (
+  state_machine_t    *fsm,
+  state_descriptor_t *target,
+  const char         *event
+)
+{
+  transition_subscriber_args_t s
+    = {.prev = fsm->state->name, .next = target->name, .ev = event};
+
+  fsm->state = target;
+
+  if (fsm->subscribers) {
+    foreach (fsm->subscribers, i) {
+      void *(*subscriber)(void *);
+      // stored as data pointers; POSIX guarantees the conversion
+      *(void **)&subscriber = array_get(fsm->subscribers, i);
+      subscriber(&s);
+    }
+  }
+}
+
+#define __FSM_STATE_ENUM(m, s)                 m##_##s,
+#define __FSM_EVENT_ENUM(m, e)                 m##_ev_##e,
+#define __FSM_TRANSITION_ENUM(m, s, e, t, g, a) m##_t_##s##_##e,
+
+#define __FSM_STATE_DESCRIPTOR(m, s) \
+  [m##_##s] = {.name = #s, .transitions = NULL, .id = m##_##s},
+
+#define __FSM_EVENT_NAME(m, e) [m##_ev_##e] = #e,
+
+#define __FSM_TRANSITION(m, s, e, t, g, a) \
+  [m##_t_##s##_##e] = {.target = m##_##t, .guard = g, .action = a},
+
+// table entries are the transition's index + 1, or 0
+#define __FSM_TABLE_ENTRY(m, s, e, t, g, a) \
+  [m##_##s][m##_ev_##e] = m##_t_##s##_##e + 1,
+
+/**
+ * Define a machine `name` from X-macro lists of its states, events and
+ * transitions. Defines:
+ *
+ * - `enum name_state` with `name_<state>` for each state and `name_num_states`
+ * - `enum name_event` with `name_ev_<event>` for each event and
+ * `name_num_events`
+ * - `name_states`, `name_events` and `name_table`, the static tables
+ * - `name_transition(fsm, event)`, the step function
+ *
+ * Must be used at file scope.
+ */
+#define FSM_DEFINE(name, STATES, EVENTS, TRANSITIONS)                         \
+  enum name##_state { STATES(__FSM_STATE_ENUM, name) name##_num_states };     \
+  enum name##_event { EVENTS(__FSM_EVENT_ENUM, name) name##_num_events };     \
+  enum {                                                                      \
+    TRANSITIONS(__FSM_TRANSITION_ENUM, name) name##_num_transitions           \
+  };                                                                          \
+                                                                              \
+  _Static_assert(                                                             \
+    name##_num_transitions < UINT16_MAX,                                      \
+    "too many transitions in " #name                                          \
+  );                                                                          \
+                                                                              \
+  static state_descriptor_t name##_states[]                                   \
+    = {STATES(__FSM_STATE_DESCRIPTOR, name)};                                 \
+                                                                              \
+  static const char *const name##_events[]                                    \
+    = {EVENTS(__FSM_EVENT_NAME, name)};                                       \
+                                                                              \
+  static const fsm_static_transition_t name##_transitions[]                   \
+    = {TRANSITIONS(__FSM_TRANSITION, name)};                                  \
+                                                                              \
+  static const uint16_t name##_table[name##_num_states][name##_num_events]    \
+    = {TRANSITIONS(__FSM_TABLE_ENTRY, name)};                                 \
+                                                                              \
+  static inline void name##_transition(                                       \
+    state_machine_t *fsm,                                                     \
+    enum name##_event event                                                   \
+  )                                                                           \
+  {                                                                           \
+    if ((unsigned int)event >= name##_num_events) {                           \
+      return;                                                                 \
+    }                                                                         \
+                                                                              \
+    uint16_t entry = name##_table[fsm->state->id][event];                     \
+    if (!entry) {                                                             \
+      return;                                                                 \
+    }                                                                         \
+                                                                              \
+    const fsm_static_transition_t *t = &name##_transitions[entry - 1];        \
+    if (t->guard && !(t->guard(fsm->context))) {                              \
+      return;                                                                 \
+    }                                                                         \
+                                                                              \
+    if (t->action) {                                                          \
+      t->action(fsm->context);                                                \
+    }                                                                         \
+                                                                              \
+    fsm_static_commit(fsm, &name##_states[t->target], name##_events[event]);  \
+  }
+
+/**
+ * An initializer for a machine defined with `FSM_DEFINE`, starting in
+ * `initial_state`, e.g. FSM_STATIC_MACHINE(door, door_closed, NULL). Usable
+ * for static and automatic storage alike.
+ */
+#define FSM_STATIC_MACHINE(m, initial_state, ctx) \
+  {.name        = #m,                             \
+   .context     = (ctx),                          \
+   .subscribers = NULL,                           \
+   .states      = NULL,                           \
+   .state       = &m##_states[initial_state],     \
+   .compiled    = NULL,                           \
+   .overlay     = NULL}
+
+#endif /* LIBFSMS_STATIC_H */
@@ -0,0 +1,225 @@
+#include <string.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+// States that leave on at most this many bytes skip runs of the rest with
+// `s_find_any_n`
+#define MAX_EXITS 16
+
+static int
+u64_cmp (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+// Fills `cols` with each state's target per byte, or FSM_BYTE_ERROR. Returns
+// false if a one-character event has a guard or an action.
+static bool
+byte_columns (const fsm_compiled_t *c, uint32_t *cols)
+{
+  for (size_t i = 0; i < (size_t)c->num_states * 256; i++) {
+    cols[i] = FSM_BYTE_ERROR;
+  }
+
+  for (uint32_t s = 0; s < c->num_states; s++) {
+    // rows are sorted by event ID, so the last candidate for a byte wins
+    for (uint32_t k = c->first[s]; k < c->first[s + 1]; k++) {
+      if (c->event_lens[c->keys[k]] != 1) {
+        continue;
+      }
+
+      if (c->hot[k].guard || c->hot[k].action) {
+        return false;
+      }
+
+      unsigned char byte           = c->events[c->keys[k]][0];
+      cols[(size_t)s * 256 + byte] = c->hot[k].target;
+    }
+  }
+
+  return true;
+}
+
+// Partitions the bytes into classes that every state maps to the same target
+static uint32_t
+byte_classes (const fsm_compiled_t *c, const uint32_t *cols, uint8_t *classes)
+{
+  uint64_t keys[256];
+  uint32_t num_classes = 1;
+  memset(classes, 0, 256);
+
+  for (uint32_t s = 0; s < c->num_states && num_classes < 256; s++) {
+    const uint32_t *col = cols + (size_t)s * 256;
+
+    // refine by (class, target); the low byte carries the byte itself
+    for (int b = 0; b < 256; b++) {
+      keys[b] = (uint64_t)classes[b] << 40 | (uint64_t)col[b] << 8 | b;
+    }
+    qsort(keys, 256, sizeof(uint64_t), u64_cmp);
+
+    num_classes = 0;
+    for (int i = 0; i < 256; i++) {
+      if (i == 0 || keys[i] >> 8 != keys[i - 1] >> 8) {
+        num_classes++;
+      }
+      classes[keys[i] & 0xff] = num_classes - 1;
+    }
+  }
+
+  return num_classes;
+}
+
+static fsm_byte_table_t *
+build_byte_table (const fsm_compiled_t *c)
+{
+  uint32_t  n    = c->num_states;
+  uint32_t *cols = xmalloc((size_t)n * 256 * sizeof(uint32_t));
+  uint8_t   classes[256];
+
+  if (n >= FSM_BYTE_SKIP || !byte_columns(c, cols)) {
+    free(cols);
+    fsm_byte_table_t *t = xcalloc(1, sizeof(fsm_byte_table_t));
+    t->supported        = false;
+    return t;
+  }
+
+  uint32_t num_classes = byte_classes(c, cols, classes);
+
+  // one allocation: the header, then the table, then the exits
+  size_t            table_bytes = (size_t)n * num_classes * sizeof(uint32_t);
+  size_t            exits_bytes = (size_t)n * MAX_EXITS;
+  char             *block       = xmalloc(
+    sizeof(fsm_byte_table_t) + table_bytes + exits_bytes + n
+  );
+  fsm_byte_table_t *t = (fsm_byte_table_t *)block;
+  t->supported        = true;
+  t->num_classes      = num_classes;
+  t->table            = (uint32_t *)(block + sizeof(fsm_byte_table_t));
+  t->exits            = block + sizeof(fsm_byte_table_t) + table_bytes;
+  t->num_exits        = (uint8_t *)t->exits + exits_bytes;
+  memcpy(t->classes, classes, 256);
+
+  for (uint32_t s = 0; s < n; s++) {
+    const uint32_t *col = cols + (size_t)s * 256;
+
+    uint32_t exits = 0;
+    for (int b = 0; b < 256 && exits <= MAX_EXITS; b++) {
+      if (col[b] != s) {
+        if (exits < MAX_EXITS) {
+          t->exits[(size_t)s * MAX_EXITS + exits] = (char)b;
+        }
+        exits++;
+      }
+    }
+    // a loop back into an accepting state ends the run, so it can't be skipped
+    bool skippable  = exits <= MAX_EXITS && !c->states[s]->accepting;
+    t->num_exits[s] = skippable ? exits : 0;
+  }
+
+  for (uint32_t s = 0; s < n; s++) {
+    const uint32_t *col = cols + (size_t)s * 256;
+
+    for (int b = 0; b < 256; b++) {
+      uint32_t target = col[b];
+      if (target != FSM_BYTE_ERROR) {
+        if (c->states[target]->accepting) {
+          target |= FSM_BYTE_ACCEPT;
+        } else if (t->num_exits[target]) {
+          target |= FSM_BYTE_SKIP;
+        }
+      }
+      t->table[(size_t)s * num_classes + classes[b]] = target;
+    }
+  }
+
+  free(cols);
+
+  return t;
+}
+
+size_t
+fsm_run_bytes (state_machine_t *fsm, const char *buf, size_t len)
+{
+  fsm_compiled_t *c = fsm->compiled;
+  uint32_t        start;
+
+  if (!c || fsm_overridden(fsm) || !compiled_state_row(c, fsm->state, &start)) {
+    return 0;
+  }
+
+  // instances share `c`, so two threads can both be first; the loser frees its
+  // table and takes the winner's
+  fsm_byte_table_t *t = __atomic_load_n(&c->bytes, __ATOMIC_ACQUIRE);
+  if (!t) {
+    fsm_byte_table_t *built = build_byte_table(c);
+
+    if (__atomic_compare_exchange_n(
+          &c->bytes,
+          &t,
+          built,
+          false,
+          __ATOMIC_ACQ_REL,
+          __ATOMIC_ACQUIRE
+        )) {
+      t = built;
+    } else {
+      free(built);
+    }
+  }
+  if (!t->supported) {
+    return 0;
+  }
+
+  const unsigned char *in          = (const unsigned char *)buf;
+  const uint32_t      *table       = t->table;
+  const uint8_t       *classes     = t->classes;
+  uint32_t             num_classes = t->num_classes;
+  uint32_t             s           = start;
+  size_t               i           = 0;
+
+  // starting in a skippable state is as good as entering one
+  if (t->num_exits[s]) {
+    i = s_find_any_n(
+      buf,
+      len,
+      t->exits + (size_t)s * MAX_EXITS,
+      t->num_exits[s]
+    );
+  }
+
+  while (i < len) {
+    uint32_t next = table[(size_t)s * num_classes + classes[in[i]]];
+
+    if (next < FSM_BYTE_SKIP) {
+      s = next;
+      i++;
+      continue;
+    }
+
+    if (next == FSM_BYTE_ERROR) {
+      break;
+    }
+
+    s = next & ~(FSM_BYTE_ACCEPT | FSM_BYTE_SKIP);
+    i++;
+
+    if (next & FSM_BYTE_ACCEPT) {
+      break;
+    }
+
+    i += s_find_any_n(
+      buf + i,
+      len - i,
+      t->exits + (size_t)s * MAX_EXITS,
+      t->num_exits[s]
+    );
+  }
+
+  fsm->state = c->states[s];
+
+  return i;
+}
@@ -0,0 +1,54 @@
+#include <pthread.h>
+
+#include "fsms_internal.h"
+
+// table[k][b] is the CRC of byte `b` followed by `k` zero bytes, so eight
+// bytes can be folded in with eight independent lookups
+static uint32_t       table[8][256];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+// Reflected, polynomial 0x1edc6f41
+static void
+init_table (void)
+{
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++) {
+      c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+    }
+    table[0][i] = c;
+  }
+
+  for (uint32_t i = 0; i < 256; i++) {
+    for (int k = 1; k < 8; k++) {
+      uint32_t c  = table[k - 1][i];
+      table[k][i] = table[0][c & 0xff] ^ (c >> 8);
+    }
+  }
+}
+
+uint32_t
+fsm_crc32c (uint32_t crc, const void *p, size_t n)
+{
+  pthread_once(&table_once, init_table);
+
+  const uint8_t *b = p;
+  uint32_t       c = ~crc;
+
+  for (; n >= 8; n -= 8, b += 8) {
+    // little-endian whatever the host; a single load where it is native
+    uint32_t lo = (b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24) ^ c;
+    uint32_t hi = b[4] | b[5] << 8 | b[6] << 16 | (uint32_t)b[7] << 24;
+
+    c = table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff]
+      ^ table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24]
+      ^ table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff]
+      ^ table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24];
+  }
+
+  while (n--) {
+    c = table[0][(c ^ *b++) & 0xff] ^ (c >> 8);
+  }
+
+  return ~c;
+}
@@ -0,0 +1,162 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#endif
+
+#include "fsms_internal.h"
+
+// One per thread that has entered a read-side section. Records are never
+// freed; a thread's record is handed to a later thread once it exits.
+typedef struct epoch_record {
+  // the epoch the thread entered its outermost section in, or 0 outside one
+  uint64_t             active;
+  unsigned int         nesting;
+  bool                 in_use;
+  struct epoch_record *next;
+} __attribute__((aligned(64))) epoch_record_t;
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static epoch_record_t *records;
+static uint64_t        epoch         = 1;
+
+static pthread_once_t  epoch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t   record_key;
+// whether writers can make every reader's CPU issue a full barrier, which
+// frees readers of issuing one each time they enter
+static bool            expedited;
+
+static _Thread_local epoch_record_t *self;
+
+static void
+release_record (void *arg)
+{
+  epoch_record_t *rec = arg;
+
+  __atomic_store_n(&rec->active, 0, __ATOMIC_RELEASE);
+  rec->nesting = 0;
+  __atomic_store_n(&rec->in_use, false, __ATOMIC_RELEASE);
+}
+
+static void
+init_epoch (void)
+{
+  pthread_key_create(&record_key, release_record);
+
+#ifdef __linux__
+  expedited
+    = syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0)
+   == 0;
+#endif
+}
+
+static epoch_record_t *
+register_thread (void)
+{
+  epoch_record_t *rec;
+
+  pthread_mutex_lock(&registry_lock);
+  for (rec = records; rec; rec = rec->next) {
+    if (!__atomic_load_n(&rec->in_use, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+  }
+  if (!rec) {
+    rec = xmalloc_aligned(sizeof(epoch_record_t));
+    rec->active  = 0;
+    rec->nesting = 0;
+    rec->next    = records;
+    records      = rec;
+  }
+  __atomic_store_n(&rec->in_use, true, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&registry_lock);
+
+  pthread_setspecific(record_key, rec);
+
+  return rec;
+}
+
+// Makes stores before it visible to loads after it on every thread: with
+// `expedited`, by interrupting each CPU running one of our threads
+static void
+barrier_all (void)
+{
+#ifdef __linux__
+  if (expedited
+      && syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0) {
+    return;
+  }
+#endif
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void
+fsm_epoch_enter (void)
+{
+  epoch_record_t *rec = self;
+
+  if (!rec) {
+    pthread_once(&epoch_once, init_epoch);
+    rec = self = register_thread();
+  }
+
+  if (rec->nesting++ == 0) {
+    __atomic_store_n(
+      &rec->active,
+      __atomic_load_n(&epoch, __ATOMIC_RELAXED),
+      __ATOMIC_RELAXED
+    );
+
+    // the store above must land before the section's loads; writers see to
+    // it from their side when they can
+    if (expedited) {
+      __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    } else {
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+  }
+}
+
+void
+fsm_epoch_exit (void)
+{
+  epoch_record_t *rec = self;
+
+  if (rec && rec->nesting && --rec->nesting == 0) {
+    __atomic_store_n(&rec->active, 0, __ATOMIC_RELEASE);
+  }
+}
+
+bool
+fsm_epoch_inside (void)
+{
+  return self && self->nesting;
+}
+
+void
+fsm_epoch_synchronize (void)
+{
+  pthread_once(&epoch_once, init_epoch);
+
+  // order the caller's unpublishing stores before the scan
+  barrier_all();
+
+  pthread_mutex_lock(&registry_lock);
+  uint64_t now = __atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+
+  // sections entered since the increment can only have seen what the caller
+  // published; wait out the ones entered before it
+  for (epoch_record_t *rec = records; rec; rec = rec->next) {
+    uint64_t active;
+    while ((active = __atomic_load_n(&rec->active, __ATOMIC_ACQUIRE))
+           && active < now) {
+      sched_yield();
+    }
+  }
+  pthread_mutex_unlock(&registry_lock);
+}
@@ -1,20 +1,51 @@
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "fsms_internal.h"
 #include "libfsms.h"
 
-static void *
-xmalloc (size_t sz)
+// Finalized machines whose states * events exceed this many entries skip the
+// dense dispatch table and scan the state's (sorted) row instead.
+#ifndef FSM_DISPATCH_TABLE_MAX
+#  define FSM_DISPATCH_TABLE_MAX (1 << 22)
+#endif
+
+static void
+compiled_free (fsm_compiled_t *c)
 {
-  void *ptr;
-  if ((ptr = malloc(sz)) == NULL) {
-    fprintf(stderr, "malloc failed to allocate memory\n");
-    exit(EXIT_FAILURE);
+  if (!c) {
+    return;
   }
 
-  return ptr;
+  free(c->masks);
+  free(c->first);
+  free(c->keys);
+  free(c->hot);
+  free(c->events);
+  free(c->event_lens);
+  free(c->states);
+  free(c->event_index);
+  free(c->displacements);
+  free(c->slot_events);
+  free(c->dispatch);
+  free(c->classes);
+  free(c->bytes);
+  free(c->swapped_from);
+  free(c->swapped_to);
+  if (c->jit_handle) {
+    fsm_jit_unload(c->jit_handle);
+  }
+  free(c);
+}
+
+static void
+invalidate (state_machine_t *fsm)
+{
+  compiled_free(fsm->compiled);
+  fsm->compiled = NULL;
 }
 
 static state_descriptor_t *
@@ -29,6 +60,20 @@ get_state (state_machine_t *fsm, const char *name)
   return NULL;
 }
 
+// Maps a registered state onto the state a minimized machine dispatches from
+static state_descriptor_t *
+canonical (state_machine_t *fsm, state_descriptor_t *s)
+{
+  fsm_compiled_t *c = fsm->compiled;
+
+  if (!s || !c || !c->classes || s->id >= array_size(fsm->states)
+      || array_get(fsm->states, s->id) != s) {
+    return s;
+  }
+
+  return c->states[c->classes[s->id]];
+}
+
 state_machine_t *
 fsm_create (const char *name, void *context)
 {
@@ -38,6 +83,8 @@ fsm_create (const char *name, void *context)
   fsm->subscribers     = array_init();
   fsm->states          = array_init();
   fsm->state           = NULL;
+  fsm->compiled        = NULL;
+  fsm->overlay         = NULL;
 
   return fsm;
 }
@@ -45,6 +92,10 @@ fsm_create (const char *name, void *context)
 void
 fsm_subscribe (state_machine_t *fsm, void *(*subscriber)(void *))
 {
+  // machines defined with FSM_DEFINE start without a subscriber list
+  if (!fsm->subscribers) {
+    fsm->subscribers = array_init();
+  }
   array_push(fsm->subscribers, subscriber);
 }
 
@@ -54,9 +105,18 @@ fsm_free (state_machine_t *fsm)
   fsm->context = NULL;
   fsm->name    = NULL;
   fsm->state   = NULL;
-  array_free(fsm->subscribers);
+  // instances start without a subscriber list
+  if (fsm->subscribers) {
+    array_free(fsm->subscribers);
+  }
   fsm->subscribers = NULL;
-  array_free(fsm->states);
+  if (fsm->overlay) {
+    // an instance's states and tables are its definition's
+    free(fsm->overlay->entries);
+  } else {
+    array_free(fsm->states);
+    invalidate(fsm);
+  }
   fsm->states = NULL;
   free(fsm);
   fsm = NULL;
@@ -65,21 +125,29 @@ fsm_free (state_machine_t *fsm)
 void
 fsm_set_initial_state (state_machine_t *fsm, state_descriptor_t *s)
 {
-  fsm->state = s;
+  fsm->state = canonical(fsm, s);
 }
 
 const char *
 fsm_get_state_name (state_machine_t *fsm)
 {
-  return fsm->state->name;
+  return __atomic_load_n(&fsm->state, __ATOMIC_ACQUIRE)->name;
+}
+
+state_descriptor_t *
+fsm_get_state (state_machine_t *fsm, const char *name)
+{
+  return canonical(fsm, get_state(fsm, name));
 }
 
 state_descriptor_t *
 fsm_state_create (const char *name)
 {
   state_descriptor_t *s = xmalloc(sizeof(state_descriptor_t));
-  s->name               = name;
+  s->name               = s_intern(name);
   s->transitions        = array_init();
+  s->id                 = 0;
+  s->accepting          = false;
 
   return s;
 }
@@ -87,6 +155,12 @@ fsm_state_create (const char *name)
 state_descriptor_t *
 fsm_state_register (state_machine_t *fsm, state_descriptor_t *s)
 {
+  if (fsm->overlay) {
+    return NULL;
+  }
+
+  invalidate(fsm);
+  s->id = array_size(fsm->states);
   array_push(fsm->states, s);
   return s;
 }
@@ -111,7 +185,7 @@ fsm_transition_create (
 )
 {
   transition_t *t = xmalloc(sizeof(transition_t));
-  t->name         = name;
+  t->name         = s_intern(name);
   t->target       = target;
   t->guard        = guard;
   t->action       = action;
@@ -119,6 +193,9 @@ fsm_transition_create (
   return t;
 }
 
+static bool
+overlay_put(state_machine_t *fsm, state_descriptor_t *source, transition_t *t);
+
 transition_t *
 fsm_transition_register (
   state_machine_t    *fsm,
@@ -126,7 +203,12 @@ fsm_transition_register (
   transition_t       *t
 )
 {
+  if (fsm->overlay) {
+    return overlay_put(fsm, source, t) ? t : NULL;
+  }
+
   state_descriptor_t *state = get_state(fsm, source->name);
+  invalidate(fsm);
   array_push(state->transitions, t);
 
   return t;
@@ -143,8 +225,291 @@ fsm_transition_free (transition_t *t)
   t = NULL;
 }
 
+// Maps `x` onto [0, n) without a division
+static inline uint32_t
+reduce (uint32_t x, uint32_t n)
+{
+  return ((uint64_t)x * n) >> 32;
+}
+
+static inline uint32_t
+mph_bucket (fsm_compiled_t *c, uint64_t hash)
+{
+  return reduce(hash >> 32, c->num_buckets);
+}
+
+static inline uint32_t
+mph_slot (fsm_compiled_t *c, uint64_t hash, uint32_t displacement)
+{
+  return reduce(
+    mix64(hash ^ (displacement * UINT64_C(0x9e3779b97f4a7c15))),
+    c->num_events
+  );
+}
+
+static int
+find_event (fsm_compiled_t *c, const char *event, size_t len)
+{
+  if (c->num_events == 0) {
+    return -1;
+  }
+
+  uint64_t hash = s_hash_n(event, len);
+  uint32_t slot = mph_slot(c, hash, c->displacements[mph_bucket(c, hash)]);
+  uint32_t id   = c->slot_events[slot];
+
+  if (!s_equals_n(c->events[id], c->event_lens[id], event, len)) {
+    return -1;
+  }
+
+  return id;
+}
+
+// Builds the perfect hash over the finalized event names by hash and
+// displace: buckets are placed largest first, each trying displacements until
+// all of its names land in free slots.
+static bool
+build_mph (fsm_compiled_t *c)
+{
+  uint32_t n = c->num_events;
+  if (n == 0) {
+    return true;
+  }
+
+  c->num_buckets   = (n + 3) / 4;
+  c->displacements = xcalloc(c->num_buckets, sizeof(uint32_t));
+  c->slot_events   = xmalloc(n * sizeof(uint32_t));
+
+  uint64_t *hashes  = xmalloc(n * sizeof(uint64_t));
+  // events grouped by bucket: bucket `b` holds order[start[b]..start[b + 1])
+  uint32_t *start   = xcalloc(c->num_buckets + 1, sizeof(uint32_t));
+  uint32_t *order   = xmalloc(n * sizeof(uint32_t));
+  uint32_t *by_size = xmalloc(c->num_buckets * sizeof(uint32_t));
+  bool     *taken   = xcalloc(n, sizeof(bool));
+  uint32_t  slots[64];
+
+  for (uint32_t i = 0; i < n; i++) {
+    hashes[i] = s_hash_n(c->events[i], c->event_lens[i]);
+    start[mph_bucket(c, hashes[i]) + 1]++;
+  }
+  for (uint32_t b = 0; b < c->num_buckets; b++) {
+    start[b + 1] += start[b];
+    by_size[b]    = b;
+  }
+  uint32_t *fill = xmalloc(c->num_buckets * sizeof(uint32_t));
+  memcpy(fill, start, c->num_buckets * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; i++) {
+    order[fill[mph_bucket(c, hashes[i])]++] = i;
+  }
+  free(fill);
+
+  // insertion sort, largest bucket first; bucket sizes are small
+  for (uint32_t i = 1; i < c->num_buckets; i++) {
+    uint32_t b    = by_size[i];
+    uint32_t size = start[b + 1] - start[b];
+    uint32_t j    = i;
+    for (; j > 0; j--) {
+      uint32_t prev = by_size[j - 1];
+      if (start[prev + 1] - start[prev] >= size) {
+        break;
+      }
+      by_size[j] = prev;
+    }
+    by_size[j] = b;
+  }
+
+  bool ok = true;
+  for (uint32_t i = 0; i < c->num_buckets && ok; i++) {
+    uint32_t b    = by_size[i];
+    uint32_t size = start[b + 1] - start[b];
+    if (size == 0) {
+      break;
+    }
+    if (size > sizeof(slots) / sizeof(slots[0])) {
+      ok = false;
+      break;
+    }
+
+    uint32_t d = 0;
+    for (; d < (1u << 24); d++) {
+      uint32_t placed = 0;
+      for (; placed < size; placed++) {
+        uint32_t slot = mph_slot(c, hashes[order[start[b] + placed]], d);
+        bool     dup  = taken[slot];
+        for (uint32_t k = 0; k < placed && !dup; k++) {
+          dup = slots[k] == slot;
+        }
+        if (dup) {
+          break;
+        }
+        slots[placed] = slot;
+      }
+
+      if (placed == size) {
+        break;
+      }
+    }
+
+    if (d == (1u << 24)) {
+      ok = false;
+      break;
+    }
+
+    c->displacements[b] = d;
+    for (uint32_t k = 0; k < size; k++) {
+      taken[slots[k]]          = true;
+      c->slot_events[slots[k]] = order[start[b] + k];
+    }
+  }
+
+  free(hashes);
+  free(start);
+  free(order);
+  free(by_size);
+  free(taken);
+
+  return ok;
+}
+
+// Assigns the next ID to `event` unless it already has one
+static uint32_t
+add_event (fsm_compiled_t *c, const char *event)
+{
+  size_t   len = strlen(event);
+  uint32_t i   = s_hash_n(event, len) & c->event_index_mask;
+
+  for (;; i = (i + 1) & c->event_index_mask) {
+    uint32_t slot = c->event_index[i];
+    if (!slot) {
+      break;
+    }
+
+    if (s_equals_n(c->events[slot - 1], c->event_lens[slot - 1], event, len)) {
+      return slot - 1;
+    }
+  }
+
+  uint32_t id       = c->num_events++;
+  c->events[id]     = s_intern(event);
+  c->event_lens[id] = len;
+  c->event_index[i] = id + 1;
+
+  return id;
+}
+
+static inline uint64_t
+overlay_key (uint32_t row, uint32_t event_id)
+{
+  return ((uint64_t)row << 32 | event_id) + 1;
+}
+
+// Gets an instance's own transition from `row` on `event_id`, if it has one
+static inline const compiled_transition_t *
+overlay_find (const fsm_overlay_t *o, uint32_t row, uint32_t event_id)
+{
+  if (!o || !o->count) {
+    return NULL;
+  }
+
+  uint64_t key = overlay_key(row, event_id);
+  for (uint32_t i = mix64(key) & o->mask;; i = (i + 1) & o->mask) {
+    if (o->entries[i].key == key) {
+      return &o->entries[i].hot;
+    }
+    if (!o->entries[i].key) {
+      return NULL;
+    }
+  }
+}
+
+static overlay_entry_t *
+overlay_slot (fsm_overlay_t *o, uint64_t key)
+{
+  uint32_t i = mix64(key) & o->mask;
+  while (o->entries[i].key && o->entries[i].key != key) {
+    i = (i + 1) & o->mask;
+  }
+
+  return &o->entries[i];
+}
+
+// Gets the row of `s` in an instance's definition, if it is one of its states
+static bool
+definition_row (state_machine_t *fsm, state_descriptor_t *s, uint32_t *row)
+{
+  if (!s || s->id >= array_size(fsm->states)
+      || array_get(fsm->states, s->id) != s) {
+    return false;
+  }
+
+  *row = compiled_row(fsm->compiled, s->id);
+  return true;
+}
+
+static bool
+overlay_put (state_machine_t *fsm, state_descriptor_t *source, transition_t *t)
+{
+  fsm_overlay_t  *o = fsm->overlay;
+  fsm_compiled_t *c = fsm->compiled;
+  uint32_t        row, target;
+  int             event_id = find_event(c, t->name, strlen(t->name));
+
+  if (event_id < 0 || !definition_row(fsm, source, &row)
+      || !definition_row(fsm, t->target, &target)) {
+    return false;
+  }
+
+  if ((o->count + 1) * 2 > o->mask + 1 || !o->entries) {
+    overlay_entry_t *old      = o->entries;
+    uint32_t         old_size = old ? o->mask + 1 : 0;
+
+    o->mask    = old ? old_size * 2 - 1 : 3;
+    o->entries = xcalloc(o->mask + 1, sizeof(overlay_entry_t));
+    for (uint32_t i = 0; i < old_size; i++) {
+      if (old[i].key) {
+        *overlay_slot(o, old[i].key) = old[i];
+      }
+    }
+    free(old);
+  }
+
+  uint64_t         key = overlay_key(row, event_id);
+  overlay_entry_t *e   = overlay_slot(o, key);
+  if (!e->key) {
+    o->count++;
+  }
+  *e = (overlay_entry_t){
+    .key = key,
+    .hot = {.target = target, .guard = t->guard, .action = t->action},
+  };
+
+  return true;
+}
+
 void
-fsm_transition (state_machine_t *fsm, const char *const event)
+fsm_commit (state_machine_t *fsm, state_descriptor_t *target, const char *event)
+{
+  state_descriptor_t *prev = __atomic_load_n(&fsm->state, __ATOMIC_RELAXED);
+  transition_subscriber_args_t s
+    = {.prev = prev->name, .next = target->name, .ev = event};
+
+  // `fsm_definition_swap` may be moving the machine out of an old state
+  __atomic_store_n(&fsm->state, target, __ATOMIC_RELEASE);
+
+  if (!fsm->subscribers) {
+    return;
+  }
+
+  foreach (fsm->subscribers, i) {
+    void *(*subscriber)(void *) = array_get(fsm->subscribers, i);
+    subscriber(&s);
+  }
+}
+
+// Dispatches through the registered descriptors of a machine that has not
+// been finalized
+static void
+transition_linked (state_machine_t *fsm, const char *const event)
 {
   state_descriptor_t *curr_s = fsm->state;
 
@@ -160,29 +525,717 @@ fsm_transition (state_machine_t *fsm, const char *const event)
         t->action(fsm->context);
       }
 
-      transition_subscriber_args_t *s = NULL;
+      fsm_commit(fsm, t->target, t->name);
+    }
+  }
+}
+
+static void dispatch(state_machine_t *fsm, fsm_compiled_t *c, int event_id);
+
+void
+fsm_transition (state_machine_t *fsm, const char *const event)
+{
+  fsm_transition_n(fsm, event, strlen(event));
+}
+
+void
+fsm_transition_n (state_machine_t *fsm, const char *event, size_t len)
+{
+  fsm_compiled_t *c = __atomic_load_n(&fsm->compiled, __ATOMIC_ACQUIRE);
+
+  if (c) {
+    dispatch(fsm, c, find_event(c, event, len));
+    return;
+  }
+
+  // every registered event name is interned, so one that isn't in the pool
+  // can't match, and one that is matches its transitions by pointer
+  const char *interned = s_intern_lookup_n(event, len);
+  if (interned) {
+    transition_linked(fsm, interned);
+  }
+}
+
+// Runs state `sid`'s candidates for `event_id`, starting from index `k`
+static void
+run_candidates (
+  state_machine_t *fsm,
+  fsm_compiled_t  *c,
+  uint32_t         sid,
+  uint32_t         k,
+  uint32_t         event_id
+)
+{
+  uint32_t end = c->first[sid + 1];
+
+  // rows are sorted by event ID, so candidates for one event are adjacent
+  for (; k < end && c->keys[k] == event_id; k++) {
+    const compiled_transition_t *t = &c->hot[k];
+
+    if (t->guard && !(t->guard(fsm->context))) {
+      return;
+    }
+
+    if (t->action) {
+      t->action(fsm->context);
+    }
+
+    fsm_commit(fsm, c->states[t->target], c->events[event_id]);
+  }
+}
+
+// Gets the row of `fsm`'s current state in `c`
+static inline bool
+current_row (state_machine_t *fsm, const fsm_compiled_t *c, uint32_t *row)
+{
+  state_descriptor_t *s = __atomic_load_n(&fsm->state, __ATOMIC_RELAXED);
+
+  return compiled_state_row(c, s, row);
+}
+
+// Dispatches `event_id` through `c`, which the caller loaded from `fsm` once
+// so that the event ID and the tables it indexes agree
+static void
+dispatch (state_machine_t *fsm, fsm_compiled_t *c, int event_id)
+{
+  uint32_t sid;
+
+  if (event_id < 0 || (unsigned int)event_id >= c->num_events
+      || !current_row(fsm, c, &sid)) {
+    return;
+  }
+
+  // an instance's own transition stands in for all of the definition's
+  const compiled_transition_t *t = overlay_find(fsm->overlay, sid, event_id);
+  if (t) {
+    if (t->guard && !(t->guard(fsm->context))) {
+      return;
+    }
+
+    if (t->action) {
+      t->action(fsm->context);
+    }
+
+    fsm_commit(fsm, c->states[t->target], c->events[event_id]);
+    return;
+  }
+
+  if (c->jit) {
+    uint32_t next = c->jit(sid, event_id);
+    uint32_t k    = next & ~FSM_JIT_SLOW;
+
+    // anything out of range is treated as FSM_JIT_NONE, rather than trusted
+    if (next < c->num_states) {
+      fsm_commit(fsm, c->states[next], c->events[event_id]);
+    } else if (next != FSM_JIT_NONE && next >= FSM_JIT_SLOW
+               && k >= c->first[sid]) {
+      run_candidates(fsm, c, sid, k, event_id);
+    }
+    return;
+  }
+
+  if (!compiled_handles(c, sid, event_id)) {
+    return;
+  }
+
+  run_candidates(fsm, c, sid, compiled_first(c, sid, event_id), event_id);
+}
+
+void
+fsm_transition_id (state_machine_t *fsm, int event_id)
+{
+  fsm_compiled_t *c = __atomic_load_n(&fsm->compiled, __ATOMIC_ACQUIRE);
+
+  if (c) {
+    dispatch(fsm, c, event_id);
+  }
+}
+
+// Builds the lookup tables from the first `num_rows` registered states. With
+// `classes`, transition targets are mapped through it onto those rows.
+static fsm_compiled_t *
+compile (state_machine_t *fsm, unsigned int num_rows, uint32_t *classes)
+{
+  unsigned int num_registered  = array_size(fsm->states);
+  unsigned int num_transitions = 0;
+  for (unsigned int i = 0; i < num_rows; i++) {
+    state_descriptor_t *s = array_get(fsm->states, i);
+    num_transitions += array_size(s->transitions);
+  }
+
+  fsm_compiled_t *c = xcalloc(1, sizeof(fsm_compiled_t));
+  c->num_states     = num_rows;
+
+  // there can be no more distinct events than transitions; size the index to
+  // keep it at most half full
+  unsigned int max_events = num_transitions ? num_transitions : 1;
+  unsigned int index_size = 2;
+  while (index_size < max_events * 2) {
+    index_size <<= 1;
+  }
+
+  c->events           = xcalloc(max_events, sizeof(char *));
+  c->event_lens       = xcalloc(max_events, sizeof(uint32_t));
+  c->event_index      = xcalloc(index_size, sizeof(uint32_t));
+  c->event_index_mask = index_size - 1;
+
+  c->first  = xmalloc((num_rows + 1) * sizeof(uint32_t));
+  c->keys   = xmalloc_aligned(num_transitions * sizeof(uint32_t));
+  c->hot    = xmalloc_aligned(num_transitions * sizeof(compiled_transition_t));
+  c->states = xmalloc(num_rows * sizeof(state_descriptor_t *));
+
+  uint32_t k = 0;
+  for (uint32_t i = 0; i < num_rows; i++) {
+    state_descriptor_t *s = array_get(fsm->states, i);
+    c->states[i]          = s;
+    c->first[i]           = k;
+
+    foreach (s->transitions, j) {
+      transition_t *t = array_get(s->transitions, j);
+
+      if (t->target->id >= num_registered
+          || array_get(fsm->states, t->target->id) != t->target) {
+        // the target was never registered with this machine
+        compiled_free(c);
+        return NULL;
+      }
+
+      uint32_t key = add_event(c, t->name);
+
+      // stable insertion into the row, ordered by event ID
+      uint32_t pos = k++;
+      for (; pos > c->first[i] && c->keys[pos - 1] > key; pos--) {
+        c->keys[pos] = c->keys[pos - 1];
+        c->hot[pos]  = c->hot[pos - 1];
+      }
+
+      c->has_callbacks |= t->guard || t->action;
 
-      if (has_elements(fsm->subscribers)) {
-        s       = xmalloc(sizeof(transition_subscriber_args_t));
-        s->prev = s_copy(fsm->state->name);
-        s->next = s_copy(t->target->name);
-        s->ev   = s_copy(event);
+      c->keys[pos] = key;
+      c->hot[pos]  = (compiled_transition_t){
+         .target = classes ? classes[t->target->id] : t->target->id,
+         .guard  = t->guard,
+         .action = t->action,
+      };
+    }
+  }
+  c->first[num_rows] = k;
+
+  free(c->event_index);
+  c->event_index = NULL;
+
+  if (!build_mph(c)) {
+    compiled_free(c);
+    return NULL;
+  }
+
+  if ((size_t)num_rows * c->num_events <= FSM_DISPATCH_TABLE_MAX) {
+    c->dispatch
+      = xcalloc((size_t)num_rows * c->num_events + 1, sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < num_rows; i++) {
+      // walk backwards so each entry ends up at the first candidate
+      for (uint32_t j = c->first[i + 1]; j > c->first[i]; j--) {
+        c->dispatch[(size_t)i * c->num_events + c->keys[j - 1]] = j;
       }
+    }
+  }
+
+  c->mask_words = FSM_EVENT_MASK_WORDS(c->num_events);
+  c->masks      = xcalloc(
+    (size_t)num_rows * (c->mask_words ? c->mask_words : 1),
+    sizeof(uint64_t)
+  );
+
+  for (uint32_t i = 0; i < num_rows; i++) {
+    uint64_t *mask = c->masks + (size_t)i * c->mask_words;
+
+    for (uint32_t j = c->first[i]; j < c->first[i + 1]; j++) {
+      mask[c->keys[j] / 64] |= UINT64_C(1) << (c->keys[j] % 64);
+    }
+  }
+
+  return c;
+}
+
+bool
+fsm_finalize (state_machine_t *fsm)
+{
+  // an instance dispatches through its definition's tables
+  if (fsm->overlay) {
+    return fsm->compiled != NULL;
+  }
+
+  invalidate(fsm);
+
+  if (array_size(fsm->states) == 0) {
+    return false;
+  }
+
+  fsm->compiled = compile(fsm, array_size(fsm->states), NULL);
 
-      fsm->state = t->target;
+  return fsm->compiled != NULL;
+}
+
+// A transition's label: the event, its position among the state's candidates
+// for that event, and its callbacks. Two states are equivalent when they have
+// the same labels and each label leads to equivalent targets.
+typedef struct {
+  uint32_t event;
+  uint32_t pos;
+  bool (*guard)(void *context);
+  void (*action)(void *context);
+  uint32_t transition;
+} label_key_t;
+
+static int
+label_cmp (const void *a, const void *b)
+{
+  const label_key_t *x = a;
+  const label_key_t *y = b;
+
+  if (x->event != y->event) {
+    return x->event < y->event ? -1 : 1;
+  }
+  if (x->pos != y->pos) {
+    return x->pos < y->pos ? -1 : 1;
+  }
+
+  // only equality matters, so compare the callbacks' representations
+  int cmp = memcmp(&x->guard, &y->guard, sizeof(x->guard));
+  return cmp ? cmp : memcmp(&x->action, &y->action, sizeof(x->action));
+}
+
+// A partition of the states into blocks, refined by marking states and then
+// splitting each touched block into its marked and unmarked parts
+typedef struct {
+  // states, each block contiguous: block `b` occupies elems[start[b], end[b])
+  uint32_t *elems;
+  uint32_t *loc;
+  uint32_t *block;
+  uint32_t *start;
+  uint32_t *end;
+  // marked states sit at the front of their block
+  uint32_t *marked;
+  uint32_t *touched;
+  uint32_t  num_touched;
+  uint32_t  num_blocks;
+  // blocks still to be used as splitters
+  uint32_t *work;
+  uint32_t  num_work;
+  bool     *queued;
+} partition_t;
+
+static void
+partition_mark (partition_t *p, uint32_t s)
+{
+  uint32_t b = p->block[s];
+  uint32_t i = p->loc[s];
+  uint32_t j = p->start[b] + p->marked[b];
+
+  if (i < j) {
+    return;
+  }
+
+  uint32_t other = p->elems[j];
+  p->elems[j]    = s;
+  p->elems[i]    = other;
+  p->loc[s]      = j;
+  p->loc[other]  = i;
+
+  if (p->marked[b]++ == 0) {
+    p->touched[p->num_touched++] = b;
+  }
+}
+
+static void
+partition_queue (partition_t *p, uint32_t b)
+{
+  if (!p->queued[b]) {
+    p->queued[b]           = true;
+    p->work[p->num_work++] = b;
+  }
+}
+
+static void
+partition_split (partition_t *p)
+{
+  for (uint32_t i = 0; i < p->num_touched; i++) {
+    uint32_t b   = p->touched[i];
+    uint32_t m   = p->marked[b];
+    p->marked[b] = 0;
+
+    if (p->start[b] + m == p->end[b]) {
+      continue;
+    }
 
-      foreach (fsm->subscribers, i) {
-        void *(*subscriber)(void *) = array_get(fsm->subscribers, i);
-        subscriber(s);
+    uint32_t nb  = p->num_blocks++;
+    p->start[nb] = p->start[b];
+    p->end[nb]   = p->start[b] + m;
+    p->start[b]  = p->end[nb];
+    for (uint32_t j = p->start[nb]; j < p->end[nb]; j++) {
+      p->block[p->elems[j]] = nb;
+    }
+
+    // Hopcroft: a queued block is replaced by both halves; otherwise either
+    // half suffices, so take the smaller
+    if (p->queued[b] || m < p->end[b] - p->start[b]) {
+      partition_queue(p, nb);
+    } else {
+      partition_queue(p, b);
+    }
+  }
+
+  p->num_touched = 0;
+}
+
+// Partitions the compiled rows into classes of equivalent states, numbered in
+// order of their first member. Returns the number of classes.
+static uint32_t
+partition_states (fsm_compiled_t *c, uint32_t *classes)
+{
+  uint32_t     n      = c->num_states;
+  uint32_t     t      = c->first[n];
+  label_key_t *keys   = xmalloc((t ? t : 1) * sizeof(label_key_t));
+  uint32_t    *source = xmalloc((t ? t : 1) * sizeof(uint32_t));
+  uint32_t    *label  = xmalloc((t ? t : 1) * sizeof(uint32_t));
+
+  for (uint32_t s = 0; s < n; s++) {
+    for (uint32_t j = c->first[s]; j < c->first[s + 1]; j++) {
+      bool repeat = j > c->first[s] && c->keys[j - 1] == c->keys[j];
+      keys[j]     = (label_key_t){
+        .event      = c->keys[j],
+        .pos        = repeat ? keys[j - 1].pos + 1 : 0,
+        .guard      = c->hot[j].guard,
+        .action     = c->hot[j].action,
+        .transition = j,
+      };
+      source[j] = s;
+    }
+  }
+  qsort(keys, t, sizeof(label_key_t), label_cmp);
+
+  partition_t p = {
+    .elems   = xmalloc(n * sizeof(uint32_t)),
+    .loc     = xmalloc(n * sizeof(uint32_t)),
+    .block   = xcalloc(n, sizeof(uint32_t)),
+    .start   = xcalloc(n, sizeof(uint32_t)),
+    .end     = xcalloc(n, sizeof(uint32_t)),
+    .marked  = xcalloc(n, sizeof(uint32_t)),
+    .touched = xmalloc(n * sizeof(uint32_t)),
+    .work    = xmalloc(n * sizeof(uint32_t)),
+    .queued  = xcalloc(n, sizeof(bool)),
+  };
+  for (uint32_t s = 0; s < n; s++) {
+    p.elems[s] = s;
+    p.loc[s]   = s;
+  }
+  p.end[0]     = n;
+  p.num_blocks = 1;
+
+  // initial partition: accepting states apart from the rest, then states with
+  // the same set of labels. Each state has at most one transition per label,
+  // so it is marked at most once per pass.
+  for (uint32_t s = 0; s < n; s++) {
+    if (c->states[s]->accepting) {
+      partition_mark(&p, s);
+    }
+  }
+  partition_split(&p);
+
+  uint32_t num_labels = 0;
+  for (uint32_t i = 0; i < t; num_labels++) {
+    uint32_t j = i;
+    for (; j < t && label_cmp(&keys[i], &keys[j]) == 0; j++) {
+      label[keys[j].transition] = num_labels;
+      partition_mark(&p, source[keys[j].transition]);
+    }
+    partition_split(&p);
+    i = j;
+  }
+
+  p.num_work = 0;
+  for (uint32_t b = 0; b < p.num_blocks; b++) {
+    p.queued[b] = false;
+    partition_queue(&p, b);
+  }
+
+  // reverse edges: the transitions into state `s` are in_edges[in_first[s],
+  // in_first[s + 1])
+  uint32_t *in_first = xcalloc(n + 1, sizeof(uint32_t));
+  uint32_t *in_edges = xmalloc((t ? t : 1) * sizeof(uint32_t));
+  for (uint32_t j = 0; j < t; j++) {
+    in_first[c->hot[j].target + 1]++;
+  }
+  for (uint32_t s = 0; s < n; s++) {
+    in_first[s + 1] += in_first[s];
+  }
+  uint32_t *fill = xmalloc((n + 1) * sizeof(uint32_t));
+  memcpy(fill, in_first, (n + 1) * sizeof(uint32_t));
+  for (uint32_t j = 0; j < t; j++) {
+    in_edges[fill[c->hot[j].target]++] = j;
+  }
+  free(fill);
+
+  // incoming transitions of the current splitter, chained per label
+  size_t    label_bytes = (num_labels ? num_labels : 1) * sizeof(uint32_t);
+  uint32_t *heads       = xmalloc(label_bytes);
+  uint32_t *next        = xmalloc((t ? t : 1) * sizeof(uint32_t));
+  uint32_t *labels      = xmalloc(label_bytes);
+  uint32_t *splitter    = xmalloc(n * sizeof(uint32_t));
+  memset(heads, 0xff, label_bytes);
+
+  while (p.num_work) {
+    uint32_t b = p.work[--p.num_work];
+    p.queued[b] = false;
+
+    // the splitter's members move as blocks split, so work from a copy
+    uint32_t size = p.end[b] - p.start[b];
+    memcpy(splitter, p.elems + p.start[b], size * sizeof(uint32_t));
+
+    uint32_t num_touched_labels = 0;
+    for (uint32_t i = 0; i < size; i++) {
+      uint32_t s = splitter[i];
+      for (uint32_t e = in_first[s]; e < in_first[s + 1]; e++) {
+        uint32_t j = in_edges[e];
+        uint32_t l = label[j];
+        if (heads[l] == UINT32_MAX) {
+          labels[num_touched_labels++] = l;
+        }
+        next[j]  = heads[l];
+        heads[l] = j;
       }
     }
+
+    for (uint32_t i = 0; i < num_touched_labels; i++) {
+      uint32_t l = labels[i];
+      for (uint32_t j = heads[l]; j != UINT32_MAX; j = next[j]) {
+        partition_mark(&p, source[j]);
+      }
+      heads[l] = UINT32_MAX;
+      partition_split(&p);
+    }
   }
+
+  // number the classes in order of their first member
+  uint32_t *class_of_block = p.marked;
+  memset(class_of_block, 0xff, n * sizeof(uint32_t));
+  uint32_t num_classes = 0;
+  for (uint32_t s = 0; s < n; s++) {
+    uint32_t b = p.block[s];
+    if (class_of_block[b] == UINT32_MAX) {
+      class_of_block[b] = num_classes++;
+    }
+    classes[s] = class_of_block[b];
+  }
+
+  free(keys);
+  free(source);
+  free(label);
+  free(in_first);
+  free(in_edges);
+  free(heads);
+  free(next);
+  free(labels);
+  free(splitter);
+  free(p.elems);
+  free(p.loc);
+  free(p.block);
+  free(p.start);
+  free(p.end);
+  free(p.marked);
+  free(p.touched);
+  free(p.work);
+  free(p.queued);
+
+  return num_classes;
+}
+
+bool
+fsm_minimize (state_machine_t *fsm)
+{
+  if (fsm->overlay) {
+    return false;
+  }
+
+  if (!fsm->compiled && !fsm_finalize(fsm)) {
+    return false;
+  }
+
+  fsm_compiled_t *c = fsm->compiled;
+  if (c->classes) {
+    return true;
+  }
+
+  uint32_t  n           = c->num_states;
+  uint32_t *classes     = xmalloc(n * sizeof(uint32_t));
+  uint32_t  num_classes = partition_states(c, classes);
+
+  // reorder the registered states so that each class's first member has the
+  // ID of its row; the merged members follow, in their original order
+  array_t *states = array_init();
+  array_reserve(states, n);
+  uint32_t seen = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (classes[i] == seen) {
+      array_push(states, array_get(fsm->states, i));
+      seen++;
+    }
+  }
+  seen = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    if (classes[i] == seen) {
+      seen++;
+    } else {
+      array_push(states, array_get(fsm->states, i));
+    }
+  }
+
+  uint32_t *remapped = xmalloc(n * sizeof(uint32_t));
+  for (uint32_t i = 0; i < n; i++) {
+    state_descriptor_t *s = array_get(states, i);
+    remapped[i]           = classes[s->id];
+    s->id                 = i;
+  }
+  free(classes);
+
+  array_free(fsm->states);
+  fsm->states = states;
+  invalidate(fsm);
+
+  c = compile(fsm, num_classes, remapped);
+  if (!c) {
+    free(remapped);
+    return false;
+  }
+
+  c->classes    = remapped;
+  fsm->compiled = c;
+  fsm->state    = canonical(fsm, fsm->state);
+
+  return true;
+}
+
+int
+fsm_event_id (state_machine_t *fsm, const char *event)
+{
+  return fsm_event_id_n(fsm, event, strlen(event));
+}
+
+int
+fsm_event_id_n (state_machine_t *fsm, const char *event, size_t len)
+{
+  fsm_compiled_t *c = __atomic_load_n(&fsm->compiled, __ATOMIC_ACQUIRE);
+
+  if (!c) {
+    return -1;
+  }
+
+  return find_event(c, event, len);
+}
+
+unsigned int
+fsm_event_count (state_machine_t *fsm)
+{
+  fsm_compiled_t *c = __atomic_load_n(&fsm->compiled, __ATOMIC_ACQUIRE);
+
+  return c ? c->num_events : 0;
+}
+
+// Gets the compiled tables and the current state's row in them, if the
+// machine is finalized and the state handles `event_id`
+static fsm_compiled_t *
+handling (state_machine_t *fsm, int event_id, uint32_t *sid)
+{
+  fsm_compiled_t *c = __atomic_load_n(&fsm->compiled, __ATOMIC_ACQUIRE);
+
+  if (!c || event_id < 0 || (unsigned int)event_id >= c->num_events
+      || !current_row(fsm, c, sid)
+      || !(compiled_handles(c, *sid, event_id)
+           || overlay_find(fsm->overlay, *sid, event_id))) {
+    return NULL;
+  }
+
+  return c;
+}
+
+bool
+fsm_can_handle (state_machine_t *fsm, int event_id)
+{
+  uint32_t sid;
+
+  return handling(fsm, event_id, &sid) != NULL;
+}
+
+unsigned int
+fsm_enabled_events (state_machine_t *fsm, uint64_t *out_mask)
+{
+  fsm_compiled_t *c = __atomic_load_n(&fsm->compiled, __ATOMIC_ACQUIRE);
+  uint32_t        sid;
+
+  if (!c || !current_row(fsm, c, &sid)) {
+    return 0;
+  }
+
+  memcpy(
+    out_mask,
+    c->masks + (size_t)sid * c->mask_words,
+    c->mask_words * sizeof(uint64_t)
+  );
+
+  const fsm_overlay_t *o = fsm->overlay;
+  for (uint32_t i = 0; o && o->count && i <= o->mask; i++) {
+    uint64_t key = o->entries[i].key;
+    if (key && (key - 1) >> 32 == sid) {
+      uint32_t event_id     = (uint32_t)(key - 1);
+      out_mask[event_id / 64] |= UINT64_C(1) << (event_id % 64);
+    }
+  }
+
+  return c->mask_words;
+}
+
+bool
+fsm_transition_lookup (state_machine_t *fsm, int event_id, fsm_pending_t *out)
+{
+  uint32_t        sid;
+  fsm_compiled_t *c = handling(fsm, event_id, &sid);
+
+  if (!c) {
+    return false;
+  }
+
+  const compiled_transition_t *t = overlay_find(fsm->overlay, sid, event_id);
+  if (!t) {
+    t = &c->hot[compiled_first(c, sid, event_id)];
+  }
+
+  if (t->guard && !(t->guard(fsm->context))) {
+    return false;
+  }
+
+  out->target = c->states[t->target];
+  out->action = t->action;
+  out->event  = c->events[event_id];
+
+  return true;
+}
+
+void
+fsm_transition_commit (state_machine_t *fsm, const fsm_pending_t *pending)
+{
+  if (pending->action) {
+    pending->action(fsm->context);
+  }
+
+  fsm_commit(fsm, pending->target, pending->event);
 }
 
 state_machine_t *
 fsm_clone (const char *name, void *context, state_machine_t *source)
 {
   state_machine_t *clone = fsm_create(name, context);
+  array_reserve(clone->states, array_size(source->states));
 
   foreach (source->states, i) {
     state_descriptor_t *source_s = array_get(source->states, i);
@@ -192,6 +1245,133 @@ fsm_clone (const char *name, void *context, state_machine_t *source)
   return clone;
 }
 
+// Swaps are rare; one at a time keeps their bookkeeping simple
+static pthread_mutex_t swap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Gets the ID of the state of `def` that `fsm`'s state registered as `id`
+// moves to
+static uint32_t
+swap_target (
+  state_machine_t *fsm,
+  state_machine_t *def,
+  const int       *state_mapping,
+  uint32_t         id
+)
+{
+  if (state_mapping) {
+    return state_mapping[id] < 0 ? def->state->id : (uint32_t)state_mapping[id];
+  }
+
+  state_descriptor_t *from = array_get(fsm->states, id);
+  state_descriptor_t *to   = get_state(def, from->name);
+
+  return to ? to->id : def->state->id;
+}
+
+bool
+fsm_definition_swap (
+  state_machine_t *fsm,
+  state_machine_t *def,
+  const int       *state_mapping
+)
+{
+  unsigned int num_states = array_size(def->states);
+
+  if (fsm_epoch_inside() || fsm->overlay || def->overlay || !def->state
+      || def->state->id >= num_states
+      || array_get(def->states, def->state->id) != def->state) {
+    return false;
+  }
+
+  pthread_mutex_lock(&swap_lock);
+
+  unsigned int num_old = array_size(fsm->states);
+  for (unsigned int i = 0; state_mapping && i < num_old; i++) {
+    if (state_mapping[i] >= (int)num_states) {
+      pthread_mutex_unlock(&swap_lock);
+      return false;
+    }
+  }
+
+  fsm_compiled_t *c = compile(def, num_states, NULL);
+  if (!c) {
+    pthread_mutex_unlock(&swap_lock);
+    return false;
+  }
+
+  // a machine that was in one of these states when the tables were published
+  // dispatches from the state it maps onto, until it leaves it
+  c->swapped_from = xmalloc((num_old ? num_old : 1) * sizeof(void *));
+  c->swapped_to   = xmalloc((num_old ? num_old : 1) * sizeof(uint32_t));
+  c->num_swapped  = num_old;
+  for (uint32_t i = 0; i < num_old; i++) {
+    c->swapped_from[i] = array_get(fsm->states, i);
+    c->swapped_to[i]   = swap_target(fsm, def, state_mapping, i);
+  }
+
+  array_t *states = array_init();
+  array_reserve(states, num_states);
+  foreach (def->states, i) {
+    array_push(states, array_get(def->states, i));
+  }
+
+  array_t        *old_states = fsm->states;
+  fsm_compiled_t *old        = fsm->compiled;
+  __atomic_store_n(&fsm->states, states, __ATOMIC_RELEASE);
+  __atomic_store_n(&fsm->compiled, c, __ATOMIC_RELEASE);
+
+  // once no transition is still running on the old tables, nothing but this
+  // can leave the machine in an old state
+  fsm_epoch_synchronize();
+
+  state_descriptor_t *s = __atomic_load_n(&fsm->state, __ATOMIC_ACQUIRE);
+  uint32_t            row;
+  state_descriptor_t *to = compiled_state_row(c, s, &row)
+                          ? c->states[row]
+                          : c->states[def->state->id];
+  if (to != s) {
+    __atomic_compare_exchange_n(
+      &fsm->state,
+      &s,
+      to,
+      false,
+      __ATOMIC_ACQ_REL,
+      __ATOMIC_ACQUIRE
+    );
+  }
+
+  // and then no reader still holds an old state, so the caller may free them
+  fsm_epoch_synchronize();
+  pthread_mutex_unlock(&swap_lock);
+
+  compiled_free(old);
+  array_free(old_states);
+
+  return true;
+}
+
+state_machine_t *
+fsm_instance (const char *name, void *context, state_machine_t *def)
+{
+  if (!def->compiled && !fsm_finalize(def)) {
+    return NULL;
+  }
+
+  // the overlay shares the machine's allocation
+  state_machine_t *fsm
+    = xmalloc(sizeof(state_machine_t) + sizeof(fsm_overlay_t));
+  fsm->name        = name;
+  fsm->context     = context;
+  fsm->subscribers = NULL;
+  fsm->states      = def->states;
+  fsm->state       = def->state;
+  fsm->compiled    = def->compiled;
+  fsm->overlay     = (fsm_overlay_t *)(fsm + 1);
+  *fsm->overlay    = (fsm_overlay_t){0};
+
+  return fsm;
+}
+
 static bool
 find_by_name (state_descriptor_t *el, char *compare_to)
 {
@@ -209,6 +1389,7 @@ __fsm_inline (
 )
 {
   state_machine_t *fsm = fsm_create(name, NULL);
+  array_reserve(fsm->states, num_states);
 
   for (int i = 0; i < num_states; i++) {
     fsm_state_register(fsm, fsm_state_create(states[i]));
@@ -256,6 +1437,8 @@ __fsm_inline (
 
   va_end(args);
 
+  fsm_finalize(fsm);
+
   return fsm;
 }
 
@@ -0,0 +1,334 @@
+#ifndef FSMS_INTERNAL_H
+#define FSMS_INTERNAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libfsms.h"
+
+// Flags on `fsm_byte_table_t` entries. A target below 2^30 is a plain state.
+#define FSM_BYTE_ACCEPT (UINT32_C(1) << 31)
+#define FSM_BYTE_SKIP   (UINT32_C(1) << 30)
+#define FSM_BYTE_ERROR  UINT32_MAX
+
+// Results of a step function built by `fsm_jit`: a target below FSM_JIT_SLOW
+// is committed directly; FSM_JIT_SLOW | k runs the candidates from index `k`
+#define FSM_JIT_SLOW    (UINT32_C(1) << 31)
+#define FSM_JIT_NONE    UINT32_MAX
+
+typedef uint32_t fsm_jit_step_t(uint32_t state, uint32_t event);
+
+// Built by `fsm_run_bytes` on first use, as a single allocation
+typedef struct {
+  bool      supported;
+  uint32_t  num_classes;
+  uint8_t   classes[256];
+  // `num_classes` entries per state: the target, flagged FSM_BYTE_ACCEPT if it
+  // is accepting and FSM_BYTE_SKIP if it has `exits`, or FSM_BYTE_ERROR
+  uint32_t *table;
+  // the bytes leaving each state, for states that loop on all others
+  uint8_t  *num_exits;
+  char     *exits;
+} fsm_byte_table_t;
+
+// The hot part of a transition. Everything needed once a candidate matches;
+// the event ID it matches on lives in the parallel `keys` array so that the
+// scan over a state's candidates only touches 4 bytes each.
+typedef struct {
+  uint32_t target;
+  bool (*guard)(void *context);
+  void (*action)(void *context);
+} compiled_transition_t;
+
+struct fsm_compiled {
+  unsigned int           num_states;
+  unsigned int           num_events;
+  unsigned int           mask_words;
+  // `mask_words` words per state, indexed by state ID
+  uint64_t              *masks;
+  // state `i`'s transitions occupy [first[i], first[i + 1]) of `keys` and
+  // `hot`, sorted by event ID
+  uint32_t              *first;
+  uint32_t              *keys;
+  compiled_transition_t *hot;
+  // cold side tables: event names by event ID, descriptors by state ID
+  const char           **events;
+  uint32_t              *event_lens;
+  state_descriptor_t   **states;
+  // open-addressed index from event name to ID, used while finalizing; a slot
+  // holds ID + 1, or 0 if empty
+  uint32_t              *event_index;
+  uint32_t               event_index_mask;
+  // minimal perfect hash from event name to event ID: a name's bucket picks
+  // the displacement that maps it to a unique slot in [0, num_events)
+  uint32_t               num_buckets;
+  uint32_t              *displacements;
+  uint32_t              *slot_events;
+  // optional `num_states * num_events` table; entry is the index of the first
+  // matching transition + 1, or 0
+  uint32_t              *dispatch;
+  // set by `fsm_minimize`: the row each registered state ID dispatches from.
+  // Rows are then indexed by class, and each class's first member has the ID
+  // equal to its row.
+  uint32_t              *classes;
+  // whether any transition has a guard or an action
+  bool                   has_callbacks;
+  fsm_byte_table_t      *bytes;
+  // set by `fsm_jit`, along with the handle of the object it was loaded from
+  fsm_jit_step_t        *jit;
+  void                  *jit_handle;
+  // set by `fsm_definition_swap`: the states of the definition swapped out,
+  // by registered ID, and the row each was mapped onto
+  state_descriptor_t   **swapped_from;
+  uint32_t              *swapped_to;
+  unsigned int           num_swapped;
+};
+
+// A transition an instance takes in place of its definition's candidates
+typedef struct {
+  // (row << 32 | event ID) + 1, or 0 if the slot is empty
+  uint64_t              key;
+  compiled_transition_t hot;
+} overlay_entry_t;
+
+// Open-addressed by key, at most half full; `entries` is NULL until the first
+// override
+struct fsm_overlay {
+  uint32_t         count;
+  uint32_t         mask;
+  overlay_entry_t *entries;
+};
+
+void fsm_jit_unload(void *handle);
+
+// Moves `fsm` to `target` on `event` and notifies its subscribers
+void fsm_commit(
+  state_machine_t    *fsm,
+  state_descriptor_t *target,
+  const char         *event
+);
+
+// Waits until every read-side section entered before the call has exited.
+// Must not be called from inside one.
+void fsm_epoch_synchronize(void);
+
+// Tests whether the calling thread is inside a read-side section
+bool fsm_epoch_inside(void);
+
+// CRC32C of `n` bytes at `p`, continuing from `crc`; pass 0 to start
+uint32_t fsm_crc32c(uint32_t crc, const void *p, size_t n);
+
+// Tests whether state `sid` handles `event_id`; both must be in range
+static inline bool
+compiled_handles (const fsm_compiled_t *c, uint32_t sid, uint32_t event_id)
+{
+  uint64_t word = c->masks[(size_t)sid * c->mask_words + event_id / 64];
+  return (word >> (event_id % 64)) & 1;
+}
+
+// Gets the index into `keys` and `hot` of the first of state `sid`'s
+// candidates for `event_id`, which the state must handle
+static inline uint32_t
+compiled_first (const fsm_compiled_t *c, uint32_t sid, uint32_t event_id)
+{
+  if (c->dispatch) {
+    return c->dispatch[(size_t)sid * c->num_events + event_id] - 1;
+  }
+
+  uint32_t k = c->first[sid];
+  while (c->keys[k] != event_id) {
+    k++;
+  }
+
+  return k;
+}
+
+// Gets the row state `s` moves to on `event_id`, for machines without guards:
+// every candidate for an event fires in turn, so the last one decides where the
+// machine ends up. Unhandled and out of range events leave it in place.
+static inline uint32_t
+compiled_step (const fsm_compiled_t *c, uint32_t s, int event_id)
+{
+  if (event_id < 0 || (unsigned int)event_id >= c->num_events
+      || !compiled_handles(c, s, event_id)) {
+    return s;
+  }
+
+  uint32_t k   = compiled_first(c, s, event_id);
+  uint32_t end = c->first[s + 1];
+  while (k + 1 < end && c->keys[k + 1] == (uint32_t)event_id) {
+    k++;
+  }
+
+  return c->hot[k].target;
+}
+
+// Tests whether `fsm` is an instance with transitions of its own, which code
+// reading the compiled tables directly would miss
+static inline bool
+fsm_overridden (const state_machine_t *fsm)
+{
+  return fsm->overlay && fsm->overlay->count;
+}
+
+// Gets the row registered state `id` dispatches from
+static inline uint32_t
+compiled_row (const fsm_compiled_t *c, uint32_t id)
+{
+  return c->classes ? c->classes[id] : id;
+}
+
+// Gets the row state `s` dispatches from in `c`. Just after a definition swap,
+// the machine can still be in one of the old definition's states. A descriptor
+// shared with another machine may have been renumbered by it, e.g. when that
+// machine was minimized; such states are found by a search.
+static inline bool
+compiled_state_row (
+  const fsm_compiled_t     *c,
+  const state_descriptor_t *s,
+  uint32_t                 *row
+)
+{
+  if (!s) {
+    return false;
+  }
+
+  uint32_t id = s->id;
+  if (id < c->num_states && c->states[id] == s) {
+    *row = id;
+    return true;
+  }
+
+  if (id < c->num_swapped && c->swapped_from[id] == s) {
+    *row = c->swapped_to[id];
+    return true;
+  }
+
+  for (uint32_t i = 0; i < c->num_states; i++) {
+    if (c->states[i] == s) {
+      *row = i;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// The splitmix64 finalizer: spreads `x` so that every bit of it affects every
+// bit of the result. Stores place entities by it, so it must not change.
+static inline uint64_t
+mix64 (uint64_t x)
+{
+  x ^= x >> 30;
+  x *= UINT64_C(0xbf58476d1ce4e5b9);
+  x ^= x >> 27;
+  x *= UINT64_C(0x94d049bb133111eb);
+  x ^= x >> 31;
+
+  return x;
+}
+
+// Hashes the names of the rows' states, in order. Files that store row
+// indices record it, to refuse to be read with a different definition.
+static inline uint64_t
+compiled_hash (const fsm_compiled_t *c)
+{
+  uint64_t h = 0xcbf29ce484222325;
+
+  for (uint32_t i = 0; i < c->num_states; i++) {
+    // the terminator too, so that "ab", "c" and "a", "bc" differ
+    for (const char *p = c->states[i]->name;; p++) {
+      h = (h ^ (uint8_t)*p) * 0x100000001b3;
+      if (!*p) {
+        break;
+      }
+    }
+  }
+
+  return h;
+}
+
+// Writes `v` as a LEB128 varint of at most 10 bytes, returning its length
+static inline size_t
+varint_put (uint8_t *p, uint64_t v)
+{
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)v | 0x80;
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+
+  return n;
+}
+
+// Reads a varint from [p, end), returning its length, or 0 if it runs past
+// `end` or is too long
+static inline size_t
+varint_get (const uint8_t *p, const uint8_t *end, uint64_t *out)
+{
+  uint64_t v = 0;
+  for (size_t n = 0; n < 10 && p + n < end; n++) {
+    v |= (uint64_t)(p[n] & 0x7f) << (7 * n);
+    if (!(p[n] & 0x80)) {
+      *out = v;
+      return n + 1;
+    }
+  }
+
+  return 0;
+}
+
+static inline void *
+xmalloc (size_t sz)
+{
+  void *ptr;
+  if ((ptr = malloc(sz)) == NULL) {
+    fprintf(stderr, "malloc failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return ptr;
+}
+
+static inline void *
+xcalloc (size_t n, size_t sz)
+{
+  void *ptr;
+  if ((ptr = calloc(n, sz)) == NULL) {
+    fprintf(stderr, "calloc failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return ptr;
+}
+
+static inline void *
+xrealloc (void *ptr, size_t sz)
+{
+  if ((ptr = realloc(ptr, sz)) == NULL) {
+    fprintf(stderr, "realloc failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return ptr;
+}
+
+// Allocates `sz` bytes starting on a cache line boundary
+static inline void *
+xmalloc_aligned (size_t sz)
+{
+  void *ptr;
+  // aligned_alloc requires a multiple of the alignment
+  size_t rounded = ((sz ? sz : 1) + 63) & ~(size_t)63;
+  if ((ptr = aligned_alloc(64, rounded)) == NULL) {
+    fprintf(stderr, "aligned_alloc failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return ptr;
+}
+
+#endif /* FSMS_INTERNAL_H */
@@ -0,0 +1,367 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+// Machines with more (state, event) pairs than this are not compiled
+#ifndef FSM_JIT_MAX_ENTRIES
+#  define FSM_JIT_MAX_ENTRIES (1 << 20)
+#endif
+
+// Bumped whenever the generated code changes shape, so stale objects in the
+// cache are never loaded
+#define JIT_FORMAT 3
+
+#define STEP_SYMBOL   "fsm_jit_step"
+// The definition hash, number of states and number of events the object was
+// built for, checked against the machine before its step function is used
+#define LAYOUT_SYMBOL "fsm_jit_layout"
+
+extern char **environ;
+
+static uint64_t
+fnv1a (uint64_t h, uint32_t x)
+{
+  for (int i = 0; i < 4; i++) {
+    h = (h ^ ((x >> (i * 8)) & 0xff)) * 0x100000001b3;
+  }
+
+  return h;
+}
+
+// Hashes everything the step function depends on: the layout of each row and
+// which candidates have callbacks, but not the callbacks themselves
+static uint64_t
+definition_hash (const fsm_compiled_t *c)
+{
+  uint64_t h = 0xcbf29ce484222325;
+
+  h = fnv1a(h, JIT_FORMAT);
+  h = fnv1a(h, c->num_states);
+  h = fnv1a(h, c->num_events);
+
+  for (uint32_t s = 0; s < c->num_states; s++) {
+    h = fnv1a(h, c->first[s + 1] - c->first[s]);
+
+    for (uint32_t k = c->first[s]; k < c->first[s + 1]; k++) {
+      h = fnv1a(h, c->keys[k]);
+      h = fnv1a(h, c->hot[k].target);
+      h = fnv1a(h, (c->hot[k].guard != NULL) | (c->hot[k].action != NULL) << 1);
+    }
+  }
+
+  return h;
+}
+
+// Gets what the step function returns for each (state, event) pair: the
+// target of a lone candidate without callbacks, FSM_JIT_SLOW | the index of the
+// first candidate otherwise, or FSM_JIT_NONE
+static uint32_t *
+step_results (const fsm_compiled_t *c)
+{
+  size_t    n       = (size_t)c->num_states * c->num_events;
+  uint32_t *results = xmalloc(n * sizeof(uint32_t));
+
+  for (size_t i = 0; i < n; i++) {
+    results[i] = FSM_JIT_NONE;
+  }
+
+  for (uint32_t s = 0; s < c->num_states; s++) {
+    uint32_t end = c->first[s + 1];
+
+    for (uint32_t k = c->first[s]; k < end;) {
+      uint32_t event = c->keys[k];
+      uint32_t last  = k;
+      while (last + 1 < end && c->keys[last + 1] == event) {
+        last++;
+      }
+
+      const compiled_transition_t *t = &c->hot[k];
+      results[(size_t)s * c->num_events + event]
+        = last == k && !t->guard && !t->action ? t->target : FSM_JIT_SLOW | k;
+
+      k = last + 1;
+    }
+  }
+
+  return results;
+}
+
+// Emits the step function with the rows baked in as constants. Results fit in
+// 16 bits when the targets and the slow candidates' indices do; the latter
+// then go through a side table.
+static bool
+emit_source (const fsm_compiled_t *c, uint64_t hash, const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    return false;
+  }
+
+  size_t    n       = (size_t)c->num_states * c->num_events;
+  uint32_t *results = step_results(c);
+  uint32_t  slow    = 0;
+  for (size_t i = 0; i < n; i++) {
+    slow += results[i] != FSM_JIT_NONE && results[i] >= FSM_JIT_SLOW;
+  }
+  bool narrow = c->num_states < 0x7fff && slow < 0x7fff;
+
+  fprintf(f, "#include <stdint.h>\n\n");
+  fprintf(
+    f,
+    "const uint64_t %s[] = {%lluull, %uu, %uu};\n\n",
+    LAYOUT_SYMBOL,
+    (unsigned long long)hash,
+    c->num_states,
+    c->num_events
+  );
+
+  if (narrow) {
+    fprintf(f, "static const uint32_t slow[] = {\n");
+    for (size_t i = 0; i < n; i++) {
+      if (results[i] != FSM_JIT_NONE && results[i] >= FSM_JIT_SLOW) {
+        fprintf(f, "%uu,\n", results[i]);
+      }
+    }
+    fprintf(f, "0};\n\n");
+  }
+
+  fprintf(f, "static const uint%d_t rows[] = {\n", narrow ? 16 : 32);
+  slow = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint32_t r = results[i];
+    if (narrow) {
+      r = r == FSM_JIT_NONE   ? 0xffff
+        : r >= FSM_JIT_SLOW ? 0x8000 | slow++
+                            : r;
+    }
+    fprintf(f, "%uu,%s", r, (i + 1) % c->num_events ? "" : "\n");
+  }
+  fprintf(f, "0};\n\n");
+
+  fprintf(f, "uint32_t\n%s (uint32_t state, uint32_t event)\n{\n", STEP_SYMBOL);
+  fprintf(f, "  if (state >= %uu) {\n", c->num_states);
+  fprintf(f, "    return %uu;\n  }\n\n", FSM_JIT_NONE);
+  fprintf(f, "  uint32_t r = rows[state * %uu + event];\n", c->num_events);
+  if (narrow) {
+    fprintf(f, "  if (r < 0x8000) {\n    return r;\n  }\n");
+    fprintf(f, "  if (r == 0xffff) {\n    return %uu;\n  }\n", FSM_JIT_NONE);
+    fprintf(f, "  return slow[r & 0x7fff];\n");
+  } else {
+    fprintf(f, "  return r;\n");
+  }
+  fprintf(f, "}\n");
+
+  free(results);
+
+  return fclose(f) == 0;
+}
+
+// Tests whether no one but the current user can have written the file `st`
+// describes
+static bool
+private_to_user (const struct stat *st)
+{
+  return st->st_uid == geteuid() && !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+// Creates `path` and any missing parents, private to the current user. An
+// existing directory must already be private: anyone else able to write to it
+// could plant code for us to load.
+static bool
+make_dirs (char *path)
+{
+  for (char *p = path + 1;; p++) {
+    if (*p != '/' && *p != '\0') {
+      continue;
+    }
+
+    char saved = *p;
+    *p         = '\0';
+    int rc     = mkdir(path, 0700);
+    *p         = saved;
+
+    if (rc && errno != EEXIST) {
+      return false;
+    }
+    if (!saved) {
+      struct stat st;
+      return stat(path, &st) == 0 && S_ISDIR(st.st_mode)
+          && private_to_user(&st);
+    }
+  }
+}
+
+// Gets the cache directory: $FSMS_JIT_CACHE, else $XDG_CACHE_HOME/libfsms,
+// else $HOME/.cache/libfsms
+static char *
+cache_dir (void)
+{
+  const char *dir = getenv("FSMS_JIT_CACHE");
+  if (dir && *dir) {
+    return s_copy(dir);
+  }
+
+  dir = getenv("XDG_CACHE_HOME");
+  if (dir && *dir) {
+    return fmt_str("%s/libfsms", dir);
+  }
+
+  dir = getenv("HOME");
+  if (dir && *dir) {
+    return fmt_str("%s/.cache/libfsms", dir);
+  }
+
+  return NULL;
+}
+
+// Runs $CC, or cc, on `src`, discarding its output
+static bool
+compile_object (const char *src, const char *out)
+{
+  const char *cc = getenv("CC");
+  if (!cc || !*cc) {
+    cc = "cc";
+  }
+
+  char *argv[] = {
+    (char *)cc,
+    "-O2",
+    "-shared",
+    "-fPIC",
+    "-o",
+    (char *)out,
+    (char *)src,
+    NULL};
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+
+  pid_t pid;
+  int   status = 0;
+  int   rc     = posix_spawnp(&pid, cc, &actions, NULL, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+
+  if (rc != 0) {
+    return false;
+  }
+
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return false;
+    }
+  }
+
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Builds the object at `path`. Each process writes under its own name and
+// renames into place, so concurrent builds of one definition don't collide.
+static bool
+build_object (const fsm_compiled_t *c, uint64_t hash, const char *path)
+{
+  char *src = fmt_str("%s.%ld.c", path, (long)getpid());
+  char *tmp = fmt_str("%s.%ld.so", path, (long)getpid());
+
+  bool ok = emit_source(c, hash, src) && compile_object(src, tmp)
+         && rename(tmp, path) == 0;
+
+  unlink(src);
+  unlink(tmp);
+  free(src);
+  free(tmp);
+
+  return ok;
+}
+
+// Loads the object at `path`, building it first if it is missing. Only a
+// regular file that no one but the current user can have written is loaded;
+// the cache directory being private keeps it from being swapped after the
+// check.
+static void *
+load_object (const fsm_compiled_t *c, uint64_t hash, const char *path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0 && errno == ENOENT && build_object(c, hash, path)) {
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+  }
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  bool        trusted
+    = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && private_to_user(&st);
+  close(fd);
+
+  return trusted ? dlopen(path, RTLD_NOW | RTLD_LOCAL) : NULL;
+}
+
+bool
+fsm_jit (state_machine_t *fsm)
+{
+  if (!fsm->compiled && !fsm_finalize(fsm)) {
+    return false;
+  }
+
+  fsm_compiled_t *c = fsm->compiled;
+  if (c->jit) {
+    return true;
+  }
+
+  // transition indices must also stay clear of the flag bit
+  if ((size_t)c->num_states * c->num_events > FSM_JIT_MAX_ENTRIES
+      || c->first[c->num_states] >= FSM_JIT_SLOW) {
+    return false;
+  }
+
+  char *dir = cache_dir();
+  if (!dir || !make_dirs(dir)) {
+    free(dir);
+    return false;
+  }
+
+  uint64_t hash = definition_hash(c);
+  char    *path = fmt_str("%s/fsm-%016llx.so", dir, (unsigned long long)hash);
+  free(dir);
+
+  void *handle = load_object(c, hash, path);
+  free(path);
+  if (!handle) {
+    return false;
+  }
+
+  fsm_jit_step_t *step;
+  // POSIX guarantees that a data pointer from dlsym converts to a function
+  *(void **)&step        = dlsym(handle, STEP_SYMBOL);
+  const uint64_t *layout = dlsym(handle, LAYOUT_SYMBOL);
+
+  // a hash collision or a stale object would step through the wrong rows
+  if (!step || !layout || layout[0] != hash || layout[1] != c->num_states
+      || layout[2] != c->num_events) {
+    dlclose(handle);
+    return false;
+  }
+
+  c->jit        = step;
+  c->jit_handle = handle;
+
+  return true;
+}
+
+void
+fsm_jit_unload (void *handle)
+{
+  dlclose(handle);
+}
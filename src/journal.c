@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+#define JOURNAL_MAGIC "FSMSJRN1"
+#define HEADER_SIZE   8
+
+// Records buffered before a group is written out
+#ifndef FSM_JOURNAL_BUFFER
+#  define FSM_JOURNAL_BUFFER 65536
+#endif
+
+// A length byte, three varints of at most 10, 5 and 5 bytes, and the CRC
+#define MAX_PAYLOAD   20
+#define MAX_RECORD    (1 + MAX_PAYLOAD + 4)
+
+struct fsm_journal {
+  int             fd;
+  unsigned int    batch;
+  pthread_mutex_t lock;
+  // where the buffer goes in the file
+  uint64_t        written;
+  // records appended, and how many of them are known to be durable
+  uint64_t        appended;
+  uint64_t        synced;
+  // the last record a failed flush was to make durable
+  uint64_t        failed;
+  // set while one thread flushes outside the lock; the rest wait on `flushed`
+  bool            syncing;
+  pthread_cond_t  flushed;
+  size_t          used;
+  uint8_t         buffer[FSM_JOURNAL_BUFFER];
+};
+
+// Decodes the records in [from, size) of `data`, passing each to `apply` if
+// given. Returns the offset just past the last intact one.
+static uint64_t
+scan (
+  const uint8_t *data,
+  uint64_t       size,
+  uint64_t       from,
+  void (*apply)(void *context, const fsm_journal_record_t *record),
+  void    *context,
+  int64_t *count
+)
+{
+  uint64_t at = from;
+
+  while (size - at >= 1 + 3 + 4) {
+    const uint8_t *p   = data + at;
+    uint8_t        len = p[0];
+
+    if (len < 3 || len > MAX_PAYLOAD || size - at < 1u + len + 4) {
+      break;
+    }
+
+    uint32_t crc;
+    memcpy(&crc, p + 1 + len, sizeof(crc));
+    if (crc != fsm_crc32c(0, p, 1 + len)) {
+      break;
+    }
+
+    const uint8_t *q   = p + 1;
+    const uint8_t *end = q + len;
+    uint64_t       machine_id, event_id, state_id;
+    size_t         n;
+
+    if (!(n = varint_get(q, end, &machine_id))
+        || !(n = varint_get(q += n, end, &event_id))
+        || !(n = varint_get(q += n, end, &state_id)) || q + n != end) {
+      break;
+    }
+
+    if (apply) {
+      fsm_journal_record_t r = {
+        .machine_id = machine_id,
+        .event_id   = (int)event_id,
+        .state_id   = (unsigned int)state_id};
+      apply(context, &r);
+    }
+    (*count)++;
+    at += 1 + len + 4;
+  }
+
+  return at;
+}
+
+// Maps the journal open on `fd` read-only. Returns its size, or -1 if it
+// isn't a journal.
+static int64_t
+map_journal (int fd, const uint8_t **data)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < HEADER_SIZE) {
+    return -1;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+
+  if (memcmp(map, JOURNAL_MAGIC, HEADER_SIZE) != 0) {
+    munmap(map, st.st_size);
+    return -1;
+  }
+  // replay reads it once, front to back
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  *data = map;
+  return st.st_size;
+}
+
+static bool
+write_all (int fd, const uint8_t *p, size_t n, uint64_t offset)
+{
+  while (n) {
+    ssize_t w = pwrite(fd, p, n, (off_t)offset);
+    if (w < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p      += w;
+    n      -= w;
+    offset += w;
+  }
+
+  return true;
+}
+
+// Writes the buffer out. Called locked.
+static bool
+write_out (fsm_journal_t *j)
+{
+  if (j->used) {
+    if (!write_all(j->fd, j->buffer, j->used, j->written)) {
+      return false;
+    }
+    j->written += j->used;
+    j->used     = 0;
+  }
+
+  return true;
+}
+
+// Makes the first `seq` records appended durable. Called locked. One thread
+// at a time flushes, outside the lock, everything written out so far; the
+// callers its flush covers wait for it and return together, so a group of
+// appenders shares one fdatasync.
+static bool
+sync_to (fsm_journal_t *j, uint64_t seq)
+{
+  while (j->synced < seq) {
+    if (seq <= j->failed) {
+      return false;
+    }
+
+    if (j->syncing) {
+      pthread_cond_wait(&j->flushed, &j->lock);
+      continue;
+    }
+
+    uint64_t upto = j->appended;
+    bool     ok   = write_out(j);
+    j->syncing    = true;
+
+    pthread_mutex_unlock(&j->lock);
+    ok = ok && fdatasync(j->fd) == 0;
+    pthread_mutex_lock(&j->lock);
+
+    j->syncing = false;
+    if (ok && upto > j->synced) {
+      j->synced = upto;
+    } else if (!ok && upto > j->failed) {
+      j->failed = upto;
+    }
+    pthread_cond_broadcast(&j->flushed);
+  }
+
+  return true;
+}
+
+fsm_journal_t *
+fsm_journal_open (const char *path, unsigned int batch)
+{
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  uint64_t    end = HEADER_SIZE;
+
+  if (fstat(fd, &st) != 0) {
+    goto fail;
+  }
+
+  if (st.st_size == 0) {
+    if (!write_all(fd, (const uint8_t *)JOURNAL_MAGIC, HEADER_SIZE, 0)
+        || fdatasync(fd) != 0) {
+      goto fail;
+    }
+  } else {
+    const uint8_t *data;
+    int64_t        size  = map_journal(fd, &data);
+    int64_t        count = 0;
+    if (size < 0) {
+      goto fail;
+    }
+
+    end = scan(data, size, HEADER_SIZE, NULL, NULL, &count);
+    munmap((void *)data, size);
+
+    // drop a torn tail, so new records aren't appended after garbage
+    if (end < (uint64_t)size && ftruncate(fd, (off_t)end) != 0) {
+      goto fail;
+    }
+  }
+
+  fsm_journal_t *j = xmalloc(sizeof(fsm_journal_t));
+  j->fd            = fd;
+  j->batch         = batch;
+  j->written       = end;
+  j->appended      = 0;
+  j->synced        = 0;
+  j->failed        = 0;
+  j->syncing       = false;
+  j->used          = 0;
+  pthread_mutex_init(&j->lock, NULL);
+  pthread_cond_init(&j->flushed, NULL);
+
+  return j;
+
+fail:
+  close(fd);
+  return NULL;
+}
+
+void
+fsm_journal_close (fsm_journal_t *j)
+{
+  if (!j) {
+    return;
+  }
+
+  pthread_mutex_lock(&j->lock);
+  sync_to(j, j->appended);
+  pthread_mutex_unlock(&j->lock);
+
+  close(j->fd);
+  pthread_mutex_destroy(&j->lock);
+  pthread_cond_destroy(&j->flushed);
+  free(j);
+}
+
+bool
+fsm_journal_append (
+  fsm_journal_t *j,
+  uint64_t       machine_id,
+  int            event_id,
+  unsigned int   state_id
+)
+{
+  // encode outside the lock; it's the bulk of the work
+  uint8_t record[MAX_RECORD];
+  size_t  len = 1;
+  len += varint_put(record + len, machine_id);
+  len += varint_put(record + len, (uint32_t)event_id);
+  len += varint_put(record + len, state_id);
+  record[0] = (uint8_t)(len - 1);
+
+  uint32_t crc = fsm_crc32c(0, record, len);
+  memcpy(record + len, &crc, sizeof(crc));
+  len += sizeof(crc);
+
+  pthread_mutex_lock(&j->lock);
+
+  bool ok = true;
+  if (j->used + len > FSM_JOURNAL_BUFFER) {
+    ok = write_out(j);
+  }
+
+  if (ok) {
+    memcpy(j->buffer + j->used, record, len);
+    j->used += len;
+
+    uint64_t seq = ++j->appended;
+    if (j->batch && seq % j->batch == 0) {
+      ok = sync_to(j, seq);
+    }
+  }
+
+  pthread_mutex_unlock(&j->lock);
+
+  return ok;
+}
+
+bool
+fsm_journal_transition (
+  fsm_journal_t   *j,
+  uint64_t         machine_id,
+  state_machine_t *fsm,
+  int              event_id
+)
+{
+  if (!fsm_can_handle(fsm, event_id)) {
+    return true;
+  }
+
+  fsm_transition_id(fsm, event_id);
+
+  return fsm_journal_append(j, machine_id, event_id, fsm->state->id);
+}
+
+bool
+fsm_journal_sync (fsm_journal_t *j)
+{
+  pthread_mutex_lock(&j->lock);
+  bool ok = sync_to(j, j->appended);
+  pthread_mutex_unlock(&j->lock);
+
+  return ok;
+}
+
+uint64_t
+fsm_journal_offset (fsm_journal_t *j)
+{
+  pthread_mutex_lock(&j->lock);
+  uint64_t offset = j->written + j->used;
+  pthread_mutex_unlock(&j->lock);
+
+  return offset;
+}
+
+int64_t
+fsm_journal_replay (
+  const char *path,
+  uint64_t    offset,
+  void (*apply)(void *context, const fsm_journal_record_t *record),
+  void *context
+)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  const uint8_t *data;
+  int64_t        size = map_journal(fd, &data);
+  close(fd);
+  if (size < 0) {
+    return -1;
+  }
+
+  int64_t count = 0;
+  if (offset < HEADER_SIZE) {
+    offset = HEADER_SIZE;
+  }
+  if (offset < (uint64_t)size) {
+    scan(data, size, offset, apply, context, &count);
+  }
+  munmap((void *)data, size);
+
+  return count;
+}
@@ -0,0 +1,319 @@
+#include <string.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+struct fsm_nfa {
+  state_machine_t *def;
+  uint32_t         num_states;
+  uint32_t         num_events;
+  uint32_t         words;
+  // registered state ID -> state, copied from a minimized definition
+  uint32_t        *classes;
+  uint32_t         num_registered;
+  // `words` words per set
+  uint64_t        *accepting;
+  uint64_t        *initial;
+  uint64_t        *current;
+  uint64_t        *next;
+  // per event, the states with a transition on it
+  uint64_t        *handles;
+  // successor sets, closed over epsilon edges, for each (state, event) pair
+  // with a transition. Event `e`'s pairs start at pair_start[e], ordered by
+  // state; rank_base counts the states handling `e` in each earlier word.
+  uint64_t        *masks;
+  // per pair, the first and one past the last nonzero word of its mask
+  uint32_t        *spans;
+  uint32_t        *pair_start;
+  uint32_t        *rank_base;
+};
+
+static inline void
+set_add (uint64_t *set, uint32_t s)
+{
+  set[s / 64] |= UINT64_C(1) << (s % 64);
+}
+
+static inline bool
+set_has (const uint64_t *set, uint32_t s)
+{
+  return (set[s / 64] >> (s % 64)) & 1;
+}
+
+static inline uint32_t
+pair_index (const fsm_nfa_t *nfa, uint32_t event_id, uint32_t s)
+{
+  uint32_t        w     = s / 64;
+  const uint64_t *h     = nfa->handles + (size_t)event_id * nfa->words;
+  uint64_t        below = h[w] & ((UINT64_C(1) << (s % 64)) - 1);
+
+  return nfa->pair_start[event_id]
+       + nfa->rank_base[(size_t)event_id * nfa->words + w]
+       + __builtin_popcountll(below);
+}
+
+// Computes each state's epsilon closure: the states reachable from it through
+// epsilon edges alone, itself included
+static uint64_t *
+epsilon_closures (const fsm_compiled_t *c, int epsilon, uint32_t words)
+{
+  uint32_t  n       = c->num_states;
+  uint64_t *closure = xcalloc((size_t)n * words, sizeof(uint64_t));
+  uint32_t *stack   = xmalloc(n * sizeof(uint32_t));
+
+  for (uint32_t s = 0; s < n; s++) {
+    uint64_t *set  = closure + (size_t)s * words;
+    uint32_t  size = 0;
+
+    set_add(set, s);
+    stack[size++] = s;
+
+    while (size && epsilon >= 0) {
+      uint32_t from = stack[--size];
+      if (!compiled_handles(c, from, epsilon)) {
+        continue;
+      }
+
+      for (uint32_t k = compiled_first(c, from, epsilon);
+           k < c->first[from + 1] && c->keys[k] == (uint32_t)epsilon;
+           k++) {
+        uint32_t to = c->hot[k].target;
+        if (!set_has(set, to)) {
+          set_add(set, to);
+          stack[size++] = to;
+        }
+      }
+    }
+  }
+
+  free(stack);
+
+  return closure;
+}
+
+fsm_nfa_t *
+fsm_nfa_create (state_machine_t *def)
+{
+  if (!def->compiled && !fsm_finalize(def)) {
+    return NULL;
+  }
+
+  fsm_compiled_t *c = def->compiled;
+  uint32_t        start;
+  if (c->has_callbacks || !compiled_state_row(c, def->state, &start)) {
+    return NULL;
+  }
+
+  fsm_nfa_t *nfa     = xcalloc(1, sizeof(fsm_nfa_t));
+  uint32_t   n       = c->num_states;
+  uint32_t   words   = FSM_STATE_SET_WORDS(n);
+  int        epsilon = fsm_event_id_n(def, FSM_EPSILON, 0);
+
+  nfa->def            = def;
+  nfa->num_states     = n;
+  nfa->num_events     = c->num_events;
+  nfa->words          = words;
+  nfa->num_registered = array_size(def->states);
+
+  if (c->classes) {
+    nfa->classes = xmalloc(nfa->num_registered * sizeof(uint32_t));
+    memcpy(nfa->classes, c->classes, nfa->num_registered * sizeof(uint32_t));
+  }
+
+  uint64_t *closure = epsilon_closures(c, epsilon, words);
+
+  nfa->handles = xcalloc((size_t)c->num_events * words, sizeof(uint64_t));
+  for (uint32_t s = 0; s < n; s++) {
+    for (uint32_t k = c->first[s]; k < c->first[s + 1]; k++) {
+      if (c->keys[k] != (uint32_t)epsilon) {
+        set_add(nfa->handles + (size_t)c->keys[k] * words, s);
+      }
+    }
+  }
+
+  nfa->pair_start = xmalloc((c->num_events + 1) * sizeof(uint32_t));
+  nfa->rank_base
+    = xmalloc(((size_t)c->num_events * words + 1) * sizeof(uint32_t));
+
+  uint32_t num_pairs = 0;
+  for (uint32_t e = 0; e < c->num_events; e++) {
+    nfa->pair_start[e] = num_pairs;
+
+    uint32_t rank = 0;
+    for (uint32_t w = 0; w < words; w++) {
+      nfa->rank_base[(size_t)e * words + w]  = rank;
+      rank                                  += __builtin_popcountll(
+        nfa->handles[(size_t)e * words + w]
+      );
+    }
+    num_pairs += rank;
+  }
+  nfa->pair_start[c->num_events] = num_pairs;
+
+  nfa->masks = xcalloc((size_t)num_pairs * words, sizeof(uint64_t));
+  for (uint32_t s = 0; s < n; s++) {
+    for (uint32_t k = c->first[s]; k < c->first[s + 1]; k++) {
+      if (c->keys[k] == (uint32_t)epsilon) {
+        continue;
+      }
+
+      uint64_t *mask
+        = nfa->masks + (size_t)pair_index(nfa, c->keys[k], s) * words;
+      const uint64_t *to = closure + (size_t)c->hot[k].target * words;
+      for (uint32_t w = 0; w < words; w++) {
+        mask[w] |= to[w];
+      }
+    }
+  }
+
+  // successor sets are usually a few states, so a step only ORs their span
+  nfa->spans = xmalloc(((size_t)num_pairs * 2 + 1) * sizeof(uint32_t));
+  for (uint32_t p = 0; p < num_pairs; p++) {
+    const uint64_t *mask = nfa->masks + (size_t)p * words;
+    uint32_t        lo   = 0;
+    uint32_t        hi   = words;
+
+    while (lo < words && !mask[lo]) {
+      lo++;
+    }
+    while (hi > lo && !mask[hi - 1]) {
+      hi--;
+    }
+    nfa->spans[p * 2]     = lo;
+    nfa->spans[p * 2 + 1] = hi;
+  }
+
+  nfa->accepting = xcalloc(words, sizeof(uint64_t));
+  nfa->initial   = xmalloc(words * sizeof(uint64_t));
+  nfa->current   = xmalloc(words * sizeof(uint64_t));
+  nfa->next      = xmalloc(words * sizeof(uint64_t));
+  for (uint32_t s = 0; s < n; s++) {
+    if (c->states[s]->accepting) {
+      set_add(nfa->accepting, s);
+    }
+  }
+  memcpy(
+    nfa->initial,
+    closure + (size_t)start * words,
+    words * sizeof(uint64_t)
+  );
+  fsm_nfa_reset(nfa);
+
+  free(closure);
+
+  return nfa;
+}
+
+void
+fsm_nfa_free (fsm_nfa_t *nfa)
+{
+  if (!nfa) {
+    return;
+  }
+
+  free(nfa->classes);
+  free(nfa->accepting);
+  free(nfa->initial);
+  free(nfa->current);
+  free(nfa->next);
+  free(nfa->handles);
+  free(nfa->masks);
+  free(nfa->spans);
+  free(nfa->pair_start);
+  free(nfa->rank_base);
+  free(nfa);
+}
+
+void
+fsm_nfa_reset (fsm_nfa_t *nfa)
+{
+  memcpy(nfa->current, nfa->initial, nfa->words * sizeof(uint64_t));
+}
+
+void
+fsm_nfa_transition (fsm_nfa_t *nfa, const char *event)
+{
+  fsm_nfa_transition_id(nfa, fsm_event_id(nfa->def, event));
+}
+
+void
+fsm_nfa_transition_id (fsm_nfa_t *nfa, int event_id)
+{
+  uint32_t words = nfa->words;
+
+  // an event no state handles, epsilon included, empties the set
+  memset(nfa->next, 0, words * sizeof(uint64_t));
+
+  if (event_id >= 0 && (unsigned int)event_id < nfa->num_events) {
+    const uint64_t *h     = nfa->handles + (size_t)event_id * words;
+    const uint32_t *ranks = nfa->rank_base + (size_t)event_id * words;
+    const uint64_t *masks
+      = nfa->masks + (size_t)nfa->pair_start[event_id] * words;
+    const uint32_t *spans = nfa->spans + (size_t)nfa->pair_start[event_id] * 2;
+
+    for (uint32_t w = 0; w < words; w++) {
+      uint64_t active = nfa->current[w] & h[w];
+
+      while (active) {
+        uint64_t bit  = active & -active;
+        uint32_t rank = ranks[w] + __builtin_popcountll(h[w] & (bit - 1));
+
+        const uint64_t *mask = masks + (size_t)rank * words;
+        for (uint32_t x = spans[rank * 2]; x < spans[rank * 2 + 1]; x++) {
+          nfa->next[x] |= mask[x];
+        }
+
+        active ^= bit;
+      }
+    }
+  }
+
+  uint64_t *swap = nfa->current;
+  nfa->current   = nfa->next;
+  nfa->next      = swap;
+}
+
+bool
+fsm_nfa_in_state (fsm_nfa_t *nfa, const state_descriptor_t *s)
+{
+  uint32_t row;
+
+  if (!compiled_state_row(nfa->def->compiled, s, &row)) {
+    // a state merged away by minimization is no row of its own, but its
+    // class's
+    if (!s || !nfa->classes) {
+      return false;
+    }
+
+    uint32_t i = 0;
+    while (i < nfa->num_registered && array_get(nfa->def->states, i) != s) {
+      i++;
+    }
+    if (i == nfa->num_registered) {
+      return false;
+    }
+    row = nfa->classes[i];
+  }
+
+  return set_has(nfa->current, row);
+}
+
+bool
+fsm_nfa_accepting (fsm_nfa_t *nfa)
+{
+  for (uint32_t w = 0; w < nfa->words; w++) {
+    if (nfa->current[w] & nfa->accepting[w]) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+unsigned int
+fsm_nfa_states (fsm_nfa_t *nfa, uint64_t *out_set)
+{
+  memcpy(out_set, nfa->current, nfa->words * sizeof(uint64_t));
+
+  return nfa->words;
+}
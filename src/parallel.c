@@ -0,0 +1,226 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+// Streams are not split into chunks shorter than this many events
+#ifndef FSM_PARALLEL_MIN_CHUNK
+#  define FSM_PARALLEL_MIN_CHUNK 4096
+#endif
+
+typedef struct {
+  const fsm_compiled_t *c;
+  const int            *events;
+  size_t                lo;
+  size_t                hi;
+  // whether the state the chunk starts in is known; if so, only that path is
+  // followed and `end` receives where it leads
+  bool                  known;
+  uint32_t              start;
+  uint32_t              end;
+  // otherwise, the chunk's state -> state map
+  uint32_t             *map;
+  unsigned int         *out_states;
+} chunk_t;
+
+static uint32_t
+run_from (chunk_t *ch, size_t lo, uint32_t s)
+{
+  if (ch->out_states) {
+    for (size_t i = lo; i < ch->hi; i++) {
+      s                 = compiled_step(ch->c, s, ch->events[i]);
+      ch->out_states[i] = s;
+    }
+  } else {
+    for (size_t i = lo; i < ch->hi; i++) {
+      s = compiled_step(ch->c, s, ch->events[i]);
+    }
+  }
+
+  return s;
+}
+
+// Computes the chunk's state -> state map by following every start state at
+// once. Paths that reach the same state are merged, so the work per event is
+// the number of distinct states still in play, which in most machines falls
+// to one within a few events.
+static void
+compose_chunk (chunk_t *ch)
+{
+  uint32_t  n      = ch->c->num_states;
+  // the distinct states in play, and for each the node standing for the start
+  // states that lead to it. A merged node points at the one it merged into.
+  uint32_t *active = xmalloc(n * sizeof(uint32_t));
+  uint32_t *node   = xmalloc(n * sizeof(uint32_t));
+  uint32_t *parent = xmalloc(n * sizeof(uint32_t));
+  uint32_t *slot   = xmalloc(n * sizeof(uint32_t));
+  uint32_t *stamp  = xcalloc(n, sizeof(uint32_t));
+
+  for (uint32_t s = 0; s < n; s++) {
+    active[s] = s;
+    node[s]   = s;
+    parent[s] = s;
+  }
+
+  uint32_t m     = n;
+  uint32_t epoch = 0;
+  size_t   i     = ch->lo;
+  for (; i < ch->hi && m > 1; i++) {
+    if (++epoch == 0) {
+      memset(stamp, 0, n * sizeof(uint32_t));
+      epoch = 1;
+    }
+
+    uint32_t w = 0;
+    for (uint32_t j = 0; j < m; j++) {
+      uint32_t t = compiled_step(ch->c, active[j], ch->events[i]);
+
+      if (stamp[t] == epoch) {
+        parent[node[j]] = node[slot[t]];
+        continue;
+      }
+
+      stamp[t]  = epoch;
+      slot[t]   = w;
+      active[w] = t;
+      node[w]   = node[j];
+      w++;
+    }
+    m = w;
+  }
+
+  if (m == 1) {
+    active[0] = run_from(ch, i, active[0]);
+  }
+
+  // `slot` now maps each surviving node to its final state
+  for (uint32_t j = 0; j < m; j++) {
+    slot[node[j]] = active[j];
+  }
+
+  ch->map = xmalloc(n * sizeof(uint32_t));
+  for (uint32_t s = 0; s < n; s++) {
+    uint32_t x = s;
+    while (parent[x] != x) {
+      parent[x] = parent[parent[x]];
+      x         = parent[x];
+    }
+    ch->map[s] = slot[x];
+  }
+
+  free(active);
+  free(node);
+  free(parent);
+  free(slot);
+  free(stamp);
+}
+
+static void *
+chunk_worker (void *arg)
+{
+  chunk_t *ch = arg;
+
+  if (ch->known) {
+    ch->end = run_from(ch, ch->lo, ch->start);
+  } else {
+    compose_chunk(ch);
+  }
+
+  return NULL;
+}
+
+// Runs chunks [from, to), the first on the calling thread. A chunk whose thread
+// cannot be started runs on the calling thread instead.
+static void
+run_chunks (chunk_t *chunks, size_t from, size_t to)
+{
+  pthread_t *threads = xmalloc((to - from) * sizeof(pthread_t));
+  bool      *started = xcalloc(to - from, sizeof(bool));
+
+  for (size_t i = from + 1; i < to; i++) {
+    started[i - from]
+      = pthread_create(&threads[i - from], NULL, chunk_worker, &chunks[i]) == 0;
+  }
+
+  chunk_worker(&chunks[from]);
+
+  for (size_t i = from + 1; i < to; i++) {
+    if (started[i - from]) {
+      pthread_join(threads[i - from], NULL);
+    } else {
+      chunk_worker(&chunks[i]);
+    }
+  }
+
+  free(threads);
+  free(started);
+}
+
+state_descriptor_t *
+fsm_run_parallel (
+  state_machine_t *fsm,
+  const int       *events,
+  size_t           n,
+  unsigned int     threads,
+  unsigned int    *out_states
+)
+{
+  fsm_compiled_t *c = fsm->compiled;
+  uint32_t        start;
+
+  if (!c || c->has_callbacks || fsm_overridden(fsm)
+      || !compiled_state_row(c, fsm->state, &start)) {
+    return NULL;
+  }
+
+  size_t num_chunks = threads;
+  if (num_chunks > n / FSM_PARALLEL_MIN_CHUNK) {
+    num_chunks = n / FSM_PARALLEL_MIN_CHUNK;
+  }
+
+  if (num_chunks < 2) {
+    chunk_t ch
+      = {.c = c, .events = events, .hi = n, .out_states = out_states};
+    fsm->state = c->states[run_from(&ch, 0, start)];
+    return fsm->state;
+  }
+
+  // the first chunk's start state is known, so it runs a single path while
+  // the others compute their maps
+  chunk_t *chunks = xcalloc(num_chunks, sizeof(chunk_t));
+  for (size_t i = 0; i < num_chunks; i++) {
+    chunks[i] = (chunk_t){
+      .c          = c,
+      .events     = events,
+      .lo         = n * i / num_chunks,
+      .hi         = n * (i + 1) / num_chunks,
+      .known      = i == 0,
+      .start      = start,
+      .out_states = i == 0 ? out_states : NULL,
+    };
+  }
+
+  run_chunks(chunks, 0, num_chunks);
+
+  // composing the maps in order gives each chunk's start state
+  uint32_t s = chunks[0].end;
+  for (size_t i = 1; i < num_chunks; i++) {
+    chunks[i].start = s;
+    s               = chunks[i].map[s];
+    free(chunks[i].map);
+  }
+
+  if (out_states) {
+    for (size_t i = 1; i < num_chunks; i++) {
+      chunks[i].known      = true;
+      chunks[i].out_states = out_states;
+    }
+    run_chunks(chunks, 1, num_chunks);
+  }
+
+  free(chunks);
+
+  fsm->state = c->states[s];
+  return fsm->state;
+}
@@ -0,0 +1,541 @@
+#include <stdarg.h>
+#include <string.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+// An edge whose guarded components can stop at more combinations than this is
+// refused
+#define MAX_OUTCOMES (1 << 16)
+
+#define NO_TARGET    UINT32_MAX
+
+// One component's part of a product edge that has a guard or an action. Its
+// candidates are calls[first, first + count), run as `fsm_transition_id` runs
+// them; the number committed, times `stride`, adds to the edge's outcome.
+typedef struct {
+  uint32_t component;
+  uint32_t stride;
+  uint32_t first;
+  uint32_t count;
+} product_step_t;
+
+// Steps are steps[first_step, first_step + num_steps); the target of outcome
+// `o` is targets[first_target + o]. Edges without steps use the machine's own
+// target.
+typedef struct {
+  uint32_t first_step;
+  uint32_t num_steps;
+  uint32_t first_target;
+} product_edge_t;
+
+struct fsm_product {
+  state_machine_t       *machine;
+  uint32_t               num_components;
+  state_machine_t      **components;
+  // `num_components` component state IDs per product state
+  uint32_t              *tuples;
+  // indexed like the machine's compiled transitions
+  product_edge_t        *edges;
+  product_step_t        *steps;
+  compiled_transition_t *calls;
+  uint32_t              *targets;
+};
+
+// The reachable tuples, in the order they were found, with an open-addressed
+// index holding ID + 1, or 0 if empty
+typedef struct {
+  uint32_t  width;
+  uint32_t  size;
+  uint32_t  capacity;
+  uint32_t *tuples;
+  uint32_t *slots;
+  uint32_t  mask;
+} tuple_set_t;
+
+// A product edge before the machine is compiled
+typedef struct {
+  uint32_t       source;
+  uint32_t       event;
+  uint32_t       target;
+  product_edge_t edge;
+} pending_edge_t;
+
+// Grows `ptr` to hold at least `need` elements of `size` bytes
+static void *
+reserve (void *ptr, uint32_t *capacity, size_t need, size_t size)
+{
+  if (need <= *capacity) {
+    return ptr;
+  }
+
+  while (*capacity < need) {
+    *capacity = *capacity ? *capacity * 2 : 16;
+  }
+
+  return xrealloc(ptr, (size_t)*capacity * size);
+}
+
+static uint32_t
+tuple_hash (const uint32_t *tuple, uint32_t width)
+{
+  uint64_t h = 0x9e3779b97f4a7c15;
+
+  for (uint32_t i = 0; i < width; i++) {
+    h = (h ^ tuple[i]) * 0xff51afd7ed558ccd;
+    h ^= h >> 32;
+  }
+
+  return (uint32_t)h;
+}
+
+static void
+tuple_set_grow (tuple_set_t *set)
+{
+  set->capacity *= 2;
+  set->tuples = xrealloc(
+    set->tuples,
+    (size_t)set->capacity * set->width * sizeof(uint32_t)
+  );
+
+  free(set->slots);
+  set->mask  = set->capacity * 2 - 1;
+  set->slots = xcalloc(set->mask + 1, sizeof(uint32_t));
+
+  for (uint32_t id = 0; id < set->size; id++) {
+    const uint32_t *tuple = set->tuples + (size_t)id * set->width;
+    uint32_t        h     = tuple_hash(tuple, set->width);
+    while (set->slots[h & set->mask]) {
+      h++;
+    }
+    set->slots[h & set->mask] = id + 1;
+  }
+}
+
+// Gets the ID of `tuple`, adding it if it is new
+static uint32_t
+tuple_set_add (tuple_set_t *set, const uint32_t *tuple)
+{
+  size_t   bytes = set->width * sizeof(uint32_t);
+  uint32_t h     = tuple_hash(tuple, set->width);
+
+  for (;; h++) {
+    uint32_t slot = set->slots[h & set->mask];
+    if (!slot) {
+      break;
+    }
+    const uint32_t *found = set->tuples + (size_t)(slot - 1) * set->width;
+    if (!memcmp(found, tuple, bytes)) {
+      return slot - 1;
+    }
+  }
+
+  uint32_t id = set->size++;
+  memcpy(set->tuples + (size_t)id * set->width, tuple, bytes);
+  set->slots[h & set->mask] = id + 1;
+
+  // keep the index at most half full
+  if (set->size == set->capacity) {
+    tuple_set_grow(set);
+  }
+
+  return id;
+}
+
+// Collects the distinct event names of all components. Fills `ids` with each
+// component's ID for each name, or -1.
+static const char **
+union_events (fsm_product_t *p, uint32_t *num_events, int **ids)
+{
+  uint32_t     n      = 0;
+  uint32_t     cap    = 0;
+  const char **events = NULL;
+
+  for (uint32_t i = 0; i < p->num_components; i++) {
+    fsm_compiled_t *c = p->components[i]->compiled;
+
+    for (uint32_t e = 0; e < c->num_events; e++) {
+      bool seen = false;
+      for (uint32_t j = 0; j < i && !seen; j++) {
+        state_machine_t *m = p->components[j];
+        seen = fsm_event_id_n(m, c->events[e], c->event_lens[e]) >= 0;
+      }
+
+      if (!seen) {
+        events      = reserve(events, &cap, n + 1, sizeof(char *));
+        events[n++] = c->events[e];
+      }
+    }
+  }
+
+  *ids = xmalloc(((size_t)n * p->num_components + 1) * sizeof(int));
+  for (uint32_t u = 0; u < n; u++) {
+    for (uint32_t i = 0; i < p->num_components; i++) {
+      (*ids)[(size_t)u * p->num_components + i]
+        = fsm_event_id(p->components[i], events[u]);
+    }
+  }
+
+  *num_events = n;
+
+  return events;
+}
+
+// Builds the machine whose states are the reachable tuples, naming each after
+// its components' states
+static state_machine_t *
+build_machine (
+  fsm_product_t        *p,
+  const tuple_set_t    *set,
+  const char          **events,
+  const pending_edge_t *pending,
+  uint32_t              num_pending
+)
+{
+  state_machine_t *fsm = fsm_create("product", NULL);
+  array_reserve(fsm->states, set->size);
+
+  for (uint32_t id = 0; id < set->size; id++) {
+    buffer_t *name = buffer_init(NULL);
+
+    for (uint32_t i = 0; i < p->num_components; i++) {
+      fsm_compiled_t *c   = p->components[i]->compiled;
+      uint32_t        sid = set->tuples[(size_t)id * set->width + i];
+      if (i) {
+        buffer_append(name, ",");
+      }
+      buffer_append(name, c->states[sid]->name);
+    }
+
+    fsm_state_register(fsm, fsm_state_create(buffer_state(name)));
+    buffer_free(name);
+  }
+
+  // registered in place: states are found by ID, not by name
+  for (uint32_t x = 0; x < num_pending; x++) {
+    state_descriptor_t *source = array_get(fsm->states, pending[x].source);
+    array_push(
+      source->transitions,
+      fsm_transition_create(
+        events[pending[x].event],
+        array_get(fsm->states, pending[x].target),
+        NULL,
+        NULL
+      )
+    );
+  }
+
+  fsm_set_initial_state(fsm, array_get(fsm->states, 0));
+
+  return fsm;
+}
+
+fsm_product_t *
+__fsm_product (state_machine_t *first, ...)
+{
+  fsm_product_t *p = xcalloc(1, sizeof(fsm_product_t));
+  uint32_t       k = 0;
+
+  va_list args;
+  va_start(args, first);
+  for (state_machine_t *m = first; m; m = va_arg(args, state_machine_t *)) {
+    p->components      = xrealloc(p->components, (k + 1) * sizeof(m));
+    p->components[k++] = m;
+  }
+  va_end(args);
+
+  p->num_components = k;
+
+  // each component's current row, which the product starts from
+  uint32_t *tuple = xmalloc(k * sizeof(uint32_t));
+  for (uint32_t i = 0; i < k; i++) {
+    state_machine_t *m = p->components[i];
+    if ((!m->compiled && !fsm_finalize(m)) || fsm_overridden(m)
+        || !compiled_state_row(m->compiled, m->state, &tuple[i])) {
+      free(tuple);
+      free(p->components);
+      free(p);
+      return NULL;
+    }
+  }
+
+  uint32_t     num_events;
+  int         *ids;
+  const char **events = union_events(p, &num_events, &ids);
+
+  tuple_set_t set = {.width = k, .capacity = 64, .mask = 127};
+  set.tuples      = xmalloc((size_t)set.capacity * k * sizeof(uint32_t));
+  set.slots       = xcalloc(set.mask + 1, sizeof(uint32_t));
+
+  uint32_t *next   = xmalloc(k * sizeof(uint32_t));
+  uint32_t *counts = xmalloc(k * sizeof(uint32_t));
+  uint32_t *starts = xmalloc(k * sizeof(uint32_t));
+  uint32_t *radix  = xmalloc(k * sizeof(uint32_t));
+
+  tuple_set_add(&set, tuple);
+
+  pending_edge_t *pending     = NULL;
+  uint32_t        num_pending = 0;
+  uint32_t        num_steps   = 0;
+  uint32_t        num_calls   = 0;
+  uint32_t        num_targets = 0;
+  uint32_t        capacity[4] = {0};
+  bool            ok          = true;
+
+  // breadth-first over the tuples; `set` doubles as the queue
+  for (uint32_t id = 0; id < set.size && ok; id++) {
+    for (uint32_t u = 0; u < num_events && ok; u++) {
+      uint32_t total   = 1;
+      bool     handled = false;
+
+      memcpy(tuple, set.tuples + (size_t)id * k, k * sizeof(uint32_t));
+
+      for (uint32_t i = 0; i < k; i++) {
+        fsm_compiled_t *c   = p->components[i]->compiled;
+        int             eid = ids[(size_t)u * k + i];
+
+        counts[i] = 0;
+        radix[i]  = 1;
+        if (eid < 0 || !compiled_handles(c, tuple[i], eid)) {
+          continue;
+        }
+
+        bool guarded = false;
+        handled      = true;
+        starts[i]    = compiled_first(c, tuple[i], eid);
+        for (uint32_t x = starts[i];
+             x < c->first[tuple[i] + 1] && c->keys[x] == (uint32_t)eid;
+             x++) {
+          counts[i]++;
+          guarded |= c->hot[x].guard != NULL;
+        }
+
+        // a guarded component may commit to any number of its candidates
+        radix[i]  = guarded ? counts[i] + 1 : 1;
+        total    *= radix[i];
+        if (total > MAX_OUTCOMES) {
+          ok = false;
+        }
+      }
+
+      if (!handled || !ok) {
+        continue;
+      }
+
+      pending = reserve(
+        pending,
+        &capacity[0],
+        num_pending + 1,
+        sizeof(*pending)
+      );
+      pending_edge_t *pe    = &pending[num_pending++];
+      pe->source            = id;
+      pe->event             = u;
+      pe->edge.first_step   = num_steps;
+      pe->edge.num_steps    = 0;
+      pe->edge.first_target = num_targets;
+
+      // components with callbacks become steps, run in component order
+      uint32_t stride = 1;
+      for (uint32_t i = 0; i < k; i++) {
+        fsm_compiled_t *c         = p->components[i]->compiled;
+        bool            callbacks = false;
+        for (uint32_t x = 0; x < counts[i]; x++) {
+          const compiled_transition_t *t = &c->hot[starts[i] + x];
+          callbacks                     |= t->guard || t->action;
+        }
+        if (!callbacks) {
+          continue;
+        }
+
+        p->steps = reserve(
+          p->steps,
+          &capacity[1],
+          num_steps + 1,
+          sizeof(*p->steps)
+        );
+        p->calls = reserve(
+          p->calls,
+          &capacity[2],
+          num_calls + counts[i],
+          sizeof(*p->calls)
+        );
+        memcpy(
+          p->calls + num_calls,
+          c->hot + starts[i],
+          counts[i] * sizeof(*p->calls)
+        );
+        p->steps[num_steps++] = (product_step_t){
+          .component = i,
+          .stride    = radix[i] > 1 ? stride : 0,
+          .first     = num_calls,
+          .count     = counts[i]};
+        pe->edge.num_steps++;
+        num_calls += counts[i];
+        stride    *= radix[i];
+      }
+
+      p->targets = reserve(
+        p->targets,
+        &capacity[3],
+        num_targets + total,
+        sizeof(uint32_t)
+      );
+      for (uint32_t o = 0; o < total; o++) {
+        uint32_t rest     = o;
+        bool     possible = true;
+
+        for (uint32_t i = 0; i < k; i++) {
+          fsm_compiled_t *c         = p->components[i]->compiled;
+          uint32_t        committed = counts[i];
+          if (radix[i] > 1) {
+            committed  = rest % radix[i];
+            rest      /= radix[i];
+            // stopping early takes a failed guard
+            if (committed < counts[i]
+                && !c->hot[starts[i] + committed].guard) {
+              possible = false;
+            }
+          }
+          next[i] = committed ? c->hot[starts[i] + committed - 1].target
+                              : tuple[i];
+        }
+
+        p->targets[num_targets + o]
+          = possible ? tuple_set_add(&set, next) : NO_TARGET;
+      }
+
+      // every guard passing is the outcome with the most commits
+      pe->target   = p->targets[num_targets + total - 1];
+      num_targets += total;
+    }
+  }
+
+  free(next);
+  free(counts);
+  free(starts);
+  free(radix);
+
+  if (ok) {
+    p->machine = build_machine(p, &set, events, pending, num_pending);
+    ok         = fsm_finalize(p->machine);
+  }
+
+  if (ok) {
+    fsm_compiled_t *c = p->machine->compiled;
+    p->edges = xmalloc((c->first[c->num_states] + 1) * sizeof(*p->edges));
+
+    for (uint32_t x = 0; x < num_pending; x++) {
+      int      eid = fsm_event_id(p->machine, events[pending[x].event]);
+      uint32_t at  = compiled_first(c, pending[x].source, eid);
+      p->edges[at] = pending[x].edge;
+    }
+
+    p->tuples  = set.tuples;
+    set.tuples = NULL;
+  }
+
+  free(tuple);
+  free(set.tuples);
+  free(set.slots);
+  free(pending);
+  free(events);
+  free(ids);
+
+  if (!ok) {
+    fsm_product_free(p);
+    return NULL;
+  }
+
+  return p;
+}
+
+void
+fsm_product_free (fsm_product_t *p)
+{
+  if (!p) {
+    return;
+  }
+
+  if (p->machine) {
+    fsm_inline_free(p->machine);
+  }
+  free(p->components);
+  free(p->tuples);
+  free(p->edges);
+  free(p->steps);
+  free(p->calls);
+  free(p->targets);
+  free(p);
+}
+
+state_machine_t *
+fsm_product_machine (fsm_product_t *p)
+{
+  return p->machine;
+}
+
+void
+fsm_product_transition (fsm_product_t *p, const char *event)
+{
+  fsm_product_transition_id(p, fsm_event_id(p->machine, event));
+}
+
+void
+fsm_product_transition_id (fsm_product_t *p, int event_id)
+{
+  state_machine_t *fsm = p->machine;
+  fsm_compiled_t  *c   = fsm->compiled;
+  uint32_t         row;
+
+  if (!fsm_can_handle(fsm, event_id)
+      || !compiled_state_row(c, fsm->state, &row)) {
+    return;
+  }
+
+  uint32_t              k      = compiled_first(c, row, event_id);
+  const product_edge_t *edge   = &p->edges[k];
+  uint32_t              target = c->hot[k].target;
+
+  if (edge->num_steps) {
+    uint32_t outcome = 0;
+
+    for (uint32_t x = 0; x < edge->num_steps; x++) {
+      const product_step_t *step      = &p->steps[edge->first_step + x];
+      void                 *context   = p->components[step->component]->context;
+      uint32_t              committed = 0;
+
+      for (; committed < step->count; committed++) {
+        const compiled_transition_t *t = &p->calls[step->first + committed];
+
+        if (t->guard && !(t->guard(context))) {
+          break;
+        }
+
+        if (t->action) {
+          t->action(context);
+        }
+      }
+
+      outcome += committed * step->stride;
+    }
+
+    target = p->targets[edge->first_target + outcome];
+  }
+
+  fsm_commit(fsm, c->states[target], c->events[event_id]);
+}
+
+state_descriptor_t *
+fsm_product_state (fsm_product_t *p, unsigned int i)
+{
+  uint32_t row;
+  if (i >= p->num_components
+      || !compiled_state_row(p->machine->compiled, p->machine->state, &row)) {
+    return NULL;
+  }
+
+  uint32_t id = p->tuples[(size_t)row * p->num_components + i];
+
+  return p->components[i]->compiled->states[id];
+}
@@ -0,0 +1,481 @@
+#define _GNU_SOURCE
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+#ifdef __linux__
+
+#  include <errno.h>
+#  include <limits.h>
+#  include <pthread.h>
+#  include <string.h>
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  include <sys/timerfd.h>
+#  include <unistd.h>
+
+// Ready descriptors reaped per epoll_wait
+#  ifndef FSM_REACTOR_BATCH
+#    define FSM_REACTOR_BATCH 64
+#  endif
+
+// Events sent per readiness of a timerfd or eventfd; the rest of a larger
+// count waits for the next run, or, for a timer, is dropped
+#  ifndef FSM_REACTOR_COUNTER_MAX
+#    define FSM_REACTOR_COUNTER_MAX 65536
+#  endif
+
+_Static_assert(
+  FSM_REACTOR_COUNTER_MAX <= INT_MAX / (FSM_REACTOR_BATCH * 2),
+  "fsm_reactor_run counts the events it sends in an int"
+);
+
+// The epoll data of the reactor's own wakeup eventfd
+#  define WAKEUP_TAG UINT64_MAX
+
+typedef enum {
+  WATCH_NONE,
+  // readiness sends the event once
+  WATCH_FD,
+  // readiness sends the event once per expiration read
+  WATCH_TIMER,
+  // readiness sends the event once per count read
+  WATCH_EVENTFD
+} watch_kind_t;
+
+// Indexed by descriptor. The generation, also stored in the epoll data, tells
+// a reaped event apart from one for an earlier watch of a reused descriptor.
+typedef struct {
+  state_machine_t *fsm;
+  int              event_id;
+  uint32_t         generation;
+  watch_kind_t     kind;
+  // whether the reactor created the descriptor, and so closes it
+  bool             owned;
+} watch_t;
+
+typedef struct {
+  state_machine_t *fsm;
+  int              event_id;
+} post_t;
+
+struct fsm_reactor {
+  int             epfd;
+  int             wakeup;
+  watch_t        *watches;
+  unsigned int    num_watches;
+  uint32_t        generation;
+  // posts from any thread, guarded by `lock`; `woken` is set while a wakeup is
+  // pending, so posts made before the reactor drains them don't write again
+  pthread_mutex_t lock;
+  post_t         *posts;
+  unsigned int    num_posts;
+  unsigned int    posts_capacity;
+  bool            woken;
+  // posts being sent, swapped with `posts` under the lock
+  post_t         *draining;
+  unsigned int    draining_capacity;
+};
+
+fsm_reactor_t *
+fsm_reactor_create (void)
+{
+  int epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    return NULL;
+  }
+
+  int wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  struct epoll_event ev = {.events = EPOLLIN, .data.u64 = WAKEUP_TAG};
+  if (wakeup < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, wakeup, &ev) != 0) {
+    if (wakeup >= 0) {
+      close(wakeup);
+    }
+    close(epfd);
+    return NULL;
+  }
+
+  fsm_reactor_t *r = xcalloc(1, sizeof(fsm_reactor_t));
+  r->epfd          = epfd;
+  r->wakeup        = wakeup;
+  pthread_mutex_init(&r->lock, NULL);
+
+  return r;
+}
+
+void
+fsm_reactor_free (fsm_reactor_t *r)
+{
+  if (!r) {
+    return;
+  }
+
+  for (unsigned int fd = 0; fd < r->num_watches; fd++) {
+    if (r->watches[fd].kind != WATCH_NONE && r->watches[fd].owned) {
+      close((int)fd);
+    }
+  }
+
+  close(r->wakeup);
+  close(r->epfd);
+  pthread_mutex_destroy(&r->lock);
+
+  free(r->watches);
+  free(r->posts);
+  free(r->draining);
+  free(r);
+}
+
+static bool
+add_watch (
+  fsm_reactor_t   *r,
+  int              fd,
+  uint32_t         events,
+  watch_kind_t     kind,
+  bool             owned,
+  state_machine_t *fsm,
+  int              event_id
+)
+{
+  if (fd < 0) {
+    return false;
+  }
+
+  if ((unsigned int)fd >= r->num_watches) {
+    unsigned int n = r->num_watches ? r->num_watches : 16;
+    while (n <= (unsigned int)fd) {
+      n *= 2;
+    }
+
+    r->watches = xrealloc(r->watches, n * sizeof(watch_t));
+    memset(
+      r->watches + r->num_watches,
+      0,
+      (n - r->num_watches) * sizeof(watch_t)
+    );
+    r->num_watches = n;
+  }
+
+  watch_t *w          = &r->watches[fd];
+  uint32_t generation = ++r->generation;
+
+  struct epoll_event ev = {
+    .events   = events,
+    .data.u64 = (uint64_t)generation << 32 | (uint32_t)fd};
+  int op = w->kind == WATCH_NONE ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+  int rc = epoll_ctl(r->epfd, op, fd, &ev);
+
+  // the watched descriptor was closed without unwatching it, and its number
+  // reused: closing it left the epoll set, so this is a new one
+  if (rc != 0 && op == EPOLL_CTL_MOD && errno == ENOENT) {
+    op = EPOLL_CTL_ADD;
+    rc = epoll_ctl(r->epfd, op, fd, &ev);
+  }
+  if (rc != 0) {
+    return false;
+  }
+
+  // watching an owned descriptor again keeps it owned
+  *w = (watch_t){
+    .fsm        = fsm,
+    .event_id   = event_id,
+    .generation = generation,
+    .kind       = kind,
+    .owned      = owned || (op == EPOLL_CTL_MOD && w->owned)};
+
+  return true;
+}
+
+bool
+fsm_reactor_watch (
+  fsm_reactor_t   *r,
+  int              fd,
+  unsigned int     readiness,
+  state_machine_t *fsm,
+  int              event_id
+)
+{
+  uint32_t events = 0;
+  if (readiness & FSM_REACTOR_READABLE) {
+    events |= EPOLLIN;
+  }
+  if (readiness & FSM_REACTOR_WRITABLE) {
+    events |= EPOLLOUT;
+  }
+
+  return add_watch(r, fd, events, WATCH_FD, false, fsm, event_id);
+}
+
+void
+fsm_reactor_unwatch (fsm_reactor_t *r, int fd)
+{
+  if (fd < 0 || (unsigned int)fd >= r->num_watches
+      || r->watches[fd].kind == WATCH_NONE) {
+    return;
+  }
+
+  epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL);
+  if (r->watches[fd].owned) {
+    close(fd);
+  }
+  r->watches[fd].kind = WATCH_NONE;
+}
+
+int
+fsm_reactor_timer (
+  fsm_reactor_t   *r,
+  uint64_t         initial_ns,
+  uint64_t         interval_ns,
+  state_machine_t *fsm,
+  int              event_id
+)
+{
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  // a zero initial expiration would disarm the timer instead
+  if (!initial_ns) {
+    initial_ns = 1;
+  }
+
+  struct itimerspec spec = {
+    .it_value    = {
+      .tv_sec  = initial_ns / 1000000000,
+      .tv_nsec = initial_ns % 1000000000},
+    .it_interval = {
+      .tv_sec  = interval_ns / 1000000000,
+      .tv_nsec = interval_ns % 1000000000}
+  };
+
+  if (timerfd_settime(fd, 0, &spec, NULL) != 0
+      || !add_watch(r, fd, EPOLLIN, WATCH_TIMER, true, fsm, event_id)) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+int
+fsm_reactor_eventfd (fsm_reactor_t *r, state_machine_t *fsm, int event_id)
+{
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (!add_watch(r, fd, EPOLLIN, WATCH_EVENTFD, true, fsm, event_id)) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+void
+fsm_reactor_post (fsm_reactor_t *r, state_machine_t *fsm, int event_id)
+{
+  pthread_mutex_lock(&r->lock);
+
+  if (r->num_posts == r->posts_capacity) {
+    r->posts_capacity = r->posts_capacity ? r->posts_capacity * 2 : 64;
+    r->posts = xrealloc(r->posts, r->posts_capacity * sizeof(post_t));
+  }
+  r->posts[r->num_posts++] = (post_t){.fsm = fsm, .event_id = event_id};
+
+  bool wake = !r->woken;
+  r->woken  = true;
+
+  pthread_mutex_unlock(&r->lock);
+
+  if (wake) {
+    uint64_t one = 1;
+    while (write(r->wakeup, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+  }
+}
+
+// Sends everything posted so far. Posts made meanwhile wait for the next run.
+static int
+drain_posts (fsm_reactor_t *r)
+{
+  uint64_t count;
+  while (read(r->wakeup, &count, sizeof(count)) < 0 && errno == EINTR) {
+  }
+
+  pthread_mutex_lock(&r->lock);
+
+  post_t      *posts    = r->posts;
+  unsigned int n        = r->num_posts;
+  unsigned int capacity = r->posts_capacity;
+
+  r->posts              = r->draining;
+  r->posts_capacity     = r->draining_capacity;
+  r->num_posts          = 0;
+  r->woken              = false;
+
+  pthread_mutex_unlock(&r->lock);
+
+  for (unsigned int i = 0; i < n; i++) {
+    fsm_transition_id(posts[i].fsm, posts[i].event_id);
+  }
+
+  r->draining          = posts;
+  r->draining_capacity = capacity;
+
+  return (int)n;
+}
+
+int
+fsm_reactor_run (fsm_reactor_t *r, int timeout_ms)
+{
+  struct epoll_event events[FSM_REACTOR_BATCH];
+
+  int n = epoll_wait(r->epfd, events, FSM_REACTOR_BATCH, timeout_ms);
+  if (n < 0) {
+    return errno == EINTR ? 0 : -1;
+  }
+
+  int  sent  = 0;
+  bool woken = false;
+
+  for (int i = 0; i < n; i++) {
+    uint64_t tag = events[i].data.u64;
+    if (tag == WAKEUP_TAG) {
+      woken = true;
+      continue;
+    }
+
+    // actions may watch or unwatch descriptors, so look the watch up afresh
+    int fd = (int)(uint32_t)tag;
+    if ((unsigned int)fd >= r->num_watches) {
+      continue;
+    }
+
+    watch_t w = r->watches[fd];
+    if (w.kind == WATCH_NONE || w.generation != (uint32_t)(tag >> 32)) {
+      continue;
+    }
+
+    uint64_t count = 1;
+    if (w.kind != WATCH_FD) {
+      ssize_t got;
+      while ((got = read(fd, &count, sizeof(count))) < 0 && errno == EINTR) {
+      }
+      if (got != sizeof(count)) {
+        continue;
+      }
+    }
+
+    // an eventfd can hold up to 2^64 - 2: add the rest back, so that it stays
+    // readable and is sent by later runs
+    if (count > FSM_REACTOR_COUNTER_MAX) {
+      if (w.kind == WATCH_EVENTFD) {
+        uint64_t rest = count - FSM_REACTOR_COUNTER_MAX;
+        while (write(fd, &rest, sizeof(rest)) < 0 && errno == EINTR) {
+        }
+      }
+      count = FSM_REACTOR_COUNTER_MAX;
+    }
+
+    for (uint64_t c = 0; c < count; c++) {
+      fsm_transition_id(w.fsm, w.event_id);
+    }
+    sent += (int)count;
+  }
+
+  if (woken) {
+    sent += drain_posts(r);
+  }
+
+  return sent;
+}
+
+#else
+
+fsm_reactor_t *
+fsm_reactor_create (void)
+{
+
+  return NULL;
+}
+
+void
+fsm_reactor_free (fsm_reactor_t *r)
+{
+  (void)r;
+}
+
+bool
+fsm_reactor_watch (
+  fsm_reactor_t   *r,
+  int              fd,
+  unsigned int     readiness,
+  state_machine_t *fsm,
+  int              event_id
+)
+{
+  (void)r;
+  (void)fd;
+  (void)readiness;
+  (void)fsm;
+  (void)event_id;
+
+  return false;
+}
+
+void
+fsm_reactor_unwatch (fsm_reactor_t *r, int fd)
+{
+  (void)r;
+  (void)fd;
+}
+
+int
+fsm_reactor_timer (
+  fsm_reactor_t   *r,
+  uint64_t         initial_ns,
+  uint64_t         interval_ns,
+  state_machine_t *fsm,
+  int              event_id
+)
+{
+  (void)r;
+  (void)initial_ns;
+  (void)interval_ns;
+  (void)fsm;
+  (void)event_id;
+
+  return -1;
+}
+
+int
+fsm_reactor_eventfd (fsm_reactor_t *r, state_machine_t *fsm, int event_id)
+{
+  (void)r;
+  (void)fsm;
+  (void)event_id;
+
+  return -1;
+}
+
+void
+fsm_reactor_post (fsm_reactor_t *r, state_machine_t *fsm, int event_id)
+{
+  (void)r;
+  (void)fsm;
+  (void)event_id;
+}
+
+int
+fsm_reactor_run (fsm_reactor_t *r, int timeout_ms)
+{
+  (void)r;
+  (void)timeout_ms;
+
+  return -1;
+}
+
+#endif
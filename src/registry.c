@@ -0,0 +1,296 @@
+#include <pthread.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+// IDs are spread over this many stripes, each a table with its own lock, so
+// threads dispatching to different IDs rarely contend
+#ifndef FSM_REGISTRY_STRIPES
+#  define FSM_REGISTRY_STRIPES 64
+#endif
+
+_Static_assert(
+  (FSM_REGISTRY_STRIPES & (FSM_REGISTRY_STRIPES - 1)) == 0,
+  "FSM_REGISTRY_STRIPES must be a power of two"
+);
+
+#define STRIPE_SHIFT      (64 - __builtin_ctz(FSM_REGISTRY_STRIPES))
+#define MIN_SLOTS         16
+
+// How far ahead `fsm_registry_dispatch_n` prefetches the slots of its IDs
+#define PREFETCH_DISTANCE 8
+
+// An empty slot has no instance
+typedef struct {
+  uint64_t         id;
+  state_machine_t *fsm;
+} registry_slot_t;
+
+// Open-addressed with linear probing, at most 3/4 full. `slots` and `mask`
+// change only under `lock`, but are read without it to prefetch.
+typedef struct {
+  pthread_mutex_t  lock;
+  registry_slot_t *slots;
+  uint64_t         mask;
+  uint64_t         count;
+} __attribute__((aligned(64))) registry_stripe_t;
+
+struct fsm_registry {
+  registry_stripe_t stripes[FSM_REGISTRY_STRIPES];
+  state_machine_t  *def;
+};
+
+// The stripe takes the high bits of the hash and the slot the low ones, so
+// each stripe's IDs still spread over its whole table
+static inline registry_stripe_t *
+stripe_of (fsm_registry_t *reg, uint64_t hash)
+{
+  return &reg->stripes[FSM_REGISTRY_STRIPES > 1 ? hash >> STRIPE_SHIFT : 0];
+}
+
+// Finds the slot holding `id`, or else the empty slot where it would go
+static registry_slot_t *
+locate (registry_stripe_t *st, uint64_t hash, uint64_t id)
+{
+  for (uint64_t i = hash & st->mask;; i = (i + 1) & st->mask) {
+    registry_slot_t *slot = &st->slots[i];
+    if (!slot->fsm || slot->id == id) {
+      return slot;
+    }
+  }
+}
+
+static void
+grow (registry_stripe_t *st)
+{
+  registry_slot_t *old      = st->slots;
+  uint64_t         old_size = st->mask + 1;
+
+  registry_slot_t *slots = xcalloc(old_size * 2, sizeof(registry_slot_t));
+  __atomic_store_n(&st->slots, slots, __ATOMIC_RELAXED);
+  __atomic_store_n(&st->mask, old_size * 2 - 1, __ATOMIC_RELAXED);
+
+  for (uint64_t i = 0; i < old_size; i++) {
+    if (old[i].fsm) {
+      *locate(st, mix64(old[i].id), old[i].id) = old[i];
+    }
+  }
+  free(old);
+}
+
+fsm_registry_t *
+fsm_registry_create (state_machine_t *def)
+{
+  if (!def->compiled && !fsm_finalize(def)) {
+    return NULL;
+  }
+
+  fsm_registry_t *reg = xmalloc_aligned(sizeof(fsm_registry_t));
+  reg->def            = def;
+
+  for (int i = 0; i < FSM_REGISTRY_STRIPES; i++) {
+    registry_stripe_t *st = &reg->stripes[i];
+    pthread_mutex_init(&st->lock, NULL);
+    st->slots = xcalloc(MIN_SLOTS, sizeof(registry_slot_t));
+    st->mask  = MIN_SLOTS - 1;
+    st->count = 0;
+  }
+
+  return reg;
+}
+
+void
+fsm_registry_free (fsm_registry_t *reg)
+{
+  if (!reg) {
+    return;
+  }
+
+  for (int i = 0; i < FSM_REGISTRY_STRIPES; i++) {
+    registry_stripe_t *st = &reg->stripes[i];
+
+    for (uint64_t k = 0; k <= st->mask; k++) {
+      if (st->slots[k].fsm) {
+        fsm_free(st->slots[k].fsm);
+      }
+    }
+    free(st->slots);
+    pthread_mutex_destroy(&st->lock);
+  }
+
+  free(reg);
+}
+
+uint64_t
+fsm_registry_count (fsm_registry_t *reg)
+{
+  uint64_t count = 0;
+
+  for (int i = 0; i < FSM_REGISTRY_STRIPES; i++) {
+    registry_stripe_t *st = &reg->stripes[i];
+
+    pthread_mutex_lock(&st->lock);
+    count += st->count;
+    pthread_mutex_unlock(&st->lock);
+  }
+
+  return count;
+}
+
+// Gets the instance for `id`, creating it if `create`. Called with the
+// stripe locked.
+static state_machine_t *
+find (
+  fsm_registry_t    *reg,
+  registry_stripe_t *st,
+  uint64_t           hash,
+  uint64_t           id,
+  bool               create
+)
+{
+  registry_slot_t *slot = locate(st, hash, id);
+  if (slot->fsm || !create) {
+    return slot->fsm;
+  }
+
+  if ((st->count + 1) * 4 > (st->mask + 1) * 3) {
+    grow(st);
+    slot = locate(st, hash, id);
+  }
+
+  slot->id  = id;
+  slot->fsm = fsm_instance(reg->def->name, NULL, reg->def);
+  st->count++;
+
+  return slot->fsm;
+}
+
+state_machine_t *
+fsm_registry_get (fsm_registry_t *reg, uint64_t id)
+{
+  uint64_t           hash = mix64(id);
+  registry_stripe_t *st   = stripe_of(reg, hash);
+
+  pthread_mutex_lock(&st->lock);
+  state_machine_t *fsm = find(reg, st, hash, id, false);
+  pthread_mutex_unlock(&st->lock);
+
+  return fsm;
+}
+
+state_machine_t *
+fsm_registry_instance (fsm_registry_t *reg, uint64_t id)
+{
+  uint64_t           hash = mix64(id);
+  registry_stripe_t *st   = stripe_of(reg, hash);
+
+  pthread_mutex_lock(&st->lock);
+  state_machine_t *fsm = find(reg, st, hash, id, true);
+  pthread_mutex_unlock(&st->lock);
+
+  return fsm;
+}
+
+bool
+fsm_registry_remove (fsm_registry_t *reg, uint64_t id)
+{
+  uint64_t           hash = mix64(id);
+  registry_stripe_t *st   = stripe_of(reg, hash);
+
+  pthread_mutex_lock(&st->lock);
+  registry_slot_t *slot = locate(st, hash, id);
+  state_machine_t *fsm  = slot->fsm;
+
+  if (fsm) {
+    // shift later members of the probe run back, so that no lookup stops
+    // short at the hole
+    uint64_t hole = slot - st->slots;
+    uint64_t i    = (hole + 1) & st->mask;
+    while (st->slots[i].fsm) {
+      uint64_t home = mix64(st->slots[i].id) & st->mask;
+      if (((i - home) & st->mask) >= ((i - hole) & st->mask)) {
+        st->slots[hole] = st->slots[i];
+        hole            = i;
+      }
+      i = (i + 1) & st->mask;
+    }
+    st->slots[hole].fsm = NULL;
+    st->count--;
+  }
+  pthread_mutex_unlock(&st->lock);
+
+  if (!fsm) {
+    return false;
+  }
+
+  fsm_free(fsm);
+  return true;
+}
+
+// Dispatches to `id`'s instance, creating it first if it has none
+static state_descriptor_t *
+dispatch (fsm_registry_t *reg, uint64_t hash, uint64_t id, int event_id)
+{
+  registry_stripe_t *st = stripe_of(reg, hash);
+
+  pthread_mutex_lock(&st->lock);
+  state_machine_t *fsm = find(reg, st, hash, id, true);
+  fsm_transition_id(fsm, event_id);
+  state_descriptor_t *state = fsm->state;
+  pthread_mutex_unlock(&st->lock);
+
+  return state;
+}
+
+state_descriptor_t *
+fsm_registry_dispatch_id (fsm_registry_t *reg, uint64_t id, int event_id)
+{
+  if (event_id < 0 || (unsigned int)event_id >= fsm_event_count(reg->def)) {
+    return NULL;
+  }
+
+  return dispatch(reg, mix64(id), id, event_id);
+}
+
+state_descriptor_t *
+fsm_registry_dispatch (fsm_registry_t *reg, uint64_t id, const char *event)
+{
+  return fsm_registry_dispatch_id(reg, id, fsm_event_id(reg->def, event));
+}
+
+void
+fsm_registry_dispatch_n (
+  fsm_registry_t *reg,
+  const uint64_t *ids,
+  const int      *event_ids,
+  size_t          n
+)
+{
+  unsigned int num_events = fsm_event_count(reg->def);
+  uint64_t     hashes[PREFETCH_DISTANCE];
+
+  for (size_t i = 0; i < n && i < PREFETCH_DISTANCE; i++) {
+    hashes[i] = mix64(ids[i]);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    uint64_t hash = hashes[i % PREFETCH_DISTANCE];
+
+    // the slot an ID a few ahead will probe from; a table being grown may
+    // leave this stale, which costs nothing but the prefetch
+    if (i + PREFETCH_DISTANCE < n) {
+      uint64_t           ahead = mix64(ids[i + PREFETCH_DISTANCE]);
+      registry_stripe_t *st    = stripe_of(reg, ahead);
+      registry_slot_t   *slots = __atomic_load_n(&st->slots, __ATOMIC_RELAXED);
+      uint64_t           mask  = __atomic_load_n(&st->mask, __ATOMIC_RELAXED);
+
+      __builtin_prefetch(&slots[ahead & mask]);
+      hashes[i % PREFETCH_DISTANCE] = ahead;
+    }
+
+    int event_id = event_ids[i];
+    if (event_id >= 0 && (unsigned int)event_id < num_events) {
+      dispatch(reg, hash, ids[i], event_id);
+    }
+  }
+}
@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+#define SHARED_MAGIC "FSMSSHM1"
+
+// A `next` entry for an event the state doesn't handle
+#define NO_TARGET    UINT32_MAX
+
+// At the start of the segment. Everything after it is found by offset, so
+// the segment can be mapped anywhere.
+typedef struct {
+  char     magic[8];
+  uint32_t num_states;
+  uint32_t num_events;
+  uint32_t num_instances;
+  uint32_t reserved;
+  uint64_t size;
+  // `num_states * num_events` targets, indexed by state then event
+  uint64_t next;
+  // offsets into `strings` of the state names, then of the event names
+  uint64_t names;
+  uint64_t strings;
+  uint64_t strings_size;
+  // `num_instances` states, on cache lines of their own
+  uint64_t instances;
+} shared_header_t;
+
+struct fsm_shared {
+  int             fd;
+  uint8_t        *base;
+  size_t          size;
+  // copied out of the header, which another process could overwrite
+  uint32_t        num_states;
+  uint32_t        num_events;
+  uint32_t        num_instances;
+  const uint32_t *next;
+  const uint32_t *names;
+  const char     *strings;
+  uint64_t        strings_size;
+  uint32_t       *instances;
+};
+
+// Maps the segment open on `fd`, taking the descriptor over
+static fsm_shared_t *
+map_segment (int fd)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(shared_header_t)) {
+    close(fd);
+    return NULL;
+  }
+
+  size_t size = st.st_size;
+  void  *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+
+  shared_header_t h;
+  memcpy(&h, base, sizeof(h));
+
+  uint64_t table = (uint64_t)h.num_states * h.num_events;
+  uint64_t names = (uint64_t)h.num_states + h.num_events;
+
+  if (memcmp(h.magic, SHARED_MAGIC, sizeof(h.magic)) != 0 || h.size != size
+      || h.next > size || table > (size - h.next) / sizeof(uint32_t)
+      || h.names > size || names > (size - h.names) / sizeof(uint32_t)
+      || h.strings > size || h.strings_size == 0
+      || h.strings_size > size - h.strings
+      || ((uint8_t *)base)[h.strings + h.strings_size - 1] != '\0'
+      || h.instances > size
+      || h.num_instances > (size - h.instances) / sizeof(uint32_t)) {
+    munmap(base, size);
+    close(fd);
+    return NULL;
+  }
+
+  fsm_shared_t *sh  = xmalloc(sizeof(fsm_shared_t));
+  sh->fd            = fd;
+  sh->base          = base;
+  sh->size          = size;
+  sh->num_states    = h.num_states;
+  sh->num_events    = h.num_events;
+  sh->num_instances = h.num_instances;
+  sh->next          = (const uint32_t *)(sh->base + h.next);
+  sh->names         = (const uint32_t *)(sh->base + h.names);
+  sh->strings       = (const char *)sh->base + h.strings;
+  sh->strings_size  = h.strings_size;
+  sh->instances     = (uint32_t *)(sh->base + h.instances);
+
+  return sh;
+}
+
+// Sizes the new segment open on `fd` and lays `def` out in it
+static bool
+init_segment (int fd, const fsm_compiled_t *c, uint32_t initial, uint32_t n)
+{
+  uint32_t num_names = c->num_states + c->num_events;
+  size_t   strings   = 0;
+  for (uint32_t i = 0; i < c->num_states; i++) {
+    strings += strlen(c->states[i]->name) + 1;
+  }
+  for (uint32_t i = 0; i < c->num_events; i++) {
+    strings += c->event_lens[i] + 1;
+  }
+
+  shared_header_t h = {
+    .num_states    = c->num_states,
+    .num_events    = c->num_events,
+    .num_instances = n,
+    .next          = sizeof(shared_header_t)};
+  memcpy(h.magic, SHARED_MAGIC, sizeof(h.magic));
+
+  h.names        = h.next + (uint64_t)c->num_states * c->num_events * 4;
+  h.strings      = h.names + (uint64_t)num_names * 4;
+  h.strings_size = strings;
+  // instances are written from every process; keep the read-mostly tables
+  // off their cache lines
+  h.instances    = (h.strings + strings + 63) & ~(uint64_t)63;
+  h.size         = (h.instances + (uint64_t)n * 4 + 63) & ~(uint64_t)63;
+
+  if (ftruncate(fd, (off_t)h.size) != 0) {
+    return false;
+  }
+
+  uint8_t *base = mmap(NULL, h.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+
+  uint32_t *next = (uint32_t *)(base + h.next);
+  for (uint32_t s = 0; s < c->num_states; s++) {
+    for (uint32_t e = 0; e < c->num_events; e++) {
+      next[(size_t)s * c->num_events + e] = compiled_handles(c, s, e)
+                                            ? compiled_step(c, s, (int)e)
+                                            : NO_TARGET;
+    }
+  }
+
+  uint32_t *names = (uint32_t *)(base + h.names);
+  uint32_t  at    = 0;
+  for (uint32_t i = 0; i < num_names; i++) {
+    const char *name = i < c->num_states ? c->states[i]->name
+                                         : c->events[i - c->num_states];
+    size_t      len  = strlen(name) + 1;
+
+    names[i]         = at;
+    memcpy(base + h.strings + at, name, len);
+    at += len;
+  }
+
+  uint32_t *instances = (uint32_t *)(base + h.instances);
+  for (uint32_t i = 0; i < n; i++) {
+    instances[i] = initial;
+  }
+
+  // the header goes last, so a half-built segment is never taken for one
+  memcpy(base, &h, sizeof(h));
+  munmap(base, h.size);
+
+  return true;
+}
+
+fsm_shared_t *
+fsm_shared_create (
+  const char      *name,
+  state_machine_t *def,
+  uint32_t         num_instances
+)
+{
+  if (!def->state || (!def->compiled && !fsm_finalize(def))
+      || def->compiled->has_callbacks) {
+    return NULL;
+  }
+
+  int fd;
+  if (name) {
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  } else {
+#ifdef __linux__
+    fd = memfd_create("fsms", MFD_CLOEXEC);
+#else
+    fd = -1;
+#endif
+  }
+  if (fd < 0) {
+    return NULL;
+  }
+
+  fsm_compiled_t *c       = def->compiled;
+  uint32_t        initial = compiled_row(c, def->state->id);
+
+  if (!init_segment(fd, c, initial, num_instances)) {
+    if (name) {
+      shm_unlink(name);
+    }
+    close(fd);
+    return NULL;
+  }
+
+  return map_segment(fd);
+}
+
+fsm_shared_t *
+fsm_shared_open (const char *name)
+{
+  int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  return map_segment(fd);
+}
+
+fsm_shared_t *
+fsm_shared_open_fd (int fd)
+{
+  int dup = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dup < 0) {
+    return NULL;
+  }
+
+  return map_segment(dup);
+}
+
+int
+fsm_shared_fd (fsm_shared_t *sh)
+{
+  return sh->fd;
+}
+
+void
+fsm_shared_free (fsm_shared_t *sh)
+{
+  if (!sh) {
+    return;
+  }
+
+  munmap(sh->base, sh->size);
+  close(sh->fd);
+  free(sh);
+}
+
+int
+fsm_shared_event_id (fsm_shared_t *sh, const char *event)
+{
+  for (uint32_t i = 0; i < sh->num_events; i++) {
+    uint32_t at = sh->names[sh->num_states + i];
+    if (at < sh->strings_size && s_equals(sh->strings + at, event)) {
+      return (int)i;
+    }
+  }
+
+  return -1;
+}
+
+const char *
+fsm_shared_state_name (fsm_shared_t *sh, unsigned int state)
+{
+  if (state >= sh->num_states || sh->names[state] >= sh->strings_size) {
+    return NULL;
+  }
+
+  return sh->strings + sh->names[state];
+}
+
+int
+fsm_shared_state (fsm_shared_t *sh, uint32_t instance)
+{
+  if (instance >= sh->num_instances) {
+    return -1;
+  }
+
+  return (int)__atomic_load_n(&sh->instances[instance], __ATOMIC_ACQUIRE);
+}
+
+bool
+fsm_shared_set (fsm_shared_t *sh, uint32_t instance, unsigned int state)
+{
+  if (instance >= sh->num_instances || state >= sh->num_states) {
+    return false;
+  }
+
+  __atomic_store_n(&sh->instances[instance], state, __ATOMIC_RELEASE);
+  return true;
+}
+
+int
+fsm_shared_transition_id (fsm_shared_t *sh, uint32_t instance, int event_id)
+{
+  if (instance >= sh->num_instances || event_id < 0
+      || (unsigned int)event_id >= sh->num_events) {
+    return -1;
+  }
+
+  uint32_t *slot = &sh->instances[instance];
+  uint32_t  s    = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+  for (;;) {
+    // another process may have stored anything here
+    if (s >= sh->num_states) {
+      return -1;
+    }
+
+    uint32_t t = sh->next[(size_t)s * sh->num_events + event_id];
+    if (t == NO_TARGET) {
+      return -1;
+    }
+
+    // on failure `s` is reloaded, and the target recomputed from it
+    if (__atomic_compare_exchange_n(
+          slot,
+          &s,
+          t,
+          true,
+          __ATOMIC_ACQ_REL,
+          __ATOMIC_ACQUIRE
+        )) {
+      return (int)t;
+    }
+  }
+}
+
+int
+fsm_shared_transition (fsm_shared_t *sh, uint32_t instance, const char *event)
+{
+  return fsm_shared_transition_id(sh, instance, fsm_shared_event_id(sh, event));
+}
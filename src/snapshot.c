@@ -0,0 +1,284 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+#define SNAPSHOT_MAGIC   "FSMSSNAP"
+#define SNAPSHOT_VERSION 1
+
+// Bytes gathered before each write
+#ifndef FSM_SNAPSHOT_BUFFER
+#  define FSM_SNAPSHOT_BUFFER (1 << 20)
+#endif
+
+// Followed by each instance's row and context length as varints, then the
+// context, then a CRC32C of everything before it
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t definition;
+  uint64_t count;
+} snapshot_header_t;
+
+typedef struct {
+  int      fd;
+  uint32_t crc;
+  size_t   used;
+  uint8_t *buffer;
+} writer_t;
+
+static bool
+write_all (int fd, const uint8_t *p, size_t n)
+{
+  while (n) {
+    ssize_t w = write(fd, p, n);
+    if (w < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    p += w;
+    n -= w;
+  }
+
+  return true;
+}
+
+static bool
+drain (writer_t *w)
+{
+  w->crc  = fsm_crc32c(w->crc, w->buffer, w->used);
+  bool ok = write_all(w->fd, w->buffer, w->used);
+  w->used = 0;
+
+  return ok;
+}
+
+// Ensures room for `n` more bytes in the buffer
+static bool
+reserve (writer_t *w, size_t n)
+{
+  return w->used + n <= FSM_SNAPSHOT_BUFFER || drain(w);
+}
+
+static bool
+put (writer_t *w, const void *p, size_t n)
+{
+  if (!reserve(w, n)) {
+    return false;
+  }
+
+  // too large to buffer; written in place
+  if (n > FSM_SNAPSHOT_BUFFER) {
+    w->crc = fsm_crc32c(w->crc, p, n);
+    return write_all(w->fd, p, n);
+  }
+
+  memcpy(w->buffer + w->used, p, n);
+  w->used += n;
+
+  return true;
+}
+
+static bool
+write_instances (
+  writer_t         *w,
+  state_machine_t  *def,
+  state_machine_t **instances,
+  size_t            count,
+  size_t (*save)(void *context, void *out, size_t capacity)
+)
+{
+  fsm_compiled_t *c        = def->compiled;
+  size_t          capacity = 64;
+  uint8_t        *ctx      = xmalloc(capacity);
+  bool            ok       = true;
+
+  for (size_t i = 0; ok && i < count; i++) {
+    state_descriptor_t *s = instances[i]->state;
+    if (!s || s->id >= array_size(def->states)
+        || array_get(def->states, s->id) != s) {
+      ok = false;
+      break;
+    }
+
+    size_t len = 0;
+    if (save) {
+      len = save(instances[i]->context, ctx, capacity);
+      if (len > capacity) {
+        capacity = len > 2 * capacity ? len : 2 * capacity;
+        ctx      = xrealloc(ctx, capacity);
+        len      = save(instances[i]->context, ctx, capacity);
+      }
+      // it asked for less room than it then needed; `ctx` holds only part
+      if (len > capacity) {
+        ok = false;
+        break;
+      }
+    }
+
+    // the row and length, as two varints of at most 10 bytes
+    ok = reserve(w, 20);
+    if (ok) {
+      w->used += varint_put(w->buffer + w->used, compiled_row(c, s->id));
+      w->used += varint_put(w->buffer + w->used, len);
+      ok       = !len || put(w, ctx, len);
+    }
+  }
+
+  free(ctx);
+  return ok;
+}
+
+bool
+fsm_snapshot_write (
+  const char       *path,
+  state_machine_t  *def,
+  state_machine_t **instances,
+  size_t            count,
+  size_t (*save)(void *context, void *out, size_t capacity)
+)
+{
+  if (!def->compiled && !fsm_finalize(def)) {
+    return false;
+  }
+
+  size_t len = strlen(path);
+  char  *tmp = xmalloc(len + sizeof(".tmp"));
+  memcpy(tmp, path, len);
+  memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+
+  writer_t w = {
+    .fd     = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644),
+    .buffer = xmalloc(FSM_SNAPSHOT_BUFFER)};
+  if (w.fd < 0) {
+    free(w.buffer);
+    free(tmp);
+    return false;
+  }
+
+  snapshot_header_t h = {
+    .version    = SNAPSHOT_VERSION,
+    .definition = compiled_hash(def->compiled),
+    .count      = count};
+  memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+
+  bool ok = put(&w, &h, sizeof(h))
+         && write_instances(&w, def, instances, count, save) && drain(&w);
+
+  // the CRC covers everything before it
+  uint32_t crc = w.crc;
+  ok = ok && write_all(w.fd, (uint8_t *)&crc, sizeof(crc))
+    && fdatasync(w.fd) == 0;
+  ok = close(w.fd) == 0 && ok && rename(tmp, path) == 0;
+  if (!ok) {
+    unlink(tmp);
+  }
+
+  free(w.buffer);
+  free(tmp);
+
+  return ok;
+}
+
+int64_t
+fsm_snapshot_read (
+  const char      *path,
+  state_machine_t *def,
+  void (*restore)(
+    void               *arg,
+    uint64_t            index,
+    state_descriptor_t *state,
+    const void         *context,
+    size_t              len
+  ),
+  void *arg
+)
+{
+  if (!def->compiled && !fsm_finalize(def)) {
+    return -1;
+  }
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0
+      || (size_t)st.st_size < sizeof(snapshot_header_t) + sizeof(uint32_t)) {
+    close(fd);
+    return -1;
+  }
+
+  // read ahead in bulk, rather than a fault at a time
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+
+  size_t   size = st.st_size;
+  uint8_t *data = mmap(NULL, size, PROT_READ, flags, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+
+  fsm_compiled_t   *c = def->compiled;
+  snapshot_header_t h;
+  uint32_t          crc;
+  memcpy(&h, data, sizeof(h));
+  memcpy(&crc, data + size - sizeof(crc), sizeof(crc));
+
+  const uint8_t *p     = data + sizeof(h);
+  const uint8_t *end   = data + size - sizeof(crc);
+  int64_t        count = -1;
+
+  if (memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0
+      || h.version != SNAPSHOT_VERSION || h.definition != compiled_hash(c)
+      || crc != fsm_crc32c(0, data, size - sizeof(crc))) {
+    goto done;
+  }
+
+  // decode everything before restoring anything, so a bad file restores
+  // nothing
+  for (int pass = 0; pass < 2; pass++) {
+    p = data + sizeof(h);
+
+    for (uint64_t i = 0; i < h.count; i++) {
+      uint64_t row, len;
+      size_t   n, m;
+
+      if (!(n = varint_get(p, end, &row)) || row >= c->num_states
+          || !(m = varint_get(p + n, end, &len))
+          || len > (uint64_t)(end - p - n - m)) {
+        goto done;
+      }
+
+      if (pass && restore) {
+        restore(arg, i, c->states[row], p + n + m, len);
+      }
+      p += n + m + len;
+    }
+
+    if (p != end) {
+      goto done;
+    }
+  }
+
+  count = (int64_t)h.count;
+
+done:
+  munmap(data, size);
+  return count;
+}
@@ -0,0 +1,322 @@
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+#define STORE_MAGIC   "FSMSTORE"
+#define STORE_VERSION 1
+
+// Buckets start a page into the file, so none straddles a page
+#define HEADER_SIZE   4096
+#define BUCKET_SIZE   64
+
+// Slots hold ID + 1, so that 0 marks an empty one
+#define EMPTY_KEY     0
+
+// At the start of the file
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t state_bytes;
+  uint32_t num_states;
+  uint32_t reserved;
+  // hash of the definition's state names, in ID order
+  uint64_t definition;
+  uint64_t num_buckets;
+  uint64_t count;
+} store_header_t;
+
+// A bucket is `slots` keys followed by `slots` states of `state_bytes` each:
+// 7 one-byte or 6 two-byte states to a 64-byte bucket. Full buckets overflow
+// into the next.
+struct fsm_store {
+  state_machine_t *def;
+  int              fd;
+  uint8_t         *map;
+  size_t           size;
+  store_header_t  *header;
+  uint8_t         *buckets;
+  uint64_t         mask;
+  uint32_t         state_bytes;
+  uint32_t         slots;
+  // entities beyond this would leave too few empty slots to end a probe soon
+  uint64_t         max_count;
+};
+
+// Finds the slot holding `key`, or else the empty slot where it would go.
+// Returns whether it was found. A probe visits each bucket at most once; if
+// every one is full, as only a damaged file can be, `*bucket` is NULL.
+static bool
+locate (const fsm_store_t *s, uint64_t key, uint8_t **bucket, uint32_t *slot)
+{
+  uint64_t b = mix64(key) & s->mask;
+
+  for (uint64_t n = 0; n <= s->mask; n++, b = (b + 1) & s->mask) {
+    uint8_t  *base = s->buckets + b * BUCKET_SIZE;
+    uint64_t *keys = (uint64_t *)base;
+
+    for (uint32_t i = 0; i < s->slots; i++) {
+      if (keys[i] == key || keys[i] == EMPTY_KEY) {
+        *bucket = base;
+        *slot   = i;
+        return keys[i] == key;
+      }
+    }
+  }
+
+  *bucket = NULL;
+
+  return false;
+}
+
+// Gets the row stored in a slot. Returns false if it is out of range, as it
+// can be in a damaged file.
+static bool
+load_state (
+  const fsm_store_t    *s,
+  const fsm_compiled_t *c,
+  const uint8_t        *bucket,
+  uint32_t              slot,
+  uint32_t             *row
+)
+{
+  const uint8_t *states = bucket + s->slots * sizeof(uint64_t);
+
+  *row = s->state_bytes == 1 ? states[slot] : ((const uint16_t *)states)[slot];
+
+  return *row < c->num_states;
+}
+
+static void
+store_state (fsm_store_t *s, uint8_t *bucket, uint32_t slot, uint32_t row)
+{
+  uint8_t *states = bucket + s->slots * sizeof(uint64_t);
+
+  if (s->state_bytes == 1) {
+    states[slot] = (uint8_t)row;
+  } else {
+    ((uint16_t *)states)[slot] = (uint16_t)row;
+  }
+}
+
+// Sets up a new, zero-filled file for `capacity` entities
+static bool
+init_file (fsm_store_t *s, const fsm_compiled_t *c, uint64_t capacity)
+{
+  uint32_t state_bytes = c->num_states <= 256 ? 1 : 2;
+  uint32_t slots       = BUCKET_SIZE / (sizeof(uint64_t) + state_bytes);
+
+  // keep the table at most 7/8 full
+  uint64_t needed      = ((capacity * 8 + 6) / 7 + slots - 1) / slots;
+  uint64_t num_buckets = 1;
+  while (num_buckets < needed) {
+    num_buckets <<= 1;
+  }
+
+  // the file stays sparse until buckets are written
+  off_t size = HEADER_SIZE + (off_t)num_buckets * BUCKET_SIZE;
+  if (ftruncate(s->fd, size) != 0) {
+    return false;
+  }
+
+  store_header_t h = {
+    .version     = STORE_VERSION,
+    .state_bytes = state_bytes,
+    .num_states  = c->num_states,
+    .definition  = compiled_hash(c),
+    .num_buckets = num_buckets};
+  memcpy(h.magic, STORE_MAGIC, sizeof(h.magic));
+
+  return pwrite(s->fd, &h, sizeof(h), 0) == sizeof(h);
+}
+
+fsm_store_t *
+fsm_store_open (const char *path, state_machine_t *def, uint64_t capacity)
+{
+  if (!def->compiled && !fsm_finalize(def)) {
+    return NULL;
+  }
+
+  fsm_compiled_t *c = def->compiled;
+  if (c->num_states > UINT16_MAX + 1) {
+    return NULL;
+  }
+
+  fsm_store_t *s = xcalloc(1, sizeof(fsm_store_t));
+  s->def         = def;
+  s->fd          = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+  struct stat st;
+  if (s->fd < 0 || fstat(s->fd, &st) != 0) {
+    goto fail;
+  }
+
+  if (st.st_size == 0) {
+    if (!init_file(s, c, capacity) || fstat(s->fd, &st) != 0) {
+      goto fail;
+    }
+  }
+
+  s->size = st.st_size;
+  if (s->size < HEADER_SIZE) {
+    goto fail;
+  }
+
+  s->map = mmap(NULL, s->size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+  if (s->map == MAP_FAILED) {
+    s->map = NULL;
+    goto fail;
+  }
+  // lookups are scattered; don't read ahead around them
+  madvise(s->map, s->size, MADV_RANDOM);
+
+  store_header_t *h = (store_header_t *)s->map;
+  if (memcmp(h->magic, STORE_MAGIC, sizeof(h->magic)) != 0
+      || h->version != STORE_VERSION || h->num_states != c->num_states
+      || h->definition != compiled_hash(c)
+      || h->state_bytes != (c->num_states <= 256 ? 1u : 2u)
+      || h->num_buckets == 0 || (h->num_buckets & (h->num_buckets - 1))
+      || h->num_buckets > (s->size - HEADER_SIZE) / BUCKET_SIZE) {
+    goto fail;
+  }
+
+  s->header      = h;
+  s->buckets     = s->map + HEADER_SIZE;
+  s->mask        = h->num_buckets - 1;
+  s->state_bytes = h->state_bytes;
+  s->slots       = BUCKET_SIZE / (sizeof(uint64_t) + h->state_bytes);
+  s->max_count   = h->num_buckets * s->slots * 7 / 8;
+
+  if (h->count > s->max_count) {
+    goto fail;
+  }
+
+  return s;
+
+fail:
+  if (s->map) {
+    munmap(s->map, s->size);
+  }
+  if (s->fd >= 0) {
+    close(s->fd);
+  }
+  free(s);
+
+  return NULL;
+}
+
+void
+fsm_store_close (fsm_store_t *s)
+{
+  if (!s) {
+    return;
+  }
+
+  munmap(s->map, s->size);
+  close(s->fd);
+  free(s);
+}
+
+bool
+fsm_store_set (fsm_store_t *s, uint64_t id, state_descriptor_t *state)
+{
+  state_machine_t *def = s->def;
+  fsm_compiled_t  *c   = def->compiled;
+
+  if (id == UINT64_MAX || !state || !c || state->id >= array_size(def->states)
+      || array_get(def->states, state->id) != state) {
+    return false;
+  }
+
+  // minimized definitions dispatch from the state's class
+  uint32_t row = compiled_row(c, state->id);
+
+  uint8_t *bucket;
+  uint32_t slot;
+  if (!locate(s, id + 1, &bucket, &slot)) {
+    if (!bucket || s->header->count >= s->max_count) {
+      return false;
+    }
+    ((uint64_t *)bucket)[slot] = id + 1;
+    s->header->count++;
+  }
+  store_state(s, bucket, slot, row);
+
+  return true;
+}
+
+state_descriptor_t *
+fsm_store_get (fsm_store_t *s, uint64_t id)
+{
+  fsm_compiled_t *c = s->def->compiled;
+  uint8_t        *bucket;
+  uint32_t        slot;
+  uint32_t        row;
+
+  if (id == UINT64_MAX || !c || !locate(s, id + 1, &bucket, &slot)
+      || !load_state(s, c, bucket, slot, &row)) {
+    return NULL;
+  }
+
+  return c->states[row];
+}
+
+bool
+fsm_store_transition_id (fsm_store_t *s, uint64_t id, int event_id)
+{
+  state_machine_t *def = s->def;
+  fsm_compiled_t  *c   = def->compiled;
+  uint8_t         *bucket;
+  uint32_t         slot;
+  uint32_t         row;
+
+  if (id == UINT64_MAX || !c || !locate(s, id + 1, &bucket, &slot)
+      || !load_state(s, c, bucket, slot, &row)) {
+    return false;
+  }
+
+  uint32_t next;
+
+  if (!c->has_callbacks
+      && (!def->subscribers || !array_size(def->subscribers))) {
+    next = compiled_step(c, row, event_id);
+  } else {
+    // run the definition from the entity's state, so guards, actions and
+    // subscribers see exactly what `fsm_transition_id` would do
+    state_descriptor_t *saved = def->state;
+    def->state                = c->states[row];
+    fsm_transition_id(def, event_id);
+    next       = def->state->id;
+    def->state = saved;
+  }
+
+  if (next != row) {
+    store_state(s, bucket, slot, next);
+  }
+
+  return true;
+}
+
+bool
+fsm_store_transition (fsm_store_t *s, uint64_t id, const char *event)
+{
+  return fsm_store_transition_id(s, id, fsm_event_id(s->def, event));
+}
+
+uint64_t
+fsm_store_count (fsm_store_t *s)
+{
+  return s->header->count;
+}
+
+bool
+fsm_store_sync (fsm_store_t *s)
+{
+  return msync(s->map, s->size, MS_SYNC) == 0 && fdatasync(s->fd) == 0;
+}
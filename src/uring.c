@@ -0,0 +1,347 @@
+#define _GNU_SOURCE
+
+#include "fsms_internal.h"
+#include "libfsms.h"
+
+#ifdef __linux__
+
+#  include <errno.h>
+#  include <linux/io_uring.h>
+#  include <string.h>
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+
+// Who an operation's completion goes to. Its index is the SQE's user_data.
+typedef struct {
+  state_machine_t *fsm;
+  int              event_id;
+  int             *result;
+} uring_tag_t;
+
+struct fsm_uring {
+  int                  fd;
+  // the kernel's rings, mapped into our address space. With
+  // IORING_FEAT_SINGLE_MMAP both live in `sq_ring`.
+  void                *sq_ring;
+  size_t               sq_ring_size;
+  void                *cq_ring;
+  size_t               cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t               sqes_size;
+  unsigned int        *sq_head;
+  unsigned int        *sq_tail;
+  unsigned int        *sq_array;
+  unsigned int         sq_mask;
+  unsigned int         sq_entries;
+  unsigned int        *cq_head;
+  unsigned int        *cq_tail;
+  struct io_uring_cqe *cqes;
+  unsigned int         cq_mask;
+  // SQEs published to the ring but not yet passed to io_uring_enter
+  unsigned int         to_submit;
+  // one tag per CQE slot, so the completion queue can never overflow; free
+  // tags are kept on a stack
+  uring_tag_t         *tags;
+  uint32_t            *free_tags;
+  unsigned int         num_tags;
+  unsigned int         num_free;
+};
+
+static int
+uring_enter (
+  int          fd,
+  unsigned int to_submit,
+  unsigned int min_complete,
+  unsigned int flags
+)
+{
+  return (int)syscall(
+    __NR_io_uring_enter,
+    fd,
+    to_submit,
+    min_complete,
+    flags,
+    NULL,
+    0
+  );
+}
+
+// Passes published SQEs to the kernel, waiting for `wait_for` completions.
+// Returns false on failure.
+static bool
+submit (fsm_uring_t *r, unsigned int wait_for)
+{
+  // the kernel waits only once it has taken every SQE, so the wait stays due
+  // until then; what it took before a failure stays taken
+  while (r->to_submit || wait_for) {
+    int n = uring_enter(
+      r->fd,
+      r->to_submit,
+      wait_for,
+      wait_for ? IORING_ENTER_GETEVENTS : 0
+    );
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    r->to_submit -= n;
+    if (!r->to_submit) {
+      break;
+    }
+  }
+
+  return true;
+}
+
+fsm_uring_t *
+fsm_uring_create (unsigned int entries)
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  fsm_uring_t *r  = xcalloc(1, sizeof(fsm_uring_t));
+  r->fd           = fd;
+  r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  r->sqes_size    = p.sq_entries * sizeof(struct io_uring_sqe);
+
+  bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single && r->cq_ring_size > r->sq_ring_size) {
+    r->sq_ring_size = r->cq_ring_size;
+  }
+
+  int prot  = PROT_READ | PROT_WRITE;
+  int flags = MAP_SHARED | MAP_POPULATE;
+
+  r->sq_ring = mmap(NULL, r->sq_ring_size, prot, flags, fd, IORING_OFF_SQ_RING);
+  r->cq_ring = single ? r->sq_ring
+                      : mmap(
+                          NULL,
+                          r->cq_ring_size,
+                          prot,
+                          flags,
+                          fd,
+                          IORING_OFF_CQ_RING
+                        );
+  r->sqes    = mmap(NULL, r->sqes_size, prot, flags, fd, IORING_OFF_SQES);
+
+  if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED
+      || r->sqes == MAP_FAILED) {
+    if (r->sq_ring != MAP_FAILED) {
+      munmap(r->sq_ring, r->sq_ring_size);
+    }
+    if (!single && r->cq_ring != MAP_FAILED) {
+      munmap(r->cq_ring, r->cq_ring_size);
+    }
+    if (r->sqes != MAP_FAILED) {
+      munmap(r->sqes, r->sqes_size);
+    }
+    close(fd);
+    free(r);
+    return NULL;
+  }
+
+  char *sq      = r->sq_ring;
+  char *cq      = r->cq_ring;
+  r->sq_head    = (unsigned int *)(sq + p.sq_off.head);
+  r->sq_tail    = (unsigned int *)(sq + p.sq_off.tail);
+  r->sq_array   = (unsigned int *)(sq + p.sq_off.array);
+  r->sq_mask    = *(unsigned int *)(sq + p.sq_off.ring_mask);
+  r->sq_entries = p.sq_entries;
+  r->cq_head    = (unsigned int *)(cq + p.cq_off.head);
+  r->cq_tail    = (unsigned int *)(cq + p.cq_off.tail);
+  r->cqes       = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  r->cq_mask    = *(unsigned int *)(cq + p.cq_off.ring_mask);
+
+  r->num_tags   = p.cq_entries;
+  r->num_free   = p.cq_entries;
+  r->tags       = xmalloc(p.cq_entries * sizeof(uring_tag_t));
+  r->free_tags  = xmalloc(p.cq_entries * sizeof(uint32_t));
+  for (uint32_t i = 0; i < p.cq_entries; i++) {
+    r->free_tags[i] = p.cq_entries - 1 - i;
+  }
+
+  return r;
+}
+
+void
+fsm_uring_free (fsm_uring_t *r)
+{
+  if (!r) {
+    return;
+  }
+
+  munmap(r->sqes, r->sqes_size);
+  if (r->cq_ring != r->sq_ring) {
+    munmap(r->cq_ring, r->cq_ring_size);
+  }
+  munmap(r->sq_ring, r->sq_ring_size);
+  close(r->fd);
+
+  free(r->tags);
+  free(r->free_tags);
+  free(r);
+}
+
+bool
+fsm_uring_queue (
+  fsm_uring_t          *r,
+  state_machine_t      *fsm,
+  int                   event_id,
+  int                  *result,
+  const fsm_uring_io_t *io
+)
+{
+  if (!r->num_free) {
+    return false;
+  }
+
+  // only we advance the tail; the kernel advances the head as it consumes
+  unsigned int tail = *r->sq_tail;
+  if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) == r->sq_entries) {
+    if (!submit(r, 0)) {
+      return false;
+    }
+  }
+
+  uint32_t tag = r->free_tags[--r->num_free];
+  r->tags[tag] = (uring_tag_t){
+    .fsm      = fsm,
+    .event_id = event_id,
+    .result   = result};
+
+  unsigned int         slot = tail & r->sq_mask;
+  struct io_uring_sqe *sqe  = &r->sqes[slot];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->fd        = io->fd;
+  sqe->user_data = tag;
+
+  switch (io->op) {
+    case FSM_URING_READ:
+    case FSM_URING_WRITE:
+      sqe->opcode = io->op == FSM_URING_READ ? IORING_OP_READ : IORING_OP_WRITE;
+      sqe->addr   = (uintptr_t)io->buf;
+      sqe->len    = io->len;
+      sqe->off    = (uint64_t)io->offset;
+      break;
+    case FSM_URING_RECV:
+    case FSM_URING_SEND:
+      sqe->opcode = io->op == FSM_URING_RECV ? IORING_OP_RECV : IORING_OP_SEND;
+      sqe->addr   = (uintptr_t)io->buf;
+      sqe->len    = io->len;
+      break;
+    case FSM_URING_ACCEPT:
+      sqe->opcode = IORING_OP_ACCEPT;
+      break;
+  }
+
+  r->sq_array[slot] = slot;
+  __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  r->to_submit++;
+
+  return true;
+}
+
+int
+fsm_uring_run (fsm_uring_t *r, unsigned int wait_for)
+{
+  unsigned int in_flight = r->num_tags - r->num_free;
+  if (wait_for > in_flight) {
+    wait_for = in_flight;
+  }
+
+  if ((r->to_submit || wait_for) && !submit(r, wait_for)) {
+    return -1;
+  }
+
+  unsigned int head = *r->cq_head;
+  unsigned int tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+  int          sent = 0;
+
+  for (; head != tail; head++) {
+    struct io_uring_cqe *cqe = &r->cqes[head & r->cq_mask];
+    uring_tag_t          t   = r->tags[cqe->user_data];
+    int                  res = cqe->res;
+
+    r->free_tags[r->num_free++] = (uint32_t)cqe->user_data;
+    // release the slot before the event runs, in case its actions queue more
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    if (t.result) {
+      *t.result = res;
+    }
+    fsm_transition_id(t.fsm, t.event_id);
+    sent++;
+  }
+
+  return sent;
+}
+
+unsigned int
+fsm_uring_in_flight (fsm_uring_t *r)
+{
+  return r->num_tags - r->num_free;
+}
+
+#else
+
+fsm_uring_t *
+fsm_uring_create (unsigned int entries)
+{
+  (void)entries;
+
+  return NULL;
+}
+
+void
+fsm_uring_free (fsm_uring_t *r)
+{
+  (void)r;
+}
+
+bool
+fsm_uring_queue (
+  fsm_uring_t          *r,
+  state_machine_t      *fsm,
+  int                   event_id,
+  int                  *result,
+  const fsm_uring_io_t *io
+)
+{
+  (void)r;
+  (void)fsm;
+  (void)event_id;
+  (void)result;
+  (void)io;
+
+  return false;
+}
+
+int
+fsm_uring_run (fsm_uring_t *r, unsigned int wait_for)
+{
+  (void)r;
+  (void)wait_for;
+
+  return -1;
+}
+
+unsigned int
+fsm_uring_in_flight (fsm_uring_t *r)
+{
+  (void)r;
+
+  return 0;
+}
+
+#endif
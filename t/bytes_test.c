@@ -0,0 +1,204 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tests.h"
+
+static bool
+always (void* ctx)
+{
+  return true;
+}
+
+static void
+add_byte (
+  state_machine_t*    fsm,
+  state_descriptor_t* source,
+  int                 byte,
+  state_descriptor_t* target
+)
+{
+  char name[2] = {(char)byte, '\0'};
+  fsm_transition_register(
+    fsm,
+    source,
+    fsm_transition_create(name, target, NULL, NULL)
+  );
+}
+
+// Recognizes a double-quoted string with backslash escapes, after any number
+// of spaces
+static state_machine_t*
+create_string_lexer (void)
+{
+  state_machine_t*    fsm = fsm_create("lexer", NULL);
+  state_descriptor_t* start
+    = fsm_state_register(fsm, fsm_state_create("start"));
+  state_descriptor_t* string
+    = fsm_state_register(fsm, fsm_state_create("string"));
+  state_descriptor_t* escape
+    = fsm_state_register(fsm, fsm_state_create("escape"));
+  state_descriptor_t* done = fsm_state_register(fsm, fsm_state_create("done"));
+  done->accepting          = true;
+
+  add_byte(fsm, start, ' ', start);
+  add_byte(fsm, start, '"', string);
+  for (int b = 1; b < 256; b++) {
+    add_byte(
+      fsm,
+      string,
+      b,
+      b == '"' ? done : b == '\\' ? escape : string
+    );
+    add_byte(fsm, escape, b, string);
+  }
+
+  // not a byte transition
+  fsm_transition_register(
+    fsm,
+    start,
+    fsm_transition_create("reset", start, NULL, NULL)
+  );
+
+  fsm_set_initial_state(fsm, start);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+void
+fsm_run_bytes_test ()
+{
+  state_machine_t* fsm   = create_string_lexer();
+  const char*      input = "  \"say \\\"hi\\\"\" and more";
+
+  cmp_ok(
+    fsm_run_bytes(fsm, input, strlen(input)),
+    "==",
+    14,
+    "stops after the byte that reaches an accepting state"
+  );
+  is(fsm_get_state_name(fsm), "done", "is left in the accepting state");
+
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "start"));
+  cmp_ok(fsm_run_bytes(fsm, " x", 2), "==", 1, "stops on an unhandled byte");
+  is(fsm_get_state_name(fsm), "start", "is left before the unhandled byte");
+
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "start"));
+  cmp_ok(fsm_run_bytes(fsm, " \"ab", 4), "==", 4, "consumes a partial match");
+  is(fsm_get_state_name(fsm), "string", "is left mid-match");
+  cmp_ok(fsm_run_bytes(fsm, "c\"", 2), "==", 2, "resumes where it stopped");
+  is(fsm_get_state_name(fsm), "done", "completes the match");
+
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "start"));
+  cmp_ok(fsm_run_bytes(fsm, "r", 1), "==", 0, "ignores longer event names");
+
+  // long enough for the looping state to be skipped a vector at a time
+  size_t len        = 1000;
+  char*  long_input = malloc(len);
+  memset(long_input, 'a', len);
+  long_input[0]       = '"';
+  long_input[500]     = '\\';
+  long_input[len - 2] = '"';
+
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "start"));
+  cmp_ok(
+    fsm_run_bytes(fsm, long_input, len),
+    "==",
+    len - 1,
+    "skips runs of looping bytes"
+  );
+  is(fsm_get_state_name(fsm), "done", "skips to the accepting byte");
+
+  long_input[len - 2] = '\0';
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "start"));
+  cmp_ok(
+    fsm_run_bytes(fsm, long_input, len),
+    "==",
+    len - 2,
+    "stops a skip on the NUL byte"
+  );
+
+  free(long_input);
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_run_bytes_rejects_test ()
+{
+  state_machine_t*    fsm = fsm_create("guarded", NULL);
+  state_descriptor_t* s   = fsm_state_register(fsm, fsm_state_create("s"));
+  fsm_transition_register(fsm, s, fsm_transition_create("a", s, always, NULL));
+  fsm_set_initial_state(fsm, s);
+
+  cmp_ok(fsm_run_bytes(fsm, "aaa", 3), "==", 0, "requires a finalized machine");
+  fsm_finalize(fsm);
+  cmp_ok(fsm_run_bytes(fsm, "aaa", 3), "==", 0, "refuses guarded bytes");
+
+  fsm_inline_free(fsm);
+}
+
+static void*
+lex (void* arg)
+{
+  state_machine_t* fsm = arg;
+
+  return (void*)fsm_run_bytes(fsm, " \"abc\"", 6);
+}
+
+void
+fsm_run_bytes_concurrent_test ()
+{
+  state_machine_t* def = create_string_lexer();
+  state_machine_t* instances[4];
+  pthread_t        threads[4];
+
+  // the first runs on each instance race to build the shared byte table
+  for (int i = 0; i < 4; i++) {
+    instances[i] = fsm_instance("lexer", NULL, def);
+    pthread_create(&threads[i], NULL, lex, instances[i]);
+  }
+
+  bool consumed = true;
+  for (int i = 0; i < 4; i++) {
+    void* n;
+    pthread_join(threads[i], &n);
+    consumed &= (size_t)n == 6;
+    consumed &= fsm_get_state(def, "done") == instances[i]->state;
+    fsm_free(instances[i]);
+  }
+  ok(consumed, "runs instances sharing a definition concurrently");
+
+  fsm_inline_free(def);
+}
+
+void
+fsm_minimize_accepting_test ()
+{
+  state_machine_t* fsm = fsm_inline(
+    "accepting",
+    "start",
+    fsm_inline_states({"start", "a", "b"}),
+    &(inline_transition_t){.name = "x", .source = "start", .target = "a"},
+    &(inline_transition_t){.name = "y", .source = "start", .target = "b"}
+  );
+  fsm_get_state(fsm, "b")->accepting = true;
+
+  fsm_finalize(fsm);
+  fsm_minimize(fsm);
+  ok(
+    fsm_get_state(fsm, "a") != fsm_get_state(fsm, "b"),
+    "does not merge accepting states with others"
+  );
+
+  fsm_inline_free(fsm);
+}
+
+void
+run_bytes_tests (void)
+{
+  fsm_run_bytes_test();
+  fsm_run_bytes_rejects_test();
+  fsm_run_bytes_concurrent_test();
+  fsm_minimize_accepting_test();
+}
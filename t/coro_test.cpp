@@ -0,0 +1,138 @@
+#include <coroutine>
+#include <stdexcept>
+#include <vector>
+
+#include "libfsms_coro.hpp"
+#include "tests.h"
+
+// Suspends until the test resumes it, standing in for I/O
+static std::vector<std::coroutine_handle<>> parked;
+
+struct io {
+  bool
+  await_ready () const noexcept
+  {
+    return false;
+  }
+
+  void
+  await_suspend (std::coroutine_handle<> h)
+  {
+    parked.push_back(h);
+  }
+
+  void
+  await_resume () const noexcept
+  {
+  }
+};
+
+static void
+resume_all ()
+{
+  std::vector<std::coroutine_handle<>> ready;
+  ready.swap(parked);
+  for (std::coroutine_handle<> h : ready) {
+    h.resume();
+  }
+}
+
+static state_machine_t*
+create_ping ()
+{
+  state_machine_t*    fsm = fsm_create("ping", NULL);
+  state_descriptor_t* a   = fsm_state_register(fsm, fsm_state_create("a"));
+  state_descriptor_t* b   = fsm_state_register(fsm, fsm_state_create("b"));
+
+  fsm_transition_register(fsm, a, fsm_transition_create("ping", b, NULL, NULL));
+  fsm_transition_register(fsm, b, fsm_transition_create("pong", a, NULL, NULL));
+  fsm_set_initial_state(fsm, a);
+
+  return fsm;
+}
+
+void
+coro_queue_test ()
+{
+  state_machine_t*    fsm = create_ping();
+  fsms::async_machine m(fsm, fsms::policy::queue);
+  int                 ping = fsm_event_id(fsm, "ping");
+  int                 pong = fsm_event_id(fsm, "pong");
+
+  m.on("a", "ping", [](void*) -> fsms::task { co_await io{}; });
+
+  ok(m.dispatch(ping), "starts an asynchronous action");
+  ok(m.transitioning(), "is transitioning while it is suspended");
+  is(fsm_get_state_name(fsm), "a", "stays in the source state meanwhile");
+
+  ok(m.dispatch(pong), "accepts an event sent meanwhile");
+  cmp_ok(m.queued(), "==", 1, "queues it");
+
+  resume_all();
+  ok(!m.transitioning(), "completes once the action finishes");
+  is(fsm_get_state_name(fsm), "a", "commits, then runs the queued event");
+  cmp_ok(m.queued(), "==", 0, "empties the queue");
+
+  fsm_free(fsm);
+}
+
+void
+coro_reject_test ()
+{
+  state_machine_t*    fsm = create_ping();
+  fsms::async_machine m(fsm, fsms::policy::reject);
+
+  m.on("a", "ping", [](void*) -> fsms::task { co_await io{}; });
+
+  m.dispatch(fsm_event_id(fsm, "ping"));
+  ok(!m.dispatch(fsm_event_id(fsm, "pong")), "rejects an event sent meanwhile");
+  cmp_ok(m.queued(), "==", 0, "without queueing it");
+
+  resume_all();
+  is(fsm_get_state_name(fsm), "b", "completes the transition alone");
+
+  fsm_free(fsm);
+}
+
+void
+coro_throw_test ()
+{
+  state_machine_t*    fsm = create_ping();
+  fsms::async_machine m(fsm);
+  int                 ping = fsm_event_id(fsm, "ping");
+
+  m.on("a", "ping", [](void*) -> fsms::task {
+    co_await io{};
+    throw std::runtime_error("unreachable");
+  });
+
+  m.dispatch(ping);
+  m.dispatch(fsm_event_id(fsm, "pong"));
+  resume_all();
+
+  ok(!m.transitioning(), "ends a transition whose action throws");
+  is(fsm_get_state_name(fsm), "a", "leaves the machine in the source state");
+
+  std::exception_ptr e = m.error();
+  bool               rethrown = false;
+  try {
+    std::rethrow_exception(e);
+  } catch (const std::runtime_error& err) {
+    rethrown = s_equals(err.what(), "unreachable");
+  }
+  ok(rethrown, "keeps the exception");
+  ok(!m.error(), "clears it once taken");
+  cmp_ok(m.queued(), "==", 0, "drops queued events the state doesn't handle");
+
+  ok(m.dispatch(ping), "can try the transition again");
+
+  fsm_free(fsm);
+}
+
+void
+run_coro_tests (void)
+{
+  coro_queue_test();
+  coro_reject_test();
+  coro_throw_test();
+}
@@ -0,0 +1,276 @@
+#include "tests.h"
+
+static const char* SWITCH_EVENT = "switch";
+static const char* BREAK_EVENT  = "break";
+static const char* FIX_EVENT    = "fix";
+
+static const char* ON_STATE     = "on";
+static const char* OFF_STATE    = "off";
+static const char* BROKEN_STATE = "broken";
+
+static state_machine_t*
+create_switch (void)
+{
+  state_machine_t* fsm = fsm_inline(
+    "switch",
+    OFF_STATE,
+    fsm_inline_states({OFF_STATE, ON_STATE, BROKEN_STATE}),
+    &(inline_transition_t){
+      .name   = SWITCH_EVENT,
+      .source = OFF_STATE,
+      .target = ON_STATE},
+    &(inline_transition_t){
+      .name   = SWITCH_EVENT,
+      .source = ON_STATE,
+      .target = OFF_STATE},
+    &(inline_transition_t){
+      .name   = BREAK_EVENT,
+      .source = ON_STATE,
+      .target = BROKEN_STATE},
+    &(inline_transition_t){
+      .name   = FIX_EVENT,
+      .source = BROKEN_STATE,
+      .target = OFF_STATE}
+  );
+
+  return fsm;
+}
+
+void
+fsm_event_id_test ()
+{
+  state_machine_t* fsm = create_switch();
+
+  cmp_ok(fsm_event_count(fsm), "==", 3, "assigns an ID to each distinct event");
+  cmp_ok(fsm_event_id(fsm, SWITCH_EVENT), "==", 0, "assigns IDs in order");
+  cmp_ok(fsm_event_id(fsm, BREAK_EVENT), "==", 1, "assigns IDs in order");
+  cmp_ok(fsm_event_id(fsm, FIX_EVENT), "==", 2, "assigns IDs in order");
+  cmp_ok(fsm_event_id(fsm, "explode"), "==", -1, "unknown events have no ID");
+
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_can_handle_test ()
+{
+  state_machine_t* fsm = create_switch();
+
+  int switch_id        = fsm_event_id(fsm, SWITCH_EVENT);
+  int break_id         = fsm_event_id(fsm, BREAK_EVENT);
+  int fix_id           = fsm_event_id(fsm, FIX_EVENT);
+
+  ok(fsm_can_handle(fsm, switch_id), "off handles switch");
+  ok(!fsm_can_handle(fsm, break_id), "off does not handle break");
+  ok(!fsm_can_handle(fsm, -1), "rejects an unknown event");
+  ok(!fsm_can_handle(fsm, 64), "rejects an out-of-range event");
+
+  fsm_transition(fsm, SWITCH_EVENT);
+  ok(fsm_can_handle(fsm, break_id), "on handles break");
+
+  uint64_t mask[FSM_EVENT_MASK_WORDS(3)] = {0};
+  cmp_ok(fsm_enabled_events(fsm, mask), "==", 1, "writes one mask word");
+  cmp_ok(
+    mask[0],
+    "==",
+    (1 << switch_id) | (1 << break_id),
+    "on enables switch and break"
+  );
+
+  fsm_transition(fsm, BREAK_EVENT);
+  fsm_enabled_events(fsm, mask);
+  cmp_ok(mask[0], "==", 1 << fix_id, "broken enables only fix");
+
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_finalize_invalidation_test ()
+{
+  state_machine_t*    fsm = fsm_create("test", NULL);
+  state_descriptor_t* off_s
+    = fsm_state_register(fsm, fsm_state_create(OFF_STATE));
+
+  ok(!fsm_can_handle(fsm, 0), "an unfinalized machine handles nothing");
+
+  fsm_set_initial_state(fsm, off_s);
+  transition_t* t = fsm_transition_register(
+    fsm,
+    off_s,
+    fsm_transition_create(SWITCH_EVENT, off_s, NULL, NULL)
+  );
+
+  ok(fsm_finalize(fsm), "finalizes a machine with states");
+  ok(fsm_can_handle(fsm, 0), "finalized machine handles its event");
+
+  state_descriptor_t* on_s
+    = fsm_state_register(fsm, fsm_state_create(ON_STATE));
+  cmp_ok(
+    fsm_event_id(fsm, SWITCH_EVENT),
+    "==",
+    -1,
+    "registering a state discards the finalized tables"
+  );
+
+  fsm_state_free(on_s);
+  fsm_state_free(off_s);
+  fsm_transition_free(t);
+  fsm_free(fsm);
+}
+
+void
+fsm_transition_id_test ()
+{
+  state_machine_t* fsm = create_switch();
+
+  fsm_transition_id(fsm, fsm_event_id(fsm, BREAK_EVENT));
+  is(fsm_get_state_name(fsm), OFF_STATE, "ignores an unhandled event ID");
+
+  fsm_transition_id(fsm, fsm_event_id(fsm, SWITCH_EVENT));
+  is(fsm_get_state_name(fsm), ON_STATE, "transitions by event ID");
+
+  fsm_transition_id(fsm, fsm_event_id(fsm, BREAK_EVENT));
+  is(fsm_get_state_name(fsm), BROKEN_STATE, "transitions by event ID");
+
+  fsm_transition(fsm, FIX_EVENT);
+  is(fsm_get_state_name(fsm), OFF_STATE, "transitions by name when finalized");
+
+  fsm_inline_free(fsm);
+}
+
+static bool allow;
+static int  actions;
+static int  notifications;
+
+static bool
+allowed (void* ctx)
+{
+  return allow;
+}
+
+static void
+count_action (void* ctx)
+{
+  actions++;
+}
+
+static void*
+count_notification (void* arg)
+{
+  notifications++;
+  return NULL;
+}
+
+void
+fsm_transition_lookup_test ()
+{
+  state_machine_t* fsm = fsm_inline(
+    "lookup",
+    OFF_STATE,
+    fsm_inline_states({OFF_STATE, ON_STATE}),
+    &(inline_transition_t){
+      .name   = SWITCH_EVENT,
+      .source = OFF_STATE,
+      .target = ON_STATE,
+      .guard  = allowed,
+      .action = count_action}
+  );
+  fsm_subscribe(fsm, count_notification);
+
+  int           id = fsm_event_id(fsm, SWITCH_EVENT);
+  fsm_pending_t p;
+
+  ok(!fsm_transition_lookup(fsm, id + 1, &p), "resolves no unknown event");
+  ok(!fsm_transition_lookup(fsm, id, &p), "resolves nothing if guards fail");
+
+  allow = true;
+  ok(fsm_transition_lookup(fsm, id, &p), "resolves a transition");
+  is(p.target->name, ON_STATE, "resolves the target");
+  is(p.event, SWITCH_EVENT, "resolves the event name");
+  is(fsm_get_state_name(fsm), OFF_STATE, "does not take the transition");
+  ok(actions == 0 && notifications == 0, "runs nothing but the guard");
+
+  fsm_transition_commit(fsm, &p);
+  is(fsm_get_state_name(fsm), ON_STATE, "commits the transition");
+  ok(actions == 1 && notifications == 1, "runs actions and subscribers");
+  ok(!fsm_transition_lookup(fsm, id, &p), "resolves from the new state");
+
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_finalize_unregistered_target_test ()
+{
+  state_machine_t*    fsm = fsm_create("test", NULL);
+  state_descriptor_t* off_s
+    = fsm_state_register(fsm, fsm_state_create(OFF_STATE));
+  state_descriptor_t* on_s = fsm_state_create(ON_STATE);
+
+  transition_t* t          = fsm_transition_register(
+    fsm,
+    off_s,
+    fsm_transition_create(SWITCH_EVENT, on_s, NULL, NULL)
+  );
+
+  ok(!fsm_finalize(fsm), "refuses a transition to an unregistered state");
+  ok(fsm->compiled == NULL, "leaves the machine unfinalized");
+
+  fsm_state_free(on_s);
+  fsm_state_free(off_s);
+  fsm_transition_free(t);
+  fsm_free(fsm);
+}
+
+void
+fsm_transition_n_test ()
+{
+  // a buffer as it might arrive off the wire, with no terminators
+  const char buf[]          = {'<', 's', 'w', 'i', 't', 'c', 'h', 'b', 'r',
+                               'e', 'a', 'k', 'f', 'i', 'x', '>'};
+
+  state_machine_t* fsm      = create_switch();
+
+  cmp_ok(fsm_event_id_n(fsm, buf + 1, 6), "==", 0, "resolves a sliced event");
+  cmp_ok(fsm_event_id_n(fsm, buf + 1, 5), "==", -1, "respects the length");
+
+  fsm_transition_n(fsm, buf + 1, 6);
+  is(fsm_get_state_name(fsm), ON_STATE, "transitions on a sliced event");
+  fsm_transition_n(fsm, buf + 7, 5);
+  is(fsm_get_state_name(fsm), BROKEN_STATE, "transitions on a sliced event");
+
+  fsm_inline_free(fsm);
+
+  // the same through a machine that was never finalized
+  state_machine_t*    raw = fsm_create("raw", NULL);
+  state_descriptor_t* off_s
+    = fsm_state_register(raw, fsm_state_create(OFF_STATE));
+  state_descriptor_t* on_s
+    = fsm_state_register(raw, fsm_state_create(ON_STATE));
+  transition_t* t = fsm_transition_register(
+    raw,
+    off_s,
+    fsm_transition_create(SWITCH_EVENT, on_s, NULL, NULL)
+  );
+  fsm_set_initial_state(raw, off_s);
+
+  fsm_transition_n(raw, buf + 1, 5);
+  is(fsm_get_state_name(raw), OFF_STATE, "ignores a truncated event");
+  fsm_transition_n(raw, buf + 1, 6);
+  is(fsm_get_state_name(raw), ON_STATE, "transitions when unfinalized");
+
+  fsm_state_free(on_s);
+  fsm_state_free(off_s);
+  fsm_transition_free(t);
+  fsm_free(raw);
+}
+
+void
+run_finalize_tests (void)
+{
+  fsm_event_id_test();
+  fsm_can_handle_test();
+  fsm_finalize_invalidation_test();
+  fsm_transition_id_test();
+  fsm_transition_lookup_test();
+  fsm_finalize_unregistered_target_test();
+  fsm_transition_n_test();
+}
@@ -0,0 +1,143 @@
+#include <array>
+#include <cstring>
+
+#include "libfsms.hpp"
+#include "tests.h"
+
+enum class door { closed, open, locked };
+enum class ev { open, close, lock, unlock };
+
+struct ctx_t {
+  bool has_key;
+  int  opened;
+};
+
+struct has_key {
+  bool
+  operator() (ctx_t& ctx) const
+  {
+    return ctx.has_key;
+  }
+};
+
+static void
+on_open (ctx_t& ctx)
+{
+  ctx.opened++;
+}
+
+using door_machine = fsms::machine<
+  ctx_t,
+  fsms::transition<door::closed, ev::open, door::open, fsms::always,
+                   fsms::fn<on_open>>,
+  fsms::transition<door::open, ev::close, door::closed>,
+  fsms::transition<door::closed, ev::lock, door::locked, has_key>,
+  fsms::transition<door::locked, ev::unlock, door::closed, has_key>>;
+
+// door_machine's transitions spelled out, by state and then event
+constexpr door expected[3][4] = {
+  {door::open, door::closed, door::locked, door::closed},
+  {door::open, door::closed, door::open, door::open},
+  {door::locked, door::locked, door::locked, door::closed},
+};
+
+static constexpr bool
+table_matches ()
+{
+  for (int s = 0; s < 3; s++) {
+    for (int e = 0; e < 4; e++) {
+      if (door_machine::target(door(s), ev(e)) != expected[s][e]) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+static_assert(table_matches(), "the table holds every transition");
+static_assert(door_machine::num_states == 3 && door_machine::num_events == 4);
+
+static int  notifications;
+static char last[64];
+
+static void*
+subscriber (void* arg)
+{
+  auto* args = static_cast<transition_subscriber_args_t*>(arg);
+  snprintf(last, sizeof(last), "%s-%s-%s", args->prev, args->ev, args->next);
+  notifications++;
+
+  return NULL;
+}
+
+void
+hpp_dispatch_test ()
+{
+  door_machine m(door::closed, ctx_t{true, 0});
+
+  ok(m.dispatch(ev::open), "takes a transition");
+  ok(m.state() == door::open, "moves to its target");
+  ok(!m.dispatch(ev::open), "ignores an unhandled event");
+  ok(m.state() == door::open, "stays put on an unhandled event");
+
+  bool matches = true;
+  for (int s = 0; s < 3; s++) {
+    for (int e = 0; e < 4; e++) {
+      door_machine each(door(s), ctx_t{true, 0});
+      each.dispatch(ev(e));
+      matches &= each.state() == expected[s][e];
+    }
+  }
+  ok(matches, "dispatches as the compile-time table says");
+}
+
+void
+hpp_guards_test ()
+{
+  door_machine m(door::closed, ctx_t{false, 0});
+
+  ok(!m.dispatch(ev::lock), "refuses a transition whose guard fails");
+  ok(m.state() == door::closed, "stays put when the guard fails");
+
+  m.context().has_key = true;
+  ok(m.dispatch(ev::lock), "takes it once the guard passes");
+  ok(m.dispatch(ev::unlock), "and the way back");
+
+  m.dispatch(ev::open);
+  m.dispatch(ev::close);
+  m.dispatch(ev::open);
+  cmp_ok(m.context().opened, "==", 2, "runs the action on each transition");
+}
+
+void
+hpp_view_test ()
+{
+  door_machine         m(door::closed, ctx_t{true, 0});
+  door_machine::c_view view(
+    m,
+    "door",
+    {"closed", "open", "locked"},
+    {"open", "close", "lock", "unlock"}
+  );
+
+  is(fsm_get_state_name(view.get()), "closed", "exports the state");
+
+  notifications = 0;
+  fsm_subscribe(view.get(), subscriber);
+  m.dispatch(ev::open);
+  is(fsm_get_state_name(view.get()), "open", "follows transitions");
+  cmp_ok(notifications, "==", 1, "notifies subscribers");
+  is(last, "closed-open-open", "with the names of the transition");
+
+  m.dispatch(ev::lock);
+  cmp_ok(notifications, "==", 1, "not for events that are ignored");
+}
+
+void
+run_hpp_tests (void)
+{
+  hpp_dispatch_test();
+  hpp_guards_test();
+  hpp_view_test();
+}
@@ -0,0 +1,203 @@
+#include <stdio.h>
+
+#include "tests.h"
+
+#define NUM_RING      64
+#define NUM_OVERRIDES 40
+
+static int notified = 0;
+
+static bool
+never (void* ctx)
+{
+  return false;
+}
+
+static void*
+count_notified (void* args)
+{
+  notified++;
+  return NULL;
+}
+
+static state_machine_t*
+create_door (void)
+{
+  return fsm_inline(
+    "door",
+    "closed",
+    fsm_inline_states({"closed", "opened", "locked"}),
+    &(inline_transition_t){
+      .name   = "open",
+      .source = "closed",
+      .target = "opened"},
+    &(inline_transition_t){
+      .name   = "close",
+      .source = "opened",
+      .target = "closed"},
+    &(inline_transition_t){
+      .name   = "lock",
+      .source = "closed",
+      .target = "locked"}
+  );
+}
+
+void
+fsm_instance_shares_test (state_machine_t* def)
+{
+  state_machine_t* fsm = fsm_instance("door", NULL, def);
+
+  ok(fsm != NULL, "creates an instance");
+  ok(fsm->states == def->states, "shares the definition's states");
+  is(fsm_get_state_name(fsm), "closed", "starts in the definition's state");
+  ok(fsm_finalize(fsm), "is finalized through the definition");
+  ok(!fsm_minimize(fsm), "refuses to minimize the definition");
+  ok(
+    fsm_state_register(fsm, fsm_state_create("ajar")) == NULL,
+    "refuses new states"
+  );
+
+  fsm_subscribe(fsm, count_notified);
+  fsm_transition(fsm, "open");
+  is(fsm_get_state_name(fsm), "opened", "takes the definition's transitions");
+  is(fsm_get_state_name(def), "closed", "leaves the definition's state");
+  cmp_ok(notified, "==", 1, "notifies its subscribers");
+
+  fsm_free(fsm);
+}
+
+void
+fsm_instance_override_test (state_machine_t* def)
+{
+  state_machine_t*    fsm    = fsm_instance("door", NULL, def);
+  state_machine_t*    plain  = fsm_instance("door", NULL, def);
+  state_descriptor_t* closed = fsm_get_state(def, "closed");
+  state_descriptor_t* opened = fsm_get_state(def, "opened");
+  state_descriptor_t* locked = fsm_get_state(def, "locked");
+  unsigned int        shared = array_size(closed->transitions);
+  int                 lock   = fsm_event_id(def, "lock");
+
+  transition_t* t = fsm_transition_create("open", locked, NULL, NULL);
+  ok(fsm_transition_register(fsm, closed, t) == t, "overrides a transition");
+  cmp_ok(
+    array_size(closed->transitions),
+    "==",
+    shared,
+    "leaves the shared states alone"
+  );
+
+  fsm_pending_t pending;
+  ok(
+    fsm_transition_lookup(fsm, fsm_event_id(def, "open"), &pending)
+      && pending.target == locked,
+    "looks up its own transition"
+  );
+  fsm_transition(fsm, "open");
+  is(fsm_get_state_name(fsm), "locked", "takes its own transition");
+  fsm_transition(plain, "open");
+  is(fsm_get_state_name(plain), "opened", "doesn't change other instances");
+
+  fsm_set_initial_state(fsm, opened);
+  ok(!fsm_can_handle(fsm, lock), "starts without an added transition");
+  fsm_transition_register(
+    fsm,
+    opened,
+    fsm_transition_create("lock", locked, NULL, NULL)
+  );
+  ok(fsm_can_handle(fsm, lock), "adds a transition");
+  ok(!fsm_can_handle(plain, lock), "adds it to this instance only");
+
+  uint64_t mask[1] = {0};
+  fsm_enabled_events(fsm, mask);
+  ok(mask[0] >> lock & 1, "enables the added event");
+
+  fsm_transition_register(
+    fsm,
+    opened,
+    fsm_transition_create("close", closed, never, NULL)
+  );
+  fsm_transition(fsm, "close");
+  is(fsm_get_state_name(fsm), "opened", "runs its own guards");
+
+  ok(
+    fsm_transition_register(
+      fsm,
+      closed,
+      fsm_transition_create("kick", opened, NULL, NULL)
+    ) == NULL,
+    "refuses events the definition doesn't have"
+  );
+  state_descriptor_t stray = {.name = "stray"};
+  ok(
+    fsm_transition_register(
+      fsm,
+      closed,
+      fsm_transition_create("open", &stray, NULL, NULL)
+    ) == NULL,
+    "refuses states the definition doesn't have"
+  );
+
+  int events[] = {lock};
+  ok(
+    fsm_run_parallel(fsm, events, 1, 1, NULL) == NULL,
+    "refuses to run in parallel with overrides"
+  );
+  ok(fsm_run_parallel(plain, events, 1, 1, NULL) != NULL, "unless it has none");
+
+  fsm_free(fsm);
+  fsm_free(plain);
+}
+
+void
+fsm_instance_growth_test (void)
+{
+  state_machine_t*    def = fsm_create("ring", NULL);
+  state_descriptor_t* s[NUM_RING];
+  static char         names[NUM_RING][8];
+
+  for (int i = 0; i < NUM_RING; i++) {
+    snprintf(names[i], sizeof(names[i]), "r%d", i);
+    s[i] = fsm_state_register(def, fsm_state_create(names[i]));
+  }
+  for (int i = 0; i < NUM_RING; i++) {
+    fsm_transition_register(
+      def,
+      s[i],
+      fsm_transition_create("next", s[(i + 1) % NUM_RING], NULL, NULL)
+    );
+  }
+  fsm_set_initial_state(def, s[0]);
+
+  // the first NUM_OVERRIDES states skip ahead by two instead
+  state_machine_t* fsm = fsm_instance("ring", NULL, def);
+  for (int i = 0; i < NUM_OVERRIDES; i++) {
+    fsm_transition_register(
+      fsm,
+      s[i],
+      fsm_transition_create("next", s[(i + 2) % NUM_RING], NULL, NULL)
+    );
+  }
+
+  bool skips = true;
+  for (int i = 0; i < NUM_RING; i++) {
+    fsm_set_initial_state(fsm, s[i]);
+    fsm_transition(fsm, "next");
+    skips &= fsm->state == s[(i + (i < NUM_OVERRIDES ? 2 : 1)) % NUM_RING];
+  }
+  ok(skips, "keeps every override as its table grows");
+
+  fsm_free(fsm);
+  fsm_free(def);
+}
+
+void
+run_instance_tests (void)
+{
+  state_machine_t* def = create_door();
+
+  fsm_instance_shares_test(def);
+  fsm_instance_override_test(def);
+  fsm_instance_growth_test();
+
+  fsm_inline_free(def);
+}
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+
+#include "tests.h"
+
+static const char* last_ev = NULL;
+
+static void*
+record_subscriber (void* arg)
+{
+  last_ev = ((transition_subscriber_args_t*)arg)->ev;
+  return NULL;
+}
+
+void
+s_intern_test ()
+{
+  char* a = s_copy("intern_test_event");
+  char* b = s_copy("intern_test_event");
+
+  ok(s_intern_lookup(a) == NULL, "lookup does not intern unseen strings");
+
+  const char* ia = s_intern(a);
+  const char* ib = s_intern(b);
+
+  ok(ia == ib, "equal strings intern to the same pointer");
+  ok(ia != a && ia != b, "the pool keeps its own copy");
+  is(ia, "intern_test_event", "the interned copy is equal");
+  ok(s_intern_lookup(b) == ia, "lookup finds the canonical pointer");
+  ok(s_intern("intern_test_other") != ia, "distinct strings stay distinct");
+  ok(s_intern(NULL) == NULL, "NULL interns to NULL");
+
+  free(a);
+  free(b);
+}
+
+void
+fsm_interned_names_test ()
+{
+  state_descriptor_t* a = fsm_state_create("on");
+  state_descriptor_t* b = fsm_state_create("on");
+
+  ok(a->name == b->name, "state names are interned");
+
+  state_machine_t* fsm  = fsm_create("test", NULL);
+  fsm_state_register(fsm, a);
+  fsm_set_initial_state(fsm, a);
+
+  char*         event   = s_copy("flip");
+  transition_t* t = fsm_transition_register(
+    fsm,
+    a,
+    fsm_transition_create(event, a, NULL, NULL)
+  );
+  ok(t->name == s_intern("flip"), "transition names are interned");
+
+  fsm_subscribe(fsm, record_subscriber);
+  fsm_transition(fsm, event);
+  ok(last_ev == t->name, "subscribers receive the interned event name");
+
+  free(event);
+  fsm_state_free(a);
+  fsm_state_free(b);
+  fsm_transition_free(t);
+  fsm_free(fsm);
+}
+
+void
+run_intern_tests (void)
+{
+  s_intern_test();
+  fsm_interned_names_test();
+}
@@ -0,0 +1,225 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+static int guard_calls;
+static int action_calls;
+static int notifications;
+
+static bool
+odd_calls (void* ctx)
+{
+  return ++guard_calls % 2;
+}
+
+static void
+action (void* ctx)
+{
+  action_calls++;
+}
+
+static void*
+subscriber (void* arg)
+{
+  notifications++;
+  return NULL;
+}
+
+// "b" from "idle" has two candidates, and "c" from "busy" is guarded; `variant`
+// changes where "a" leads from "done"
+static state_machine_t*
+create_machine (const char* name, const char* variant)
+{
+  state_machine_t* fsm = fsm_inline(
+    name,
+    "idle",
+    fsm_inline_states({"idle", "busy", "done"}),
+    &(inline_transition_t){.name = "a", .source = "idle", .target = "busy"},
+    &(inline_transition_t){.name = "b", .source = "idle", .target = "busy"},
+    &(inline_transition_t){.name = "b", .source = "idle", .target = "done"},
+    &(inline_transition_t){
+      .name   = "c",
+      .source = "busy",
+      .target = "done",
+      .guard  = odd_calls,
+      .action = action},
+    &(inline_transition_t){.name = "a", .source = "busy", .target = "idle"},
+    &(inline_transition_t){.name = "a", .source = "done", .target = variant}
+  );
+  fsm_subscribe(fsm, subscriber);
+
+  return fsm;
+}
+
+static int
+count_files (const char* path)
+{
+  DIR* dir = opendir(path);
+  int  n   = 0;
+
+  for (struct dirent* e; (e = readdir(dir));) {
+    n += e->d_name[0] != '.';
+  }
+  closedir(dir);
+
+  return n;
+}
+
+static void
+remove_cache (const char* path)
+{
+  DIR* dir = opendir(path);
+
+  for (struct dirent* e; (e = readdir(dir));) {
+    if (e->d_name[0] != '.') {
+      char* file = fmt_str("%s/%s", path, e->d_name);
+      unlink(file);
+      free(file);
+    }
+  }
+  closedir(dir);
+  rmdir(path);
+}
+
+// Gets the path of a file in `path` other than `except`, which may be NULL
+static char*
+other_file (const char* path, const char* except)
+{
+  DIR*  dir   = opendir(path);
+  char* found = NULL;
+
+  for (struct dirent* e; !found && (e = readdir(dir));) {
+    char* file = fmt_str("%s/%s", path, e->d_name);
+    if (e->d_name[0] != '.' && !(except && s_equals(file, except))) {
+      found = file;
+    } else {
+      free(file);
+    }
+  }
+  closedir(dir);
+
+  return found;
+}
+
+void
+fsm_jit_test ()
+{
+  char cache[] = "/tmp/fsms-jit-XXXXXX";
+  ok(mkdtemp(cache) != NULL, "creates a cache directory");
+  setenv("FSMS_JIT_CACHE", cache, 1);
+
+  state_machine_t* jitted = create_machine("jitted", "idle");
+  state_machine_t* plain  = create_machine("plain", "idle");
+  fsm_finalize(plain);
+
+  ok(fsm_jit(jitted), "compiles a machine");
+  ok(fsm_jit(jitted), "compiles a machine only once");
+  cmp_ok(count_files(cache), "==", 1, "caches the object");
+
+  const char* events[] = {"a", "b", "c", "d"};
+  int         jit_guards, jit_actions, jit_notifications;
+  uint64_t    seed = 3;
+
+  for (int pass = 0; pass < 2; pass++) {
+    state_machine_t* fsm = pass ? plain : jitted;
+    guard_calls          = 0;
+    action_calls         = 0;
+    notifications        = 0;
+
+    for (int i = 0; i < 1000; i++) {
+      seed = seed * 6364136223846793005 + 1442695040888963407;
+      fsm_transition(fsm, events[(seed >> 33) % 4]);
+    }
+
+    if (!pass) {
+      jit_guards        = guard_calls;
+      jit_actions       = action_calls;
+      jit_notifications = notifications;
+      seed              = 3;
+    }
+  }
+  bool same = s_equals(fsm_get_state_name(jitted), fsm_get_state_name(plain))
+           && jit_guards == guard_calls && jit_actions == action_calls
+           && jit_notifications == notifications;
+  ok(same, "matches dispatch through the tables");
+  ok(jit_actions > 0, "runs guarded transitions");
+
+  state_machine_t* twin = create_machine("twin", "idle");
+  ok(fsm_jit(twin), "compiles a machine with the same layout");
+  cmp_ok(count_files(cache), "==", 1, "shares the cached object");
+
+  setenv("CC", "/nonexistent/cc", 1);
+  state_machine_t* other = create_machine("other", "busy");
+  ok(!fsm_jit(other), "fails without a compiler");
+  cmp_ok(count_files(cache), "==", 1, "leaves no partial objects");
+  fsm_transition(other, "a");
+  is(fsm_get_state_name(other), "busy", "still dispatches");
+  unsetenv("CC");
+
+  fsm_state_register(jitted, fsm_state_create("extra"));
+  fsm_transition(jitted, "a");
+  ok(jitted->compiled == NULL, "drops the native code with the tables");
+
+  fsm_inline_free(jitted);
+  fsm_inline_free(plain);
+  fsm_inline_free(twin);
+  fsm_inline_free(other);
+  unsetenv("FSMS_JIT_CACHE");
+  remove_cache(cache);
+}
+
+void
+fsm_jit_untrusted_test ()
+{
+  char cache[] = "/tmp/fsms-jit-XXXXXX";
+  mkdtemp(cache);
+  setenv("FSMS_JIT_CACHE", cache, 1);
+
+  state_machine_t* idle = create_machine("idle", "idle");
+  state_machine_t* busy = create_machine("busy", "busy");
+
+  chmod(cache, 0770);
+  ok(!fsm_jit(idle), "refuses a cache directory others can write to");
+  chmod(cache, 0700);
+
+  fsm_jit(busy);
+  char* busy_object = other_file(cache, NULL);
+  fsm_jit(idle);
+  char* idle_object = other_file(cache, busy_object);
+
+  state_machine_t* twin = create_machine("twin", "idle");
+  chmod(idle_object, 0666);
+  ok(!fsm_jit(twin), "refuses an object others can write to");
+  chmod(idle_object, 0644);
+
+  // as if the two layouts' hashes collided; `busy` goes first, so that its
+  // object is no longer loaded under that name
+  fsm_inline_free(busy);
+  rename(idle_object, busy_object);
+  state_machine_t* collided = create_machine("collided", "busy");
+  ok(!fsm_jit(collided), "refuses an object built for another layout");
+
+  fsm_transition(collided, "b");
+  fsm_transition(collided, "a");
+  is(fsm_get_state_name(collided), "busy", "still steps through its tables");
+
+  free(busy_object);
+  free(idle_object);
+  fsm_inline_free(idle);
+  fsm_inline_free(twin);
+  fsm_inline_free(collided);
+  unsetenv("FSMS_JIT_CACHE");
+  remove_cache(cache);
+}
+
+void
+run_jit_tests (void)
+{
+  fsm_jit_test();
+  fsm_jit_untrusted_test();
+}
@@ -0,0 +1,249 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+#define MAX_RECORDS 16
+#define NUM_THREADS 8
+#define NUM_APPENDS 200
+
+typedef struct {
+  fsm_journal_record_t records[MAX_RECORDS];
+  int                  count;
+} replayed_t;
+
+static void
+collect (void* ctx, const fsm_journal_record_t* record)
+{
+  replayed_t* r = ctx;
+  if (r->count < MAX_RECORDS) {
+    r->records[r->count] = *record;
+  }
+  r->count++;
+}
+
+// Sets a machine to the state of each record for it, as recovery would
+static void
+restore (void* ctx, const fsm_journal_record_t* record)
+{
+  state_machine_t* fsm = ctx;
+  if (record->machine_id == 1ull << 40) {
+    fsm_set_initial_state(fsm, array_get(fsm->states, record->state_id));
+  }
+}
+
+static state_machine_t*
+create_light (void)
+{
+  return fsm_inline(
+    "light",
+    "off",
+    fsm_inline_states({"off", "on"}),
+    &(inline_transition_t){.name = "push", .source = "off", .target = "on"},
+    &(inline_transition_t){.name = "push", .source = "on", .target = "off"},
+    &(inline_transition_t){.name = "break", .source = "on", .target = "on"}
+  );
+}
+
+typedef struct {
+  fsm_journal_t* journal;
+  uint64_t       machine_id;
+  bool           ok;
+} appender_t;
+
+static void*
+append_all (void* arg)
+{
+  appender_t* a = arg;
+
+  a->ok = true;
+  for (int i = 0; i < NUM_APPENDS; i++) {
+    a->ok &= fsm_journal_append(a->journal, a->machine_id, 0, i & 1);
+  }
+
+  return NULL;
+}
+
+static long
+file_size (const char* path)
+{
+  struct stat st;
+  return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+void
+fsm_journal_record_test (void)
+{
+  char path[] = "/tmp/fsms-journal-XXXXXX";
+  close(mkstemp(path));
+
+  state_machine_t* a     = create_light();
+  state_machine_t* b     = create_light();
+  int              push  = fsm_event_id(a, "push");
+  int              brk   = fsm_event_id(a, "break");
+  fsm_journal_t*   j     = fsm_journal_open(path, 0);
+  uint64_t         start = fsm_journal_offset(j);
+
+  ok(j != NULL, "creates a journal");
+  ok(fsm_journal_transition(j, 1, a, push), "transitions a machine");
+  is(fsm_get_state_name(a), "on", "takes the transition");
+  fsm_journal_transition(j, 2, b, brk);
+  fsm_journal_transition(j, 2, b, push);
+  fsm_journal_transition(j, 1ull << 40, a, brk);
+  ok(fsm_journal_offset(j) > start, "advances the offset");
+  cmp_ok(file_size(path), "==", start, "buffers records without a batch");
+  ok(fsm_journal_sync(j), "syncs");
+  cmp_ok(file_size(path), "==", fsm_journal_offset(j), "writes on sync");
+
+  replayed_t r = {0};
+  cmp_ok(fsm_journal_replay(path, 0, collect, &r), "==", 3, "replays records");
+  ok(
+    r.records[0].machine_id == 1 && r.records[0].event_id == push
+      && r.records[0].state_id == fsm_get_state(a, "on")->id,
+    "records the machine, event and state"
+  );
+  ok(
+    r.records[1].machine_id == 2 && r.records[2].machine_id == 1ull << 40,
+    "skips unhandled events, in order"
+  );
+
+  uint64_t mid = fsm_journal_offset(j);
+  fsm_journal_transition(j, 2, b, push);
+  fsm_journal_close(j);
+
+  r = (replayed_t){0};
+  cmp_ok(
+    fsm_journal_replay(path, mid, collect, &r),
+    "==",
+    1,
+    "replays from an offset"
+  );
+
+  state_machine_t* recovered = create_light();
+  fsm_journal_replay(path, 0, restore, recovered);
+  is(fsm_get_state_name(recovered), "on", "recovers a machine's state");
+
+  fsm_inline_free(recovered);
+  fsm_inline_free(a);
+  fsm_inline_free(b);
+  unlink(path);
+}
+
+void
+fsm_journal_batch_test (void)
+{
+  char path[] = "/tmp/fsms-journal-XXXXXX";
+  close(mkstemp(path));
+
+  fsm_journal_t* j     = fsm_journal_open(path, 2);
+  long           empty = file_size(path);
+
+  fsm_journal_append(j, 1, 0, 1);
+  cmp_ok(file_size(path), "==", empty, "waits for a full batch");
+  fsm_journal_append(j, 1, 0, 0);
+  cmp_ok(
+    file_size(path),
+    "==",
+    fsm_journal_offset(j),
+    "writes a batch once full"
+  );
+  fsm_journal_append(j, 1, 0, 1);
+  fsm_journal_close(j);
+
+  // tear the last record, as a crash mid-write would
+  ok(truncate(path, file_size(path) - 2) == 0, "tears the last record");
+  cmp_ok(
+    fsm_journal_replay(path, 0, NULL, NULL),
+    "==",
+    2,
+    "stops at a torn record"
+  );
+
+  j = fsm_journal_open(path, 1);
+  ok(j != NULL, "reopens a torn journal");
+  fsm_journal_append(j, 7, 0, 1);
+  fsm_journal_close(j);
+
+  replayed_t r = {0};
+  cmp_ok(
+    fsm_journal_replay(path, 0, collect, &r),
+    "==",
+    3,
+    "drops the torn tail"
+  );
+  cmp_ok(r.records[2].machine_id, "==", 7, "appends after the last record");
+
+  int fd = open(path, O_WRONLY);
+  ok(pwrite(fd, "X", 1, empty + 3) == 1, "corrupts a record");
+  close(fd);
+  cmp_ok(
+    fsm_journal_replay(path, 0, NULL, NULL),
+    "==",
+    0,
+    "stops at a corrupt record"
+  );
+
+  fd = open(path, O_WRONLY | O_TRUNC);
+  ok(write(fd, "not a journal", 13) == 13, "overwrites the journal");
+  close(fd);
+  cmp_ok(
+    fsm_journal_replay(path, 0, NULL, NULL),
+    "==",
+    -1,
+    "refuses files that aren't journals"
+  );
+  ok(fsm_journal_open(path, 1) == NULL, "refuses to append to them");
+  unlink(path);
+}
+
+void
+fsm_journal_group_test (void)
+{
+  char path[] = "/tmp/fsms-journal-XXXXXX";
+  close(mkstemp(path));
+
+  // every append waits to be durable, sharing flushes with the others
+  fsm_journal_t* j = fsm_journal_open(path, 1);
+  appender_t     appenders[NUM_THREADS];
+  pthread_t      threads[NUM_THREADS];
+
+  for (int i = 0; i < NUM_THREADS; i++) {
+    appenders[i] = (appender_t){.journal = j, .machine_id = i};
+    pthread_create(&threads[i], NULL, append_all, &appenders[i]);
+  }
+
+  bool all_ok = true;
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+    all_ok &= appenders[i].ok;
+  }
+  ok(all_ok, "appends from several threads");
+  cmp_ok(
+    file_size(path),
+    "==",
+    fsm_journal_offset(j),
+    "has written every record once they return"
+  );
+  fsm_journal_close(j);
+
+  cmp_ok(
+    fsm_journal_replay(path, 0, NULL, NULL),
+    "==",
+    NUM_THREADS * NUM_APPENDS,
+    "replays every thread's records"
+  );
+  unlink(path);
+}
+
+void
+run_journal_tests (void)
+{
+  fsm_journal_record_test();
+  fsm_journal_batch_test();
+  fsm_journal_group_test();
+}
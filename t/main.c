@@ -4,11 +4,29 @@
 int
 main ()
 {
-  plan(85);
+  plan(470);
 
   run_fsm_tests();
   run_macro_tests();
   run_inline_tests();
+  run_finalize_tests();
+  run_intern_tests();
+  run_minimize_tests();
+  run_parallel_tests();
+  run_bytes_tests();
+  run_nfa_tests();
+  run_product_tests();
+  run_jit_tests();
+  run_static_tests();
+  run_uring_tests();
+  run_reactor_tests();
+  run_store_tests();
+  run_journal_tests();
+  run_snapshot_tests();
+  run_shared_tests();
+  run_swap_tests();
+  run_instance_tests();
+  run_registry_tests();
 
   done_testing();
 }
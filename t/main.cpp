@@ -0,0 +1,13 @@
+#include "tap.c/tap.h"
+#include "tests.h"
+
+int
+main ()
+{
+  plan(32);
+
+  run_hpp_tests();
+  run_coro_tests();
+
+  done_testing();
+}
@@ -0,0 +1,184 @@
+#include "tests.h"
+
+static int actions = 0;
+
+static void
+action_a (void* ctx)
+{
+  actions++;
+}
+
+static void
+action_b (void* ctx)
+{
+  actions += 10;
+}
+
+// "left_done" and "right_done" differ only in the action on their way back to
+// "idle", so "left" and "right" differ only through their targets
+static state_machine_t*
+create_diamond (void (*right_action)(void*))
+{
+  return fsm_inline(
+    "diamond",
+    "idle",
+    fsm_inline_states({"idle", "left", "right", "left_done", "right_done"}),
+    &(inline_transition_t){
+      .name   = "go_left",
+      .source = "idle",
+      .target = "left"},
+    &(inline_transition_t){
+      .name   = "go_right",
+      .source = "idle",
+      .target = "right"},
+    &(inline_transition_t){
+      .name   = "step",
+      .source = "left",
+      .target = "left_done"},
+    &(inline_transition_t){
+      .name   = "step",
+      .source = "right",
+      .target = "right_done"},
+    &(inline_transition_t){
+      .name   = "step",
+      .source = "left_done",
+      .target = "idle",
+      .action = action_a},
+    &(inline_transition_t){
+      .name   = "step",
+      .source = "right_done",
+      .target = "idle",
+      .action = right_action}
+  );
+}
+
+void
+fsm_minimize_merges_test ()
+{
+  state_machine_t*    fsm   = create_diamond(action_a);
+  state_descriptor_t* right = array_get(fsm->states, 2);
+
+  ok(fsm_minimize(fsm), "minimizes a finalized machine");
+  cmp_ok(array_size(fsm->states), "==", 5, "keeps every state registered");
+  ok(
+    fsm_get_state(fsm, "right") == fsm_get_state(fsm, "left"),
+    "merges equivalent states"
+  );
+  ok(
+    fsm_get_state(fsm, "right_done") == fsm_get_state(fsm, "left_done"),
+    "merges states with the same actions"
+  );
+  ok(
+    fsm_get_state(fsm, "left_done") != fsm_get_state(fsm, "idle"),
+    "keeps states with different events apart"
+  );
+  is(
+    fsm_get_state(fsm, "right")->name,
+    "left",
+    "names a class by its first member"
+  );
+  ok(fsm_get_state(fsm, "missing") == NULL, "unknown names resolve to NULL");
+
+  actions = 0;
+  fsm_transition(fsm, "go_right");
+  is(fsm_get_state_name(fsm), "left", "dispatches into the merged state");
+  fsm_transition(fsm, "step");
+  is(fsm_get_state_name(fsm), "left_done", "dispatches out of a merged state");
+  fsm_transition(fsm, "step");
+  is(fsm_get_state_name(fsm), "idle", "returns to the unmerged state");
+  cmp_ok(actions, "==", 1, "runs the shared action");
+
+  fsm_set_initial_state(fsm, right);
+  is(fsm_get_state_name(fsm), "left", "maps a merged initial state");
+
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_minimize_callbacks_test ()
+{
+  state_machine_t* fsm = create_diamond(action_b);
+
+  ok(fsm_minimize(fsm), "minimizes a finalized machine");
+  ok(
+    fsm_get_state(fsm, "right_done") != fsm_get_state(fsm, "left_done"),
+    "keeps states with different actions apart"
+  );
+  ok(
+    fsm_get_state(fsm, "right") != fsm_get_state(fsm, "left"),
+    "keeps states that differ only through their targets apart"
+  );
+
+  actions = 0;
+  fsm_transition(fsm, "go_right");
+  fsm_transition(fsm, "step");
+  fsm_transition(fsm, "step");
+  cmp_ok(actions, "==", 10, "runs the action of the unmerged state");
+
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_minimize_invalidation_test ()
+{
+  state_machine_t*    fsm   = create_diamond(action_a);
+  state_descriptor_t* right = fsm_get_state(fsm, "right");
+
+  fsm_minimize(fsm);
+
+  transition_t* t = fsm_transition_register(
+    fsm,
+    right,
+    fsm_transition_create("reset", fsm_get_state(fsm, "idle"), NULL, NULL)
+  );
+
+  ok(fsm->compiled == NULL, "registering discards the minimization");
+  ok(fsm_get_state(fsm, "right") == right, "names resolve to their own states");
+
+  ok(fsm_minimize(fsm), "minimizes again");
+  ok(
+    fsm_get_state(fsm, "right") != fsm_get_state(fsm, "left"),
+    "sees the new transition"
+  );
+  ok(
+    fsm_get_state(fsm, "right_done") == fsm_get_state(fsm, "left_done"),
+    "keeps merging what is still equivalent"
+  );
+
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_minimize_shared_test ()
+{
+  state_machine_t* fsm   = create_diamond(action_a);
+  state_machine_t* clone = fsm_clone("clone", NULL, fsm);
+
+  fsm_set_initial_state(clone, fsm_get_state(fsm, "idle"));
+  fsm_finalize(clone);
+  fsm_transition(clone, "go_right");
+
+  // renumbers the descriptors the clone shares
+  fsm_minimize(fsm);
+
+  fsm_transition(clone, "step");
+  is(
+    fsm_get_state_name(clone),
+    "right_done",
+    "a clone still dispatches from its own state"
+  );
+  fsm_transition(clone, "step");
+  is(fsm_get_state_name(clone), "idle", "and from the next one");
+
+  fsm_free(clone);
+  fsm_inline_free(fsm);
+}
+
+void
+run_minimize_tests (void)
+{
+  fsm_minimize_merges_test();
+  fsm_minimize_callbacks_test();
+  fsm_minimize_invalidation_test();
+  fsm_minimize_shared_test();
+}
@@ -0,0 +1,138 @@
+#include "tests.h"
+
+static bool
+always (void* ctx)
+{
+  return true;
+}
+
+// Accepts inputs over {a, b} that end in "ab". "start" only reaches the loop
+// through an epsilon edge.
+static state_machine_t*
+create_ends_with_ab (void)
+{
+  state_machine_t* fsm = fsm_inline(
+    "ends_with_ab",
+    "start",
+    fsm_inline_states({"start", "loop", "saw_a", "match"}),
+    &(inline_transition_t){
+      .name   = FSM_EPSILON,
+      .source = "start",
+      .target = "loop"},
+    &(inline_transition_t){.name = "a", .source = "loop", .target = "loop"},
+    &(inline_transition_t){.name = "b", .source = "loop", .target = "loop"},
+    &(inline_transition_t){.name = "a", .source = "loop", .target = "saw_a"},
+    &(inline_transition_t){.name = "b", .source = "saw_a", .target = "match"}
+  );
+  fsm_get_state(fsm, "match")->accepting = true;
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+void
+fsm_nfa_test ()
+{
+  state_machine_t* def = create_ends_with_ab();
+  fsm_nfa_t*       nfa = fsm_nfa_create(def);
+
+  state_descriptor_t* start = fsm_get_state(def, "start");
+  state_descriptor_t* loop  = fsm_get_state(def, "loop");
+  state_descriptor_t* saw_a = fsm_get_state(def, "saw_a");
+  state_descriptor_t* match = fsm_get_state(def, "match");
+
+  ok(nfa != NULL, "creates an NFA");
+  ok(fsm_nfa_in_state(nfa, start), "starts in the initial state");
+  ok(fsm_nfa_in_state(nfa, loop), "follows epsilon edges from the start");
+  ok(!fsm_nfa_accepting(nfa), "does not accept the empty input");
+
+  fsm_nfa_transition(nfa, "a");
+  ok(fsm_nfa_in_state(nfa, loop), "takes every transition on an event");
+  ok(fsm_nfa_in_state(nfa, saw_a), "takes every transition on an event");
+  ok(!fsm_nfa_in_state(nfa, start), "drops states without a transition");
+
+  fsm_nfa_transition(nfa, "b");
+  ok(fsm_nfa_in_state(nfa, match), "reaches the match");
+  ok(fsm_nfa_accepting(nfa), "accepts \"ab\"");
+
+  fsm_nfa_transition(nfa, "a");
+  ok(!fsm_nfa_accepting(nfa), "rejects \"aba\"");
+
+  uint64_t set[FSM_STATE_SET_WORDS(4)];
+  cmp_ok(fsm_nfa_states(nfa, set), "==", 1, "copies the set");
+  cmp_ok(
+    set[0],
+    "==",
+    (1 << loop->id) | (1 << saw_a->id),
+    "copies the set"
+  );
+
+  fsm_nfa_transition(nfa, "c");
+  ok(!fsm_nfa_in_state(nfa, loop), "unknown events empty the set");
+
+  fsm_nfa_reset(nfa);
+  ok(fsm_nfa_in_state(nfa, start), "resets to the initial set");
+  ok(fsm_nfa_in_state(nfa, loop), "resets to the initial set");
+
+  fsm_nfa_free(nfa);
+  fsm_inline_free(def);
+}
+
+void
+fsm_nfa_rejects_test ()
+{
+  state_machine_t* def = fsm_inline(
+    "guarded",
+    "a",
+    fsm_inline_states({"a", "b"}),
+    &(inline_transition_t){
+      .name   = "go",
+      .source = "a",
+      .target = "b",
+      .guard  = always}
+  );
+
+  ok(fsm_nfa_create(def) == NULL, "refuses guarded definitions");
+
+  fsm_inline_free(def);
+}
+
+void
+fsm_nfa_shared_states_test ()
+{
+  state_machine_t*    def   = create_ends_with_ab();
+  state_machine_t*    other = fsm_create("other", NULL);
+  state_descriptor_t* start = fsm_get_state(def, "start");
+  state_descriptor_t* saw_a = fsm_get_state(def, "saw_a");
+  state_descriptor_t* fillers[8];
+
+  // registering them with another machine renumbers them past def's rows
+  fsm_state_register(other, saw_a);
+  for (int i = 0; i < 8; i++) {
+    fillers[i] = fsm_state_register(other, fsm_state_create("filler"));
+  }
+  fsm_state_register(other, start);
+
+  fsm_nfa_t* nfa = fsm_nfa_create(def);
+  ok(nfa != NULL, "creates an NFA from renumbered states");
+  ok(fsm_nfa_in_state(nfa, start), "starts in the renumbered initial state");
+  ok(!fsm_nfa_in_state(nfa, saw_a), "not in the state its new ID names");
+
+  fsm_nfa_transition(nfa, "a");
+  ok(fsm_nfa_in_state(nfa, saw_a), "finds renumbered states by descriptor");
+
+  fsm_nfa_free(nfa);
+  for (int i = 0; i < 8; i++) {
+    fsm_state_free(fillers[i]);
+  }
+  fsm_free(other);
+  fsm_inline_free(def);
+}
+
+void
+run_nfa_tests (void)
+{
+  fsm_nfa_test();
+  fsm_nfa_rejects_test();
+  fsm_nfa_shared_states_test();
+}
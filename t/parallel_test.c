@@ -0,0 +1,155 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "tests.h"
+
+#define NUM_STATES 16
+#define NUM_EVENTS 100000
+
+static bool
+always (void* ctx)
+{
+  return true;
+}
+
+// A counter modulo NUM_STATES that "inc" advances and "reset" sends back to
+// zero: increments alone never bring two paths together, resets always do
+static state_machine_t*
+create_counter (state_descriptor_t** states)
+{
+  state_machine_t* fsm = fsm_create("counter", NULL);
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    char* name = fmt_str("s%d", i);
+    states[i]  = fsm_state_register(fsm, fsm_state_create(name));
+    free(name);
+  }
+
+  for (int i = 0; i < NUM_STATES; i++) {
+    fsm_transition_register(
+      fsm,
+      states[i],
+      fsm_transition_create("inc", states[(i + 1) % NUM_STATES], NULL, NULL)
+    );
+    fsm_transition_register(
+      fsm,
+      states[i],
+      fsm_transition_create("reset", states[0], NULL, NULL)
+    );
+  }
+
+  // every candidate fires, so "twice" takes the second
+  fsm_transition_register(
+    fsm,
+    states[1],
+    fsm_transition_create("twice", states[5], NULL, NULL)
+  );
+  fsm_transition_register(
+    fsm,
+    states[1],
+    fsm_transition_create("twice", states[9], NULL, NULL)
+  );
+
+  fsm_set_initial_state(fsm, states[3]);
+  fsm_finalize(fsm);
+
+  return fsm;
+}
+
+static void
+run_stream (int reset_every, const char* description)
+{
+  state_descriptor_t* states[NUM_STATES];
+  state_machine_t*    fsm  = create_counter(states);
+
+  int                 inc  = fsm_event_id(fsm, "inc");
+  int                 rst  = fsm_event_id(fsm, "reset");
+  int                 twc  = fsm_event_id(fsm, "twice");
+
+  int*          events     = malloc(NUM_EVENTS * sizeof(int));
+  unsigned int* expected   = malloc(NUM_EVENTS * sizeof(unsigned int));
+  unsigned int* out_states = malloc(NUM_EVENTS * sizeof(unsigned int));
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    events[i] = (reset_every && i % reset_every == 0) ? rst
+              : i % 7 == 0                             ? twc
+              : i % 1000 == 0                          ? -1
+                                                       : inc;
+  }
+
+  for (int i = 0; i < NUM_EVENTS; i++) {
+    fsm_transition_id(fsm, events[i]);
+    expected[i] = fsm->state->id;
+  }
+  state_descriptor_t* sequential = fsm->state;
+
+  fsm_set_initial_state(fsm, states[3]);
+  state_descriptor_t* parallel
+    = fsm_run_parallel(fsm, events, NUM_EVENTS, 4, out_states);
+
+  ok(parallel == sequential, "%s: reaches the same final state", description);
+  ok(fsm->state == sequential, "%s: leaves the machine there", description);
+  ok(
+    memcmp(expected, out_states, NUM_EVENTS * sizeof(unsigned int)) == 0,
+    "%s: reports every intermediate state",
+    description
+  );
+
+  fsm_set_initial_state(fsm, states[3]);
+  ok(
+    fsm_run_parallel(fsm, events, NUM_EVENTS, 3, NULL) == sequential,
+    "%s: runs without intermediate states",
+    description
+  );
+
+  free(events);
+  free(expected);
+  free(out_states);
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_run_parallel_test ()
+{
+  run_stream(0, "without convergence");
+  run_stream(50, "with convergence");
+}
+
+void
+fsm_run_parallel_rejects_test ()
+{
+  state_descriptor_t* states[NUM_STATES];
+  state_machine_t*    fsm   = create_counter(states);
+  int                 event = fsm_event_id(fsm, "inc");
+
+  fsm_set_initial_state(fsm, states[0]);
+  ok(
+    fsm_run_parallel(fsm, &event, 1, 1, NULL) == states[1],
+    "runs short streams on the calling thread"
+  );
+
+  fsm_transition_register(
+    fsm,
+    states[0],
+    fsm_transition_create("guarded", states[1], always, NULL)
+  );
+
+  ok(
+    fsm_run_parallel(fsm, &event, 1, 1, NULL) == NULL,
+    "refuses a machine that has not been finalized"
+  );
+
+  fsm_finalize(fsm);
+  ok(
+    fsm_run_parallel(fsm, &event, 1, 1, NULL) == NULL,
+    "refuses a machine with guards"
+  );
+
+  fsm_inline_free(fsm);
+}
+
+void
+run_parallel_tests (void)
+{
+  fsm_run_parallel_test();
+  fsm_run_parallel_rejects_test();
+}
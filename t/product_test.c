@@ -0,0 +1,288 @@
+#include <string.h>
+
+#include "tests.h"
+
+typedef struct {
+  int  actions;
+  bool allow;
+} counter_t;
+
+static char log_buf[16];
+
+static void
+count (void* ctx)
+{
+  ((counter_t*)ctx)->actions++;
+}
+
+static void
+log_a (void* ctx)
+{
+  strcat(log_buf, "a");
+}
+
+static void
+log_b (void* ctx)
+{
+  strcat(log_buf, "b");
+}
+
+static bool
+allowed (void* ctx)
+{
+  return ((counter_t*)ctx)->allow;
+}
+
+// Unlocking takes the key, and every third lock leaves it in the door
+static bool
+has_key (void* ctx)
+{
+  return ((counter_t*)ctx)->actions % 3 != 0;
+}
+
+static const char* subscriber_next;
+
+static void*
+subscriber (void* arg)
+{
+  subscriber_next = ((transition_subscriber_args_t*)arg)->next;
+  return NULL;
+}
+
+static state_machine_t*
+create_switch (const char* name, const char* initial_state)
+{
+  return fsm_inline(
+    name,
+    initial_state,
+    fsm_inline_states({"off", "on"}),
+    &(inline_transition_t){.name = "switch", .source = "off", .target = "on"},
+    &(inline_transition_t){.name = "switch", .source = "on", .target = "off"}
+  );
+}
+
+static state_machine_t*
+create_door (counter_t* ctx)
+{
+  state_machine_t* fsm = fsm_inline(
+    "door",
+    "closed",
+    fsm_inline_states({"closed", "open", "locked"}),
+    &(inline_transition_t){
+      .name   = "open",
+      .source = "closed",
+      .target = "open"},
+    &(inline_transition_t){
+      .name   = "close",
+      .source = "open",
+      .target = "closed"},
+    &(inline_transition_t){
+      .name   = "lock",
+      .source = "closed",
+      .target = "locked",
+      .action = count},
+    &(inline_transition_t){
+      .name   = "unlock",
+      .source = "locked",
+      .target = "closed",
+      .guard  = has_key}
+  );
+  fsm->context = ctx;
+
+  return fsm;
+}
+
+static state_machine_t*
+create_light (counter_t* ctx)
+{
+  state_machine_t* fsm = fsm_inline(
+    "light",
+    "off",
+    fsm_inline_states({"off", "on"}),
+    &(inline_transition_t){
+      .name   = "open",
+      .source = "off",
+      .target = "on",
+      .action = count},
+    &(inline_transition_t){
+      .name   = "close",
+      .source = "on",
+      .target = "off",
+      .action = count},
+    &(inline_transition_t){.name = "lock", .source = "off", .target = "off"}
+  );
+  fsm->context = ctx;
+
+  return fsm;
+}
+
+void
+fsm_product_test ()
+{
+  state_machine_t* switch1 = create_switch("switch1", "off");
+  state_machine_t* switch2 = create_switch("switch2", "on");
+  fsm_product_t*   p       = fsm_product(switch1, switch2);
+  state_machine_t* fsm     = fsm_product_machine(p);
+
+  ok(p != NULL, "creates a product");
+  cmp_ok(
+    array_size(fsm->states),
+    "==",
+    2,
+    "builds only the reachable combinations"
+  );
+  is(fsm_get_state_name(fsm), "off,on", "names states after the components");
+
+  fsm_subscribe(fsm, subscriber);
+  fsm_product_transition(p, "switch");
+  is(fsm_get_state_name(fsm), "on,off", "steps every component at once");
+  is(fsm_product_state(p, 0)->name, "on", "tracks each component");
+  is(fsm_product_state(p, 1)->name, "off", "tracks each component");
+  ok(fsm_product_state(p, 2) == NULL, "has no third component");
+  is(subscriber_next, "on,off", "notifies the product's subscribers");
+  is(fsm_get_state_name(switch1), "off", "leaves the components alone");
+
+  fsm_product_transition(p, "nope");
+  is(fsm_get_state_name(fsm), "on,off", "ignores unknown events");
+
+  fsm_product_transition_id(p, fsm_event_id(fsm, "switch"));
+  is(fsm_get_state_name(fsm), "off,on", "steps by event ID");
+
+  fsm_product_free(p);
+  fsm_inline_free(switch1);
+  fsm_inline_free(switch2);
+}
+
+void
+fsm_product_callbacks_test ()
+{
+  counter_t        a_ctx = {.allow = false};
+  counter_t        b_ctx = {.allow = true};
+  state_machine_t* a     = fsm_inline(
+    "a",
+    "x",
+    fsm_inline_states({"x", "y"}),
+    &(inline_transition_t){
+      .name   = "go",
+      .source = "x",
+      .target = "y",
+      .guard  = allowed,
+      .action = log_a},
+    &(inline_transition_t){.name = "solo", .source = "x", .target = "y"}
+  );
+  state_machine_t* b = fsm_inline(
+    "b",
+    "x",
+    fsm_inline_states({"x", "y"}),
+    &(inline_transition_t){
+      .name   = "go",
+      .source = "x",
+      .target = "y",
+      .guard  = allowed,
+      .action = log_b}
+  );
+  a->context = &a_ctx;
+  b->context = &b_ctx;
+
+  fsm_product_t*   p   = fsm_product(a, b);
+  state_machine_t* fsm = fsm_product_machine(p);
+
+  fsm_product_transition(p, "go");
+  is(fsm_get_state_name(fsm), "x,y", "a failed guard holds its component");
+  is(log_buf, "b", "runs the actions of the components that move");
+
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "x,x"));
+  a_ctx.allow = true;
+  log_buf[0]  = '\0';
+  fsm_product_transition(p, "go");
+  is(fsm_get_state_name(fsm), "y,y", "moves components whose guards pass");
+  is(log_buf, "ab", "runs actions in component order");
+
+  fsm_set_initial_state(fsm, fsm_get_state(fsm, "x,x"));
+  fsm_product_transition(p, "solo");
+  is(fsm_get_state_name(fsm), "y,x", "steps only components that handle it");
+
+  fsm_product_free(p);
+  fsm_inline_free(a);
+  fsm_inline_free(b);
+}
+
+void
+fsm_product_lockstep_test ()
+{
+  const char* events[] = {"open", "close", "lock", "unlock"};
+  counter_t   ctxs[4]  = {0};
+
+  state_machine_t* door   = create_door(&ctxs[0]);
+  state_machine_t* light  = create_light(&ctxs[1]);
+  state_machine_t* door2  = create_door(&ctxs[2]);
+  state_machine_t* light2 = create_light(&ctxs[3]);
+  fsm_product_t*   p      = fsm_product(door2, light2);
+
+  bool     same = true;
+  uint64_t seed = 7;
+  for (int i = 0; i < 2000 && same; i++) {
+    seed              = seed * 6364136223846793005 + 1442695040888963407;
+    const char* event = events[(seed >> 33) % 4];
+
+    fsm_transition(door, event);
+    fsm_transition(light, event);
+    fsm_product_transition(p, event);
+
+    same = s_equals(fsm_product_state(p, 0)->name, door->state->name)
+        && s_equals(fsm_product_state(p, 1)->name, light->state->name)
+        && ctxs[0].actions == ctxs[2].actions
+        && ctxs[1].actions == ctxs[3].actions;
+  }
+
+  ok(same, "matches stepping each machine in turn");
+  ok(ctxs[0].actions > 0, "exercises the guarded transitions");
+
+  fsm_product_free(p);
+  fsm_inline_free(door);
+  fsm_inline_free(light);
+  fsm_inline_free(door2);
+  fsm_inline_free(light2);
+}
+
+void
+fsm_product_shared_states_test ()
+{
+  state_machine_t*    switch1 = create_switch("switch1", "on");
+  state_machine_t*    switch2 = create_switch("switch2", "off");
+  state_machine_t*    other   = fsm_create("other", NULL);
+  state_descriptor_t* fillers[9];
+
+  // registering "on" with another machine renumbers it past switch1's rows
+  for (int i = 0; i < 9; i++) {
+    fillers[i] = fsm_state_register(other, fsm_state_create("filler"));
+  }
+  fsm_state_register(other, fsm_get_state(switch1, "on"));
+
+  fsm_product_t* p = fsm_product(switch1, switch2);
+  ok(p != NULL, "creates a product from renumbered states");
+  is(
+    fsm_get_state_name(fsm_product_machine(p)),
+    "on,off",
+    "starts from the renumbered state"
+  );
+  fsm_product_transition(p, "switch");
+  is(fsm_product_state(p, 0)->name, "off", "steps it");
+
+  fsm_product_free(p);
+  for (int i = 0; i < 9; i++) {
+    fsm_state_free(fillers[i]);
+  }
+  fsm_free(other);
+  fsm_inline_free(switch1);
+  fsm_inline_free(switch2);
+}
+
+void
+run_product_tests (void)
+{
+  fsm_product_test();
+  fsm_product_callbacks_test();
+  fsm_product_lockstep_test();
+  fsm_product_shared_states_test();
+}
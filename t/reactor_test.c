@@ -0,0 +1,217 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+#define NUM_POSTS 10000
+
+typedef struct {
+  int fd;
+  int ticks;
+} tick_ctx_t;
+
+static void
+tick (void* ctx)
+{
+  ((tick_ctx_t*)ctx)->ticks++;
+}
+
+// consumes the readiness, as a real handler would
+static void
+consume (void* ctx)
+{
+  tick_ctx_t* c = ctx;
+  char        byte;
+
+  if (read(c->fd, &byte, 1) == 1) {
+    c->ticks++;
+  }
+}
+
+// "tick" and "readable" loop on "on", counting as they go
+static state_machine_t*
+create_counter (tick_ctx_t* ctx)
+{
+  state_machine_t* fsm = fsm_inline(
+    "counter",
+    "on",
+    fsm_inline_states({"on"}),
+    &(inline_transition_t){
+      .name   = "tick",
+      .source = "on",
+      .target = "on",
+      .action = tick},
+    &(inline_transition_t){
+      .name   = "readable",
+      .source = "on",
+      .target = "on",
+      .action = consume}
+  );
+  fsm->context = ctx;
+
+  return fsm;
+}
+
+typedef struct {
+  fsm_reactor_t*   reactor;
+  state_machine_t* fsm;
+} poster_t;
+
+static void*
+post_all (void* arg)
+{
+  poster_t* p    = arg;
+  int       tick = fsm_event_id(p->fsm, "tick");
+
+  for (int i = 0; i < NUM_POSTS; i++) {
+    fsm_reactor_post(p->reactor, p->fsm, tick);
+  }
+
+  return NULL;
+}
+
+void
+fsm_reactor_fd_test (fsm_reactor_t* r)
+{
+  int pipefd[2];
+  ok(pipe(pipefd) == 0, "creates a pipe");
+
+  tick_ctx_t       ctx      = {.fd = pipefd[0]};
+  state_machine_t* fsm      = create_counter(&ctx);
+  int              readable = fsm_event_id(fsm, "readable");
+
+  ok(
+    fsm_reactor_watch(r, pipefd[0], FSM_REACTOR_READABLE, fsm, readable),
+    "watches a descriptor"
+  );
+  ok(
+    !fsm_reactor_watch(r, -1, FSM_REACTOR_READABLE, fsm, readable),
+    "refuses a bad descriptor"
+  );
+  cmp_ok(fsm_reactor_run(r, 0), "==", 0, "sends nothing until ready");
+
+  ok(write(pipefd[1], "xy", 2) == 2, "writes to the pipe");
+  cmp_ok(fsm_reactor_run(r, 1000), "==", 1, "sends the mapped event");
+  cmp_ok(ctx.ticks, "==", 1, "runs the machine's actions");
+  cmp_ok(fsm_reactor_run(r, 1000), "==", 1, "is level-triggered");
+  cmp_ok(fsm_reactor_run(r, 0), "==", 0, "stops once consumed");
+
+  fsm_reactor_unwatch(r, pipefd[0]);
+  ok(write(pipefd[1], "z", 1) == 1, "writes to the pipe");
+  cmp_ok(fsm_reactor_run(r, 0), "==", 0, "stops watching");
+  ok(read(pipefd[0], &(char){0}, 1) == 1, "leaves the descriptor open");
+
+  close(pipefd[0]);
+  close(pipefd[1]);
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_reactor_reuse_test (fsm_reactor_t* r)
+{
+  int pipefd[2];
+  ok(pipe(pipefd) == 0, "creates a pipe");
+
+  tick_ctx_t       ctx      = {.fd = -1};
+  state_machine_t* fsm      = create_counter(&ctx);
+  int              readable = fsm_event_id(fsm, "readable");
+
+  // the reactor's own eventfd, closed behind its back and its number reused
+  int efd = fsm_reactor_eventfd(r, fsm, fsm_event_id(fsm, "tick"));
+  close(efd);
+  ok(dup2(pipefd[0], efd) == efd, "reuses the eventfd's number");
+  ctx.fd = efd;
+
+  ok(
+    fsm_reactor_watch(r, efd, FSM_REACTOR_READABLE, fsm, readable),
+    "watches a reused descriptor"
+  );
+  ok(write(pipefd[1], "x", 1) == 1, "writes to the pipe");
+  cmp_ok(fsm_reactor_run(r, 1000), "==", 1, "sends the new mapping's event");
+
+  fsm_reactor_unwatch(r, efd);
+  ok(close(efd) == 0, "doesn't own the reused descriptor");
+
+  close(pipefd[0]);
+  close(pipefd[1]);
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_reactor_counter_test (fsm_reactor_t* r)
+{
+  tick_ctx_t       ctx = {.fd = -1};
+  state_machine_t* fsm = create_counter(&ctx);
+  int              id  = fsm_event_id(fsm, "tick");
+
+  int efd = fsm_reactor_eventfd(r, fsm, id);
+  ok(efd >= 0, "creates an eventfd");
+  ok(write(efd, &(uint64_t){3}, 8) == 8, "adds to the eventfd");
+  cmp_ok(fsm_reactor_run(r, 1000), "==", 3, "sends an event per count");
+  cmp_ok(ctx.ticks, "==", 3, "runs the machine per count");
+
+  // a run sends at most FSM_REACTOR_COUNTER_MAX, by default 65536
+  ok(write(efd, &(uint64_t){100000}, 8) == 8, "adds a large count");
+  cmp_ok(fsm_reactor_run(r, 1000), "==", 65536, "caps the events per run");
+  cmp_ok(fsm_reactor_run(r, 1000), "==", 34464, "sends the rest later");
+  fsm_reactor_unwatch(r, efd);
+
+  ctx.ticks = 0;
+  int tfd   = fsm_reactor_timer(r, 1000000, 0, fsm, id);
+  ok(tfd >= 0, "creates a timer");
+  cmp_ok(fsm_reactor_run(r, 1000), "==", 1, "sends the timer's event");
+  cmp_ok(fsm_reactor_run(r, 10), "==", 0, "fires a one-shot timer once");
+  fsm_reactor_unwatch(r, tfd);
+
+  fsm_inline_free(fsm);
+}
+
+void
+fsm_reactor_post_test (fsm_reactor_t* r)
+{
+  state_machine_t* fsm = fsm_inline(
+    "ordered",
+    "s0",
+    fsm_inline_states({"s0", "s1", "s2"}),
+    &(inline_transition_t){.name = "a", .source = "s0", .target = "s1"},
+    &(inline_transition_t){.name = "b", .source = "s1", .target = "s2"}
+  );
+
+  fsm_reactor_post(r, fsm, fsm_event_id(fsm, "a"));
+  fsm_reactor_post(r, fsm, fsm_event_id(fsm, "b"));
+  is(fsm_get_state_name(fsm), "s0", "waits for the reactor to run");
+  cmp_ok(fsm_reactor_run(r, 1000), "==", 2, "sends posts in one batch");
+  is(fsm_get_state_name(fsm), "s2", "sends posts in order");
+  fsm_inline_free(fsm);
+
+  tick_ctx_t       ctx     = {.fd = -1};
+  state_machine_t* counter = create_counter(&ctx);
+  poster_t         p       = {.reactor = r, .fsm = counter};
+  pthread_t        thread;
+
+  pthread_create(&thread, NULL, post_all, &p);
+  while (ctx.ticks < NUM_POSTS && fsm_reactor_run(r, 1000) >= 0) {
+  }
+  pthread_join(thread, NULL);
+
+  cmp_ok(ctx.ticks, "==", NUM_POSTS, "sends posts from other threads");
+  fsm_inline_free(counter);
+}
+
+void
+run_reactor_tests (void)
+{
+  fsm_reactor_t* r = fsm_reactor_create();
+
+  skip(!r, 32, "epoll is unavailable");
+  fsm_reactor_fd_test(r);
+  fsm_reactor_reuse_test(r);
+  fsm_reactor_counter_test(r);
+  fsm_reactor_post_test(r);
+  end_skip;
+
+  fsm_reactor_free(r);
+}
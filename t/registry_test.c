@@ -0,0 +1,200 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tests.h"
+
+#define NUM_RING    8
+#define NUM_IDS     100000
+#define NUM_THREADS 4
+#define NUM_SHARED  1000
+#define NUM_ROUNDS  50
+
+static state_machine_t*
+create_door (void)
+{
+  return fsm_inline(
+    "door",
+    "closed",
+    fsm_inline_states({"closed", "opened"}),
+    &(inline_transition_t){
+      .name   = "open",
+      .source = "closed",
+      .target = "opened"},
+    &(inline_transition_t){
+      .name   = "close",
+      .source = "opened",
+      .target = "closed"}
+  );
+}
+
+// "next" moves around a ring of NUM_RING states
+static state_machine_t*
+create_ring (void)
+{
+  state_machine_t*    fsm = fsm_create("ring", NULL);
+  state_descriptor_t* s[NUM_RING];
+  static char         names[NUM_RING][8];
+
+  for (int i = 0; i < NUM_RING; i++) {
+    snprintf(names[i], sizeof(names[i]), "r%d", i);
+    s[i] = fsm_state_register(fsm, fsm_state_create(names[i]));
+  }
+  for (int i = 0; i < NUM_RING; i++) {
+    fsm_transition_register(
+      fsm,
+      s[i],
+      fsm_transition_create("next", s[(i + 1) % NUM_RING], NULL, NULL)
+    );
+  }
+  fsm_set_initial_state(fsm, s[0]);
+
+  return fsm;
+}
+
+void
+fsm_registry_basic_test (void)
+{
+  state_machine_t*    def    = create_door();
+  fsm_registry_t*     reg    = fsm_registry_create(def);
+  state_descriptor_t* opened = fsm_get_state(def, "opened");
+
+  ok(reg != NULL, "creates a registry");
+  cmp_ok(fsm_registry_count(reg), "==", 0, "starts empty");
+  ok(fsm_registry_get(reg, 42) == NULL, "has no instances yet");
+
+  ok(
+    fsm_registry_dispatch(reg, 42, "open") == opened,
+    "creates an instance on first dispatch"
+  );
+  cmp_ok(fsm_registry_count(reg), "==", 1, "counts it");
+  ok(fsm_registry_get(reg, 42)->state == opened, "keeps its state");
+  ok(
+    fsm_registry_dispatch(reg, 42, "open") == opened,
+    "returns the state after unhandled events"
+  );
+  ok(fsm_registry_dispatch(reg, 7, "kick") == NULL, "refuses unknown events");
+  cmp_ok(fsm_registry_count(reg), "==", 1, "without creating an instance");
+
+  state_machine_t* fsm = fsm_registry_instance(reg, 7);
+  is(fsm_get_state_name(fsm), "closed", "creates instances on request");
+  ok(fsm_registry_instance(reg, 7) == fsm, "gets the same one again");
+
+  ok(fsm_registry_remove(reg, 42), "removes an instance");
+  ok(!fsm_registry_remove(reg, 42), "removes it once");
+  ok(fsm_registry_get(reg, 42) == NULL, "forgets it");
+  is(
+    fsm_registry_dispatch(reg, 42, "close")->name,
+    "closed",
+    "recreates it in the initial state"
+  );
+
+  fsm_registry_free(reg);
+  fsm_inline_free(def);
+}
+
+void
+fsm_registry_bulk_test (void)
+{
+  state_machine_t* def  = create_ring();
+  fsm_registry_t*  reg  = fsm_registry_create(def);
+  int              next = fsm_event_id(def, "next");
+  uint64_t*        ids  = malloc(NUM_IDS * 3 * sizeof(uint64_t));
+  int*             evs  = malloc(NUM_IDS * 3 * sizeof(int));
+
+  // ID `i * 7919` is sent `i % 3 + 1` events, interleaved with the others
+  size_t n = 0;
+  for (int round = 0; round < 3; round++) {
+    for (uint64_t i = 0; i < NUM_IDS; i++) {
+      if (round <= (int)(i % 3)) {
+        ids[n]   = i * 7919;
+        evs[n++] = next;
+      }
+    }
+  }
+  fsm_registry_dispatch_n(reg, ids, evs, n);
+
+  cmp_ok(fsm_registry_count(reg), "==", NUM_IDS, "creates every instance");
+
+  bool states_match = true;
+  for (uint64_t i = 0; i < NUM_IDS; i++) {
+    state_machine_t* fsm = fsm_registry_get(reg, i * 7919);
+    states_match &= fsm && fsm->state->id == i % 3 + 1;
+  }
+  ok(states_match, "dispatches each ID's events in order");
+
+  bool removed = true;
+  for (uint64_t i = 0; i < NUM_IDS; i += 2) {
+    removed &= fsm_registry_remove(reg, i * 7919);
+  }
+  bool kept = true;
+  for (uint64_t i = 1; i < NUM_IDS; i += 2) {
+    kept &= fsm_registry_get(reg, i * 7919) != NULL;
+  }
+  ok(removed && kept, "finds the others after removals");
+
+  fsm_registry_free(reg);
+  free(ids);
+  free(evs);
+  fsm_free(def);
+}
+
+typedef struct {
+  fsm_registry_t* reg;
+  int             next;
+} worker_t;
+
+static void*
+work (void* arg)
+{
+  worker_t* w = arg;
+
+  for (int round = 0; round < NUM_ROUNDS; round++) {
+    for (uint64_t id = 0; id < NUM_SHARED; id++) {
+      fsm_registry_dispatch_id(w->reg, id, w->next);
+    }
+  }
+
+  return NULL;
+}
+
+void
+fsm_registry_concurrent_test (void)
+{
+  state_machine_t* def = create_ring();
+  fsm_registry_t*  reg = fsm_registry_create(def);
+  worker_t         w   = {.reg = reg, .next = fsm_event_id(def, "next")};
+  pthread_t        threads[NUM_THREADS];
+
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_create(&threads[i], NULL, work, &w);
+  }
+  for (int i = 0; i < NUM_THREADS; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  cmp_ok(
+    fsm_registry_count(reg),
+    "==",
+    NUM_SHARED,
+    "creates each instance once"
+  );
+
+  bool states_match = true;
+  for (uint64_t id = 0; id < NUM_SHARED; id++) {
+    states_match &= fsm_registry_get(reg, id)->state->id
+                 == NUM_THREADS * NUM_ROUNDS % NUM_RING;
+  }
+  ok(states_match, "loses no concurrent transitions");
+
+  fsm_registry_free(reg);
+  fsm_free(def);
+}
+
+void
+run_registry_tests (void)
+{
+  fsm_registry_basic_test();
+  fsm_registry_bulk_test();
+  fsm_registry_concurrent_test();
+}
@@ -0,0 +1,170 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+#define NUM_RING     64
+#define NUM_CHILDREN 4
+#define NUM_STEPS    10000
+
+// "next" moves around a ring of NUM_RING states
+static state_machine_t*
+create_ring (void)
+{
+  state_machine_t*    fsm = fsm_create("ring", NULL);
+  state_descriptor_t* s[NUM_RING];
+  static char         names[NUM_RING][8];
+
+  for (int i = 0; i < NUM_RING; i++) {
+    snprintf(names[i], sizeof(names[i]), "r%d", i);
+    s[i] = fsm_state_register(fsm, fsm_state_create(names[i]));
+  }
+  for (int i = 0; i < NUM_RING; i++) {
+    fsm_transition_register(
+      fsm,
+      s[i],
+      fsm_transition_create("next", s[(i + 1) % NUM_RING], NULL, NULL)
+    );
+  }
+  fsm_transition_register(
+    fsm,
+    s[0],
+    fsm_transition_create("stop", s[0], NULL, NULL)
+  );
+  fsm_set_initial_state(fsm, s[0]);
+
+  return fsm;
+}
+
+static bool
+never (void* ctx)
+{
+  return false;
+}
+
+void
+fsm_shared_basic_test (state_machine_t* ring)
+{
+  fsm_shared_t* sh = fsm_shared_create(NULL, ring, 8);
+  ok(sh != NULL, "creates a shared segment");
+
+  int next = fsm_shared_event_id(sh, "next");
+  int stop = fsm_shared_event_id(sh, "stop");
+  cmp_ok(next, "==", fsm_event_id(ring, "next"), "keeps the event IDs");
+  cmp_ok(fsm_shared_event_id(sh, "nope"), "==", -1, "finds no unknown events");
+  cmp_ok(fsm_shared_state(sh, 7), "==", 0, "starts in the initial state");
+  is(fsm_shared_state_name(sh, 0), "r0", "names states");
+  ok(fsm_shared_state_name(sh, NUM_RING) == NULL, "names no unknown states");
+
+  cmp_ok(fsm_shared_transition_id(sh, 3, next), "==", 1, "transitions");
+  cmp_ok(fsm_shared_state(sh, 3), "==", 1, "commits the new state");
+  cmp_ok(fsm_shared_state(sh, 2), "==", 0, "leaves other instances alone");
+  cmp_ok(fsm_shared_transition_id(sh, 3, stop), "==", -1, "rejects unhandled");
+  cmp_ok(
+    fsm_shared_transition(sh, 8, "next"),
+    "==",
+    -1,
+    "rejects bad instances"
+  );
+  ok(fsm_shared_set(sh, 3, 0), "sets a state");
+  cmp_ok(fsm_shared_transition(sh, 3, "stop"), "==", 0, "transitions by name");
+  ok(!fsm_shared_set(sh, 3, NUM_RING), "refuses unknown states");
+
+  fsm_shared_t* other = fsm_shared_open_fd(fsm_shared_fd(sh));
+  ok(other != NULL, "maps a segment by descriptor");
+  fsm_shared_transition_id(other, 5, next);
+  cmp_ok(fsm_shared_state(sh, 5), "==", 1, "shares instances across mappings");
+  fsm_shared_free(other);
+
+  fsm_shared_free(sh);
+}
+
+void
+fsm_shared_process_test (state_machine_t* ring)
+{
+  fsm_shared_t* sh   = fsm_shared_create(NULL, ring, 4);
+  int           next = fsm_shared_event_id(sh, "next");
+  pid_t         children[NUM_CHILDREN];
+
+  // children inherit the mapping, and contend for instance 0
+  for (int i = 0; i < NUM_CHILDREN; i++) {
+    if ((children[i] = fork()) == 0) {
+      for (int k = 0; k < NUM_STEPS; k++) {
+        fsm_shared_transition_id(sh, 0, next);
+      }
+      fsm_shared_transition_id(sh, 1 + i % 3, next);
+      _exit(0);
+    }
+  }
+
+  bool all_exited = true;
+  for (int i = 0; i < NUM_CHILDREN; i++) {
+    int status;
+    all_exited &= waitpid(children[i], &status, 0) == children[i]
+               && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  ok(all_exited, "is driven from child processes");
+  cmp_ok(
+    fsm_shared_state(sh, 0),
+    "==",
+    NUM_CHILDREN * NUM_STEPS % NUM_RING,
+    "loses no concurrent transitions"
+  );
+  cmp_ok(fsm_shared_state(sh, 1), "==", 2, "sees each child's transitions");
+
+  fsm_shared_free(sh);
+}
+
+void
+fsm_shared_named_test (state_machine_t* ring)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "/fsms-test-%d", (int)getpid());
+
+  fsm_shared_t* sh = fsm_shared_create(name, ring, 2);
+  ok(sh != NULL, "creates a named segment");
+  ok(fsm_shared_create(name, ring, 2) == NULL, "refuses an existing name");
+
+  fsm_shared_t* other = fsm_shared_open(name);
+  ok(other != NULL, "opens a named segment");
+  fsm_shared_transition(sh, 1, "next");
+  cmp_ok(fsm_shared_state(other, 1), "==", 1, "shares instances by name");
+
+  fsm_shared_free(other);
+  fsm_shared_free(sh);
+  shm_unlink(name);
+  ok(fsm_shared_open(name) == NULL, "opens nothing once unlinked");
+}
+
+void
+run_shared_tests (void)
+{
+  state_machine_t* ring = create_ring();
+
+  fsm_shared_basic_test(ring);
+  fsm_shared_process_test(ring);
+  fsm_shared_named_test(ring);
+
+  state_machine_t* guarded = fsm_inline(
+    "guarded",
+    "a",
+    fsm_inline_states({"a", "b"}),
+    &(inline_transition_t){
+      .name   = "go",
+      .source = "a",
+      .target = "b",
+      .guard  = never}
+  );
+  ok(
+    fsm_shared_create(NULL, guarded, 1) == NULL,
+    "refuses definitions with callbacks"
+  );
+
+  fsm_inline_free(guarded);
+  fsm_free(ring);
+}
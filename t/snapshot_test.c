@@ -0,0 +1,226 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+#define NUM_INSTANCES 1000
+
+typedef struct {
+  char name[16];
+} door_ctx_t;
+
+static size_t
+save_name (void* context, void* out, size_t capacity)
+{
+  size_t len = strlen(((door_ctx_t*)context)->name);
+  if (len <= capacity) {
+    memcpy(out, ((door_ctx_t*)context)->name, len);
+  }
+
+  return len;
+}
+
+// always asks for more room than it was given
+static size_t
+save_growing (void* context, void* out, size_t capacity)
+{
+  return capacity + 1;
+}
+
+static void
+restore_door (
+  void*               arg,
+  uint64_t            index,
+  state_descriptor_t* state,
+  const void*         context,
+  size_t              len
+)
+{
+  state_machine_t* fsm = ((state_machine_t**)arg)[index];
+
+  fsm_set_initial_state(fsm, state);
+  memcpy(((door_ctx_t*)fsm->context)->name, context, len);
+  ((door_ctx_t*)fsm->context)->name[len] = '\0';
+}
+
+static void
+count_restored (
+  void*               arg,
+  uint64_t            index,
+  state_descriptor_t* state,
+  const void*         context,
+  size_t              len
+)
+{
+  (*(int*)arg)++;
+}
+
+static state_machine_t*
+create_door (void)
+{
+  return fsm_inline(
+    "door",
+    "closed",
+    fsm_inline_states({"closed", "opened", "locked"}),
+    &(inline_transition_t){
+      .name   = "open",
+      .source = "closed",
+      .target = "opened"},
+    &(inline_transition_t){
+      .name   = "lock",
+      .source = "closed",
+      .target = "locked"}
+  );
+}
+
+static state_machine_t**
+create_instances (state_machine_t* def, door_ctx_t* contexts)
+{
+  state_machine_t** instances = malloc(NUM_INSTANCES * sizeof(*instances));
+
+  for (int i = 0; i < NUM_INSTANCES; i++) {
+    instances[i] = fsm_clone("door", &contexts[i], def);
+    fsm_set_initial_state(instances[i], fsm_get_state(def, "closed"));
+  }
+
+  return instances;
+}
+
+static void
+free_instances (state_machine_t** instances)
+{
+  for (int i = 0; i < NUM_INSTANCES; i++) {
+    fsm_free(instances[i]);
+  }
+  free(instances);
+}
+
+void
+fsm_snapshot_roundtrip_test (void)
+{
+  char path[] = "/tmp/fsms-snapshot-XXXXXX";
+  close(mkstemp(path));
+
+  state_machine_t*  def = create_door();
+  door_ctx_t        saved[NUM_INSTANCES];
+  door_ctx_t        loaded[NUM_INSTANCES];
+  state_machine_t** out = create_instances(def, saved);
+  state_machine_t** in  = create_instances(def, loaded);
+
+  const char* states[] = {"closed", "opened", "locked"};
+  for (int i = 0; i < NUM_INSTANCES; i++) {
+    fsm_set_initial_state(out[i], fsm_get_state(def, states[i % 3]));
+    snprintf(saved[i].name, sizeof(saved[i].name), "door %d", i);
+  }
+
+  ok(
+    fsm_snapshot_write(path, def, out, NUM_INSTANCES, save_name),
+    "writes a snapshot"
+  );
+  ok(access(path, F_OK) == 0, "renames it into place");
+
+  cmp_ok(
+    fsm_snapshot_read(path, def, restore_door, in),
+    "==",
+    NUM_INSTANCES,
+    "reads every instance"
+  );
+
+  bool states_match = true, contexts_match = true;
+  for (int i = 0; i < NUM_INSTANCES; i++) {
+    states_match   &= in[i]->state == out[i]->state;
+    contexts_match &= s_equals(loaded[i].name, saved[i].name);
+  }
+  ok(states_match, "restores states");
+  ok(contexts_match, "restores contexts");
+
+  ok(fsm_snapshot_write(path, def, out, 2, NULL), "writes without contexts");
+  int restored = 0;
+  cmp_ok(
+    fsm_snapshot_read(path, def, count_restored, &restored),
+    "==",
+    2,
+    "replaces the previous snapshot"
+  );
+  cmp_ok(restored, "==", 2, "restores each instance once");
+
+  state_descriptor_t stray = {.name = "stray"};
+  state_descriptor_t* was  = out[0]->state;
+  out[0]->state            = &stray;
+  ok(
+    !fsm_snapshot_write(path, def, out, 1, NULL),
+    "refuses states the definition doesn't have"
+  );
+  out[0]->state = was;
+
+  ok(
+    !fsm_snapshot_write(path, def, out, 1, save_growing),
+    "refuses contexts that outgrow the room they asked for"
+  );
+
+  free_instances(out);
+  free_instances(in);
+  fsm_inline_free(def);
+  unlink(path);
+}
+
+void
+fsm_snapshot_corrupt_test (void)
+{
+  char path[] = "/tmp/fsms-snapshot-XXXXXX";
+  close(mkstemp(path));
+
+  state_machine_t*  def = create_door();
+  door_ctx_t        contexts[NUM_INSTANCES] = {0};
+  state_machine_t** instances = create_instances(def, contexts);
+  int               restored  = 0;
+
+  fsm_snapshot_write(path, def, instances, NUM_INSTANCES, save_name);
+
+  int fd = open(path, O_WRONLY);
+  ok(pwrite(fd, "X", 1, 100) == 1, "corrupts a snapshot");
+  close(fd);
+  cmp_ok(
+    fsm_snapshot_read(path, def, count_restored, &restored),
+    "==",
+    -1,
+    "refuses a corrupt snapshot"
+  );
+  cmp_ok(restored, "==", 0, "restores nothing from it");
+
+  fsm_snapshot_write(path, def, instances, NUM_INSTANCES, save_name);
+  state_machine_t* other = fsm_inline(
+    "other",
+    "closed",
+    fsm_inline_states({"closed", "ajar"}),
+    &(inline_transition_t){.name = "push", .source = "closed", .target = "ajar"}
+  );
+  cmp_ok(
+    fsm_snapshot_read(path, other, NULL, NULL),
+    "==",
+    -1,
+    "refuses another definition"
+  );
+  cmp_ok(
+    fsm_snapshot_read("/nonexistent", def, NULL, NULL),
+    "==",
+    -1,
+    "refuses missing files"
+  );
+
+  fsm_inline_free(other);
+  free_instances(instances);
+  fsm_inline_free(def);
+  unlink(path);
+}
+
+void
+run_snapshot_tests (void)
+{
+  fsm_snapshot_roundtrip_test();
+  fsm_snapshot_corrupt_test();
+}
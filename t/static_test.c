@@ -0,0 +1,98 @@
+#include "libfsms_static.h"
+#include "tests.h"
+
+typedef struct {
+  bool has_key;
+  int  opened;
+} door_ctx_t;
+
+static const char* last_prev;
+static const char* last_next;
+static const char* last_ev;
+
+static bool
+has_key (void* ctx)
+{
+  return ((door_ctx_t*)ctx)->has_key;
+}
+
+static void
+on_open (void* ctx)
+{
+  ((door_ctx_t*)ctx)->opened++;
+}
+
+static void*
+subscriber (void* arg)
+{
+  transition_subscriber_args_t* args = arg;
+  last_prev                          = args->prev;
+  last_next                          = args->next;
+  last_ev                            = args->ev;
+  return NULL;
+}
+
+#define DOOR_STATES(X, M) X(M, closed) X(M, open) X(M, locked)
+#define DOOR_EVENTS(X, M) X(M, open) X(M, close) X(M, lock) X(M, unlock)
+#define DOOR_TRANSITIONS(X, M)                  \
+  X(M, closed, open, open, NULL, on_open)       \
+  X(M, open, close, closed, NULL, NULL)         \
+  X(M, closed, lock, locked, has_key, NULL)     \
+  X(M, locked, unlock, closed, has_key, NULL)
+
+FSM_DEFINE(door, DOOR_STATES, DOOR_EVENTS, DOOR_TRANSITIONS)
+
+#define SWITCH_STATES(X, M)      X(M, off) X(M, on)
+#define SWITCH_EVENTS(X, M)      X(M, toggle)
+#define SWITCH_TRANSITIONS(X, M) \
+  X(M, off, toggle, on, NULL, NULL) X(M, on, toggle, off, NULL, NULL)
+
+FSM_DEFINE(light, SWITCH_STATES, SWITCH_EVENTS, SWITCH_TRANSITIONS)
+
+static state_machine_t global_light = FSM_STATIC_MACHINE(light, light_on, NULL);
+
+void
+fsm_static_test ()
+{
+  door_ctx_t      ctx = {.has_key = false};
+  state_machine_t fsm = FSM_STATIC_MACHINE(door, door_closed, &ctx);
+
+  cmp_ok(door_num_states, "==", 3, "enumerates the states");
+  cmp_ok(door_num_events, "==", 4, "enumerates the events");
+  is(fsm_get_state_name(&fsm), "closed", "starts in the initial state");
+
+  door_transition(&fsm, door_ev_open);
+  is(fsm_get_state_name(&fsm), "open", "transitions");
+  cmp_ok(ctx.opened, "==", 1, "runs actions with the context");
+
+  door_transition(&fsm, door_ev_lock);
+  is(fsm_get_state_name(&fsm), "open", "ignores unhandled events");
+
+  door_transition(&fsm, door_ev_close);
+  door_transition(&fsm, door_ev_lock);
+  is(fsm_get_state_name(&fsm), "closed", "respects guards");
+
+  ctx.has_key = true;
+  fsm_subscribe(&fsm, subscriber);
+  door_transition(&fsm, door_ev_lock);
+  is(fsm_get_state_name(&fsm), "locked", "passes guards");
+  is(last_prev, "closed", "notifies subscribers of the previous state");
+  is(last_next, "locked", "notifies subscribers of the next state");
+  is(last_ev, "lock", "notifies subscribers of the event");
+  array_free(fsm.subscribers);
+
+  door_transition(&fsm, door_num_events);
+  is(fsm_get_state_name(&fsm), "locked", "ignores out of range events");
+
+  ok(fsm.compiled == NULL && fsm.states == NULL, "builds nothing at runtime");
+
+  light_transition(&global_light, light_ev_toggle);
+  is(fsm_get_state_name(&global_light), "off", "defines static machines");
+  is(global_light.name, "light", "names the machine after its definition");
+}
+
+void
+run_static_tests (void)
+{
+  fsm_static_test();
+}
@@ -0,0 +1,251 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+#define NUM_ENTITIES 10000
+
+static int notifications = 0;
+
+static bool
+allowed (void* ctx)
+{
+  return *(bool*)ctx;
+}
+
+static void*
+count_notification (void* arg)
+{
+  notifications++;
+  return NULL;
+}
+
+// "open" and "close" flip a door between "closed" and "opened"
+static state_machine_t*
+create_door (void)
+{
+  return fsm_inline(
+    "door",
+    "closed",
+    fsm_inline_states({"closed", "opened"}),
+    &(inline_transition_t){
+      .name   = "open",
+      .source = "closed",
+      .target = "opened"},
+    &(inline_transition_t){
+      .name   = "close",
+      .source = "opened",
+      .target = "closed"}
+  );
+}
+
+static int
+create_file (char* path)
+{
+  int fd = mkstemp(path);
+  if (fd >= 0) {
+    close(fd);
+  }
+
+  return fd;
+}
+
+void
+fsm_store_basic_test (void)
+{
+  char             path[] = "/tmp/fsms-store-XXXXXX";
+  state_machine_t* door   = create_door();
+  create_file(path);
+
+  fsm_store_t* s = fsm_store_open(path, door, NUM_ENTITIES);
+  ok(s != NULL, "creates a store");
+  cmp_ok(fsm_store_count(s), "==", 0, "starts empty");
+
+  state_descriptor_t* closed = fsm_get_state(door, "closed");
+  state_descriptor_t* opened = fsm_get_state(door, "opened");
+
+  bool all_set = true;
+  for (uint64_t id = 0; id < NUM_ENTITIES; id++) {
+    all_set &= fsm_store_set(s, id * 7919, id % 3 ? closed : opened);
+  }
+  ok(all_set, "adds entities");
+  cmp_ok(fsm_store_count(s), "==", NUM_ENTITIES, "counts entities");
+
+  bool all_found = true;
+  for (uint64_t id = 0; id < NUM_ENTITIES; id++) {
+    all_found &= fsm_store_get(s, id * 7919) == (id % 3 ? closed : opened);
+  }
+  ok(all_found, "gets each entity's state");
+  ok(fsm_store_get(s, 1) == NULL, "gets nothing for unknown entities");
+  ok(!fsm_store_set(s, UINT64_MAX, closed), "refuses the reserved ID");
+
+  state_descriptor_t stray = {.name = "stray"};
+  ok(!fsm_store_set(s, 1, &stray), "refuses unregistered states");
+
+  ok(fsm_store_transition(s, 7919, "open"), "transitions an entity");
+  ok(fsm_store_get(s, 7919) == opened, "stores the new state");
+  ok(fsm_store_get(s, 2 * 7919) == closed, "leaves other entities alone");
+  fsm_store_transition(s, 7919, "open");
+  ok(fsm_store_get(s, 7919) == opened, "ignores unhandled events");
+  ok(!fsm_store_transition(s, 1, "open"), "refuses unknown entities");
+  is(fsm_get_state_name(door), "closed", "leaves the definition's state");
+
+  ok(fsm_store_set(s, 7919, closed), "sets an existing entity");
+  cmp_ok(fsm_store_count(s), "==", NUM_ENTITIES, "does not count it again");
+  ok(fsm_store_sync(s), "syncs");
+  fsm_store_close(s);
+
+  s = fsm_store_open(path, door, 0);
+  ok(s != NULL, "reopens a store");
+  cmp_ok(fsm_store_count(s), "==", NUM_ENTITIES, "keeps the count");
+  ok(
+    fsm_store_get(s, 7919) == closed && fsm_store_get(s, 0) == opened,
+    "keeps states"
+  );
+  fsm_store_close(s);
+
+  state_machine_t* other = fsm_inline(
+    "other",
+    "closed",
+    fsm_inline_states({"closed", "ajar"}),
+    &(inline_transition_t){.name = "push", .source = "closed", .target = "ajar"}
+  );
+  ok(fsm_store_open(path, other, 0) == NULL, "refuses another definition");
+
+  fsm_inline_free(other);
+  fsm_inline_free(door);
+  unlink(path);
+}
+
+void
+fsm_store_callbacks_test (void)
+{
+  char path[] = "/tmp/fsms-store-XXXXXX";
+  bool allow  = false;
+  create_file(path);
+
+  state_machine_t* fsm = fsm_inline(
+    "guarded",
+    "off",
+    fsm_inline_states({"off", "on"}),
+    &(inline_transition_t){
+      .name   = "switch",
+      .source = "off",
+      .target = "on",
+      .guard  = allowed}
+  );
+  fsm->context = &allow;
+  fsm_subscribe(fsm, count_notification);
+
+  fsm_store_t* s = fsm_store_open(path, fsm, 16);
+  fsm_store_set(s, 42, fsm_get_state(fsm, "off"));
+
+  fsm_store_transition(s, 42, "switch");
+  is(fsm_store_get(s, 42)->name, "off", "runs guards");
+
+  allow = true;
+  fsm_store_transition(s, 42, "switch");
+  is(fsm_store_get(s, 42)->name, "on", "transitions once guards pass");
+  cmp_ok(notifications, "==", 1, "notifies subscribers");
+  is(fsm_get_state_name(fsm), "off", "restores the definition's state");
+
+  fsm_store_close(s);
+  fsm_inline_free(fsm);
+  unlink(path);
+}
+
+void
+fsm_store_capacity_test (void)
+{
+  char             path[] = "/tmp/fsms-store-XXXXXX";
+  state_machine_t* door   = create_door();
+  create_file(path);
+
+  fsm_store_t*        s      = fsm_store_open(path, door, 10);
+  state_descriptor_t* closed = fsm_get_state(door, "closed");
+
+  uint64_t added = 0;
+  while (added < 1000 && fsm_store_set(s, added, closed)) {
+    added++;
+  }
+  ok(added >= 10 && added < 1000, "refuses entities once full");
+  ok(fsm_store_set(s, 0, closed), "still sets existing entities");
+
+  fsm_store_close(s);
+  fsm_inline_free(door);
+  unlink(path);
+}
+
+void
+fsm_store_damaged_test (void)
+{
+  char             path[] = "/tmp/fsms-store-XXXXXX";
+  state_machine_t* door   = create_door();
+  create_file(path);
+
+  fsm_store_t* s = fsm_store_open(path, door, 10);
+  fsm_store_set(s, 0, fsm_get_state(door, "closed"));
+  fsm_store_close(s);
+
+  // find entity 0's slot past the 4096-byte header, and give it a state the
+  // definition doesn't have; one-byte states follow a bucket's 7 keys
+  int     fd = open(path, O_RDWR);
+  uint8_t bucket[64];
+  for (off_t at = 4096; pread(fd, bucket, 64, at) == 64; at += 64) {
+    for (int i = 0; i < 7; i++) {
+      if (((uint64_t*)bucket)[i] == 1) {
+        uint8_t bad = 0xff;
+        pwrite(fd, &bad, 1, at + 56 + i);
+      }
+    }
+  }
+
+  s = fsm_store_open(path, door, 0);
+  ok(fsm_store_get(s, 0) == NULL, "gets nothing for an out of range state");
+  ok(!fsm_store_transition(s, 0, "open"), "refuses to transition from it");
+  fsm_store_close(s);
+
+  // every slot taken, as no file the store writes can be
+  for (off_t at = 4096; pread(fd, bucket, 64, at) == 64; at += 64) {
+    memset(bucket, 0xaa, sizeof(bucket));
+    pwrite(fd, bucket, 64, at);
+  }
+
+  s = fsm_store_open(path, door, 0);
+  ok(fsm_store_get(s, 1000) == NULL, "ends a probe through full buckets");
+  ok(
+    !fsm_store_set(s, 1000, fsm_get_state(door, "closed")),
+    "refuses new entities when every bucket is full"
+  );
+  fsm_store_close(s);
+
+  // more entities than the 2 buckets of 7 slots are ever let hold
+  uint64_t count = 13;
+  pwrite(fd, &count, sizeof(count), 40);
+  ok(fsm_store_open(path, door, 0) == NULL, "refuses a damaged count");
+  count = 1;
+  pwrite(fd, &count, sizeof(count), 40);
+
+  // so many buckets that their size overflows
+  uint64_t num_buckets = UINT64_C(1) << 58;
+  pwrite(fd, &num_buckets, sizeof(num_buckets), 32);
+  ok(fsm_store_open(path, door, 0) == NULL, "refuses a damaged bucket count");
+
+  close(fd);
+  fsm_inline_free(door);
+  unlink(path);
+}
+
+void
+run_store_tests (void)
+{
+  fsm_store_basic_test();
+  fsm_store_callbacks_test();
+  fsm_store_capacity_test();
+  fsm_store_damaged_test();
+}
@@ -0,0 +1,196 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include "tests.h"
+
+#define NUM_RING  8
+#define NUM_SWAPS 200
+
+static state_machine_t*
+create_door (void)
+{
+  return fsm_inline(
+    "door",
+    "closed",
+    fsm_inline_states({"closed", "opened"}),
+    &(inline_transition_t){
+      .name   = "open",
+      .source = "closed",
+      .target = "opened"},
+    &(inline_transition_t){
+      .name   = "close",
+      .source = "opened",
+      .target = "closed"}
+  );
+}
+
+// The next version of the door, which can also be left ajar
+static state_machine_t*
+create_door_v2 (void)
+{
+  return fsm_inline(
+    "door",
+    "closed",
+    fsm_inline_states({"closed", "opened", "ajar"}),
+    &(inline_transition_t){
+      .name   = "push",
+      .source = "closed",
+      .target = "ajar"},
+    &(inline_transition_t){
+      .name   = "open",
+      .source = "ajar",
+      .target = "opened"},
+    &(inline_transition_t){
+      .name   = "close",
+      .source = "opened",
+      .target = "closed"}
+  );
+}
+
+// "next" moves `stride` states around a ring of NUM_RING states
+static state_machine_t*
+create_ring (int stride)
+{
+  state_machine_t*    fsm = fsm_create("ring", NULL);
+  state_descriptor_t* s[NUM_RING];
+  static char         names[NUM_RING][8];
+
+  for (int i = 0; i < NUM_RING; i++) {
+    snprintf(names[i], sizeof(names[i]), "r%d", i);
+    s[i] = fsm_state_register(fsm, fsm_state_create(names[i]));
+  }
+  for (int i = 0; i < NUM_RING; i++) {
+    fsm_transition_register(
+      fsm,
+      s[i],
+      fsm_transition_create("next", s[(i + stride) % NUM_RING], NULL, NULL)
+    );
+  }
+  fsm_set_initial_state(fsm, s[0]);
+
+  return fsm;
+}
+
+void
+fsm_definition_swap_test (void)
+{
+  state_machine_t* v1  = create_door();
+  state_machine_t* v2  = create_door_v2();
+  state_machine_t* fsm = fsm_clone("door", NULL, v1);
+
+  fsm_set_initial_state(fsm, fsm_get_state(v1, "closed"));
+  fsm_finalize(fsm);
+  fsm_transition(fsm, "open");
+
+  ok(fsm_definition_swap(fsm, v2, NULL), "swaps the definition");
+  is(fsm_get_state_name(fsm), "opened", "maps states by name");
+  ok(fsm_get_state(fsm, "ajar") != NULL, "takes the new states");
+
+  fsm_transition(fsm, "close");
+  fsm_transition(fsm, "push");
+  is(fsm_get_state_name(fsm), "ajar", "takes the new transitions");
+  ok(
+    fsm_can_handle(fsm, fsm_event_id(fsm, "open")),
+    "takes the new events"
+  );
+
+  ok(
+    !fsm_definition_swap(fsm, v1, (int[]){0, 1, 5}),
+    "refuses to map onto unknown states"
+  );
+  is(fsm_get_state_name(fsm), "ajar", "is left as it was");
+
+  ok(fsm_definition_swap(fsm, v1, (int[]){1, 0, -1}), "swaps by mapping");
+  is(fsm_get_state_name(fsm), "closed", "maps -1 to the initial state");
+  cmp_ok(fsm_event_id(fsm, "push"), "==", -1, "drops the old events");
+
+  state_machine_t* bare = fsm_create("bare", NULL);
+  fsm_state_register(bare, fsm_state_create("only"));
+  ok(!fsm_definition_swap(fsm, bare, NULL), "refuses no initial state");
+
+  fsm_epoch_enter();
+  fsm_epoch_enter();
+  fsm_epoch_exit();
+  ok(!fsm_definition_swap(fsm, v2, NULL), "refuses to wait on itself");
+  fsm_epoch_exit();
+  ok(fsm_definition_swap(fsm, v2, NULL), "swaps once the section exits");
+
+  fsm_free(bare);
+  fsm_free(fsm);
+  fsm_inline_free(v1);
+  fsm_inline_free(v2);
+}
+
+typedef struct {
+  state_machine_t* fsm;
+  bool             stop;
+  long             transitions;
+} dispatcher_t;
+
+static void*
+dispatch (void* arg)
+{
+  dispatcher_t* d = arg;
+
+  while (!__atomic_load_n(&d->stop, __ATOMIC_ACQUIRE)) {
+    fsm_epoch_enter();
+    for (int i = 0; i < 64; i++) {
+      fsm_transition(d->fsm, "next");
+    }
+    fsm_epoch_exit();
+    __atomic_add_fetch(&d->transitions, 64, __ATOMIC_RELEASE);
+  }
+
+  return NULL;
+}
+
+void
+fsm_definition_swap_concurrent_test (void)
+{
+  state_machine_t* rings[2] = {create_ring(1), create_ring(3)};
+  state_machine_t* fsm      = fsm_clone("ring", NULL, rings[0]);
+
+  fsm_set_initial_state(fsm, rings[0]->state);
+  fsm_finalize(fsm);
+
+  dispatcher_t d = {.fsm = fsm};
+  pthread_t    thread;
+  pthread_create(&thread, NULL, dispatch, &d);
+
+  while (!__atomic_load_n(&d.transitions, __ATOMIC_ACQUIRE)) {
+    sched_yield();
+  }
+
+  bool swapped = true;
+  for (int i = 1; i <= NUM_SWAPS; i++) {
+    swapped &= fsm_definition_swap(fsm, rings[i % 2], NULL);
+  }
+
+  // and then some more, on the last definition
+  long before = __atomic_load_n(&d.transitions, __ATOMIC_ACQUIRE);
+  while (__atomic_load_n(&d.transitions, __ATOMIC_ACQUIRE) == before) {
+    sched_yield();
+  }
+
+  __atomic_store_n(&d.stop, true, __ATOMIC_RELEASE);
+  pthread_join(thread, NULL);
+
+  ok(swapped, "swaps while another thread dispatches");
+  ok(d.transitions > before, "keeps dispatching through the swaps");
+  ok(
+    fsm_get_state(fsm, fsm_get_state_name(fsm)) == fsm->state,
+    "ends in a state of the last definition"
+  );
+
+  fsm_free(fsm);
+  fsm_free(rings[0]);
+  fsm_free(rings[1]);
+}
+
+void
+run_swap_tests (void)
+{
+  fsm_definition_swap_test();
+  fsm_definition_swap_concurrent_test();
+}
@@ -7,5 +7,27 @@
 void run_fsm_tests(void);
 void run_macro_tests(void);
 void run_inline_tests(void);
+void run_finalize_tests(void);
+void run_intern_tests(void);
+void run_minimize_tests(void);
+void run_parallel_tests(void);
+void run_bytes_tests(void);
+void run_nfa_tests(void);
+void run_product_tests(void);
+void run_jit_tests(void);
+void run_static_tests(void);
+void run_uring_tests(void);
+void run_reactor_tests(void);
+void run_store_tests(void);
+void run_journal_tests(void);
+void run_snapshot_tests(void);
+void run_shared_tests(void);
+void run_swap_tests(void);
+void run_instance_tests(void);
+void run_registry_tests(void);
+
+// C++ tests, built separately
+void run_hpp_tests(void);
+void run_coro_tests(void);
 
 #endif /* TESTS_H */
@@ -0,0 +1,212 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "tests.h"
+
+// A machine that starts an operation when it leaves "idle" and finishes when
+// the completion's "done" event arrives
+typedef struct {
+  fsm_uring_t*     ring;
+  state_machine_t* fsm;
+  fsm_uring_io_t   io;
+  int              result;
+} io_ctx_t;
+
+static void
+start_io (void* ctx)
+{
+  io_ctx_t* c = ctx;
+  int       id = fsm_event_id(c->fsm, "done");
+
+  fsm_uring_queue(c->ring, c->fsm, id, &c->result, &c->io);
+}
+
+static state_machine_t*
+create_machine (io_ctx_t* ctx)
+{
+  state_machine_t* fsm = fsm_inline(
+    "io",
+    "idle",
+    fsm_inline_states({"idle", "waiting", "finished"}),
+    &(inline_transition_t){
+      .name   = "start",
+      .source = "idle",
+      .target = "waiting",
+      .action = start_io},
+    &(inline_transition_t){
+      .name   = "done",
+      .source = "waiting",
+      .target = "finished"}
+  );
+  fsm->context = ctx;
+  ctx->fsm     = fsm;
+  ctx->result  = 0;
+
+  return fsm;
+}
+
+static int
+run_all (fsm_uring_t* ring)
+{
+  int sent = 0;
+  while (fsm_uring_in_flight(ring)) {
+    int n = fsm_uring_run(ring, 1);
+    if (n < 0) {
+      return -1;
+    }
+    sent += n;
+  }
+
+  return sent;
+}
+
+void
+fsm_uring_file_test (fsm_uring_t* ring)
+{
+  char path[]  = "/tmp/fsms-uring-XXXXXX";
+  int  fd      = mkstemp(path);
+  char buf[16] = {0};
+
+  ok(write(fd, "hello", 5) == 5, "writes a local file");
+
+  io_ctx_t ctx = {
+    .ring = ring,
+    .io   = {
+      .op     = FSM_URING_READ,
+      .fd     = fd,
+      .buf    = buf,
+      .len    = sizeof(buf),
+      .offset = 0}
+  };
+  state_machine_t* fsm = create_machine(&ctx);
+
+  fsm_transition(fsm, "start");
+  is(fsm_get_state_name(fsm), "waiting", "waits for the completion");
+  cmp_ok(fsm_uring_in_flight(ring), "==", 1, "counts queued operations");
+
+  cmp_ok(fsm_uring_run(ring, 1), "==", 1, "sends one event per completion");
+  is(fsm_get_state_name(fsm), "finished", "sends the tagged event");
+  cmp_ok(ctx.result, "==", 5, "stores the result");
+  is(buf, "hello", "reads the file");
+  cmp_ok(fsm_uring_run(ring, 1), "==", 0, "does not block when idle");
+
+  fsm_inline_free(fsm);
+
+  ctx.io.fd            = -1;
+  state_machine_t* bad = create_machine(&ctx);
+  fsm_transition(bad, "start");
+  run_all(ring);
+  cmp_ok(ctx.result, "==", -EBADF, "stores errors as -errno");
+  is(fsm_get_state_name(bad), "finished", "sends the event on failure");
+  fsm_inline_free(bad);
+
+  close(fd);
+  unlink(path);
+}
+
+void
+fsm_uring_socket_test (fsm_uring_t* ring)
+{
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_addr   = {.s_addr = htonl(INADDR_LOOPBACK)}};
+  socklen_t len           = sizeof(addr);
+
+  bind(listener, (struct sockaddr*)&addr, sizeof(addr));
+  listen(listener, 1);
+  getsockname(listener, (struct sockaddr*)&addr, &len);
+
+  io_ctx_t server = {
+    .ring = ring,
+    .io   = {.op = FSM_URING_ACCEPT, .fd = listener}};
+  state_machine_t* accepting = create_machine(&server);
+  fsm_transition(accepting, "start");
+
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  ok(
+    connect(client, (struct sockaddr*)&addr, sizeof(addr)) == 0,
+    "connects over loopback"
+  );
+
+  cmp_ok(run_all(ring), "==", 1, "accepts");
+  ok(server.result >= 0, "stores the accepted socket");
+  is(fsm_get_state_name(accepting), "finished", "sends the accept event");
+
+  char     out[]  = "ping";
+  char     in[8]  = {0};
+  io_ctx_t sender = {
+    .ring = ring,
+    .io   = {.op = FSM_URING_SEND, .fd = client, .buf = out, .len = 4}};
+  io_ctx_t receiver = {
+    .ring = ring,
+    .io = {.op = FSM_URING_RECV, .fd = server.result, .buf = in, .len = 4}};
+  state_machine_t* sending   = create_machine(&sender);
+  state_machine_t* receiving = create_machine(&receiver);
+
+  // both are submitted by the same run
+  fsm_transition(receiving, "start");
+  fsm_transition(sending, "start");
+  cmp_ok(run_all(ring), "==", 2, "drives several machines");
+  ok(sender.result == 4 && receiver.result == 4, "stores both results");
+  is(in, "ping", "receives what was sent");
+  ok(
+    s_equals(fsm_get_state_name(sending), "finished")
+      && s_equals(fsm_get_state_name(receiving), "finished"),
+    "sends each machine its own event"
+  );
+
+  close(server.result);
+  close(client);
+  close(listener);
+  fsm_inline_free(accepting);
+  fsm_inline_free(sending);
+  fsm_inline_free(receiving);
+}
+
+void
+fsm_uring_capacity_test (void)
+{
+  // one submission slot; the kernel sizes the completion queue at two
+  fsm_uring_t* ring = fsm_uring_create(1);
+  char         buf[4];
+  int          fd   = open("/dev/zero", 0);
+
+  io_ctx_t ctx = {
+    .ring = ring,
+    .io = {.op = FSM_URING_READ, .fd = fd, .buf = buf, .len = 4, .offset = -1}};
+  state_machine_t* fsm = create_machine(&ctx);
+  int              id  = fsm_event_id(fsm, "done");
+
+  ok(fsm_uring_queue(ring, fsm, id, NULL, &ctx.io), "queues an operation");
+  ok(fsm_uring_queue(ring, fsm, id, NULL, &ctx.io), "flushes a full queue");
+  ok(!fsm_uring_queue(ring, fsm, id, NULL, &ctx.io), "refuses to overflow");
+  cmp_ok(run_all(ring), "==", 2, "completes what it accepted");
+
+  fsm_inline_free(fsm);
+  close(fd);
+  fsm_uring_free(ring);
+}
+
+void
+run_uring_tests (void)
+{
+  fsm_uring_t* ring = fsm_uring_create(8);
+
+  skip(!ring, 22, "io_uring is unavailable");
+  fsm_uring_file_test(ring);
+  fsm_uring_socket_test(ring);
+  fsm_uring_capacity_test();
+  end_skip;
+
+  fsm_uring_free(ring);
+}